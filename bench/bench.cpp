@@ -0,0 +1,285 @@
+// Times the stages every statement goes through - lexing and parsing with ANTLR, building the IR,
+// generating bytecode and running it - separately, over generated workloads of several sizes.
+// The native parser is timed on the same text as well, for comparison.
+//
+// Prints one JSON object per line for every workload, size and stage, so the output of runs on
+// different commits can be compared with a script:
+//   {"label": "...", "workload": "scan", "rows": 10000, "stage": "execute", "runs": 5, ...}
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/base.h>
+#include <fmt/format.h>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IR.hpp"
+#include "bytecode_gen.hpp"
+#include "common.hpp"
+#include "database.hpp"
+#include "frontend.hpp"
+#include "parser.hpp"
+#include "vm.hpp"
+
+#include "GrammarLexer.h"
+#include "GrammarParser.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Stage : std::uint8_t { NATIVE_PARSE, LEX, PARSE, IR, CODEGEN, EXECUTE };
+
+constexpr auto stage_names = std::array<std::string_view, 6>{"native_parse", "lex", "parse", "ir", "codegen", "execute"};
+
+struct Timing {
+    std::uint64_t runs = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t min_ns = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t max_ns = 0;
+
+    auto add(Clock::duration elapsed) -> void {
+        const auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        ++runs;
+        total_ns += ns;
+        min_ns = std::min(min_ns, ns);
+        max_ns = std::max(max_ns, ns);
+    }
+};
+
+using Timings = std::array<Timing, stage_names.size()>;
+
+// Runs statements through the ANTLR frontend stage by stage, timing each stage on its own.
+class Pipeline {
+public:
+    explicit Pipeline(Database& db) : db(db), vm(db) {}
+
+    // returns the number of result rows
+    auto run(std::string_view sql) -> std::size_t {
+        timed(Stage::NATIVE_PARSE, [&] {
+            auto native = Parser{sql};
+            static_cast<void>(native.parse());
+        });
+
+        antlr4::ANTLRInputStream input(sql);
+        GrammarLexer lexer(&input);
+        antlr4::CommonTokenStream tokens(&lexer);
+        timed(Stage::LEX, [&] { tokens.fill(); });
+        GrammarParser parser(&tokens);
+        GrammarParser::ProgramContext* tree = nullptr;
+        timed(Stage::PARSE, [&] { tree = parser.program(); });
+        if (lexer.getNumberOfSyntaxErrors() > 0 || parser.getNumberOfSyntaxErrors() > 0) {
+            fail("Syntax error in '{}'", sql);
+        }
+
+        auto IR_generator = SqlGrammarVisitor{sql};
+        auto statement = std::optional<Statement>{};
+        timed(Stage::IR, [&] { statement.emplace(IR_generator.build(tree)); });
+        auto program = SqlBytecodeProgram{};
+        timed(Stage::CODEGEN, [&] { program = generate_bytecode(*statement, db); });
+        auto rows = std::size_t{0};
+        timed(Stage::EXECUTE, [&] { vm.execute(program, [&](std::span<const Value>) { ++rows; }); });
+        return rows;
+    }
+
+    [[nodiscard]] auto timings() const -> const Timings& { return stage_timings; }
+
+private:
+    auto timed(Stage stage, const auto& body) -> void {
+        const auto start = Clock::now();
+        body();
+        stage_timings[static_cast<std::size_t>(stage)].add(Clock::now() - start);
+    }
+
+    Database& db;
+    VirtualMachine vm;
+    Timings stage_timings{};
+};
+
+// runs sql without timing it, for loading the data a workload works on
+auto execute(Database& db, std::string_view sql) -> void {
+    auto vm = VirtualMachine{db};
+    parse(sql, Frontend::NATIVE, [&](const Statement& statement, std::span<const std::string_view>) {
+        vm.execute(generate_bytecode(statement, db));
+    });
+}
+
+constexpr std::size_t insert_batch = 100;
+constexpr std::size_t point_lookups = 1000;
+constexpr std::size_t scan_repeats = 5;
+constexpr std::size_t join_repeats = 3;
+
+// "INSERT INTO t VALUES (a, 'b', c), ..." for rows [first, last) of t (a, b, c), a is the row number
+auto insert_sql(std::size_t first, std::size_t last, std::mt19937_64& random) -> std::string {
+    auto sql = std::string{"INSERT INTO t VALUES "};
+    for (auto row = first; row < last; ++row) {
+        fmt::format_to(std::back_inserter(sql), "{}({}, 'name{}', {})",
+                       row == first ? "" : ", ", row, random() % 1000, random() % 1'000'000);
+    }
+    return sql;
+}
+
+auto load(Database& db, std::size_t rows) -> void {
+    auto random = std::mt19937_64{42};
+    execute(db, "CREATE TABLE t (a, b, c)");
+    for (auto first = std::size_t{0}; first < rows; first += insert_batch) {
+        execute(db, insert_sql(first, std::min(first + insert_batch, rows), random));
+    }
+}
+
+struct Workload {
+    std::string_view name;
+    // loads the data, untimed
+    auto (*setup)(Database& db, std::size_t rows) -> void;
+    // returns the number of result rows, as a sanity check
+    auto (*run)(Pipeline& pipeline, std::size_t rows) -> std::size_t;
+};
+
+constexpr auto workloads = std::array{
+    Workload{
+        .name = "insert",
+        .setup = [](Database& db, std::size_t) { execute(db, "CREATE TABLE t (a, b, c)"); },
+        .run = [](Pipeline& pipeline, std::size_t rows) {
+            auto random = std::mt19937_64{42};
+            for (auto first = std::size_t{0}; first < rows; first += insert_batch) {
+                pipeline.run(insert_sql(first, std::min(first + insert_batch, rows), random));
+            }
+            return std::size_t{0};
+        },
+    },
+    Workload{
+        .name = "point_lookup",
+        .setup = [](Database& db, std::size_t rows) {
+            load(db, rows);
+            execute(db, "CREATE INDEX ta ON t (a)");
+        },
+        .run = [](Pipeline& pipeline, std::size_t rows) {
+            auto random = std::mt19937_64{7};
+            auto found = std::size_t{0};
+            for (auto i = std::size_t{0}; i < point_lookups; ++i) {
+                found += pipeline.run(fmt::format("SELECT b, c FROM t WHERE a = {}", random() % rows));
+            }
+            return found;
+        },
+    },
+    Workload{
+        .name = "scan",
+        .setup = load,
+        .run = [](Pipeline& pipeline, std::size_t) {
+            auto found = std::size_t{0};
+            for (auto i = std::size_t{0}; i < scan_repeats; ++i) {
+                found += pipeline.run("SELECT a, b FROM t WHERE c < 500000");
+            }
+            return found;
+        },
+    },
+    Workload{
+        .name = "join",
+        .setup = [](Database& db, std::size_t rows) {
+            load(db, rows);
+            // every tenth row of t has a match in u
+            execute(db, "CREATE TABLE u (a, d)");
+            for (auto first = std::size_t{0}; first < rows; first += insert_batch * 10) {
+                auto sql = std::string{"INSERT INTO u VALUES "};
+                for (auto row = first; row < std::min(first + insert_batch * 10, rows); row += 10) {
+                    fmt::format_to(std::back_inserter(sql), "{}({}, {})", row == first ? "" : ", ", row, row * 2);
+                }
+                execute(db, sql);
+            }
+        },
+        .run = [](Pipeline& pipeline, std::size_t) {
+            auto found = std::size_t{0};
+            for (auto i = std::size_t{0}; i < join_repeats; ++i) {
+                found += pipeline.run("SELECT t.b, u.d FROM t JOIN u ON t.a = u.a");
+            }
+            return found;
+        },
+    },
+};
+
+auto parse_sizes(std::string_view list) -> std::vector<std::size_t> {
+    auto sizes = std::vector<std::size_t>{};
+    while (!list.empty()) {
+        const auto end = std::min(list.find(','), list.size());
+        auto size = std::size_t{0};
+        const auto item = list.substr(0, end);
+        if (std::from_chars(item.data(), item.data() + item.size(), size).ec != std::errc{} || size == 0) {
+            fail("Invalid size '{}'", item);
+        }
+        sizes.push_back(size);
+        list.remove_prefix(std::min(end + 1, list.size()));
+    }
+    return sizes;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    constexpr auto sizes_flag = std::string_view{"--sizes="};
+    constexpr auto label_flag = std::string_view{"--label="};
+    constexpr auto threads_flag = std::string_view{"--threads="};
+
+    try {
+        auto sizes = std::vector<std::size_t>{1'000, 10'000, 100'000};
+        auto label = std::string_view{};
+        auto threads = std::optional<std::size_t>{};
+        auto selected = std::vector<std::string_view>{};
+        for (auto arg = 1; arg < argc; ++arg) {
+            const auto flag = std::string_view{argv[arg]};
+            if (flag.starts_with(sizes_flag)) {
+                sizes = parse_sizes(flag.substr(sizes_flag.size()));
+            } else if (flag.starts_with(label_flag)) {
+                label = flag.substr(label_flag.size());
+            } else if (flag.starts_with(threads_flag)) {
+                const auto value = flag.substr(threads_flag.size());
+                threads.emplace();
+                if (std::from_chars(value.data(), value.data() + value.size(), *threads).ec != std::errc{}) {
+                    fail("Invalid thread count '{}'", value);
+                }
+            } else if (flag.starts_with("--") || std::ranges::none_of(workloads, [&](const Workload& w) { return w.name == flag; })) {
+                fmt::println(stderr, "Usage: {} [--sizes=<rows>,...] [--label=<name>] [--threads=<count>] [insert|point_lookup|scan|join ...]", argv[0]);
+                return 1;
+            } else {
+                selected.push_back(flag);
+            }
+        }
+
+        for (const auto& workload : workloads) {
+            if (!selected.empty() && std::ranges::find(selected, workload.name) == selected.end()) {
+                continue;
+            }
+            for (const auto rows : sizes) {
+                // in memory, so the numbers don't depend on the disk
+                auto db = Database{};
+                if (threads) {
+                    db.set_worker_count(*threads);
+                }
+                workload.setup(db, rows);
+                auto pipeline = Pipeline{db};
+                const auto result_rows = workload.run(pipeline, rows);
+
+                for (auto stage = std::size_t{0}; stage < stage_names.size(); ++stage) {
+                    const auto& timing = pipeline.timings()[stage];
+                    fmt::println(R"({{"label": {:?}, "workload": "{}", "rows": {}, "stage": "{}", "runs": {}, )"
+                                 R"("total_ns": {}, "mean_ns": {}, "min_ns": {}, "max_ns": {}, "result_rows": {}}})",
+                                 label, workload.name, rows, stage_names[stage], timing.runs,
+                                 timing.total_ns, timing.total_ns / std::max(timing.runs, std::uint64_t{1}),
+                                 timing.runs > 0 ? timing.min_ns : 0, timing.max_ns, result_rows);
+                }
+            }
+        }
+    } catch (const SqlError& e) {
+        fmt::println(stderr, "{}", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -1,184 +1,407 @@
 #include "IR.hpp"
-std::any SqlGrammarVisitor::visitProgram(GrammarParser::ProgramContext *ctx) {
-    return visit(ctx->sql_stmt());
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+auto ParameterList::add(std::string_view name) -> Parameter {
+    // sqlite's SQLITE_MAX_VARIABLE_NUMBER
+    constexpr auto max_parameters = std::size_t{32766};
+
+    if (name == "?") {
+        if (parameter_names.size() >= max_parameters) {
+            fail("Too many SQL variables");
+        }
+        parameter_names.emplace_back();
+        return Parameter{.index = static_cast<std::int64_t>(parameter_names.size()), .name = {}};
+    }
+
+    auto index = std::size_t{0};
+    if (name.front() == '?') {
+        const auto digits = name.substr(1);
+        const auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), index);
+        if (ec != std::errc{} || index == 0 || index > max_parameters) {
+            fail("Variable number must be between ?1 and ?{}", max_parameters);
+        }
+        if (index > parameter_names.size()) {
+            parameter_names.resize(index);
+        }
+        // a number that's already taken keeps its first name, so ":a" still finds it later on
+        if (parameter_names[index - 1].empty()) {
+            parameter_names[index - 1] = name;
+        }
+    } else {
+        const auto it = std::ranges::find(parameter_names, name);
+        index = static_cast<std::size_t>(it - parameter_names.begin()) + 1;
+        if (it == parameter_names.end()) {
+            if (parameter_names.size() >= max_parameters) {
+                fail("Too many SQL variables");
+            }
+            parameter_names.push_back(name);
+        }
+    }
+    return Parameter{.index = static_cast<std::int64_t>(index), .name = name};
+}
+
+auto numeric_literal(std::string_view text) -> Expr {
+    const auto* end = text.data() + text.size();
+    auto integer = std::int64_t{};
+    if (const auto [ptr, ec] = std::from_chars(text.data(), end, integer); ec == std::errc{} && ptr == end) {
+        return Expr{IntegerLiteral{integer}};
+    }
+    auto real = double{};
+    const auto [ptr, ec] = std::from_chars(text.data(), end, real);
+    if (ec != std::errc{} || ptr != end) {
+        fail("Numeric literal '{}' is out of range", text);
+    }
+    return Expr{RealLiteral{real}};
 }
 
-std::any SqlGrammarVisitor::visitSql_stmt(GrammarParser::Sql_stmtContext *ctx) {
+auto string_literal(std::string_view text, std::pmr::memory_resource* arena) -> Expr {
+    const auto value = text.substr(1, text.size() - 2);
+    if (value.find('\'') == std::string_view::npos) {
+        return Expr{StringLiteral{value}};
+    }
+    auto* bytes = static_cast<char*>(arena->allocate(value.size(), alignof(char)));
+    auto size = std::size_t{0};
+    for (auto i = std::size_t{0}; i < value.size(); ++i) {
+        bytes[size++] = value[i];
+        // the lexer only lets quotes through in pairs
+        if (value[i] == '\'') {
+            ++i;
+        }
+    }
+    return Expr{StringLiteral{std::string_view{bytes, size}}};
+}
+
+auto make_child(Expr expr, std::pmr::memory_resource* arena) -> const Expr* {
+    return std::pmr::polymorphic_allocator<>{arena}.new_object<Expr>(std::move(expr));
+}
+
+auto make_child(Statement statement, std::pmr::memory_resource* arena) -> const Statement* {
+    return std::pmr::polymorphic_allocator<>{arena}.new_object<Statement>(std::move(statement));
+}
+
+SqlGrammarVisitor::SqlGrammarVisitor(std::string_view sql)
+    : sql(sql),
+      ascii_only(std::ranges::all_of(sql, [](char c) { return static_cast<unsigned char>(c) < 0x80; })) {}
+
+auto SqlGrammarVisitor::text(antlr4::tree::TerminalNode *node) -> std::string_view {
+    const auto* token = node->getSymbol();
+    if (ascii_only) {
+        return sql.substr(token->getStartIndex(), token->getStopIndex() - token->getStartIndex() + 1);
+    }
+    const auto copy = token->getText();
+    auto* bytes = static_cast<char*>(arena.allocate(copy.size(), alignof(char)));
+    std::memcpy(bytes, copy.data(), copy.size());
+    return {bytes, copy.size()};
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::ProgramContext *ctx) -> Statement {
+    return build(ctx->sql_stmt());
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Sql_stmtContext *ctx) -> Statement {
+    if (ctx->analyze_stmt()) {
+        return build(ctx->analyze_stmt());
+    }
+    if (!ctx->EXPLAIN()) {
+        return build(ctx->explainable_stmt());
+    }
+    const auto mode = ctx->PLAN() ? ExplainMode::QUERY_PLAN : ctx->ANALYZE() ? ExplainMode::ANALYZE : ExplainMode::PROGRAM;
+    return ExplainStmt{.mode = mode, .statement = make_child(build(ctx->explainable_stmt()), &arena)};
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Explainable_stmtContext *ctx) -> Statement {
     if (ctx->select_stmt()) {
-        return Statement{std::any_cast<SelectStmt>(visit(ctx->select_stmt()))};
+        return build(ctx->select_stmt());
     }
     if (ctx->create_table_stmt()) {
-        return Statement{std::any_cast<CreateTableStmt>(visit(ctx->create_table_stmt()))};
+        return build(ctx->create_table_stmt());
     }
     if (ctx->insert_stmt()) {
-        return Statement{std::any_cast<InsertStmt>(visit(ctx->insert_stmt()))};
+        return build(ctx->insert_stmt());
+    }
+    if (ctx->create_index_stmt()) {
+        return build(ctx->create_index_stmt());
     }
     fail("Invalid SQL statement '{}'", ctx->getText());
 }
 
-std::any SqlGrammarVisitor::visitInsert_stmt(GrammarParser::Insert_stmtContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::Analyze_stmtContext *ctx) -> AnalyzeStmt {
+    if (!ctx->table_name()) {
+        return AnalyzeStmt{.target = std::nullopt};
+    }
+    auto schema_name = std::optional<std::string_view>{};
+    if (ctx->schema_name()) { schema_name = build(ctx->schema_name()); }
+    return AnalyzeStmt{.target = Table{.table_name = build(ctx->table_name()), .schema_name = schema_name}};
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Insert_stmtContext *ctx) -> InsertStmt {
     auto with_clause = std::optional<WithClause>{};
     if (ctx->with_clause()) {
-        with_clause = std::any_cast<WithClause>(visit(ctx->with_clause()));
+        with_clause = build(ctx->with_clause());
     }
 
     auto operation = InsertStmtOp{};
     if (ctx->INSERT()) {
         operation = InsertContainer{};
         if (ctx->confilct_resolution_method()) {
-            std::get<InsertContainer>(operation).confilct_res_method =
-                std::any_cast<ConflictResolutionMethod>(visit(ctx->confilct_resolution_method()));
+            std::get<InsertContainer>(operation).confilct_res_method = build(ctx->confilct_resolution_method());
         }
     } else if (ctx->REPLACE()) {
         operation = ReplaceContainer {};
     }
 
-    auto schema_name = std::optional<std::string>{};
-    if (ctx->schema_name()) { schema_name = std::any_cast<std::string>(visit(ctx->schema_name())); }
-    auto alias = std::optional<std::string>{};
-    if (ctx->table_alias()) { alias = std::any_cast<std::string>(visit(ctx->table_alias())); }
+    auto schema_name = std::optional<std::string_view>{};
+    if (ctx->schema_name()) { schema_name = build(ctx->schema_name()); }
+    auto alias = std::optional<std::string_view>{};
+    if (ctx->table_alias()) { alias = build(ctx->table_alias()); }
     auto aliased_table = AliasedTable {
         .table = Table {
-            .table_name = std::any_cast<TableName>(visit(ctx->table_name())),
-                .schema_name = std::move(schema_name)
+            .table_name = build(ctx->table_name()),
+                .schema_name = schema_name
         },
-            .alias = std::move(alias)
+            .alias = alias
     };
 
     auto tuples = InsertedTuples{DefaultValues{}};
-    if (ctx->VALUES()) {
+    // DEFAULT VALUES has a VALUES token as well
+    if (ctx->VALUES() && !ctx->DEFAULT()) {
         tuples = InsertStmtValuesExpr{
-            .expressions = collect<Expr>(ctx->expr())
+            .rows = collect(ctx->value_row())
         };
     } else if (ctx->select_stmt()) {
-        tuples = std::any_cast<SelectStmt>(visit(ctx->select_stmt()));
+        tuples = build(ctx->select_stmt());
+    }
+
+    auto column_names = std::optional<std::pmr::vector<ColumnName>>{};
+    if (!ctx->column_name().empty()) {
+        column_names = collect(ctx->column_name());
     }
 
     return InsertStmt {
         .with_clause = std::move(with_clause),
-            .operation = std::move(operation),
-            .table = std::move(aliased_table),
-            .column_names = collect<ColumnName>(ctx->column_name()),
+            .operation = operation,
+            .table = aliased_table,
+            .column_names = std::move(column_names),
             .tuples = std::move(tuples)
     };
 }
 
-std::any SqlGrammarVisitor::visitSelect_stmt(GrammarParser::Select_stmtContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::Select_stmtContext *ctx) -> SelectStmt {
     const auto modifier =
         ctx->ALL()      ? SelectModifier::ALL
         : ctx->DISTINCT() ? SelectModifier::DISTINCT
         : SelectModifier::NONE;
 
-    return SelectStmt {
+    auto projections = collect(ctx->result_column());
+    auto statement = SelectStmt {
         .modifier = modifier,
-            .projections = collect<ResultColumn>(ctx->result_column()),
-            .sources = collect<TableOrSubquery>(ctx->table_or_subquery())
+            .projections = std::move(projections),
+            .sources = std::pmr::vector<TableOrSubquery>{&arena},
+            .joins = std::pmr::vector<JoinConstraint>{&arena},
+            .where = std::nullopt,
+            .group_by = std::pmr::vector<Expr>{&arena},
+            .having = std::nullopt,
+            .order_by = collect(ctx->ordering_term()),
+            .limit = std::nullopt,
+            .offset = std::nullopt
+    };
+    build(ctx->join_clause(), statement);
+    // the WHERE, the GROUP BY terms, the HAVING, the LIMIT and the OFFSET, in that order
+    auto expressions = ctx->expr();
+    auto first = expressions.begin();
+    auto last = expressions.end();
+    if (ctx->WHERE()) {
+        statement.where = build(*first++);
+    }
+    if (ctx->OFFSET()) {
+        statement.offset = build(*--last);
+    }
+    if (ctx->LIMIT()) {
+        statement.limit = build(*--last);
+    }
+    if (ctx->HAVING()) {
+        statement.having = build(*--last);
+    }
+    for (; first != last; ++first) {
+        statement.group_by.push_back(build(*first));
+    }
+    return statement;
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Ordering_termContext *ctx) -> OrderingTerm {
+    return OrderingTerm {
+        .expr = build(ctx->expr()),
+            .order = ctx->DESC() ? SortOrder::DESC : SortOrder::ASC
     };
 }
 
-std::any SqlGrammarVisitor::visitCreate_table_stmt(GrammarParser::Create_table_stmtContext *ctx) {
-    const auto is_temporary = bool(ctx->TEMPORARY());
+auto SqlGrammarVisitor::build(GrammarParser::Join_clauseContext *ctx, SelectStmt& statement) -> void {
+    // a join_constraint belongs to the join_operator before it, which only the order of the children tells
+    for (auto* child : ctx->children) {
+        if (auto* source = dynamic_cast<GrammarParser::Table_or_subqueryContext*>(child)) {
+            statement.sources.push_back(build(source));
+        } else if (auto* op = dynamic_cast<GrammarParser::Join_operatorContext*>(child)) {
+            statement.joins.push_back(JoinConstraint{.op = build(op), .on = std::nullopt});
+        } else if (auto* constraint = dynamic_cast<GrammarParser::Join_constraintContext*>(child)) {
+            statement.joins.back().on = build(constraint->expr());
+        }
+    }
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Join_operatorContext *ctx) -> JoinOperator {
+    return ctx->COMMA() ? JoinOperator::COMMA
+        : ctx->INNER()  ? JoinOperator::INNER
+        : ctx->CROSS()  ? JoinOperator::CROSS
+        : JoinOperator::JOIN;
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Create_table_stmtContext *ctx) -> CreateTableStmt {
+    const auto is_temporary = ctx->TEMP() || ctx->TEMPORARY();
     const auto if_not_exists_clause = bool(ctx->IF());
 
-    auto schema_name_opt = std::optional<std::string>{};
+    auto schema_name_opt = std::optional<std::string_view>{};
     if (ctx->schema_name()) {
-        schema_name_opt = std::any_cast<std::string>(visit(ctx->schema_name()));
+        schema_name_opt = build(ctx->schema_name());
     }
 
     auto table = Table {
-        .table_name = std::any_cast<std::string>(visit(ctx->table_name())),
+        .table_name = build(ctx->table_name()),
             .schema_name = schema_name_opt
     };
 
-    // TODO: Both here and in the struct, parse the `AS select_stmt` variant (https://sqlite.org/lang_createtable.html)
+    auto as_select = std::optional<SelectStmt>{};
+    if (ctx->select_stmt()) {
+        as_select = build(ctx->select_stmt());
+    }
+
+    auto table_options = std::pmr::vector<TableOption>{&arena};
+    if (ctx->table_options()) {
+        table_options = collect(ctx->table_options()->table_option());
+    }
 
     return CreateTableStmt {
         .temporary = is_temporary,
             .if_not_exists_clause = if_not_exists_clause,
-            .table = std::move(table),
-            .column_definitions = collect<ColumnDef>(ctx->column_def()),
-            .table_options = {}
+            .table = table,
+            .column_definitions = collect(ctx->column_def()),
+            .table_options = std::move(table_options),
+            .as_select = std::move(as_select)
     };
 }
 
-std::any SqlGrammarVisitor::visitColumn_def(GrammarParser::Column_defContext *ctx) {
-    auto type_name = std::optional<std::string>{};
+auto SqlGrammarVisitor::build(GrammarParser::Create_index_stmtContext *ctx) -> CreateIndexStmt {
+    auto schema_name = std::optional<std::string_view>{};
+    if (ctx->schema_name()) {
+        schema_name = build(ctx->schema_name());
+    }
+
+    return CreateIndexStmt {
+        .unique = bool(ctx->UNIQUE()),
+            .if_not_exists_clause = bool(ctx->IF()),
+            .schema_name = schema_name,
+            .index_name = build(ctx->index_name()),
+            .table_name = build(ctx->table_name()),
+            .columns = collect(ctx->indexed_column())
+    };
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Indexed_columnContext *ctx) -> IndexedColumn {
+    return IndexedColumn {
+        .column_name = build(ctx->column_name()),
+            .order = ctx->DESC() ? SortOrder::DESC : SortOrder::ASC
+    };
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Column_defContext *ctx) -> ColumnDef {
+    auto type_name = std::optional<std::string_view>{};
     if (ctx->type_name()) {
-        type_name = std::any_cast<std::string>(visit(ctx->type_name()));
+        type_name = build(ctx->type_name());
     }
 
     return ColumnDef {
-        .column_name = std::any_cast<std::string>(visit(ctx->column_name())),
-            .type_name = std::move(type_name),
-            .column_constraints = collect<ColumnConstraint>(ctx->column_constraint())
+        .column_name = build(ctx->column_name()),
+            .type_name = type_name,
+            .column_constraints = collect(ctx->column_constraint())
     };
 }
 
-std::any SqlGrammarVisitor::visitColumn_constraint([[maybe_unused]] GrammarParser::Column_constraintContext *ctx) {
-    // TODO: Implement this
-    fail("Column constraints not yet implemented");
+auto SqlGrammarVisitor::build(GrammarParser::Table_optionContext *ctx) -> TableOption {
+    if (ctx->WITHOUT()) {
+        return TableOption::WITHOUT_ROWID;
+    }
+    return ctx->STRICT() ? TableOption::STRICT : TableOption::COLUMNAR;
+}
+
+auto SqlGrammarVisitor::build([[maybe_unused]] GrammarParser::Column_constraintContext *ctx) -> ColumnConstraint {
+    fail("Column constraints are not supported");
 }
 
-std::any SqlGrammarVisitor::visitResult_column(GrammarParser::Result_columnContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::Result_columnContext *ctx) -> ResultColumn {
     if (ctx->table_name()) {
-        return ResultColumn{TableStarColumn {.table_name = std::any_cast<std::string>(visit(ctx->table_name()))}};
+        return TableStarColumn {.table_name = build(ctx->table_name())};
     }
     if (ctx->STAR()) {
-        return ResultColumn{StarColumn{}};
+        return StarColumn{};
     }
     if (ctx->expr()) {
-        std::optional<std::string> alias = std::nullopt;
+        std::optional<std::string_view> alias = std::nullopt;
         if (ctx->column_alias()) {
-            alias = std::any_cast<std::string>(ctx->column_alias());
+            alias = build(ctx->column_alias());
         }
-        return ResultColumn{ExprColumn {
-            .expr = std::any_cast<Expr>(visit(ctx->expr())),
+        return ExprColumn {
+            .expr = build(ctx->expr()),
                 .alias = alias
-        }};
+        };
     }
     fail("Invalid result column value");
 }
 
-std::any SqlGrammarVisitor::visitTable_or_subquery(GrammarParser::Table_or_subqueryContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::Table_or_subqueryContext *ctx) -> TableOrSubquery {
     auto table_or_subquery = AliasedTable{
         .table = Table {
-            .table_name = std::any_cast<std::string>(visit(ctx->table_name())),
+            .table_name = build(ctx->table_name()),
                 .schema_name = std::nullopt,
         },
             .alias = std::nullopt
     };
     if (ctx->schema_name()) {
-        table_or_subquery.table.schema_name = std::any_cast<std::string>(visit(ctx->schema_name()));
+        table_or_subquery.table.schema_name = build(ctx->schema_name());
     }
     if (ctx->table_alias()) {
-        table_or_subquery.alias = std::any_cast<std::string>(visit(ctx->table_alias()));
+        table_or_subquery.alias = build(ctx->table_alias());
     }
 
-    return TableOrSubquery{table_or_subquery};
+    return table_or_subquery;
 }
 
-std::any SqlGrammarVisitor::visitCommon_table_expression(GrammarParser::Common_table_expressionContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::Common_table_expressionContext *ctx) -> CommonTableExpression {
     const auto materliazed_specifier =
         ctx->NOT()          ? MateralizedSpecifier::NOT_MATERIALIZED
         : ctx->MATERIALIZED() ? MateralizedSpecifier::MATERLIAZED
         : /* Not specified */   MateralizedSpecifier::NONE;
 
     return CommonTableExpression {
-        .name = std::any_cast<TableName>(visit(ctx->table_name())),
-            .column_names = collect<ColumnName>(ctx->column_name()),
+        .name = build(ctx->table_name()),
+            .column_names = collect(ctx->column_name()),
             .materliazed_specifier = materliazed_specifier,
-            .select_stmt = std::any_cast<SelectStmt>(visit(ctx->select_stmt()))
+            .select_stmt = build(ctx->select_stmt())
     };
 }
 
-std::any SqlGrammarVisitor::visitWith_clause(GrammarParser::With_clauseContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::With_clauseContext *ctx) -> WithClause {
     return WithClause {
         .recursive = bool(ctx->RECURSIVE()),
-            .common_table_expressions = collect<CommonTableExpression>(ctx->common_table_expression())
+            .common_table_expressions = collect(ctx->common_table_expression())
     };
 }
 
-std::any SqlGrammarVisitor::visitConfilct_resolution_method(GrammarParser::Confilct_resolution_methodContext *ctx) {
+auto SqlGrammarVisitor::build(GrammarParser::Value_rowContext *ctx) -> std::pmr::vector<Expr> {
+    return collect(ctx->expr());
+}
+
+auto SqlGrammarVisitor::build(GrammarParser::Confilct_resolution_methodContext *ctx) -> ConflictResolutionMethod {
     if (ctx->ABORT())    return ConflictResolutionMethod::ABORT;
     if (ctx->FAIL())     return ConflictResolutionMethod::FAIL;
     if (ctx->IGNORE())   return ConflictResolutionMethod::IGNORE;
@@ -188,32 +411,91 @@ std::any SqlGrammarVisitor::visitConfilct_resolution_method(GrammarParser::Confi
     fail("Unknown resolution method {}", ctx->getText());
 }
 
-std::any SqlGrammarVisitor::visitExpr(GrammarParser::ExprContext *ctx) {
-    return Expr{ctx->IDENTIFIER()->getText()};
+auto SqlGrammarVisitor::build(GrammarParser::ExprContext *ctx) -> Expr {
+    if (ctx->function_name()) {
+        const auto name = build(ctx->function_name());
+        return Expr{FunctionCall{.name = name, .arguments = collect(ctx->expr()), .star = ctx->STAR() != nullptr}};
+    }
+
+    const auto operands = ctx->expr();
+    if (operands.size() == 2) {
+        const auto op =
+            ctx->PIPE2()     ? BinaryOperator::CONCAT
+            : ctx->STAR()    ? BinaryOperator::MULTIPLY
+            : ctx->DIV()     ? BinaryOperator::DIVIDE
+            : ctx->MOD()     ? BinaryOperator::MODULO
+            : ctx->PLUS()    ? BinaryOperator::ADD
+            : ctx->MINUS()   ? BinaryOperator::SUBTRACT
+            : ctx->LT()      ? BinaryOperator::LESS
+            : ctx->LT_EQ()   ? BinaryOperator::LESS_EQUAL
+            : ctx->GT()      ? BinaryOperator::GREATER
+            : ctx->GT_EQ()   ? BinaryOperator::GREATER_EQUAL
+            : ctx->NOT_EQ1() || ctx->NOT_EQ2() ? BinaryOperator::NOT_EQUAL
+            : ctx->AND()     ? BinaryOperator::AND
+            : ctx->OR()      ? BinaryOperator::OR
+            : /* = or == */    BinaryOperator::EQUAL;
+        const auto* lhs = make_child(build(operands[0]), &arena);
+        const auto* rhs = make_child(build(operands[1]), &arena);
+        return Expr{BinaryExpr{.op = op, .lhs = lhs, .rhs = rhs}};
+    }
+    if (operands.size() == 1) {
+        if (ctx->LPAREN()) {
+            return build(operands[0]);
+        }
+        const auto op =
+            ctx->MINUS() ? UnaryOperator::NEGATE
+            : ctx->PLUS() ? UnaryOperator::PLUS
+            : UnaryOperator::NOT;
+        return Expr{UnaryExpr{.op = op, .operand = make_child(build(operands[0]), &arena)}};
+    }
+
+    if (ctx->NUMERIC_LITERAL()) {
+        return numeric_literal(text(ctx->NUMERIC_LITERAL()));
+    }
+    if (ctx->STRING_LITERAL()) {
+        return string_literal(text(ctx->STRING_LITERAL()), &arena);
+    }
+    if (ctx->NULL_()) {
+        return Expr{NullLiteral{}};
+    }
+    if (ctx->BIND_PARAMETER()) {
+        return Expr{parameter_list.add(text(ctx->BIND_PARAMETER()))};
+    }
+    auto column = ColumnRef{.name = text(ctx->IDENTIFIER())};
+    if (ctx->table_name()) {
+        column.table = build(ctx->table_name());
+    }
+    return Expr{column};
 }
 
-std::any SqlGrammarVisitor::visitColumn_alias(GrammarParser::Column_aliasContext *ctx) {
-    return ctx->IDENTIFIER()->getText();
+auto SqlGrammarVisitor::build(GrammarParser::Function_nameContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
 }
 
-std::any SqlGrammarVisitor::visitType_name(GrammarParser::Type_nameContext *ctx) {
-    return ctx->IDENTIFIER()->getText();
+auto SqlGrammarVisitor::build(GrammarParser::Column_aliasContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
 }
 
-std::any SqlGrammarVisitor::visitSchema_name(GrammarParser::Schema_nameContext *ctx) {
-    return ctx->IDENTIFIER()->getText();
+auto SqlGrammarVisitor::build(GrammarParser::Type_nameContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
 }
 
-std::any SqlGrammarVisitor::visitTable_alias(GrammarParser::Table_aliasContext *ctx) {
-    return ctx->IDENTIFIER()->getText();
+auto SqlGrammarVisitor::build(GrammarParser::Schema_nameContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
 }
 
-std::any SqlGrammarVisitor::visitTable_name(GrammarParser::Table_nameContext *ctx) {
-    return ctx->IDENTIFIER()->getText();
+auto SqlGrammarVisitor::build(GrammarParser::Table_aliasContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
 }
 
-std::any SqlGrammarVisitor::visitColumn_name(GrammarParser::Column_nameContext *ctx) {
-    return ctx->IDENTIFIER()->getText();
+auto SqlGrammarVisitor::build(GrammarParser::Table_nameContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
 }
 
+auto SqlGrammarVisitor::build(GrammarParser::Index_nameContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
+}
 
+auto SqlGrammarVisitor::build(GrammarParser::Column_nameContext *ctx) -> std::string_view {
+    return text(ctx->IDENTIFIER());
+}
@@ -1,13 +1,20 @@
 #pragma once
-#include "GrammarBaseVisitor.h"
-#include <fmt/base.h>
-#include <fmt/format.h>
-#include <stdexcept>
-#include <string>
+#include "GrammarParser.h"
+#include "common.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
 #include <optional>
+#include <span>
 #include <variant>
 #include <vector>
 
+// The IR is built per statement inside an arena (see SqlGrammarVisitor): containers allocate from
+// it and names are views into the query text, so a Statement must not outlive either of them.
+// Nodes compare member-wise, which is how the parsers are checked against each other.
+
 // ===================================
 // SELECT STATEMENT
 // ===================================
@@ -17,34 +24,154 @@ enum class SelectModifier {
     ALL
 };
 
-using ColumnName = std::string;
-using TableName = std::string;
+using ColumnName = std::string_view;
+using TableName = std::string_view;
+
+// "table.column" names the table (or its alias), a plain "column" leaves finding it to the code generator
+struct ColumnRef {
+    ColumnName name;
+    std::optional<TableName> table{};
+    auto operator==(const ColumnRef&) const -> bool = default;
+};
+struct IntegerLiteral { std::int64_t value; auto operator==(const IntegerLiteral&) const -> bool = default; };
+// a bind parameter, numbered from 1 the way sqlite does it (https://sqlite.org/c3ref/bind_blob.html):
+// "?NNN" is number NNN, "?" and a new ":name" take the largest number so far plus one
+struct Parameter {
+    std::int64_t index;
+    // as written, empty for an anonymous "?"
+    std::string_view name;
+    auto operator==(const Parameter&) const -> bool = default;
+};
+struct RealLiteral { double value; auto operator==(const RealLiteral&) const -> bool = default; };
+// the literal's text without the quotes, a doubled quote already collapsed into one
+struct StringLiteral { std::string_view value; auto operator==(const StringLiteral&) const -> bool = default; };
+struct NullLiteral { auto operator==(const NullLiteral&) const -> bool = default; };
+
+struct Expr;
 
-struct Expr { std::string name; };
+// https://sqlite.org/lang_expr.html#operators
+enum class UnaryOperator {
+    NEGATE,
+    PLUS,
+    NOT
+};
+struct UnaryExpr {
+    UnaryOperator op;
+    const Expr* operand;
+    auto operator==(const UnaryExpr& other) const -> bool;
+};
+
+enum class BinaryOperator {
+    CONCAT,
+    MULTIPLY,
+    DIVIDE,
+    MODULO,
+    ADD,
+    SUBTRACT,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+    AND,
+    OR
+};
+struct BinaryExpr {
+    BinaryOperator op;
+    const Expr* lhs;
+    const Expr* rhs;
+    auto operator==(const BinaryExpr& other) const -> bool;
+};
+
+struct FunctionCall {
+    // as written, functions are looked up case insensitively
+    std::string_view name;
+    std::pmr::vector<Expr> arguments;
+    // count(*), which has no arguments
+    bool star = false;
+    auto operator==(const FunctionCall&) const -> bool = default;
+};
+
+// subexpressions are allocated in the arena as well
+struct Expr {
+    std::variant<ColumnRef, IntegerLiteral, RealLiteral, StringLiteral, NullLiteral, Parameter,
+                 UnaryExpr, BinaryExpr, FunctionCall> value;
+    auto operator==(const Expr&) const -> bool = default;
+};
+
+inline auto UnaryExpr::operator==(const UnaryExpr& other) const -> bool {
+    return op == other.op && *operand == *other.operand;
+}
+inline auto BinaryExpr::operator==(const BinaryExpr& other) const -> bool {
+    return op == other.op && *lhs == *other.lhs && *rhs == *other.rhs;
+}
 
 // https://sqlite.org/syntax/result-column.html
-struct StarColumn { };
-struct TableStarColumn { TableName table_name; };
+struct StarColumn { auto operator==(const StarColumn&) const -> bool = default; };
+struct TableStarColumn { TableName table_name; auto operator==(const TableStarColumn&) const -> bool = default; };
 struct ExprColumn {
     Expr expr;
-    std::optional<std::string> alias;
+    std::optional<std::string_view> alias;
+    auto operator==(const ExprColumn&) const -> bool = default;
 };
 using ResultColumn = std::variant<StarColumn, TableStarColumn, ExprColumn>;
 
 struct Table {
     TableName table_name;
-    std::optional<std::string> schema_name;
+    std::optional<std::string_view> schema_name;
+    auto operator==(const Table&) const -> bool = default;
 };
 struct AliasedTable {
     Table table;
-    std::optional<std::string> alias;
+    std::optional<std::string_view> alias;
+    auto operator==(const AliasedTable&) const -> bool = default;
 };
 using TableOrSubquery = std::variant<AliasedTable>;
 
+// https://sqlite.org/syntax/join-operator.html, all of them are inner joins
+enum class JoinOperator {
+    COMMA,
+    JOIN,
+    INNER,
+    CROSS
+};
+// how a source is joined to the ones before it
+struct JoinConstraint {
+    JoinOperator op;
+    std::optional<Expr> on;
+    auto operator==(const JoinConstraint&) const -> bool = default;
+};
+
+enum class SortOrder {
+    ASC,
+    DESC
+};
+
+// https://sqlite.org/syntax/ordering-term.html
+struct OrderingTerm {
+    Expr expr;
+    // ASC unless DESC is given
+    SortOrder order;
+    auto operator==(const OrderingTerm&) const -> bool = default;
+};
+
 struct SelectStmt {
     SelectModifier modifier;
-    std::vector<ResultColumn> projections;
-    std::vector<TableOrSubquery> sources;
+    std::pmr::vector<ResultColumn> projections;
+    std::pmr::vector<TableOrSubquery> sources;
+    // joins[i] joins sources[i + 1], see https://sqlite.org/syntax/join-clause.html
+    std::pmr::vector<JoinConstraint> joins;
+    std::optional<Expr> where;
+    // empty without a GROUP BY, which the HAVING needs
+    std::pmr::vector<Expr> group_by;
+    std::optional<Expr> having;
+    // empty without an ORDER BY, which applies before the LIMIT and the OFFSET
+    std::pmr::vector<OrderingTerm> order_by;
+    std::optional<Expr> limit;
+    // only with a LIMIT
+    std::optional<Expr> offset;
+    auto operator==(const SelectStmt&) const -> bool = default;
 };
 
 // ===================================
@@ -59,26 +186,33 @@ enum class ConflictResolutionMethod {
 };
 
 struct ColumnConstraint {
-
+    auto operator==(const ColumnConstraint&) const -> bool = default;
 };
 
 struct ColumnDef {
     ColumnName column_name;
-    std::optional<std::string> type_name;
-    std::vector<ColumnConstraint> column_constraints{};
+    std::optional<std::string_view> type_name;
+    std::pmr::vector<ColumnConstraint> column_constraints{};
+    auto operator==(const ColumnDef&) const -> bool = default;
 };
 
 enum class TableOption {
     WITHOUT_ROWID,
-    STRICT
+    STRICT,
+    // not sqlite's, the rows are stored in compressed column segments, see ColumnarCursor
+    COLUMNAR
 };
 
 struct CreateTableStmt {
     bool temporary;
     bool if_not_exists_clause;
     Table table;
-    std::vector<ColumnDef> column_definitions;
-    std::vector<TableOption> table_options;
+    std::pmr::vector<ColumnDef> column_definitions;
+    std::pmr::vector<TableOption> table_options;
+    // CREATE TABLE ... AS SELECT, whose result columns are the table's columns, column_definitions
+    // is empty then
+    std::optional<SelectStmt> as_select{};
+    auto operator==(const CreateTableStmt&) const -> bool = default;
 };
 
 // ===================================
@@ -91,85 +225,196 @@ enum class MateralizedSpecifier {
 };
 struct CommonTableExpression {
     TableName name;
-    std::vector<ColumnName> column_names;
+    std::pmr::vector<ColumnName> column_names;
     MateralizedSpecifier materliazed_specifier;
     SelectStmt select_stmt;
+    auto operator==(const CommonTableExpression&) const -> bool = default;
 };
 
 struct WithClause {
     bool recursive;
-    std::vector<CommonTableExpression> common_table_expressions;
+    std::pmr::vector<CommonTableExpression> common_table_expressions;
+    auto operator==(const WithClause&) const -> bool = default;
 };
 
-struct ReplaceContainer {};
-struct InsertContainer {std::optional<ConflictResolutionMethod> confilct_res_method;};
+struct ReplaceContainer { auto operator==(const ReplaceContainer&) const -> bool = default; };
+struct InsertContainer { std::optional<ConflictResolutionMethod> confilct_res_method; auto operator==(const InsertContainer&) const -> bool = default; };
 using InsertStmtOp = std::variant<ReplaceContainer, InsertContainer>;
 
-// this struct represents use of the VALUES keyword, e.g. INSERT INTO temp VALUES("123", 5)
+// this struct represents use of the VALUES keyword, e.g. INSERT INTO temp VALUES("123", 5), (6, 7)
 struct InsertStmtValuesExpr {
-    std::vector<Expr> expressions;
+    std::pmr::vector<std::pmr::vector<Expr>> rows;
+    auto operator==(const InsertStmtValuesExpr&) const -> bool = default;
 };
-struct DefaultValues {};
+struct DefaultValues { auto operator==(const DefaultValues&) const -> bool = default; };
 using InsertedTuples = std::variant<InsertStmtValuesExpr, SelectStmt, DefaultValues>;
 
 struct InsertStmt {
     std::optional<WithClause> with_clause;
     InsertStmtOp operation;
     AliasedTable table;
-    std::optional<std::vector<ColumnName>> column_names;
+    std::optional<std::pmr::vector<ColumnName>> column_names;
     InsertedTuples tuples;
+    auto operator==(const InsertStmt&) const -> bool = default;
+};
+
+// ===================================
+// CREATE INDEX STATEMENT
+// ===================================
+struct IndexedColumn {
+    ColumnName column_name;
+    // ASC unless DESC is given
+    SortOrder order;
+    auto operator==(const IndexedColumn&) const -> bool = default;
 };
 
-using Statement = std::variant<SelectStmt, CreateTableStmt, InsertStmt>;
+struct CreateIndexStmt {
+    bool unique;
+    bool if_not_exists_clause;
+    std::optional<std::string_view> schema_name;
+    std::string_view index_name;
+    TableName table_name;
+    std::pmr::vector<IndexedColumn> columns;
+    auto operator==(const CreateIndexStmt&) const -> bool = default;
+};
 
 // ===================================
-// IR generator
+// EXPLAIN
 // ===================================
+enum class ExplainMode {
+    // the program's instructions, one row each
+    PROGRAM,
+    // QUERY PLAN - the access paths the program takes
+    QUERY_PLAN,
+    // ANALYZE - runs the program and lists its instructions with how often they ran and how
+    // long they took
+    ANALYZE
+};
+
+struct ExplainStmt;
 
-struct SqlError : std::runtime_error {
-    using std::runtime_error::runtime_error;
+// ===================================
+// ANALYZE
+// ===================================
+// https://sqlite.org/lang_analyze.html
+struct AnalyzeStmt {
+    // a table or an index, whose table is analyzed then, every table if there's none
+    std::optional<Table> target;
+    auto operator==(const AnalyzeStmt&) const -> bool = default;
 };
 
-template <typename... Args>
-[[noreturn]] void fail(fmt::format_string<Args...> fmtstr, Args&&... args) {
-    throw SqlError{fmt::format(fmtstr, std::forward<Args>(args)...)};
+using Statement = std::variant<SelectStmt, CreateTableStmt, InsertStmt, CreateIndexStmt, ExplainStmt, AnalyzeStmt>;
+
+// https://sqlite.org/lang_explain.html, plus EXPLAIN ANALYZE
+struct ExplainStmt {
+    ExplainMode mode;
+    // never another ExplainStmt, allocated in the arena
+    const Statement* statement;
+    auto operator==(const ExplainStmt& other) const -> bool;
+};
+
+inline auto ExplainStmt::operator==(const ExplainStmt& other) const -> bool {
+    return mode == other.mode && *statement == *other.statement;
 }
 
-class SqlGrammarVisitor : public GrammarBaseVisitor {
+// Numbers a statement's bind parameters as the parser runs into them, see Parameter.
+class ParameterList {
 public:
-    std::any visitProgram(GrammarParser::ProgramContext *ctx) override;
-    std::any visitSql_stmt(GrammarParser::Sql_stmtContext *ctx) override;
-    std::any visitInsert_stmt(GrammarParser::Insert_stmtContext *ctx) override;
-    std::any visitSelect_stmt(GrammarParser::Select_stmtContext *ctx) override;
-    std::any visitCreate_table_stmt(GrammarParser::Create_table_stmtContext *ctx) override;
-    std::any visitColumn_def(GrammarParser::Column_defContext *ctx) override;
-    std::any visitColumn_constraint([[maybe_unused]] GrammarParser::Column_constraintContext *ctx) override;
-    std::any visitResult_column(GrammarParser::Result_columnContext *ctx) override;
-    std::any visitTable_or_subquery(GrammarParser::Table_or_subqueryContext *ctx) override;
-    std::any visitCommon_table_expression(GrammarParser::Common_table_expressionContext *ctx) override;
-    std::any visitWith_clause(GrammarParser::With_clauseContext *ctx) override;
-    std::any visitConfilct_resolution_method(GrammarParser::Confilct_resolution_methodContext *ctx) override;
-    std::any visitExpr(GrammarParser::ExprContext *ctx) override;
-    std::any visitColumn_alias(GrammarParser::Column_aliasContext *ctx) override;
-    std::any visitType_name(GrammarParser::Type_nameContext *ctx) override;
-    std::any visitSchema_name(GrammarParser::Schema_nameContext *ctx) override;
-    std::any visitTable_alias(GrammarParser::Table_aliasContext *ctx) override;
-    std::any visitTable_name(GrammarParser::Table_nameContext *ctx) override;
-    std::any visitColumn_name(GrammarParser::Column_nameContext *ctx) override;
+    explicit ParameterList(std::pmr::memory_resource* arena) : parameter_names(arena) {}
+
+    // name - the parameter as written: "?", "?NNN" or ":name"
+    auto add(std::string_view name) -> Parameter;
+    // parameter i's name is at i - 1, empty for an anonymous "?"
+    [[nodiscard]] auto names() const -> std::span<const std::string_view> { return parameter_names; }
 
 private:
+    std::pmr::vector<std::string_view> parameter_names;
+};
+
+// A NUMERIC_LITERAL the way sqlite reads it: an IntegerLiteral, unless it has a fraction or an
+// exponent or doesn't fit into 64 bits, which makes it a RealLiteral.
+[[nodiscard]] auto numeric_literal(std::string_view text) -> Expr;
+// text - a STRING_LITERAL including its quotes, the result is copied into the arena only if it had doubled quotes
+[[nodiscard]] auto string_literal(std::string_view text, std::pmr::memory_resource* arena) -> Expr;
+// the expression moved into the arena, as the child of a UnaryExpr or a BinaryExpr
+[[nodiscard]] auto make_child(Expr expr, std::pmr::memory_resource* arena) -> const Expr*;
+// the statement moved into the arena, as the one an ExplainStmt explains
+[[nodiscard]] auto make_child(Statement statement, std::pmr::memory_resource* arena) -> const Statement*;
+
+// ===================================
+// IR generator
+// ===================================
+
+// Builds the IR of one statement from its parse tree. Every node is returned by value and moved
+// into its parent, the vectors allocate from the visitor's arena.
+class SqlGrammarVisitor {
+public:
+    // sql - the text the parse tree was built from
+    explicit SqlGrammarVisitor(std::string_view sql);
+    SqlGrammarVisitor(const SqlGrammarVisitor&) = delete;
+    auto operator=(const SqlGrammarVisitor&) -> SqlGrammarVisitor& = delete;
+
+    // the result lives in this visitor's arena and points into sql
+    [[nodiscard]] auto build(GrammarParser::ProgramContext *ctx) -> Statement;
+
+    // names of the statement's bind parameters, parameter i is at i - 1, see Parameter
+    [[nodiscard]] auto parameters() const -> std::span<const std::string_view> { return parameter_list.names(); }
+
+private:
+    auto build(GrammarParser::Sql_stmtContext *ctx) -> Statement;
+    auto build(GrammarParser::Explainable_stmtContext *ctx) -> Statement;
+    auto build(GrammarParser::Analyze_stmtContext *ctx) -> AnalyzeStmt;
+    auto build(GrammarParser::Insert_stmtContext *ctx) -> InsertStmt;
+    auto build(GrammarParser::Select_stmtContext *ctx) -> SelectStmt;
+    auto build(GrammarParser::Join_clauseContext *ctx, SelectStmt& statement) -> void;
+    auto build(GrammarParser::Ordering_termContext *ctx) -> OrderingTerm;
+    auto build(GrammarParser::Join_operatorContext *ctx) -> JoinOperator;
+    auto build(GrammarParser::Create_table_stmtContext *ctx) -> CreateTableStmt;
+    auto build(GrammarParser::Create_index_stmtContext *ctx) -> CreateIndexStmt;
+    auto build(GrammarParser::Indexed_columnContext *ctx) -> IndexedColumn;
+    auto build(GrammarParser::Column_defContext *ctx) -> ColumnDef;
+    auto build(GrammarParser::Table_optionContext *ctx) -> TableOption;
+    auto build([[maybe_unused]] GrammarParser::Column_constraintContext *ctx) -> ColumnConstraint;
+    auto build(GrammarParser::Result_columnContext *ctx) -> ResultColumn;
+    auto build(GrammarParser::Table_or_subqueryContext *ctx) -> TableOrSubquery;
+    auto build(GrammarParser::Common_table_expressionContext *ctx) -> CommonTableExpression;
+    auto build(GrammarParser::With_clauseContext *ctx) -> WithClause;
+    auto build(GrammarParser::Value_rowContext *ctx) -> std::pmr::vector<Expr>;
+    auto build(GrammarParser::Confilct_resolution_methodContext *ctx) -> ConflictResolutionMethod;
+    auto build(GrammarParser::ExprContext *ctx) -> Expr;
+    auto build(GrammarParser::Function_nameContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Column_aliasContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Type_nameContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Schema_nameContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Table_aliasContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Table_nameContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Index_nameContext *ctx) -> std::string_view;
+    auto build(GrammarParser::Column_nameContext *ctx) -> std::string_view;
+
+    // the token's text as a view into sql
+    auto text(antlr4::tree::TerminalNode *node) -> std::string_view;
+
     // used to collect grammar constructs like "column_name (COMMA column_name)*" that antlr parses into vec
     // U - some grammar rule, hence the requires clause
-    // T - the IR struct representing that grammar rule, returned by the corresponding, overriden visit function
-    template <typename T, typename U>
-        requires std::derived_from<std::remove_pointer_t<U>, antlr4::ParserRuleContext>
-    auto collect(const std::vector<U>& grammar_expr) -> std::vector<T> {
-        auto vec = std::vector<T>{};
+    // the element type is the IR struct returned by the build overload for U
+    template <typename U>
+        requires std::derived_from<U, antlr4::ParserRuleContext>
+    auto collect(const std::vector<U*>& grammar_expr) {
+        using T = decltype(build(std::declval<U*>()));
+        auto vec = std::pmr::vector<T>{&arena};
         vec.reserve(grammar_expr.size());
-        for (const auto& e : grammar_expr) {
-            vec.push_back(std::any_cast<T>(visit(e)));
+        for (auto* e : grammar_expr) {
+            vec.push_back(build(e));
         }
 
         return vec;
     }
+
+    std::string_view sql;
+    // antlr's token offsets count code points, they're only byte offsets for ASCII input
+    bool ascii_only;
+    // statements small enough to fit here don't touch the heap at all
+    std::array<std::byte, 4096> initial_buffer;
+    std::pmr::monotonic_buffer_resource arena{initial_buffer.data(), initial_buffer.size()};
+    ParameterList parameter_list{&arena};
 };
@@ -0,0 +1,491 @@
+#include "batch.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// the kernels below keep per-row branches out of their inner loops so they vectorize
+
+auto decode_columns(std::span<const std::span<const std::uint8_t>> payloads, std::span<const std::size_t> columns,
+                    std::span<const std::unique_ptr<ColumnVector>> vectors) -> void {
+    if (columns.empty()) {
+        return;
+    }
+    for (auto i = std::size_t{0}; i < payloads.size(); ++i) {
+        auto record = RecordView{payloads[i]};
+        for (auto slot = std::size_t{0}; slot < columns.size(); ++slot) {
+            auto& vector = *vectors[slot];
+            const auto value = record.column(columns[slot]);
+            vector.types[i] = static_cast<std::uint8_t>(value.index());
+            if (const auto* integer = std::get_if<std::int64_t>(&value)) {
+                vector.integers[i] = *integer;
+            } else {
+                vector.integers[i] = 0;
+                vector.others[i] = value;
+            }
+        }
+    }
+}
+
+// a segment's decoded column, its TEXT and BLOB views pointing into the values
+auto load_column(std::span<const Value> values, ColumnVector& vector) -> void {
+    for (auto i = std::size_t{0}; i < values.size(); ++i) {
+        vector.types[i] = static_cast<std::uint8_t>(values[i].index());
+        if (const auto* integer = std::get_if<std::int64_t>(&values[i])) {
+            vector.integers[i] = *integer;
+        } else {
+            vector.integers[i] = 0;
+            vector.others[i] = view_of(values[i]);
+        }
+    }
+}
+
+template <typename Compare>
+auto compare_integers(const ColumnVector& vector, std::size_t count, std::int64_t constant,
+                      std::uint8_t* matches, Compare compare) -> void {
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        matches[i] = static_cast<std::uint8_t>((vector.types[i] == integer_type) & compare(vector.integers[i], constant));
+    }
+}
+
+auto compare_other(const ValueView& value, Comparison comparison, std::int64_t constant) -> bool {
+    if (std::holds_alternative<Null>(value)) {
+        return false;
+    }
+    // TEXT and BLOB sort after every number
+    auto order = 1;
+    if (const auto* real = std::get_if<double>(&value)) {
+        const auto other = static_cast<double>(constant);
+        order = *real < other ? -1 : *real > other ? 1 : 0;
+    }
+    switch (comparison) {
+        case Comparison::EQ: return order == 0;
+        case Comparison::NE: return order != 0;
+        case Comparison::LT: return order < 0;
+        case Comparison::LE: return order <= 0;
+        case Comparison::GT: return order > 0;
+        case Comparison::GE: return order >= 0;
+    }
+    return false;
+}
+
+// narrows the selection to the rows matching the filter, returns the new selection size
+auto apply_filter(const ColumnVector& vector, std::size_t count, const BatchFilter& filter,
+                  std::uint16_t* selection, std::size_t selected) -> std::size_t {
+    auto matches = std::array<std::uint8_t, batch_size>{};
+    const auto constant = filter.constant;
+    switch (filter.comparison) {
+        case Comparison::EQ: compare_integers(vector, count, constant, matches.data(), std::equal_to{}); break;
+        case Comparison::NE: compare_integers(vector, count, constant, matches.data(), std::not_equal_to{}); break;
+        case Comparison::LT: compare_integers(vector, count, constant, matches.data(), std::less{}); break;
+        case Comparison::LE: compare_integers(vector, count, constant, matches.data(), std::less_equal{}); break;
+        case Comparison::GT: compare_integers(vector, count, constant, matches.data(), std::greater{}); break;
+        case Comparison::GE: compare_integers(vector, count, constant, matches.data(), std::greater_equal{}); break;
+    }
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        if (vector.types[i] != integer_type) {
+            matches[i] = compare_other(vector.others[i], filter.comparison, constant);
+        }
+    }
+
+    // branch-free compaction, every row is written and kept only if it matched
+    auto kept = std::size_t{0};
+    for (auto k = std::size_t{0}; k < selected; ++k) {
+        selection[kept] = selection[k];
+        kept += matches[selection[k]];
+    }
+    return kept;
+}
+
+auto project(const ColumnVector& vector, std::span<const std::uint16_t> selection, Value* out, std::size_t stride) -> void {
+    for (const auto row : selection) {
+        *out = vector.types[row] == integer_type ? Value{vector.integers[row]} : to_value(vector.others[row]);
+        out += stride;
+    }
+}
+
+} // namespace
+
+auto compile_batch_plan(std::span<const Instruction> body, std::int64_t cursor,
+                        std::span<const Value> registers, std::int64_t next,
+                        std::span<const std::int64_t> yielded) -> std::optional<BatchPlan> {
+    const auto comparison_of = [](Opcode opcode) -> std::optional<Comparison> {
+        switch (opcode) {
+            case Opcode::EQ: return Comparison::EQ;
+            case Opcode::NE: return Comparison::NE;
+            case Opcode::LT: return Comparison::LT;
+            case Opcode::LE: return Comparison::LE;
+            case Opcode::GT: return Comparison::GT;
+            case Opcode::GE: return Comparison::GE;
+            default: return std::nullopt;
+        }
+    };
+    // constant < column is column > constant
+    const auto mirrored = [](Comparison comparison) {
+        switch (comparison) {
+            case Comparison::LT: return Comparison::GT;
+            case Comparison::LE: return Comparison::GE;
+            case Comparison::GT: return Comparison::LT;
+            case Comparison::GE: return Comparison::LE;
+            default: return comparison;
+        }
+    };
+
+    // the registers the body writes, everything else keeps the value it had before the loop
+    auto written = std::unordered_set<std::int64_t>{};
+    for (const auto& instr : body) {
+        switch (instr.opcode) {
+            case Opcode::COLUMN:
+                written.insert(instr.P3);
+                break;
+            case Opcode::ROWID:
+            case Opcode::INTEGER:
+            case Opcode::COPY:
+                written.insert(instr.P2);
+                break;
+            default:
+                if (comparison_of(instr.opcode)) {
+                    written.insert(instr.P3);
+                }
+                break;
+        }
+    }
+
+    // what each register holds for the current row, columns by their record index for now
+    auto row_registers = std::unordered_map<std::int64_t, BatchOutput>{};
+    const auto lookup = [&](std::int64_t reg) -> std::optional<BatchOutput> {
+        if (const auto it = row_registers.find(reg); it != row_registers.end()) {
+            return it->second;
+        }
+        if (written.contains(reg) || reg < 0 || static_cast<std::size_t>(reg) >= registers.size()) {
+            return std::nullopt;
+        }
+        return BatchOutput{.source = BatchOutput::Source::CONSTANT, .slot = 0, .constant = registers[static_cast<std::size_t>(reg)]};
+    };
+    auto plan = BatchPlan{};
+    auto has_result = false;
+
+    for (auto i = std::size_t{0}; i < body.size(); ++i) {
+        const auto& instr = body[i];
+        if (has_result) {
+            return std::nullopt;
+        }
+        switch (instr.opcode) {
+            case Opcode::COLUMN:
+                if (instr.P1 != cursor) {
+                    return std::nullopt;
+                }
+                row_registers[instr.P3] = BatchOutput{
+                    .source = BatchOutput::Source::COLUMN,
+                    .slot = static_cast<std::size_t>(instr.P2),
+                    .constant = {}
+                };
+                plan.columns.push_back(static_cast<std::size_t>(instr.P2));
+                break;
+            case Opcode::ROWID:
+                if (instr.P1 != cursor) {
+                    return std::nullopt;
+                }
+                row_registers[instr.P2] = BatchOutput{.source = BatchOutput::Source::ROWID, .slot = 0, .constant = {}};
+                break;
+            case Opcode::INTEGER:
+                row_registers[instr.P2] = BatchOutput{.source = BatchOutput::Source::CONSTANT, .slot = 0, .constant = instr.P1};
+                break;
+            case Opcode::COPY: {
+                auto source = lookup(instr.P1);
+                if (!source) {
+                    return std::nullopt;
+                }
+                row_registers[instr.P2] = *std::move(source);
+                break;
+            }
+            case Opcode::RESULTROW:
+                for (auto reg = instr.P1; reg < instr.P1 + instr.P2; ++reg) {
+                    auto output = lookup(reg);
+                    if (!output) {
+                        return std::nullopt;
+                    }
+                    plan.outputs.push_back(*std::move(output));
+                }
+                has_result = true;
+                break;
+            case Opcode::YIELD:
+                if (yielded.empty()) {
+                    return std::nullopt;
+                }
+                for (const auto reg : yielded) {
+                    auto output = lookup(reg);
+                    if (!output) {
+                        return std::nullopt;
+                    }
+                    plan.outputs.push_back(*std::move(output));
+                }
+                has_result = true;
+                break;
+            default: {
+                // column <op> integer constant, skipping the row unless it holds
+                const auto comparison = comparison_of(instr.opcode);
+                if (!comparison || i + 1 == body.size()) {
+                    return std::nullopt;
+                }
+                const auto& jump = body[i + 1];
+                if (jump.opcode != Opcode::IFNOT || jump.P1 != instr.P3 || jump.P2 != next) {
+                    return std::nullopt;
+                }
+                auto lhs = lookup(instr.P1);
+                auto rhs = lookup(instr.P2);
+                if (!lhs || !rhs) {
+                    return std::nullopt;
+                }
+                auto filter_comparison = *comparison;
+                if (lhs->source == BatchOutput::Source::CONSTANT) {
+                    std::swap(lhs, rhs);
+                    filter_comparison = mirrored(filter_comparison);
+                }
+                const auto* constant = std::get_if<std::int64_t>(&rhs->constant);
+                if (lhs->source != BatchOutput::Source::COLUMN || rhs->source != BatchOutput::Source::CONSTANT || !constant) {
+                    return std::nullopt;
+                }
+                plan.filters.push_back(BatchFilter{.slot = lhs->slot, .comparison = filter_comparison, .constant = *constant});
+                ++i;
+                break;
+            }
+        }
+    }
+    // with no columns to decode there's nothing for the batches to win
+    if (!has_result || plan.columns.empty()) {
+        return std::nullopt;
+    }
+
+    std::ranges::sort(plan.columns);
+    const auto [last, end] = std::ranges::unique(plan.columns);
+    plan.columns.erase(last, end);
+    const auto slot_of = [&](std::size_t column) {
+        return static_cast<std::size_t>(std::ranges::lower_bound(plan.columns, column) - plan.columns.begin());
+    };
+    for (auto& output : plan.outputs) {
+        if (output.source == BatchOutput::Source::COLUMN) {
+            output.slot = slot_of(output.slot);
+        }
+    }
+    for (auto& batch_filter : plan.filters) {
+        batch_filter.slot = slot_of(batch_filter.slot);
+    }
+    return plan;
+}
+
+// ===================================
+// BatchScan
+// ===================================
+BatchScan::BatchScan(BTreeCursor& cursor, BatchPlan plan, std::int64_t last)
+    : cursor(cursor), plan(std::move(plan)), last(last) {
+    for (auto i = std::size_t{0}; i < this->plan.columns.size(); ++i) {
+        vectors.push_back(std::make_unique<ColumnVector>());
+    }
+}
+
+auto BatchScan::next_row() -> std::optional<std::span<const Value>> {
+    const auto width = plan.outputs.size();
+    while (position == selected) {
+        if (!fill()) {
+            return std::nullopt;
+        }
+    }
+    const auto row = std::span<const Value>{rows.data() + position * width, width};
+    ++position;
+    return row;
+}
+
+auto BatchScan::next_batch() -> std::optional<std::span<Value>> {
+    if (!fill()) {
+        return std::nullopt;
+    }
+    position = selected;
+    return std::span<Value>{rows};
+}
+
+auto BatchScan::fill() -> bool {
+    static_assert(segment_rows <= batch_size);
+    if (cell == cells) {
+        pins.clear();
+        cells = read_cells();
+        cell = 0;
+        if (cells == 0) {
+            return false;
+        }
+    }
+
+    auto count = std::size_t{0};
+    const std::int64_t* ids = nullptr;
+    if (plan.segment_columns > 0 && is_segment(payloads[cell])) {
+        const auto payload = payloads[cell];
+        auto segment = Segment{payload, rowids[cell], plan.segment_columns};
+        ++cell;
+        // a segment the zone maps rule out makes an empty batch
+        if (segment.passes(plan.zone_filters)) {
+            count = segment.rows();
+            segment_values.resize(plan.columns.size());
+            for (auto slot = std::size_t{0}; slot < plan.columns.size(); ++slot) {
+                segment_values[slot] = segment.column(payload, cursor.btree(), cursor.view(), plan.columns[slot]);
+                load_column(segment_values[slot], *vectors[slot]);
+            }
+            for (auto i = std::size_t{0}; i < count; ++i) {
+                segment_rowids[i] = segment.first_rowid() + static_cast<std::int64_t>(i);
+            }
+        }
+        ids = segment_rowids.data();
+    } else {
+        // the records up to the next segment
+        auto end = cell + 1;
+        while (end < cells && (plan.segment_columns == 0 || !is_segment(payloads[end]))) {
+            ++end;
+        }
+        count = end - cell;
+        decode_columns(std::span{payloads.data() + cell, count}, plan.columns, vectors);
+        ids = rowids.data() + cell;
+        cell = end;
+    }
+
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        selection[i] = static_cast<std::uint16_t>(i);
+    }
+    selected = count;
+    for (const auto& batch_filter : plan.filters) {
+        selected = apply_filter(*vectors[batch_filter.slot], count, batch_filter, selection.data(), selected);
+    }
+
+    const auto width = plan.outputs.size();
+    const auto rows_selected = std::span<const std::uint16_t>{selection.data(), selected};
+    rows.resize(selected * width);
+    for (auto j = std::size_t{0}; j < width; ++j) {
+        const auto& output = plan.outputs[j];
+        auto* out = rows.data() + j;
+        switch (output.source) {
+            case BatchOutput::Source::COLUMN:
+                project(*vectors[output.slot], rows_selected, out, width);
+                break;
+            case BatchOutput::Source::ROWID:
+                for (const auto row : rows_selected) {
+                    *out = ids[row];
+                    out += width;
+                }
+                break;
+            case BatchOutput::Source::CONSTANT:
+                for (auto k = std::size_t{0}; k < selected; ++k) {
+                    *out = output.constant;
+                    out += width;
+                }
+                break;
+        }
+    }
+    position = 0;
+    return true;
+}
+
+auto BatchScan::read_cells() -> std::size_t {
+    auto count = cursor.valid() ? cursor.next_batch(rowids, payloads, pins) : 0;
+    if (count > 0 && rowids[count - 1] > last) {
+        // the rest of the tree is someone else's
+        count = static_cast<std::size_t>(std::upper_bound(rowids.begin(), rowids.begin() + count, last) - rowids.begin());
+        last = INT64_MIN;
+    }
+    return count;
+}
+
+// ===================================
+// ParallelScan
+// ===================================
+ParallelScan::ParallelScan(BTree& tree, const Snapshot* snapshot, BatchPlan plan, std::vector<RowidRange> ranges,
+                           const std::shared_ptr<ThreadPool>& pool)
+    : tree(tree), snapshot(snapshot), plan(std::move(plan)), pool(pool) {
+    for (const auto& range : ranges) {
+        morsels.push_back(Morsel{.range = range});
+    }
+    job = pool->start(morsels.size(), [this](std::size_t morsel, std::size_t) { run(morsels[morsel]); });
+}
+
+ParallelScan::~ParallelScan() {
+    {
+        const auto lock = std::scoped_lock{mutex};
+        stopping = true;
+    }
+    batch_taken.notify_all();
+    job->cancel();
+    job->wait();
+}
+
+auto ParallelScan::run(Morsel& morsel) -> void {
+    auto error = std::exception_ptr{};
+    try {
+        auto cursor = BTreeCursor{tree, snapshot};
+        cursor.seek(morsel.range.first);
+        auto scan = BatchScan{cursor, plan, morsel.range.last};
+        while (const auto batch = scan.next_batch()) {
+            if (batch->empty()) {
+                continue;
+            }
+            auto rows = std::vector<Value>{std::make_move_iterator(batch->begin()), std::make_move_iterator(batch->end())};
+            auto lock = std::unique_lock{mutex};
+            batch_taken.wait(lock, [&] { return stopping || morsel.batches.size() < morsel_queue_batches; });
+            if (stopping) {
+                return;
+            }
+            morsel.batches.push_back(std::move(rows));
+            lock.unlock();
+            batch_queued.notify_all();
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    {
+        const auto lock = std::scoped_lock{mutex};
+        morsel.error = error;
+        morsel.done = true;
+    }
+    batch_queued.notify_all();
+}
+
+auto ParallelScan::next_row() -> std::optional<std::span<const Value>> {
+    const auto width = plan.outputs.size();
+    while (position == rows.size()) {
+        if (current == morsels.size()) {
+            return std::nullopt;
+        }
+        auto& morsel = morsels[current];
+        auto lock = std::unique_lock{mutex};
+        batch_queued.wait(lock, [&] { return !morsel.batches.empty() || morsel.done; });
+        if (morsel.batches.empty()) {
+            if (morsel.error) {
+                std::rethrow_exception(morsel.error);
+            }
+            ++current;
+            continue;
+        }
+        // the last row handed out was only valid up to this call
+        rows = std::move(morsel.batches.front());
+        morsel.batches.pop_front();
+        position = 0;
+        lock.unlock();
+        batch_taken.notify_all();
+    }
+    const auto row = std::span<const Value>{rows.data() + position, width};
+    position += width;
+    return row;
+}
+
+auto scan_morsels(BTree& tree, const Snapshot* snapshot, const BatchPlan& plan, std::span<const RowidRange> morsels,
+                  ThreadPool& pool, const std::function<void(std::size_t morsel, std::span<Value> rows)>& consume) -> void {
+    // wait() returns once no worker is on a morsel any more, so they can all refer to this frame
+    pool.start(morsels.size(), [&](std::size_t morsel, std::size_t) {
+        auto cursor = BTreeCursor{tree, snapshot};
+        cursor.seek(morsels[morsel].first);
+        auto scan = BatchScan{cursor, plan, morsels[morsel].last};
+        while (const auto batch = scan.next_batch()) {
+            consume(morsel, *batch);
+        }
+    })->wait();
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include "btree.hpp"
+#include "bytecode_gen.hpp"
+#include "columnar.hpp"
+#include "record.hpp"
+#include "thread_pool.hpp"
+#include "value.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// Vectorized execution of table scans: rows are read, filtered and projected ~1000 at a time,
+// one column at a time, instead of one instruction per column per row.
+inline constexpr std::size_t batch_size = 1024;
+
+// One column of a batch. Integers are kept unboxed in an array of their own, so the kernels
+// over them are plain loops the compiler vectorizes, every other value is a view into its page.
+struct ColumnVector {
+    // the ValueView alternative of every row
+    std::array<std::uint8_t, batch_size> types;
+    std::array<std::int64_t, batch_size> integers;
+    std::array<ValueView, batch_size> others;
+};
+inline constexpr std::uint8_t integer_type = 1;
+static_assert(std::is_same_v<std::variant_alternative_t<integer_type, ValueView>, std::int64_t>);
+
+enum class Comparison : std::uint8_t { EQ, NE, LT, LE, GT, GE };
+
+// column <op> constant, with sqlite's ordering NULL < numbers < TEXT < BLOB and NULL never matching
+struct BatchFilter {
+    // index into BatchPlan::columns
+    std::size_t slot;
+    Comparison comparison;
+    std::int64_t constant;
+};
+
+struct BatchOutput {
+    enum class Source : std::uint8_t { COLUMN, ROWID, CONSTANT };
+    Source source;
+    // COLUMN - index into BatchPlan::columns
+    std::size_t slot;
+    Value constant;
+};
+
+struct BatchPlan {
+    // the record columns to decode, ascending, so each record's header is parsed only once
+    std::vector<std::size_t> columns;
+    std::vector<BatchFilter> filters;
+    std::vector<BatchOutput> outputs;
+    // a COLUMNAR table's column count, 0 for any other table, and the filters whose zone maps
+    // skip its segments, see ColumnarCursor
+    std::size_t segment_columns = 0;
+    std::vector<ZoneFilter> zone_filters;
+};
+
+// Translates the body of a row loop over the cursor - the instructions between its SCAN and its
+// NEXT - into a plan, nullopt if the body does anything the batch kernels don't cover. The body
+// ends in a RESULTROW, or in a co-routine's YIELD when the rows all go into an aggregation or a
+// sort, see scan_morsels.
+// registers - the VM's registers as the loop starts, the ones the body doesn't write are constant
+// next - the address of the NEXT, rows jumping there are filtered out
+// yielded - the registers the other side of a YIELD reads, none to leave a YIELD row at a time
+[[nodiscard]] auto compile_batch_plan(std::span<const Instruction> body, std::int64_t cursor,
+                                      std::span<const Value> registers, std::int64_t next,
+                                      std::span<const std::int64_t> yielded = {}) -> std::optional<BatchPlan>;
+
+// Scans a table a batch at a time. A COLUMNAR table's segments are decoded a column at a time
+// straight into the batch's vectors, a segment's rows making a batch of their own, and the
+// records between them make another.
+class BatchScan {
+public:
+    // scans from the cursor's current row on, up to the row with rowid last
+    BatchScan(BTreeCursor& cursor, BatchPlan plan, std::int64_t last = INT64_MAX);
+
+    // the next result row, valid until the next call, nullopt once the scan is done
+    [[nodiscard]] auto next_row() -> std::optional<std::span<const Value>>;
+    // the result rows of the next batch, plan.outputs.size() values each and maybe none at all,
+    // the caller may move them away, nullopt once the scan is done
+    [[nodiscard]] auto next_batch() -> std::optional<std::span<Value>>;
+
+private:
+    auto fill() -> bool;
+    // reads the next cells, up to the one with rowid last, returns how many
+    auto read_cells() -> std::size_t;
+
+    BTreeCursor& cursor;
+    BatchPlan plan;
+    std::int64_t last;
+    // the cells read, the next batch starts at cell
+    std::array<std::int64_t, batch_size> rowids;
+    std::array<std::span<const std::uint8_t>, batch_size> payloads;
+    std::size_t cells = 0;
+    std::size_t cell = 0;
+    // the leaves the payloads point into
+    std::vector<PageRef> pins;
+    // a segment's rowids and the columns decoded from it, which the vectors point into
+    std::array<std::int64_t, batch_size> segment_rowids;
+    std::vector<std::vector<Value>> segment_values;
+    std::vector<std::unique_ptr<ColumnVector>> vectors;
+    // the rows of the batch that passed the filters
+    std::array<std::uint16_t, batch_size> selection;
+    std::size_t selected = 0;
+    // the projected rows, plan.outputs.size() values each
+    std::vector<Value> rows;
+    std::size_t position = 0;
+};
+
+// how finely a ParallelScan splits its table, a few morsels per worker so the ones that finish
+// early can steal from the rest, each a few leaves long so a morsel isn't mostly its setup
+inline constexpr std::size_t morsels_per_worker = 4;
+inline constexpr std::size_t morsel_min_leaves = 16;
+// how many batches a worker gets ahead of the reader by on a morsel, it waits once its queue is full
+inline constexpr std::size_t morsel_queue_batches = 4;
+
+// Runs a plan over the whole tree on a ThreadPool. The tree is split into morsels, ranges of
+// consecutive leaves (see BTree::partition), and every worker runs a BatchScan - scan, filters,
+// projection - over each morsel it takes. The rows come out in rowid order all the same, the
+// batches of one morsel after the other. Each morsel queues at most morsel_queue_batches of them,
+// so a scan holds a few batches per morsel rather than its result, and a reader that stops
+// early leaves the rest of the table unread.
+class ParallelScan {
+public:
+    // snapshot - what the workers read the tree as of, see BTreeCursor
+    ParallelScan(BTree& tree, const Snapshot* snapshot, BatchPlan plan, std::vector<RowidRange> ranges,
+                 const std::shared_ptr<ThreadPool>& pool);
+    // stops the workers, waiting for the morsels they're on
+    ~ParallelScan();
+    ParallelScan(const ParallelScan&) = delete;
+    auto operator=(const ParallelScan&) -> ParallelScan& = delete;
+
+    // like BatchScan::next_row, rethrows what a worker ran into once the scan gets there
+    [[nodiscard]] auto next_row() -> std::optional<std::span<const Value>>;
+
+private:
+    struct Morsel {
+        RowidRange range;
+        // the projected rows the reader didn't take yet, a batch at a time
+        std::deque<std::vector<Value>> batches{};
+        bool done = false;
+        std::exception_ptr error{};
+    };
+
+    auto run(Morsel& morsel) -> void;
+
+    BTree& tree;
+    const Snapshot* snapshot;
+    BatchPlan plan;
+    std::vector<Morsel> morsels;
+    std::mutex mutex;
+    // signalled when a morsel gets a batch or is done, and when the reader takes a batch
+    std::condition_variable batch_queued;
+    std::condition_variable batch_taken;
+    // the workers give up on their morsels
+    bool stopping = false;
+    // the morsel whose rows are handed out, the batch they come from and the next one of them
+    std::size_t current = 0;
+    std::vector<Value> rows;
+    std::size_t position = 0;
+    // keeps the threads around for as long as the job runs
+    std::shared_ptr<ThreadPool> pool;
+    std::shared_ptr<ThreadPool::Job> job;
+};
+
+// Runs a plan over the morsels of a tree on a ThreadPool like ParallelScan, for a loop whose rows
+// all go into an aggregation or a sort rather than out of the scan. Each batch of result rows is
+// handed to consume, which may move them away, on the worker that read it, along with its morsel's
+// index for a partial result per morsel. Returns once every morsel is done, rethrowing what a
+// worker ran into.
+auto scan_morsels(BTree& tree, const Snapshot* snapshot, const BatchPlan& plan, std::span<const RowidRange> morsels,
+                  ThreadPool& pool, const std::function<void(std::size_t morsel, std::span<Value> rows)>& consume) -> void;
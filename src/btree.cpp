@@ -0,0 +1,580 @@
+#include "btree.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr std::uint8_t leaf_type = 1;
+constexpr std::uint8_t interior_type = 2;
+
+// node header: type (u8), unused (u8), cell count (u16), content start (u16), unused (u16),
+// right (u32) - the right sibling of a leaf or the rightmost child of an interior node
+constexpr std::size_t header_size = 16;
+constexpr std::size_t type_offset = 0;
+constexpr std::size_t count_offset = 2;
+constexpr std::size_t content_offset = 4;
+constexpr std::size_t right_offset = 8;
+
+constexpr std::size_t key_size = sizeof(std::int64_t);
+constexpr std::size_t offset_size = sizeof(std::uint16_t);
+constexpr std::size_t size_prefix = sizeof(std::uint16_t);
+constexpr std::size_t leaf_cell_overhead = key_size + offset_size + size_prefix;
+
+constexpr std::size_t interior_capacity = (page_size - header_size) / (key_size + sizeof(PageId));
+constexpr std::size_t children_offset = header_size + interior_capacity * key_size;
+
+static_assert(page_size <= UINT16_MAX + 1, "page offsets have to fit in 16 bits");
+static_assert(header_size % key_size == 0, "the key array has to stay aligned");
+static_assert(3 * (leaf_cell_overhead + BTree::max_payload_size) <= page_size - header_size,
+              "a leaf has to fit at least three cells for splits to work");
+
+template <typename T>
+auto load(const Page& page, std::size_t offset) -> T {
+    auto value = T{};
+    std::memcpy(&value, page.data.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+auto store(Page& page, std::size_t offset, T value) -> void {
+    std::memcpy(page.data.data() + offset, &value, sizeof(T));
+}
+
+auto node_type(const Page& page) -> std::uint8_t { return load<std::uint8_t>(page, type_offset); }
+auto cell_count(const Page& page) -> std::size_t { return load<std::uint16_t>(page, count_offset); }
+auto set_cell_count(Page& page, std::size_t count) -> void { store(page, count_offset, static_cast<std::uint16_t>(count)); }
+auto content_start(const Page& page) -> std::size_t {
+    // 0 stands for page_size, which doesn't fit in 16 bits when pages are 64KiB
+    const auto start = load<std::uint16_t>(page, content_offset);
+    return start == 0 ? page_size : start;
+}
+auto set_content_start(Page& page, std::size_t start) -> void { store(page, content_offset, static_cast<std::uint16_t>(start)); }
+auto right(const Page& page) -> PageId { return load<PageId>(page, right_offset); }
+auto set_right(Page& page, PageId id) -> void { store(page, right_offset, id); }
+
+auto key(const Page& page, std::size_t i) -> std::int64_t { return load<std::int64_t>(page, header_size + i * key_size); }
+auto set_key(Page& page, std::size_t i, std::int64_t k) -> void { store(page, header_size + i * key_size, k); }
+
+auto child(const Page& page, std::size_t i) -> PageId { return load<PageId>(page, children_offset + i * sizeof(PageId)); }
+auto set_child(Page& page, std::size_t i, PageId id) -> void { store(page, children_offset + i * sizeof(PageId), id); }
+
+auto init_node(Page& page, std::uint8_t type) -> void {
+    std::memset(page.data.data(), 0, header_size);
+    store(page, type_offset, type);
+    set_content_start(page, page_size);
+}
+
+// index of the first key >= k, cell_count if there's none
+auto lower_bound(const Page& page, std::int64_t k) -> std::size_t {
+    auto lo = std::size_t{0};
+    auto hi = cell_count(page);
+    while (lo < hi) {
+        const auto mid = lo + (hi - lo) / 2;
+        if (key(page, mid) < k) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// child to descend into when looking for k
+auto child_for(const Page& page, std::int64_t k) -> PageId {
+    const auto i = lower_bound(page, k);
+    return i == cell_count(page) ? right(page) : child(page, i);
+}
+
+// ===================================
+// leaf cells
+// ===================================
+auto offsets_start(std::size_t count) -> std::size_t { return header_size + count * key_size; }
+
+auto payload_offset(const Page& page, std::size_t i) -> std::size_t {
+    return load<std::uint16_t>(page, offsets_start(cell_count(page)) + i * offset_size);
+}
+
+auto leaf_payload(const Page& page, std::size_t i) -> std::span<const std::uint8_t> {
+    const auto offset = payload_offset(page, i);
+    const auto size = load<std::uint16_t>(page, offset);
+    return {page.data.data() + offset + size_prefix, size};
+}
+
+auto free_space(const Page& page) -> std::size_t {
+    const auto n = cell_count(page);
+    return content_start(page) - offsets_start(n) - n * offset_size;
+}
+
+// free space after defragmentation
+auto reclaimable_space(const Page& page) -> std::size_t {
+    const auto n = cell_count(page);
+    auto used = header_size + n * (key_size + offset_size);
+    for (auto i = std::size_t{0}; i < n; ++i) {
+        used += size_prefix + leaf_payload(page, i).size();
+    }
+    return page_size - used;
+}
+
+// inserts a cell at position i, the caller has to make sure it fits in free_space
+auto insert_cell(Page& page, std::size_t i, std::int64_t k, std::span<const std::uint8_t> payload) -> void {
+    const auto n = cell_count(page);
+    auto* const data = page.data.data();
+
+    // the offset array sits right after the keys, so it moves by one key and opens a gap at i
+    const auto old_offsets = offsets_start(n);
+    const auto new_offsets = offsets_start(n + 1);
+    std::memmove(data + new_offsets + (i + 1) * offset_size, data + old_offsets + i * offset_size, (n - i) * offset_size);
+    std::memmove(data + new_offsets, data + old_offsets, i * offset_size);
+    std::memmove(data + header_size + (i + 1) * key_size, data + header_size + i * key_size, (n - i) * key_size);
+
+    const auto start = content_start(page) - size_prefix - payload.size();
+    store(page, start, static_cast<std::uint16_t>(payload.size()));
+    if (!payload.empty()) {
+        std::memcpy(data + start + size_prefix, payload.data(), payload.size());
+    }
+
+    set_key(page, i, k);
+    store(page, new_offsets + i * offset_size, static_cast<std::uint16_t>(start));
+    set_content_start(page, start);
+    set_cell_count(page, n + 1);
+}
+
+// removes the cell at position i, its payload bytes stay behind until defragment()
+auto remove_cell(Page& page, std::size_t i) -> void {
+    const auto n = cell_count(page);
+    auto* const data = page.data.data();
+
+    const auto old_offsets = offsets_start(n);
+    const auto new_offsets = offsets_start(n - 1);
+    std::memmove(data + header_size + i * key_size, data + header_size + (i + 1) * key_size, (n - i - 1) * key_size);
+    std::memmove(data + new_offsets, data + old_offsets, i * offset_size);
+    std::memmove(data + new_offsets + i * offset_size, data + old_offsets + (i + 1) * offset_size, (n - i - 1) * offset_size);
+    set_cell_count(page, n - 1);
+}
+
+auto defragment(Page& page) -> void {
+    const auto copy = page;
+    const auto n = cell_count(copy);
+    init_node(page, leaf_type);
+    set_right(page, right(copy));
+    for (auto i = std::size_t{0}; i < n; ++i) {
+        insert_cell(page, i, key(copy, i), leaf_payload(copy, i));
+    }
+}
+
+struct Cell {
+    std::int64_t key;
+    std::vector<std::uint8_t> payload;
+};
+
+} // namespace
+
+auto BTree::create(Pager& pager) -> PageId {
+    const auto id = pager.allocate();
+    init_node(pager.write(id), leaf_type);
+    return id;
+}
+
+auto BTree::insert(std::int64_t rowid, std::span<const std::uint8_t> payload) -> void {
+    if (payload.size() > max_payload_size) {
+        fail("Row too large - {} bytes, at most {} are supported", payload.size(), max_payload_size);
+    }
+
+    if (rowid > max_rowid()) {
+        append(rowid, payload);
+        return;
+    }
+
+    // every split allocates a page
+    const auto pages_before = pager.page_count();
+    const auto split = insert_into(root_page, rowid, payload);
+    if (split) {
+        // the root keeps its page number, its old contents move to a new left child
+        const auto left = pager.allocate();
+        auto& root = pager.write(root_page);
+        pager.write(left) = root;
+        init_node(root, interior_type);
+        set_key(root, 0, split->separator);
+        set_child(root, 0, left);
+        set_right(root, split->right);
+        set_cell_count(root, 1);
+    }
+
+    if (pager.page_count() != pages_before) {
+        // the rightmost path may have changed, it's looked up again on the next max_rowid()
+        append_path.clear();
+    }
+}
+
+auto BTree::append(std::int64_t rowid, std::span<const std::uint8_t> payload) -> void {
+    const auto leaf_id = append_path.back();
+    if (free_space(pager.read(leaf_id)) >= leaf_cell_overhead + payload.size()) {
+        auto& leaf = pager.write(leaf_id);
+        insert_cell(leaf, cell_count(leaf), rowid, payload);
+        max_key = rowid;
+        return;
+    }
+
+    const auto new_leaf = pager.allocate();
+    auto& next = pager.write(new_leaf);
+    init_node(next, leaf_type);
+    insert_cell(next, 0, rowid, payload);
+    set_right(pager.write(leaf_id), new_leaf);
+
+    append_node(append_path.size() - 1, max_key, new_leaf);
+    max_key = rowid;
+}
+
+// node is the new right sibling of append_path[level], which holds the rowids <= separator
+auto BTree::append_node(std::size_t level, std::int64_t separator, PageId node) -> void {
+    for (;;) {
+        append_path[level] = node;
+        if (level == 0) {
+            // the root keeps its page number, its old contents move to a new left child
+            const auto left = pager.allocate();
+            auto& root = pager.write(root_page);
+            pager.write(left) = root;
+            init_node(root, interior_type);
+            set_key(root, 0, separator);
+            set_child(root, 0, left);
+            set_right(root, node);
+            set_cell_count(root, 1);
+            append_path.insert(append_path.begin(), root_page);
+            return;
+        }
+
+        auto& parent = pager.write(append_path[level - 1]);
+        const auto n = cell_count(parent);
+        if (n < interior_capacity) {
+            // the old rightmost child becomes the last keyed child
+            set_key(parent, n, separator);
+            set_child(parent, n, right(parent));
+            set_right(parent, node);
+            set_cell_count(parent, n + 1);
+            return;
+        }
+
+        // the parent is full as well: it keeps everything <= separator and a new, empty interior
+        // node takes over the right edge one level up
+        const auto sibling = pager.allocate();
+        auto& next = pager.write(sibling);
+        init_node(next, interior_type);
+        set_right(next, node);
+        node = sibling;
+        --level;
+    }
+}
+
+auto BTree::insert_into(PageId page_id, std::int64_t rowid, std::span<const std::uint8_t> payload) -> std::optional<Split> {
+    const auto& page = pager.read(page_id);
+    if (node_type(page) == leaf_type) {
+        return insert_into_leaf(page_id, rowid, payload);
+    }
+
+    const auto i = lower_bound(page, rowid);
+    const auto n = cell_count(page);
+    const auto left = i == n ? right(page) : child(page, i);
+    const auto split = insert_into(left, rowid, payload);
+    if (!split) {
+        return std::nullopt;
+    }
+
+    // the child at position i was split into (left, split->right) around split->separator
+    if (n < interior_capacity) {
+        auto& node = pager.write(page_id);
+        auto* const data = node.data.data();
+        std::memmove(data + header_size + (i + 1) * key_size, data + header_size + i * key_size, (n - i) * key_size);
+        std::memmove(data + children_offset + (i + 1) * sizeof(PageId), data + children_offset + i * sizeof(PageId), (n - i) * sizeof(PageId));
+        set_key(node, i, split->separator);
+        set_child(node, i, left);
+        if (i == n) {
+            set_right(node, split->right);
+        } else {
+            set_child(node, i + 1, split->right);
+        }
+        set_cell_count(node, n + 1);
+        return std::nullopt;
+    }
+
+    // full interior node - split it in half and push the middle key up
+    auto keys = std::vector<std::int64_t>{};
+    auto children = std::vector<PageId>{};
+    keys.reserve(n + 1);
+    children.reserve(n + 2);
+    for (auto j = std::size_t{0}; j < n; ++j) {
+        keys.push_back(key(page, j));
+        children.push_back(child(page, j));
+    }
+    children.push_back(right(page));
+    keys.insert(keys.begin() + static_cast<std::ptrdiff_t>(i), split->separator);
+    children.insert(children.begin() + static_cast<std::ptrdiff_t>(i + 1), split->right);
+
+    const auto mid = keys.size() / 2;
+    const auto new_page = pager.allocate();
+    auto& left_node = pager.write(page_id);
+    auto& right_node = pager.write(new_page);
+    init_node(left_node, interior_type);
+    init_node(right_node, interior_type);
+
+    for (auto j = std::size_t{0}; j < mid; ++j) {
+        set_key(left_node, j, keys[j]);
+        set_child(left_node, j, children[j]);
+    }
+    set_right(left_node, children[mid]);
+    set_cell_count(left_node, mid);
+
+    for (auto j = mid + 1; j < keys.size(); ++j) {
+        set_key(right_node, j - mid - 1, keys[j]);
+        set_child(right_node, j - mid - 1, children[j]);
+    }
+    set_right(right_node, children.back());
+    set_cell_count(right_node, keys.size() - mid - 1);
+
+    return Split{.separator = keys[mid], .right = new_page};
+}
+
+auto BTree::insert_into_leaf(PageId page_id, std::int64_t rowid, std::span<const std::uint8_t> payload) -> std::optional<Split> {
+    auto& page = pager.write(page_id);
+    auto i = lower_bound(page, rowid);
+
+    if (i < cell_count(page) && key(page, i) == rowid) {
+        const auto offset = payload_offset(page, i);
+        if (load<std::uint16_t>(page, offset) >= payload.size()) {
+            store(page, offset, static_cast<std::uint16_t>(payload.size()));
+            if (!payload.empty()) {
+                std::memcpy(page.data.data() + offset + size_prefix, payload.data(), payload.size());
+            }
+            return std::nullopt;
+        }
+        remove_cell(page, i);
+    }
+
+    const auto needed = leaf_cell_overhead + payload.size();
+    if (free_space(page) < needed && reclaimable_space(page) >= needed) {
+        defragment(page);
+    }
+    if (free_space(page) >= needed) {
+        insert_cell(page, i, rowid, payload);
+        return std::nullopt;
+    }
+
+    const auto n = cell_count(page);
+    const auto new_page = pager.allocate();
+    auto& right_leaf = pager.write(new_page);
+    init_node(right_leaf, leaf_type);
+    set_right(right_leaf, right(page));
+    set_right(page, new_page);
+
+    // appending to the rightmost leaf: leave it full and start a new one instead of splitting
+    // in half, so sequentially inserted rowids produce packed pages
+    if (i == n && right(right_leaf) == 0) {
+        insert_cell(right_leaf, 0, rowid, payload);
+        return Split{.separator = key(page, n - 1), .right = new_page};
+    }
+
+    auto cells = std::vector<Cell>{};
+    cells.reserve(n + 1);
+    auto total = std::size_t{0};
+    for (auto j = std::size_t{0}; j < n; ++j) {
+        const auto bytes = leaf_payload(page, j);
+        cells.push_back(Cell{.key = key(page, j), .payload = {bytes.begin(), bytes.end()}});
+        total += leaf_cell_overhead + bytes.size();
+    }
+    cells.insert(cells.begin() + static_cast<std::ptrdiff_t>(i), Cell{.key = rowid, .payload = {payload.begin(), payload.end()}});
+    total += needed;
+
+    // split by bytes rather than by cell count, both halves need at least one cell
+    auto split_at = std::size_t{0};
+    auto left_bytes = std::size_t{0};
+    while (split_at + 1 < cells.size() && left_bytes + (leaf_cell_overhead + cells[split_at].payload.size()) / 2 < total / 2) {
+        left_bytes += leaf_cell_overhead + cells[split_at].payload.size();
+        ++split_at;
+    }
+    split_at = std::max(split_at, std::size_t{1});
+
+    const auto sibling = right(page);
+    init_node(page, leaf_type);
+    set_right(page, sibling);
+    for (auto j = std::size_t{0}; j < split_at; ++j) {
+        insert_cell(page, j, cells[j].key, cells[j].payload);
+    }
+    for (auto j = split_at; j < cells.size(); ++j) {
+        insert_cell(right_leaf, j - split_at, cells[j].key, cells[j].payload);
+    }
+
+    return Split{.separator = cells[split_at - 1].key, .right = new_page};
+}
+
+auto BTree::erase(std::int64_t rowid) -> bool {
+    auto id = root_page;
+    while (node_type(pager.read(id)) == interior_type) {
+        id = child_for(pager.read(id), rowid);
+    }
+    const auto i = lower_bound(pager.read(id), rowid);
+    if (i == cell_count(pager.read(id)) || key(pager.read(id), i) != rowid) {
+        return false;
+    }
+    remove_cell(pager.write(id), i);
+    if (rowid == max_key) {
+        // looked up again on the next max_rowid()
+        append_path.clear();
+    }
+    return true;
+}
+
+auto BTree::last_row(PageId id, const Snapshot* snapshot) -> std::optional<std::pair<PageId, std::size_t>> {
+    const auto& page = pager.read(id, snapshot);
+    const auto n = cell_count(page);
+    if (node_type(page) == leaf_type) {
+        return n == 0 ? std::nullopt : std::optional{std::pair{id, n - 1}};
+    }
+    for (auto i = n + 1; i > 0; --i) {
+        if (const auto found = last_row(i > n ? right(page) : child(page, i - 1), snapshot)) {
+            return found;
+        }
+    }
+    return std::nullopt;
+}
+
+auto BTree::max_rowid() -> std::int64_t {
+    if (append_path.empty()) {
+        auto id = root_page;
+        append_path.push_back(id);
+        while (node_type(pager.read(id)) == interior_type) {
+            id = right(pager.read(id));
+            append_path.push_back(id);
+        }
+        // the rightmost leaf, unless erase() emptied it
+        const auto last = last_row(root_page);
+        max_key = last ? key(pager.read(last->first), last->second) : 0;
+    }
+    return max_key;
+}
+
+auto BTree::collect_leaf_bounds(PageId id, std::int64_t last, std::vector<std::int64_t>& bounds, const Snapshot* snapshot) -> void {
+    const auto& page = pager.read(id, snapshot);
+    if (node_type(page) != interior_type) {
+        bounds.push_back(last);
+        return;
+    }
+    // the leaves are all on one level, the node above them has their bounds without reading them
+    const auto first_child = cell_count(page) == 0 ? right(page) : child(page, 0);
+    if (node_type(pager.read(first_child, snapshot)) != interior_type) {
+        for (auto i = std::size_t{0}; i < cell_count(page); ++i) {
+            bounds.push_back(key(page, i));
+        }
+        bounds.push_back(last);
+        return;
+    }
+    for (auto i = std::size_t{0}; i < cell_count(page); ++i) {
+        collect_leaf_bounds(child(page, i), key(page, i), bounds, snapshot);
+    }
+    collect_leaf_bounds(right(page), last, bounds, snapshot);
+}
+
+auto BTree::partition(std::size_t count, std::size_t min_leaves, const Snapshot* snapshot) -> std::vector<RowidRange> {
+    auto bounds = std::vector<std::int64_t>{};
+    collect_leaf_bounds(root_page, INT64_MAX, bounds, snapshot);
+    const auto leaves = std::max((bounds.size() + count - 1) / std::max(count, std::size_t{1}), std::max(min_leaves, std::size_t{1}));
+
+    auto ranges = std::vector<RowidRange>{};
+    auto first = INT64_MIN;
+    for (auto start = std::size_t{0}; start < bounds.size(); start += leaves) {
+        const auto end = std::min(start + leaves, bounds.size());
+        const auto last = end == bounds.size() ? INT64_MAX : bounds[end - 1];
+        ranges.push_back(RowidRange{.first = first, .last = last});
+        if (last == INT64_MAX) {
+            break;
+        }
+        first = last + 1;
+    }
+    return ranges;
+}
+
+// ===================================
+// cursor
+// ===================================
+auto BTreeCursor::enter(PageId id) -> void {
+    leaf = id;
+    page = id == 0 ? PageRef{} : tree->pager.read(id, snapshot);
+}
+
+auto BTreeCursor::settle() -> bool {
+    while (leaf != 0 && index >= cell_count(page)) {
+        enter(right(page));
+        index = 0;
+    }
+    return leaf != 0;
+}
+
+auto BTreeCursor::first() -> bool {
+    auto id = tree->root_page;
+    for (auto node = tree->pager.read(id, snapshot); node_type(node) == interior_type; node = tree->pager.read(id, snapshot)) {
+        id = cell_count(node) == 0 ? right(node) : child(node, 0);
+    }
+    enter(id);
+    index = 0;
+    return settle();
+}
+
+auto BTreeCursor::last() -> bool {
+    const auto last = tree->last_row(tree->root_page, snapshot);
+    enter(last ? last->first : 0);
+    index = last ? static_cast<std::uint16_t>(last->second) : 0;
+    return last.has_value();
+}
+
+auto BTreeCursor::seek(std::int64_t rowid) -> bool {
+    auto id = tree->root_page;
+    for (auto node = tree->pager.read(id, snapshot); node_type(node) == interior_type; node = tree->pager.read(id, snapshot)) {
+        id = child_for(node, rowid);
+    }
+    enter(id);
+    index = static_cast<std::uint16_t>(lower_bound(page, rowid));
+    return settle();
+}
+
+auto BTreeCursor::next() -> bool {
+    ++index;
+    return settle();
+}
+
+auto BTreeCursor::next_batch(std::span<std::int64_t> rowids, std::span<std::span<const std::uint8_t>> payloads,
+                             std::vector<PageRef>& pins) -> std::size_t {
+    const auto capacity = std::min(rowids.size(), payloads.size());
+    auto n = std::size_t{0};
+    while (leaf != 0 && n < capacity) {
+        const auto& current = pins.emplace_back(tree->pager.read(leaf, snapshot)).page();
+        const auto count = std::min(cell_count(current) - index, capacity - n);
+        // the keys of a leaf are one contiguous array
+        std::memcpy(rowids.data() + n, current.data.data() + header_size + index * key_size, count * key_size);
+        for (auto i = std::size_t{0}; i < count; ++i) {
+            payloads[n + i] = leaf_payload(current, index + i);
+        }
+        n += count;
+        index = static_cast<std::uint16_t>(index + count);
+        settle();
+    }
+    return n;
+}
+
+auto BTreeCursor::rowid() const -> std::int64_t {
+    return key(page, index);
+}
+
+auto BTreeCursor::payload() const -> std::span<const std::uint8_t> {
+    return leaf_payload(page, index);
+}
+
+auto BTreeCursor::insert(std::int64_t rowid, std::span<const std::uint8_t> payload) -> void {
+    enter(0);
+    tree->insert(rowid, payload);
+}
+
+auto BTreeCursor::erase() -> void {
+    const auto current = rowid();
+    enter(0);
+    tree->erase(current);
+}
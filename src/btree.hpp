@@ -0,0 +1,121 @@
+#pragma once
+#include "pager.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// rowids first..last, both included
+struct RowidRange {
+    std::int64_t first;
+    std::int64_t last;
+};
+
+// B+tree keyed by rowid, payloads live only in the leaves and the leaves are linked left to
+// right, so a scan never goes back up the tree.
+//
+// Every node starts with a 16 byte header, followed by its keys as one contiguous array of
+// 8 byte rowids, so a binary search stays within as few cache lines as possible.
+//  - leaf:     [header][rowid x n][payload offset (u16) x n] ... free ... [payloads]
+//              payloads grow down from the end of the page, each one prefixed by its u16 size
+//  - interior: [header][rowid x interior_capacity][child page (u32) x interior_capacity]
+//              child i holds the rowids <= key i, the header's right pointer the rest
+class BTree {
+public:
+    BTree(Pager& pager, PageId root) : pager(pager), root_page(root) {}
+
+    // allocates an empty tree and returns its root page
+    [[nodiscard]] static auto create(Pager& pager) -> PageId;
+
+    [[nodiscard]] auto root() const -> PageId { return root_page; }
+    // the pager the tree lives on, which a COLUMNAR table keeps its segments' chunks on as well
+    [[nodiscard]] auto pages() const -> Pager& { return pager; }
+
+    // inserts the payload under the given rowid, replacing a previous payload with that rowid
+    auto insert(std::int64_t rowid, std::span<const std::uint8_t> payload) -> void;
+    // returns whether there was a row with the rowid. Nodes aren't merged, a leaf may end up
+    // empty - cursors step over it and the separators above stay valid bounds.
+    auto erase(std::int64_t rowid) -> bool;
+    // largest rowid in the tree, 0 if empty
+    [[nodiscard]] auto max_rowid() -> std::int64_t;
+    // Splits the rowids into ranges of whole leaves, in order, about count of them but none
+    // shorter than min_leaves leaves (except the last). Reads only the interior nodes.
+    [[nodiscard]] auto partition(std::size_t count, std::size_t min_leaves, const Snapshot* snapshot = nullptr) -> std::vector<RowidRange>;
+    // after a rollback, which may have discarded the pages the appends went to
+    auto forget_append_path() -> void { append_path.clear(); }
+
+    // the largest payload a single cell can hold
+    static constexpr std::size_t max_payload_size = page_size / 4;
+
+private:
+    friend class BTreeCursor;
+
+    struct Split {
+        std::int64_t separator;
+        PageId right;
+    };
+
+    auto insert_into(PageId page, std::int64_t rowid, std::span<const std::uint8_t> payload) -> std::optional<Split>;
+    auto insert_into_leaf(PageId page, std::int64_t rowid, std::span<const std::uint8_t> payload) -> std::optional<Split>;
+    auto append(std::int64_t rowid, std::span<const std::uint8_t> payload) -> void;
+    auto append_node(std::size_t level, std::int64_t separator, PageId node) -> void;
+    // appends the largest rowid each leaf of the subtree may hold, last for its rightmost one
+    auto collect_leaf_bounds(PageId page, std::int64_t last, std::vector<std::int64_t>& bounds, const Snapshot* snapshot) -> void;
+    // the subtree's last row as (leaf, index), skipping empty leaves
+    auto last_row(PageId page, const Snapshot* snapshot = nullptr) -> std::optional<std::pair<PageId, std::size_t>>;
+
+    Pager& pager;
+    PageId root_page;
+
+    // Appends (rowid > every rowid in the tree, the NEWRECNO case) build the tree bottom-up along
+    // its rightmost path: a row goes straight into the rightmost leaf, a full node is left as it
+    // is and continued in a new right sibling, whose separator is added to the node above. So
+    // loading sorted rows fills every page completely and never descends the tree.
+    // append_path holds the pages from the root down to the rightmost leaf, empty if unknown.
+    std::vector<PageId> append_path;
+    std::int64_t max_key = 0;
+};
+
+// Position within the leaf level of a BTree, which keeps its leaf pinned. Payload views point
+// into the page and stay valid until the cursor moves to another leaf or the tree is modified.
+// With a snapshot it reads the tree as of the snapshot, see Pager, and the tree must not be
+// modified through it.
+class BTreeCursor {
+public:
+    explicit BTreeCursor(BTree& tree, const Snapshot* snapshot = nullptr) : tree(&tree), snapshot(snapshot) {}
+
+    // each of these returns whether the cursor ended up on a row
+    auto first() -> bool;
+    auto last() -> bool;
+    // positions on the first row with rowid >= the given one
+    auto seek(std::int64_t rowid) -> bool;
+    auto next() -> bool;
+    // reads the rows from the current one on into the spans and moves past them, returns how many
+    // it read, fewer than requested only at the end of the tree. The leaves the payloads point
+    // into are added to pins.
+    auto next_batch(std::span<std::int64_t> rowids, std::span<std::span<const std::uint8_t>> payloads,
+                    std::vector<PageRef>& pins) -> std::size_t;
+
+    [[nodiscard]] auto btree() const -> BTree& { return *tree; }
+    [[nodiscard]] auto view() const -> const Snapshot* { return snapshot; }
+    [[nodiscard]] auto valid() const -> bool { return leaf != 0; }
+    [[nodiscard]] auto rowid() const -> std::int64_t;
+    [[nodiscard]] auto payload() const -> std::span<const std::uint8_t>;
+
+    // inserts through the tree, the cursor has to be repositioned afterwards
+    auto insert(std::int64_t rowid, std::span<const std::uint8_t> payload) -> void;
+    // deletes the current row, the cursor has to be repositioned afterwards
+    auto erase() -> void;
+
+private:
+    // moves to the leaf, 0 for none
+    auto enter(PageId id) -> void;
+    auto settle() -> bool;
+
+    BTree* tree;
+    const Snapshot* snapshot;
+    PageId leaf = 0;
+    PageRef page;
+    std::uint16_t index = 0;
+};
@@ -1,13 +1,2555 @@
 #include "bytecode_gen.hpp"
+#include "catalog.hpp"
+#include "columnar.hpp"
 #include "common.hpp"
+#include "operators.hpp"
+#include "optimizer.hpp"
+#include "printers.hpp"
+#include "statistics.hpp"
+#include <fmt/ranges.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <span>
 
-inline auto generate_bytecode(const SelectStmt& statement) -> SqlBytecodeProgram {
+namespace {
 
+// An expression's value: known while compiling, or in a register once its code has run.
+struct Operand {
+    std::optional<Value> constant;
+    std::int64_t reg = 0;
+    // doesn't depend on the current row, its code is in the prologue
+    bool invariant = true;
+};
+
+// the instruction loading the column into the target register
+using ColumnResolver = std::function<Instruction(const ColumnRef& column, std::int64_t target)>;
+// the register already holding the expression's value, nullopt to compile it
+using ExpressionResolver = std::function<std::optional<std::int64_t>(const Expr& expr)>;
+
+auto binary_opcode(BinaryOperator op) -> Opcode {
+    switch (op) {
+        case BinaryOperator::CONCAT:        return Opcode::CONCAT;
+        case BinaryOperator::MULTIPLY:      return Opcode::MULTIPLY;
+        case BinaryOperator::DIVIDE:        return Opcode::DIVIDE;
+        case BinaryOperator::MODULO:        return Opcode::REMAINDER;
+        case BinaryOperator::ADD:           return Opcode::ADD;
+        case BinaryOperator::SUBTRACT:      return Opcode::SUBTRACT;
+        case BinaryOperator::LESS:          return Opcode::LT;
+        case BinaryOperator::LESS_EQUAL:    return Opcode::LE;
+        case BinaryOperator::GREATER:       return Opcode::GT;
+        case BinaryOperator::GREATER_EQUAL: return Opcode::GE;
+        case BinaryOperator::EQUAL:         return Opcode::EQ;
+        case BinaryOperator::NOT_EQUAL:     return Opcode::NE;
+        case BinaryOperator::AND:           return Opcode::AND;
+        case BinaryOperator::OR:            return Opcode::OR;
+    }
+    fail("Unknown binary operator");
+}
+
+auto evaluate(BinaryOperator op, const Value& lhs, const Value& rhs) -> Value {
+    const auto compared = [&](auto predicate) -> Value {
+        const auto order = compare(lhs, rhs);
+        return order ? Value{std::int64_t{predicate(*order, 0)}} : Value{};
+    };
+    switch (op) {
+        case BinaryOperator::CONCAT:        return concat(lhs, rhs);
+        case BinaryOperator::MULTIPLY:      return multiply(lhs, rhs);
+        case BinaryOperator::DIVIDE:        return divide(lhs, rhs);
+        case BinaryOperator::MODULO:        return modulo(lhs, rhs);
+        case BinaryOperator::ADD:           return add(lhs, rhs);
+        case BinaryOperator::SUBTRACT:      return subtract(lhs, rhs);
+        case BinaryOperator::LESS:          return compared(std::less{});
+        case BinaryOperator::LESS_EQUAL:    return compared(std::less_equal{});
+        case BinaryOperator::GREATER:       return compared(std::greater{});
+        case BinaryOperator::GREATER_EQUAL: return compared(std::greater_equal{});
+        case BinaryOperator::EQUAL:         return compared(std::equal_to{});
+        case BinaryOperator::NOT_EQUAL:     return compared(std::not_equal_to{});
+        case BinaryOperator::AND:           return logical_and(lhs, rhs);
+        case BinaryOperator::OR:            return logical_or(lhs, rhs);
+    }
+    fail("Unknown binary operator");
+}
+
+// Compiles expressions into register code. Subexpressions made of literals only are folded into
+// constants while compiling, and the code of the ones that don't read the current row (bind
+// parameters, constants loaded into registers) goes into the prologue, which runs once per
+// execution instead of once per row.
+class ExpressionCompiler {
+public:
+    // prologue may be the body itself when there's no loop to hoist code out of
+    // next_register - the first register free for temporaries, advanced past the ones used
+    // resolve_expression - the results of the aggregate functions and the GROUP BY terms
+    ExpressionCompiler(SqlBytecodeProgram& body, SqlBytecodeProgram& prologue, std::int64_t& next_register,
+                       ColumnResolver resolve_column, ExpressionResolver resolve_expression = {})
+        : body(body), prologue(prologue), next_register(next_register), resolve_column(std::move(resolve_column)),
+          resolve_expression(std::move(resolve_expression)) {}
+
+    // a non-constant result ends up in target, or in a new register if there's none
+    auto compile(const Expr& expr, std::optional<std::int64_t> target = std::nullopt) -> Operand {
+        if (const auto reg = resolve_expression ? resolve_expression(expr) : std::nullopt) {
+            if (target && *target != *reg) {
+                body.push_back(Instruction(Opcode::COPY, *reg, *target, 0, {}));
+            }
+            return Operand{.constant = std::nullopt, .reg = target.value_or(*reg), .invariant = false};
+        }
+        return std::visit(overloaded{
+            [&](const ColumnRef& column) {
+                const auto reg = target.value_or(next_register++);
+                body.push_back(resolve_column(column, reg));
+                return Operand{.constant = std::nullopt, .reg = reg, .invariant = false};
+            },
+            [](const IntegerLiteral& literal) { return Operand{.constant = Value{literal.value}}; },
+            [](const RealLiteral& literal) { return Operand{.constant = Value{literal.value}}; },
+            [](const StringLiteral& literal) { return Operand{.constant = Value{std::string{literal.value}}}; },
+            [](const NullLiteral&) { return Operand{.constant = Value{}}; },
+            [&](const Parameter& parameter) {
+                const auto reg = target.value_or(next_register++);
+                prologue.push_back(Instruction(Opcode::VARIABLE, parameter.index, reg, 0, {}));
+                return Operand{.constant = std::nullopt, .reg = reg, .invariant = true};
+            },
+            [&](const UnaryExpr& unary) { return compile(unary, target); },
+            [&](const BinaryExpr& binary) { return compile(binary, target); },
+            [&](const FunctionCall& call) { return compile(call, target); }
+        }, expr.value);
+    }
+
+    // the operand's value in a register, target if it's given
+    auto to_register(const Operand& operand, std::optional<std::int64_t> target = std::nullopt) -> std::int64_t {
+        if (!operand.constant) {
+            return operand.reg;
+        }
+        if (target) {
+            prologue.push_back(load(*operand.constant, *target));
+            return *target;
+        }
+        // every distinct constant is loaded once
+        for (const auto& [value, reg] : constants) {
+            if (value == *operand.constant) {
+                return reg;
+            }
+        }
+        const auto reg = next_register++;
+        prologue.push_back(load(*operand.constant, reg));
+        constants.emplace_back(*operand.constant, reg);
+        return reg;
+    }
+
+    auto compile_into(const Expr& expr, std::int64_t target) -> void {
+        to_register(compile(expr, target), target);
+    }
+
+private:
+    auto compile(const UnaryExpr& unary, std::optional<std::int64_t> target) -> Operand {
+        // unary plus is a no-op, even on TEXT
+        if (unary.op == UnaryOperator::PLUS) {
+            return compile(*unary.operand, target);
+        }
+        const auto operand = compile(*unary.operand);
+        if (operand.constant) {
+            return Operand{.constant = unary.op == UnaryOperator::NEGATE ? negate(*operand.constant) : logical_not(*operand.constant)};
+        }
+        const auto reg = target.value_or(next_register++);
+        const auto opcode = unary.op == UnaryOperator::NEGATE ? Opcode::NEGATE : Opcode::NOT;
+        emit(operand.invariant, Instruction(opcode, operand.reg, reg, 0, {}));
+        return Operand{.constant = std::nullopt, .reg = reg, .invariant = operand.invariant};
+    }
+
+    auto compile(const BinaryExpr& binary, std::optional<std::int64_t> target) -> Operand {
+        const auto lhs = compile(*binary.lhs);
+        const auto rhs = compile(*binary.rhs);
+        if (lhs.constant && rhs.constant) {
+            return Operand{.constant = evaluate(binary.op, *lhs.constant, *rhs.constant)};
+        }
+        // one constant side may decide the result on its own
+        if (const auto& constant = lhs.constant ? lhs.constant : rhs.constant) {
+            if (binary.op == BinaryOperator::AND && truth(*constant) == false) {
+                return Operand{.constant = Value{std::int64_t{0}}};
+            }
+            if (binary.op == BinaryOperator::OR && truth(*constant) == true) {
+                return Operand{.constant = Value{std::int64_t{1}}};
+            }
+            if (binary.op != BinaryOperator::AND && binary.op != BinaryOperator::OR && std::holds_alternative<Null>(*constant)) {
+                return Operand{.constant = Value{}};
+            }
+        }
+
+        const auto a = to_register(lhs);
+        const auto b = to_register(rhs);
+        const auto reg = target.value_or(next_register++);
+        const auto invariant = lhs.invariant && rhs.invariant;
+        emit(invariant, Instruction(binary_opcode(binary.op), a, b, reg, {}));
+        return Operand{.constant = std::nullopt, .reg = reg, .invariant = invariant};
+    }
+
+    auto compile(const FunctionCall& call, std::optional<std::int64_t> target) -> Operand {
+        if (find_aggregate(call.name, call.arguments.size(), call.star)) {
+            fail("Misuse of aggregate function {}()", call.name);
+        }
+        const auto id = find_function(call.name, call.arguments.size());
+        // the arguments go into consecutive registers, constants are only loaded if the call can't be folded
+        const auto first = next_register;
+        next_register += static_cast<std::int64_t>(call.arguments.size());
+        auto arguments = std::vector<Operand>{};
+        arguments.reserve(call.arguments.size());
+        for (auto i = std::size_t{0}; i < call.arguments.size(); ++i) {
+            arguments.push_back(compile(call.arguments[i], first + static_cast<std::int64_t>(i)));
+        }
+
+        if (std::ranges::all_of(arguments, [](const Operand& argument) { return argument.constant.has_value(); })) {
+            auto values = std::vector<Value>{};
+            values.reserve(arguments.size());
+            for (auto& argument : arguments) {
+                values.push_back(std::move(*argument.constant));
+            }
+            return Operand{.constant = call_function(id, values)};
+        }
+
+        auto invariant = true;
+        for (auto i = std::size_t{0}; i < arguments.size(); ++i) {
+            to_register(arguments[i], first + static_cast<std::int64_t>(i));
+            invariant = invariant && arguments[i].invariant;
+        }
+        const auto reg = target.value_or(next_register++);
+        emit(invariant, Instruction(Opcode::FUNCTION, static_cast<std::int64_t>(id), first, reg, 0, static_cast<std::uint16_t>(arguments.size())),
+             call.name);
+        return Operand{.constant = std::nullopt, .reg = reg, .invariant = invariant};
+    }
+
+    // name - the P4, if there's one
+    auto emit(bool invariant, Instruction instr, std::string_view name = {}) -> void {
+        auto& target = invariant ? prologue : body;
+        if (!name.empty()) {
+            instr.P4 = target.constant(std::string{name});
+        }
+        target.push_back(instr);
+    }
+
+    auto load(const Value& value, std::int64_t reg) -> Instruction {
+        return std::visit(overloaded{
+            [&](const Null&) { return Instruction(Opcode::NULL_, 0, reg, 0, {}); },
+            [&](std::int64_t v) { return Instruction(Opcode::INTEGER, v, reg, 0, {}); },
+            [&](double v) { return Instruction(Opcode::REAL, std::bit_cast<std::int64_t>(v), reg, 0, {}); },
+            [&](const std::string& v) { return Instruction(Opcode::STRING, 0, reg, 0, prologue.constant(v)); },
+            [](const Blob&) -> Instruction { fail("BLOB constants are not supported yet"); }
+        }, value);
+    }
+
+    SqlBytecodeProgram& body;
+    SqlBytecodeProgram& prologue;
+    std::int64_t& next_register;
+    ColumnResolver resolve_column;
+    ExpressionResolver resolve_expression;
+    std::vector<std::pair<Value, std::int64_t>> constants;
+};
+
+// the terms of a chain of ANDs, each of which has to hold for the whole expression to hold
+auto split_conjunction(const Expr& expr, std::vector<const Expr*>& terms) -> void {
+    if (const auto* binary = std::get_if<BinaryExpr>(&expr.value); binary && binary->op == BinaryOperator::AND) {
+        split_conjunction(*binary->lhs, terms);
+        split_conjunction(*binary->rhs, terms);
+    } else {
+        terms.push_back(&expr);
+    }
+}
+
+auto references_columns(const Expr& expr) -> bool {
+    return std::visit(overloaded{
+        [](const ColumnRef&) { return true; },
+        [](const UnaryExpr& unary) { return references_columns(*unary.operand); },
+        [](const BinaryExpr& binary) { return references_columns(*binary.lhs) || references_columns(*binary.rhs); },
+        [](const FunctionCall& call) { return std::ranges::any_of(call.arguments, references_columns); },
+        [](const auto&) { return false; }
+    }, expr.value);
+}
+
+// "column op value" with a value that's the same for every row
+struct Comparison {
+    ColumnName column;
+    BinaryOperator op;
+    const Expr* value;
+};
+
+// the WHERE term as a Comparison, "value op column" is turned around
+auto column_comparison(const Expr& term) -> std::optional<Comparison> {
+    const auto* binary = std::get_if<BinaryExpr>(&term.value);
+    if (!binary) {
+        return std::nullopt;
+    }
+    auto op = binary->op;
+    switch (op) {
+        case BinaryOperator::EQUAL:
+        case BinaryOperator::LESS:
+        case BinaryOperator::LESS_EQUAL:
+        case BinaryOperator::GREATER:
+        case BinaryOperator::GREATER_EQUAL:
+            break;
+        default:
+            return std::nullopt;
+    }
+
+    const auto* column = std::get_if<ColumnRef>(&binary->lhs->value);
+    const auto* value = binary->rhs;
+    if (!column || references_columns(*value)) {
+        column = std::get_if<ColumnRef>(&binary->rhs->value);
+        value = binary->lhs;
+        if (!column || references_columns(*value)) {
+            return std::nullopt;
+        }
+        op = op == BinaryOperator::LESS         ? BinaryOperator::GREATER
+           : op == BinaryOperator::LESS_EQUAL    ? BinaryOperator::GREATER_EQUAL
+           : op == BinaryOperator::GREATER       ? BinaryOperator::LESS
+           : op == BinaryOperator::GREATER_EQUAL ? BinaryOperator::LESS_EQUAL
+           : op;
+    }
+    return Comparison{.column = column->name, .op = op, .value = value};
+}
+
+auto zone_comparison(BinaryOperator op) -> ZoneComparison {
+    switch (op) {
+        case BinaryOperator::LESS:          return ZoneComparison::LESS;
+        case BinaryOperator::LESS_EQUAL:    return ZoneComparison::LESS_EQUAL;
+        case BinaryOperator::GREATER:       return ZoneComparison::GREATER;
+        case BinaryOperator::GREATER_EQUAL: return ZoneComparison::GREATER_EQUAL;
+        default:                            return ZoneComparison::EQUAL;
+    }
+}
+
+// The entries of an index holding every row a WHERE can select: the ones whose first columns
+// equal the given values and whose next column is within the bounds. The bounds are in the
+// index's order, so a DESC column swaps them. The WHERE still runs on every row of the range.
+struct IndexRange {
+    const IndexSchema* index = nullptr;
+    std::vector<const Expr*> equal{};
+    const Expr* lower = nullptr;
+    bool lower_inclusive = false;
+    const Expr* upper = nullptr;
+    bool upper_inclusive = false;
+
+    [[nodiscard]] auto bounds() const -> int { return (lower ? 1 : 0) + (upper ? 1 : 0); }
+};
+
+// ===================================
+// cost model
+// ===================================
+// what reading a row costs, in rows of a table scan: an index entry, and the row it leads to
+constexpr auto index_entry_cost = 1.0;
+constexpr auto row_lookup_cost = 4.0;
+// adding a row to a hash join's build side, probing it is one
+constexpr auto hash_build_cost = 2.0;
+// sqlite's guesses where there are no statistics to go by: the rows of a table, the fraction of
+// them a comparison or another WHERE term leaves
+constexpr auto guessed_rows = 1'000'000.0;
+constexpr auto guessed_equal = 0.1;
+constexpr auto guessed_bound = 1.0 / 3;
+constexpr auto guessed_term = 0.25;
+
+// the value of an expression that's the same for every row, if it's known while compiling
+auto constant_value(const Expr& expr) -> std::optional<Value> {
+    auto code = SqlBytecodeProgram{};
+    auto next_register = std::int64_t{0};
+    auto expressions = ExpressionCompiler{code, code, next_register, [](const ColumnRef& ref, std::int64_t) -> Instruction {
+        fail("No such column: '{}'", ref.name);
+    }};
+    return expressions.compile(expr).constant;
 }
-inline auto generate_bytecode(const CreateTableStmt& statement) -> SqlBytecodeProgram {
 
+// the statistics on a column, if the table was analyzed
+auto column_statistics(const TableSchema& schema, const TableStatistics* statistics, std::string_view column) -> const ColumnStatistics* {
+    const auto position = schema.column_index(column);
+    if (!statistics || !position || *position >= statistics->columns.size()) {
+        return nullptr;
+    }
+    return &statistics->columns[*position];
+}
+
+// the fraction of the table's rows with the column within the bounds, in the column's order
+auto bounds_selectivity(const ColumnStatistics* column, double rows, const Expr* lower, bool lower_inclusive,
+                        const Expr* upper, bool upper_inclusive) -> double {
+    const auto low = lower ? constant_value(*lower) : std::nullopt;
+    const auto high = upper ? constant_value(*upper) : std::nullopt;
+    if (!column || (lower && !low) || (upper && !high)) {
+        return (lower ? guessed_bound : 1.0) * (upper ? guessed_bound : 1.0);
+    }
+    if (low && high) {
+        return std::max(column->below(*high, upper_inclusive, rows) - column->below(*low, !lower_inclusive, rows), 0.0);
+    }
+    return low ? column->above(*low, lower_inclusive, rows) : column->below(*high, upper_inclusive, rows);
+}
+
+// the fraction of the table's rows a WHERE term on the table leaves
+auto term_selectivity(const TableSchema& schema, const TableStatistics* statistics, const Expr& term) -> double {
+    const auto comparison = column_comparison(term);
+    if (!comparison) {
+        return guessed_term;
+    }
+    const auto* column = column_statistics(schema, statistics, comparison->column);
+    const auto rows = statistics ? statistics->rows : guessed_rows;
+    switch (comparison->op) {
+        case BinaryOperator::EQUAL: {
+            if (!column) {
+                return guessed_equal;
+            }
+            const auto value = constant_value(*comparison->value);
+            return value ? column->equal(*value, rows) : column->equal(rows);
+        }
+        case BinaryOperator::LESS:
+        case BinaryOperator::LESS_EQUAL:
+            return bounds_selectivity(column, rows, nullptr, false, comparison->value, comparison->op == BinaryOperator::LESS_EQUAL);
+        default:
+            return bounds_selectivity(column, rows, comparison->value, comparison->op == BinaryOperator::GREATER_EQUAL, nullptr, false);
+    }
+}
+
+// the rows of the table an index range holds: the first equality by the column's histogram, each
+// further one by how many more distinct keys it makes, then the bounds by the next column's
+auto range_rows(const TableSchema& schema, const TableStatistics& statistics, const IndexRange& range) -> double {
+    const auto& columns = range.index->columns;
+    const auto* index = statistics.index(range.index->name);
+    auto rows = statistics.rows;
+    for (auto i = std::size_t{0}; i < range.equal.size(); ++i) {
+        if (i > 0 && index && i < index->distinct.size() && index->distinct[i] > 0) {
+            rows *= index->distinct[i - 1] / index->distinct[i];
+            continue;
+        }
+        const auto* column = column_statistics(schema, &statistics, columns[i].name);
+        const auto value = constant_value(*range.equal[i]);
+        rows *= !column ? guessed_equal : value ? column->equal(*value, statistics.rows) : column->equal(statistics.rows);
+    }
+    if (range.bounds() > 0) {
+        // the range's bounds are in the index's order, the histogram's in the column's
+        const auto& column = columns[range.equal.size()];
+        const auto* lower = column.descending ? range.upper : range.lower;
+        const auto* upper = column.descending ? range.lower : range.upper;
+        const auto lower_inclusive = column.descending ? range.upper_inclusive : range.lower_inclusive;
+        const auto upper_inclusive = column.descending ? range.lower_inclusive : range.upper_inclusive;
+        rows *= bounds_selectivity(column_statistics(schema, &statistics, column.name), statistics.rows,
+                                   lower, lower_inclusive, upper, upper_inclusive);
+    }
+    return rows;
+}
+
+// Without statistics, the index narrowing the WHERE terms down the most, if any of them can use
+// one: the longest prefix of equalities, then bounds on the column after it. With them, the
+// cheapest way to read the rows, an index range (a seek, then an entry and a row lookup per row)
+// or a scan of the whole table, which wins once a range holds a fair share of the rows.
+auto choose_index(const TableSchema& schema, const TableStatistics* statistics, std::span<const Expr* const> terms) -> std::optional<IndexRange> {
+    auto comparisons = std::vector<Comparison>{};
+    for (const auto* term : terms) {
+        if (const auto comparison = column_comparison(*term)) {
+            comparisons.push_back(*comparison);
+        }
+    }
+
+    auto best = std::optional<IndexRange>{};
+    auto best_cost = statistics ? statistics->rows : 0.0;
+    for (const auto& index : schema.indexes) {
+        auto range = IndexRange{.index = &index};
+        for (const auto& column : index.columns) {
+            const auto it = std::ranges::find_if(comparisons, [&](const Comparison& comparison) {
+                return comparison.column == column.name && comparison.op == BinaryOperator::EQUAL;
+            });
+            if (it == comparisons.end()) {
+                break;
+            }
+            range.equal.push_back(it->value);
+        }
+
+        if (range.equal.size() < index.columns.size()) {
+            const auto& column = index.columns[range.equal.size()];
+            for (const auto& comparison : comparisons) {
+                if (comparison.column != column.name || comparison.op == BinaryOperator::EQUAL) {
+                    continue;
+                }
+                const auto inclusive = comparison.op == BinaryOperator::LESS_EQUAL || comparison.op == BinaryOperator::GREATER_EQUAL;
+                const auto lower = (comparison.op == BinaryOperator::GREATER || comparison.op == BinaryOperator::GREATER_EQUAL) != column.descending;
+                auto& bound = lower ? range.lower : range.upper;
+                if (!bound) {
+                    bound = comparison.value;
+                    (lower ? range.lower_inclusive : range.upper_inclusive) = inclusive;
+                }
+            }
+        }
+
+        if (range.equal.empty() && range.bounds() == 0) {
+            continue;
+        }
+        if (statistics) {
+            const auto cost = std::log2(statistics->rows + 1) + range_rows(schema, *statistics, range) * (index_entry_cost + row_lookup_cost);
+            if (cost < best_cost) {
+                best = std::move(range);
+                best_cost = cost;
+            }
+            continue;
+        }
+        if (!best || range.equal.size() > best->equal.size() ||
+            (range.equal.size() == best->equal.size() && range.bounds() > best->bounds())) {
+            best = std::move(range);
+        }
+    }
+    return best;
+}
+
+// the EXPLAIN QUERY PLAN step of a search, worded like sqlite's: "SEARCH t USING INDEX t_a (a=? AND b>?)"
+auto search_detail(std::string_view table, const IndexRange& range) -> std::string {
+    const auto& columns = range.index->columns;
+    auto terms = std::vector<std::string>{};
+    for (auto i = std::size_t{0}; i < range.equal.size(); ++i) {
+        terms.push_back(fmt::format("{}=?", columns[i].name));
+    }
+    if (range.bounds() > 0) {
+        // the bounds are in the index's order, a DESC column's lower bound is a "<"
+        const auto& column = columns[range.equal.size()];
+        const auto bound = [&](bool lower, bool inclusive) {
+            terms.push_back(fmt::format("{}{}{}?", column.name, lower != column.descending ? '>' : '<', inclusive ? "=" : ""));
+        };
+        if (range.lower) {
+            bound(true, range.lower_inclusive);
+        }
+        if (range.upper) {
+            bound(false, range.upper_inclusive);
+        }
+    }
+    return fmt::format("SEARCH {} USING INDEX {} ({})", table, range.index->name, fmt::join(terms, " AND "));
+}
+
+// how the plan names a source: "t", or "t AS x" with an alias
+auto source_label(const AliasedTable& source) -> std::string {
+    return source.alias ? fmt::format("{} AS {}", source.table.table_name, *source.alias) : std::string{source.table.table_name};
+}
+
+// 'A' or 'D' per indexed column, see MAKEKEY
+auto sort_orders(const IndexSchema& index) -> std::string {
+    auto orders = std::string{};
+    for (const auto& column : index.columns) {
+        orders += column.descending ? 'D' : 'A';
+    }
+    return orders;
+}
+
+// the error of a duplicate in a UNIQUE index, worded like sqlite's
+auto unique_failure(const IndexSchema& index) -> std::string {
+    auto columns = std::vector<std::string>{};
+    for (const auto& column : index.columns) {
+        columns.push_back(fmt::format("{}.{}", index.table, column.name));
+    }
+    return fmt::format("UNIQUE constraint failed: {}", fmt::join(columns, ", "));
+}
+
+// the instruction loading a column of a row into the target register, the rowid for nullopt
+using RowLoader = std::function<Instruction(std::optional<std::size_t> column, std::int64_t target)>;
+
+// loads the row's indexed columns into consecutive registers from first on, followed by its rowid
+// for a whole index entry, returns the number of registers
+auto load_index_entry(SqlBytecodeProgram& program, const TableSchema& table, const IndexSchema& index,
+                      const RowLoader& load, std::int64_t first, bool with_rowid) -> std::int64_t {
+    auto reg = first;
+    for (const auto& column : index.columns) {
+        const auto position = table.column_index(column.name);
+        if (!position) {
+            fail("Index '{}' refers to a missing column '{}'", index.name, column.name);
+        }
+        program.push_back(load(*position, reg++));
+    }
+    if (with_rowid) {
+        program.push_back(load(std::nullopt, reg++));
+    }
+    return reg - first;
+}
+
+auto conflict_method(const InsertStmtOp& operation) -> ConflictResolutionMethod {
+    return std::visit(overloaded{
+        [](const ReplaceContainer&) { return ConflictResolutionMethod::REPLACE; },
+        [](const InsertContainer& insert) { return insert.confilct_res_method.value_or(ConflictResolutionMethod::ABORT); }
+    }, operation);
+}
+
+// The registers an INSERT puts a row together in: the row's rowid, its values from first_value
+// on, their record, the index entries from first_key on and in entry, and the rowid of the row it
+// conflicts with in replaced
+struct InsertRegisters {
+    std::int64_t rowid;
+    std::int64_t first_value;
+    std::int64_t record;
+    std::int64_t first_key;
+    std::int64_t entry;
+    std::int64_t replaced;
+};
+
+// the P3 of an OPENREAD or OPENWRITE of the table
+auto columnar_width(const TableSchema& schema) -> std::int64_t {
+    return schema.columnar ? static_cast<std::int64_t>(schema.columns.size()) : 0;
+}
+
+// the registers of the longest index entry, the indexed columns and the rowid
+auto max_entry_size(const TableSchema& schema) -> std::int64_t {
+    auto size = std::int64_t{0};
+    for (const auto& index : schema.indexes) {
+        size = std::max(size, static_cast<std::int64_t>(index.columns.size()) + 1);
+    }
+    return size;
+}
+
+// Inserts the row with the values and rowid in the registers into the table on cursor 0, and
+// into every index, index cursor i belonging to schema.indexes[i].
+auto insert_row(SqlBytecodeProgram& program, const TableSchema& schema, ConflictResolutionMethod method,
+                const InsertRegisters& registers) -> void {
+    constexpr auto cursor = 0;
+    const auto new_row = [&](std::optional<std::size_t> column, std::int64_t target) {
+        return Instruction(Opcode::COPY, column ? registers.first_value + static_cast<std::int64_t>(*column) : registers.rowid, target, 0, {});
+    };
+    const auto replaced_row = [&](std::optional<std::size_t> column, std::int64_t target) {
+        return column ? Instruction(Opcode::COLUMN, cursor, static_cast<std::int64_t>(*column), target, {})
+                      : Instruction(Opcode::COPY, registers.replaced, target, 0, {});
+    };
+
+    // a STRICT table's values are converted to their column's type first, the indexes get them that way too
+    if (schema.strict) {
+        for (auto i = std::size_t{0}; i < schema.columns.size(); ++i) {
+            const auto& column = schema.columns[i];
+            const auto type = strict_column_type(column.type.value_or(""));
+            if (type && *type != ColumnType::ANY) {
+                program.push_back(Instruction(Opcode::TYPECHECK, registers.first_value + static_cast<std::int64_t>(i), static_cast<std::int64_t>(*type), 0,
+                                              program.constant(fmt::format("{}.{}", schema.name, column.name))));
+            }
+        }
+    }
+
+    // a row clashing with another one in a UNIQUE index fails the statement, is skipped
+    // (IGNORE) or takes the other row's place (REPLACE), which removes it from every index
+    auto skip_row = std::vector<std::size_t>{};
+    for (auto i = std::size_t{0}; i < schema.indexes.size(); ++i) {
+        const auto& index = schema.indexes[i];
+        if (!index.unique) {
+            continue;
+        }
+        const auto count = load_index_entry(program, schema, index, new_row, registers.first_key, false);
+        const auto check = program.size();
+        auto instr = Instruction(Opcode::NOCONFLICT, static_cast<std::int64_t>(i), 0, registers.first_key, program.constant(sort_orders(index)));
+        instr.P5 = static_cast<std::uint16_t>(count);
+        program.push_back(instr);
+
+        auto no_conflict = std::vector<std::size_t>{check};
+        switch (method) {
+            case ConflictResolutionMethod::IGNORE:
+                skip_row.push_back(program.size());
+                program.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+                break;
+            case ConflictResolutionMethod::REPLACE:
+                program.push_back(Instruction(Opcode::IDXROWID, static_cast<std::int64_t>(i), registers.replaced, 0, {}));
+                no_conflict.push_back(program.size());
+                program.push_back(Instruction(Opcode::SEEKROWID, cursor, 0, registers.replaced, {}));
+                for (auto j = std::size_t{0}; j < schema.indexes.size(); ++j) {
+                    const auto& other = schema.indexes[j];
+                    const auto size = load_index_entry(program, schema, other, replaced_row, registers.first_key, true);
+                    program.push_back(Instruction(Opcode::MAKEKEY, registers.first_key, size, registers.entry, program.constant(sort_orders(other) + 'A')));
+                    program.push_back(Instruction(Opcode::IDXDELETE, static_cast<std::int64_t>(j), registers.entry, 0, {}));
+                }
+                program.push_back(Instruction(Opcode::DELETE, cursor, 0, 0, {}));
+                break;
+            default:
+                // there's a single statement per transaction, so FAIL and ROLLBACK undo the
+                // whole statement just like ABORT
+                program.push_back(Instruction(Opcode::HALT, 1, 0, 0, program.constant(unique_failure(index))));
+                break;
+        }
+        for (const auto jump : no_conflict) {
+            program[jump].P2 = static_cast<std::int64_t>(program.size());
+        }
+    }
+
+    const auto column_count = static_cast<std::int64_t>(schema.columns.size());
+    program.push_back(Instruction(Opcode::MAKERECORD, registers.first_value, column_count, registers.record, {}));
+    program.push_back(Instruction(Opcode::PUTINTKEY, cursor, registers.record, registers.rowid, {}));
+    for (auto i = std::size_t{0}; i < schema.indexes.size(); ++i) {
+        const auto& index = schema.indexes[i];
+        const auto size = load_index_entry(program, schema, index, new_row, registers.first_key, true);
+        program.push_back(Instruction(Opcode::MAKEKEY, registers.first_key, size, registers.entry, program.constant(sort_orders(index) + 'A')));
+        program.push_back(Instruction(Opcode::IDXINSERT, static_cast<std::int64_t>(i), registers.entry, 0, {}));
+    }
+    for (const auto jump : skip_row) {
+        program[jump].P2 = static_cast<std::int64_t>(program.size());
+    }
+}
+
+auto for_each_column(const Expr& expr, const std::function<void(const ColumnRef&)>& use) -> void {
+    std::visit(overloaded{
+        [&](const ColumnRef& column) { use(column); },
+        [&](const UnaryExpr& unary) { for_each_column(*unary.operand, use); },
+        [&](const BinaryExpr& binary) {
+            for_each_column(*binary.lhs, use);
+            for_each_column(*binary.rhs, use);
+        },
+        [&](const FunctionCall& call) {
+            for (const auto& argument : call.arguments) {
+                for_each_column(argument, use);
+            }
+        },
+        [](const auto&) {}
+    }, expr.value);
+}
+
+// whether the expression calls an aggregate function, see find_aggregate
+auto contains_aggregate(const Expr& expr) -> bool {
+    return std::visit(overloaded{
+        [](const UnaryExpr& unary) { return contains_aggregate(*unary.operand); },
+        [](const BinaryExpr& binary) { return contains_aggregate(*binary.lhs) || contains_aggregate(*binary.rhs); },
+        [](const FunctionCall& call) {
+            return find_aggregate(call.name, call.arguments.size(), call.star).has_value()
+                || std::ranges::any_of(call.arguments, [](const Expr& argument) { return contains_aggregate(argument); });
+        },
+        [](const auto&) { return false; }
+    }, expr.value);
+}
+
+// One of the tables of a join, read with the cursor of its position. The columns the statement
+// uses are loaded into consecutive registers, the sources' blocks one after the other, so the
+// sources before a join make up its probe row and the joined source its build row.
+struct JoinSource {
+    const TableSchema* schema;
+    // what qualified column names call it, its alias if it has one
+    std::string_view name;
+    // the loaded columns in register order, nullopt for the rowid
+    std::vector<std::optional<std::size_t>> columns{};
+    std::int64_t first_register = 0;
+
+    auto use(std::optional<std::size_t> column) -> void {
+        if (std::ranges::find(columns, column) == columns.end()) {
+            columns.push_back(column);
+        }
+    }
+    [[nodiscard]] auto register_of(std::optional<std::size_t> column) const -> std::int64_t {
+        return first_register + (std::ranges::find(columns, column) - columns.begin());
+    }
+    [[nodiscard]] auto width() const -> std::int64_t { return static_cast<std::int64_t>(columns.size()); }
+};
+
+struct ResolvedColumn {
+    std::size_t source;
+    // nullopt for the rowid
+    std::optional<std::size_t> column;
+};
+
+auto resolve(std::span<const JoinSource> sources, const ColumnRef& ref) -> ResolvedColumn {
+    auto found = std::optional<ResolvedColumn>{};
+    for (auto i = std::size_t{0}; i < sources.size(); ++i) {
+        if (ref.table && *ref.table != sources[i].name) {
+            continue;
+        }
+        const auto column = sources[i].schema->column_index(ref.name);
+        if (!column && ref.name != "rowid") {
+            continue;
+        }
+        if (found) {
+            fail("Ambiguous column name: '{}'", ref.name);
+        }
+        found = ResolvedColumn{.source = i, .column = column};
+    }
+    if (!found) {
+        if (ref.table) {
+            fail("No such column: '{}.{}'", *ref.table, ref.name);
+        }
+        fail("No such column: '{}'", ref.name);
+    }
+    return *found;
+}
+
+// the sources an expression reads, bit i for sources[i]
+auto source_mask(std::span<const JoinSource> sources, const Expr& expr) -> std::uint64_t {
+    auto mask = std::uint64_t{0};
+    for_each_column(expr, [&](const ColumnRef& ref) { mask |= std::uint64_t{1} << resolve(sources, ref).source; });
+    return mask;
+}
+
+// "probe = build" out of a join's terms, build reads only the joined source and probe only the
+// sources before it
+struct JoinKey {
+    const Expr* probe;
+    const Expr* build;
+};
+
+// A common table expression of a WITH clause, as the SELECTs of its statement see it: a table
+// named after it, read from a co-routine running its SELECT inline, or from the temporary table
+// it was materialized into before the statement's SELECT starts.
+struct CteBinding {
+    const CommonTableExpression* cte;
+    // its name and result columns, see result_columns
+    TableSchema schema;
+    // the temporary table it's materialized into, nullopt to run it inline
+    std::optional<std::int64_t> table{};
+    // the statement's SELECTs that read it, the main one and those of the CTEs after it
+    std::size_t references = 0;
+};
+
+// the source a SELECT reads, the CTEs shadow the tables of the database
+auto source_schema(const Database& db, std::span<const CteBinding> ctes, std::string_view name) -> const TableSchema& {
+    const auto it = std::ranges::find_if(ctes, [&](const CteBinding& binding) { return binding.schema.name == name; });
+    return it != ctes.end() ? it->schema : db.schema(name);
+}
+
+// the statistics on the source a SELECT reads, there are none on a CTE
+auto source_statistics(const Database& db, std::span<const CteBinding> ctes, std::string_view name) -> const TableStatistics* {
+    if (std::ranges::any_of(ctes, [&](const CteBinding& binding) { return binding.schema.name == name; })) {
+        return nullptr;
+    }
+    return db.statistics(name);
+}
+
+// The result columns of a SELECT as the columns of a table, for CREATE TABLE ... AS and CTEs:
+// an alias names its column, then a plain column reference, the others are "columnN" by their
+// position, repeated names stay repeated until unique_column_names. Only a plain column
+// reference keeps the column's type.
+auto result_columns(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> std::vector<ColumnSchema> {
+    auto sources = std::vector<std::pair<std::string_view, const TableSchema*>>{};
+    for (const auto& source : statement.sources) {
+        const auto& table = std::get<AliasedTable>(source);
+        sources.emplace_back(table.alias.value_or(table.table.table_name), &source_schema(db, ctes, table.table.table_name));
+    }
+    auto columns = std::vector<ColumnSchema>{};
+    const auto append_all = [&](const TableSchema& schema) { columns.insert(columns.end(), schema.columns.begin(), schema.columns.end()); };
+    for (const auto& projection : statement.projections) {
+        std::visit(overloaded{
+            [&](const StarColumn&) {
+                for (const auto& [name, schema] : sources) {
+                    append_all(*schema);
+                }
+            },
+            [&](const TableStarColumn& column) {
+                const auto it = std::ranges::find(sources, column.table_name, &std::pair<std::string_view, const TableSchema*>::first);
+                if (it == sources.end()) {
+                    fail("No such table: '{}'", column.table_name);
+                }
+                append_all(*it->second);
+            },
+            [&](const ExprColumn& column) {
+                auto result = ColumnSchema{.name = fmt::format("column{}", columns.size() + 1), .type = std::nullopt};
+                if (const auto* ref = std::get_if<ColumnRef>(&column.expr.value)) {
+                    result.name = ref->name;
+                    for (const auto& [name, schema] : sources) {
+                        const auto index = (!ref->table || *ref->table == name) ? schema->column_index(ref->name) : std::nullopt;
+                        if (index) {
+                            result.type = schema->columns[*index].type;
+                            break;
+                        }
+                    }
+                }
+                if (column.alias) {
+                    result.name = *column.alias;
+                }
+                columns.push_back(std::move(result));
+            }
+        }, projection);
+    }
+
+    return columns;
+}
+
+// Renames the repeated column names of a table built from a SELECT as sqlite does, the first
+// keeps its name and the others get a ":1", ":2"... suffix no column before them has, so that
+// "SELECT a, a" or "SELECT t.a, u.a" don't make a table with two columns named "a".
+auto unique_column_names(std::vector<ColumnSchema>& columns) -> void {
+    for (auto i = std::size_t{0}; i < columns.size(); ++i) {
+        const auto taken = [&](const std::string& name) {
+            return std::ranges::any_of(columns.begin(), columns.begin() + static_cast<std::ptrdiff_t>(i), [&](const ColumnSchema& column) { return column.name == name; });
+        };
+        if (!taken(columns[i].name)) {
+            continue;
+        }
+        auto suffix = 1;
+        while (taken(fmt::format("{}:{}", columns[i].name, suffix))) {
+            ++suffix;
+        }
+        columns[i].name = fmt::format("{}:{}", columns[i].name, suffix);
+    }
+}
+
+// how many of the SELECT's sources are the table or CTE
+auto references(const SelectStmt& statement, std::string_view name) -> std::size_t {
+    return static_cast<std::size_t>(std::ranges::count_if(statement.sources, [&](const TableOrSubquery& source) {
+        return std::get<AliasedTable>(source).table.table_name == name;
+    }));
+}
+
+// The CTEs of a WITH clause in the order they're declared, each seeing the ones before it. A CTE
+// is materialized when it's MATERIALIZED, or read more than once and not NOT MATERIALIZED,
+// otherwise its SELECT runs inline wherever it's read.
+auto cte_bindings(const WithClause& with, const SelectStmt& select, const Database& db) -> std::vector<CteBinding> {
+    if (with.recursive) {
+        fail("WITH RECURSIVE is not supported yet");
+    }
+    auto bindings = std::vector<CteBinding>{};
+    bindings.reserve(with.common_table_expressions.size());
+    for (const auto& cte : with.common_table_expressions) {
+        if (std::ranges::any_of(bindings, [&](const CteBinding& binding) { return binding.schema.name == cte.name; })) {
+            fail("Duplicate WITH table name: '{}'", cte.name);
+        }
+        auto columns = result_columns(cte.select_stmt, db, bindings);
+        if (!cte.column_names.empty()) {
+            if (cte.column_names.size() != columns.size()) {
+                fail("Table '{}' has {} values for {} columns", cte.name, columns.size(), cte.column_names.size());
+            }
+            for (auto i = std::size_t{0}; i < columns.size(); ++i) {
+                columns[i].name = cte.column_names[i];
+            }
+        }
+        unique_column_names(columns);
+        bindings.push_back(CteBinding{.cte = &cte, .schema = TableSchema{.name = std::string{cte.name}, .columns = std::move(columns)}});
+    }
+
+    auto tables = std::int64_t{0};
+    for (auto i = std::size_t{0}; i < bindings.size(); ++i) {
+        auto& binding = bindings[i];
+        binding.references = references(select, binding.schema.name);
+        for (auto j = i + 1; j < bindings.size(); ++j) {
+            binding.references += references(bindings[j].cte->select_stmt, binding.schema.name);
+        }
+        const auto specifier = binding.cte->materliazed_specifier;
+        const auto materialize = specifier == MateralizedSpecifier::MATERLIAZED
+            || (specifier == MateralizedSpecifier::NONE && binding.references > 1);
+        if (materialize && binding.references > 0) {
+            binding.table = tables++;
+        }
+    }
+    return bindings;
+}
+
+auto generate_select(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> SqlBytecodeProgram;
+
+enum class OperandKind : std::uint8_t { NONE, REGISTER, CURSOR, INDEX_CURSOR, JOIN, AGGREGATION, SORTER, ADDRESS, STEP };
+
+// what P1, P2 and P3 of an instruction are
+auto operand_kinds(Opcode opcode) -> std::array<OperandKind, 3> {
+    using enum OperandKind;
+    switch (opcode) {
+        case Opcode::OPENWRITE:
+        case Opcode::OPENREAD:
+        case Opcode::CLOSE:
+        case Opcode::DELETE:
+        case Opcode::OPENEPHEMERAL:
+            return {CURSOR, NONE, NONE};
+        case Opcode::NEWRECNO:
+        case Opcode::ROWID:
+            return {CURSOR, REGISTER, NONE};
+        case Opcode::PUTINTKEY:
+            return {CURSOR, REGISTER, REGISTER};
+        case Opcode::REWIND:
+        case Opcode::NEXT:
+        case Opcode::SCAN:
+            return {CURSOR, ADDRESS, NONE};
+        case Opcode::COLUMN:
+            return {CURSOR, NONE, REGISTER};
+        case Opcode::SEEKROWID:
+            return {CURSOR, ADDRESS, REGISTER};
+        case Opcode::CREATETABLE:
+        case Opcode::CREATEINDEX:
+        case Opcode::GOTO:
+            return {NONE, ADDRESS, NONE};
+        case Opcode::INTEGER:
+        case Opcode::VARIABLE:
+        case Opcode::NULL_:
+        case Opcode::REAL:
+        case Opcode::STRING:
+        case Opcode::BLOB:
+            return {NONE, REGISTER, NONE};
+        case Opcode::MAKERECORD:
+        case Opcode::MAKEKEY:
+            return {REGISTER, NONE, REGISTER};
+        case Opcode::RESULTROW:
+        case Opcode::ENDCOROUTINE:
+            return {REGISTER, NONE, NONE};
+        case Opcode::ADD:
+        case Opcode::SUBTRACT:
+        case Opcode::MULTIPLY:
+        case Opcode::DIVIDE:
+        case Opcode::REMAINDER:
+        case Opcode::CONCAT:
+        case Opcode::EQ:
+        case Opcode::NE:
+        case Opcode::LT:
+        case Opcode::LE:
+        case Opcode::GT:
+        case Opcode::GE:
+        case Opcode::AND:
+        case Opcode::OR:
+            return {REGISTER, REGISTER, REGISTER};
+        case Opcode::NOT:
+        case Opcode::NEGATE:
+        case Opcode::COPY:
+            return {REGISTER, REGISTER, NONE};
+        case Opcode::IFNOT:
+            return {REGISTER, ADDRESS, NONE};
+        case Opcode::FUNCTION:
+            return {NONE, REGISTER, REGISTER};
+        case Opcode::OPENINDEX:
+        case Opcode::CLOSEINDEX:
+            return {INDEX_CURSOR, NONE, NONE};
+        case Opcode::IDXINSERT:
+        case Opcode::IDXDELETE:
+        case Opcode::IDXROWID:
+            return {INDEX_CURSOR, REGISTER, NONE};
+        case Opcode::NOCONFLICT:
+        case Opcode::IDXSEEK:
+        case Opcode::IDXGE:
+            return {INDEX_CURSOR, ADDRESS, REGISTER};
+        case Opcode::IDXNEXT:
+            return {INDEX_CURSOR, ADDRESS, NONE};
+        case Opcode::HASHOPEN:
+            return {JOIN, REGISTER, REGISTER};
+        case Opcode::HASHINSERT:
+            return {JOIN, REGISTER, NONE};
+        case Opcode::HASHPROBE:
+            return {JOIN, ADDRESS, REGISTER};
+        case Opcode::HASHNEXT:
+            return {JOIN, ADDRESS, ADDRESS};
+        case Opcode::HASHDRAIN:
+            return {JOIN, ADDRESS, NONE};
+        case Opcode::AGGOPEN:
+            return {AGGREGATION, NONE, NONE};
+        case Opcode::AGGSTEP:
+        case Opcode::AGGNEXT:
+            return {AGGREGATION, ADDRESS, REGISTER};
+        case Opcode::SORTOPEN:
+            return {SORTER, NONE, REGISTER};
+        case Opcode::SORTINSERT:
+            return {SORTER, REGISTER, REGISTER};
+        case Opcode::SORTNEXT:
+            return {SORTER, ADDRESS, REGISTER};
+        case Opcode::MUSTBEINT:
+        case Opcode::TYPECHECK:
+            return {REGISTER, NONE, NONE};
+        case Opcode::ZONEFILTER:
+            return {CURSOR, NONE, REGISTER};
+        case Opcode::IFPOS:
+        case Opcode::DECRJUMPZERO:
+            return {REGISTER, ADDRESS, NONE};
+        case Opcode::INITCOROUTINE:
+        case Opcode::YIELD:
+            return {REGISTER, ADDRESS, ADDRESS};
+        case Opcode::EXPLAIN:
+            return {STEP, STEP, ADDRESS};
+        case Opcode::PROFILEROW:
+            return {ADDRESS, REGISTER, NONE};
+        default:
+            return {NONE, NONE, NONE};
+    }
+}
+
+// the registers from the operand on that the instruction reads or writes
+auto register_width(const Instruction& instr, std::size_t operand) -> std::int64_t {
+    switch (instr.opcode) {
+        case Opcode::MAKERECORD:
+        case Opcode::MAKEKEY:
+        case Opcode::RESULTROW:
+            return operand == 0 ? instr.P2 : 1;
+        case Opcode::FUNCTION:
+        case Opcode::HASHINSERT:
+            return operand == 1 ? instr.P5 : 1;
+        case Opcode::NOCONFLICT:
+        case Opcode::HASHOPEN:
+        case Opcode::HASHPROBE:
+        case Opcode::AGGSTEP:
+        case Opcode::AGGNEXT:
+        case Opcode::SORTINSERT:
+        case Opcode::SORTNEXT:
+            return operand == 2 ? instr.P5 : 1;
+        case Opcode::SORTOPEN:
+            return operand == 2 ? 2 : 1;
+        case Opcode::PROFILEROW:
+            return profile_row_width;
+        default:
+            return 1;
+    }
+}
+
+// The first registers, cursors, index cursors, hash joins, aggregations, sorters and plan steps no
+// instruction of a program uses, where the code embedded into it numbers its own from.
+struct Usage {
+    std::int64_t registers = 0;
+    std::int64_t cursors = 0;
+    std::int64_t index_cursors = 0;
+    std::int64_t joins = 0;
+    std::int64_t aggregations = 0;
+    std::int64_t sorters = 0;
+    std::int64_t steps = 1;
+
+    auto add(const SqlBytecodeProgram& program) -> Usage& {
+        for (const auto& instr : program) {
+            const auto operands = std::array{instr.P1, instr.P2, instr.P3};
+            const auto kinds = operand_kinds(instr.opcode);
+            for (auto i = std::size_t{0}; i < kinds.size(); ++i) {
+                switch (kinds[i]) {
+                    case OperandKind::REGISTER: registers = std::max(registers, operands[i] + register_width(instr, i)); break;
+                    case OperandKind::CURSOR: cursors = std::max(cursors, operands[i] + 1); break;
+                    case OperandKind::INDEX_CURSOR: index_cursors = std::max(index_cursors, operands[i] + 1); break;
+                    case OperandKind::JOIN: joins = std::max(joins, operands[i] + 1); break;
+                    case OperandKind::AGGREGATION: aggregations = std::max(aggregations, operands[i] + 1); break;
+                    case OperandKind::SORTER: sorters = std::max(sorters, operands[i] + 1); break;
+                    case OperandKind::STEP: steps = std::max(steps, operands[i] + 1); break;
+                    default: break;
+                }
+            }
+        }
+        return *this;
+    }
+};
+
+// A SELECT running as a co-routine of the program it's embedded into, see INITCOROUTINE
+struct Coroutine {
+    std::int64_t reg;
+    // its first instruction
+    std::int64_t start;
+    // the row it yields, in the registers from row on
+    std::int64_t row;
+    std::int64_t width;
+    // the YIELD handing a row over
+    std::int64_t yield;
+};
+
+// Appends the SELECT's program to host as a co-routine, numbering its registers, cursors,
+// index cursors, joins, aggregations, sorters and plan steps from the first ones used doesn't
+// have, its top level plan steps part of parent_step. Its RESULTROW yields the row, its HALT ends
+// it. It runs in the host's transaction, which checks the schema cookie.
+auto embed(SqlBytecodeProgram& host, const Usage& used, const SqlBytecodeProgram& select, std::int64_t parent_step) -> Coroutine {
+    const auto start = static_cast<std::int64_t>(host.size());
+    auto coroutine = Coroutine{.reg = used.registers, .start = start, .row = 0, .width = 0, .yield = 0};
+    const auto first_step = used.steps - 1;
+    const auto relocated = [&](OperandKind kind, std::int64_t operand) {
+        switch (kind) {
+            case OperandKind::REGISTER: return operand + used.registers + 1;
+            case OperandKind::CURSOR: return operand + used.cursors;
+            case OperandKind::INDEX_CURSOR: return operand + used.index_cursors;
+            case OperandKind::JOIN: return operand + used.joins;
+            case OperandKind::AGGREGATION: return operand + used.aggregations;
+            case OperandKind::SORTER: return operand + used.sorters;
+            case OperandKind::ADDRESS: return operand + start;
+            case OperandKind::STEP: return operand + first_step;
+            default: return operand;
+        }
+    };
+    for (auto instr : select) {
+        auto kinds = operand_kinds(instr.opcode);
+        if (instr.opcode == Opcode::YIELD) {
+            // a co-routine's own YIELDs don't jump anywhere
+            kinds[1] = instr.P2 == 0 ? OperandKind::NONE : kinds[1];
+            kinds[2] = instr.P3 == 0 ? OperandKind::NONE : kinds[2];
+        }
+        instr.P1 = relocated(kinds[0], instr.P1);
+        instr.P2 = relocated(kinds[1], instr.P2);
+        instr.P3 = relocated(kinds[2], instr.P3);
+        if (instr.P4 != 0) {
+            instr.P4 = host.constant(select.operand(instr.P4));
+        }
+        switch (instr.opcode) {
+            case Opcode::TRANSACTION:
+            case Opcode::VERIFY_COOKIE:
+            case Opcode::COMMIT:
+                instr = Instruction(Opcode::NOOP, 0, 0, 0, {});
+                break;
+            case Opcode::RESULTROW:
+                coroutine.row = instr.P1;
+                coroutine.width = instr.P2;
+                coroutine.yield = static_cast<std::int64_t>(host.size());
+                instr = Instruction(Opcode::YIELD, coroutine.reg, 0, 0, {});
+                break;
+            case Opcode::HALT:
+                if (instr.P1 == 0) {
+                    instr = Instruction(Opcode::ENDCOROUTINE, coroutine.reg, 0, 0, {});
+                }
+                break;
+            case Opcode::EXPLAIN:
+                if (instr.P2 == first_step) {
+                    instr.P2 = parent_step;
+                }
+                break;
+            default:
+                break;
+        }
+        host.push_back(instr);
+    }
+    return coroutine;
+}
+
+// the co-routine right where it's read, behind the INITCOROUTINE jumping past it
+auto inline_coroutine(SqlBytecodeProgram& host, const SqlBytecodeProgram& select, std::int64_t parent_step) -> Coroutine {
+    const auto used = Usage{}.add(host);
+    const auto init = host.size();
+    host.push_back(Instruction(Opcode::INITCOROUTINE, used.registers, 0, static_cast<std::int64_t>(init) + 1, {}));
+    const auto coroutine = embed(host, used, select, parent_step);
+    host[init].P2 = static_cast<std::int64_t>(host.size());
+    return coroutine;
+}
+
+// appends the rows the co-routine yields to the table on cursor, each with the next rowid,
+// returns the address of the PUTINTKEY
+auto append_rows(SqlBytecodeProgram& program, const Coroutine& rows, std::int64_t cursor) -> std::int64_t {
+    const auto record_reg = Usage{}.add(program).registers;
+    const auto rowid_reg = record_reg + 1;
+    const auto loop = program.size();
+    program.push_back(Instruction(Opcode::YIELD, rows.reg, 0, 0, {}));
+    program.push_back(Instruction(Opcode::MAKERECORD, rows.row, rows.width, record_reg, {}));
+    program.push_back(Instruction(Opcode::NEWRECNO, cursor, rowid_reg, 0, {}));
+    const auto put = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::PUTINTKEY, cursor, record_reg, rowid_reg, {}));
+    program.push_back(Instruction(Opcode::GOTO, 0, static_cast<std::int64_t>(loop), 0, {}));
+    program[loop].P2 = static_cast<std::int64_t>(program.size());
+    return put;
+}
+
+// Points the cursors a SELECT opened on CTEs at them, before the prologue goes in: a materialized
+// CTE's cursor reads its temporary table, the reads of an inline one's become YIELDs to a
+// co-routine running its SELECT, appended after the HALT:
+//         OPENREAD c cte  ->  INITCOROUTINE r, next, coroutine
+//         SCAN c, done    ->  YIELD r, done
+//         COLUMN c, i, t  ->  COPY row + i, t
+//         NEXT c, loop    ->  YIELD r, next, loop
+auto attach_ctes(SqlBytecodeProgram& program, const SqlBytecodeProgram& prologue, std::span<const CteBinding> ctes,
+                 const Database& db) -> void {
+    const auto end = program.size();
+    for (auto open = std::size_t{0}; open < end; ++open) {
+        if (program[open].opcode != Opcode::OPENREAD) {
+            continue;
+        }
+        const auto cursor = program[open].P1;
+        const auto name = program.text(program[open].P4);
+        const auto binding = std::ranges::find_if(ctes, [&](const CteBinding& cte) { return cte.schema.name == name; });
+        if (binding == ctes.end()) {
+            continue;
+        }
+        if (binding->table) {
+            program[open].opcode = Opcode::OPENEPHEMERAL;
+            program[open].P2 = *binding->table;
+        }
+
+        auto coroutine = std::optional<Coroutine>{};
+        if (!binding->table) {
+            auto used = Usage{}.add(program).add(prologue);
+            const auto step = used.steps++;
+            const auto explain = program.size();
+            program.push_back(Instruction(Opcode::EXPLAIN, step, 0, 0, program.constant(fmt::format("CO-ROUTINE {}", name))));
+            const auto earlier = ctes.first(static_cast<std::size_t>(binding - ctes.begin()));
+            coroutine = embed(program, used, generate_select(binding->cte->select_stmt, db, earlier), step);
+            program[explain].P3 = coroutine->yield;
+        }
+        for (auto address = std::size_t{0}; address < end; ++address) {
+            auto& instr = program[address];
+            if (operand_kinds(instr.opcode)[0] != OperandKind::CURSOR || instr.P1 != cursor) {
+                continue;
+            }
+            if (instr.opcode == Opcode::ROWID) {
+                fail("No such column: 'rowid'");
+            }
+            if (!coroutine) {
+                continue;
+            }
+            const auto next = static_cast<std::int64_t>(address) + 1;
+            switch (instr.opcode) {
+                case Opcode::OPENREAD: instr = Instruction(Opcode::INITCOROUTINE, coroutine->reg, next, coroutine->start, {}); break;
+                case Opcode::REWIND:
+                case Opcode::SCAN: instr = Instruction(Opcode::YIELD, coroutine->reg, instr.P2, 0, {}); break;
+                case Opcode::NEXT: instr = Instruction(Opcode::YIELD, coroutine->reg, next, instr.P2, {}); break;
+                case Opcode::COLUMN: instr = Instruction(Opcode::COPY, coroutine->row + instr.P2, instr.P3, 0, {}); break;
+                case Opcode::CLOSE: instr = Instruction(Opcode::NOOP, 0, 0, 0, {}); break;
+                default: fail("Cannot run {} on CTE '{}'", opcode_name(instr.opcode), name);
+            }
+        }
+    }
+}
+
+// Every source after the first is joined with a HashJoin, built from a scan of the source before
+// the first source is scanned to probe them all, one after the other:
+//         GOTO prologue
+//         OPENREAD, one per source
+//         HASHOPEN, one per joined source
+//         EXPLAIN, one per step of the plan
+//         REWIND 1, then per row: its columns, its own filters, its keys, HASHINSERT, NEXT 1
+//         ... the same for the other joined sources
+//         REWIND 0 -> drain 1
+//  loop:  the columns of source 0, the filters that only read it
+//         its key for source 1, HASHPROBE -> next 0
+//  match1: the filters of source 1, the key for source 2, HASHPROBE -> next 1
+//  match2: ...
+//         projections, RESULTROW
+//  next2: HASHNEXT -> match2 (or -> close once drained)
+//  next1: HASHNEXT -> match1 (or -> drain 2 once drained)
+//  next0: NEXT 0 -> loop
+//  drain1: HASHDRAIN -> match1
+//  drain2: HASHDRAIN -> match2
+//  close: CLOSE, one per source, COMMIT, HALT
+// A join that spilled hands the pairs of its spilled probe rows to the rest of the pipeline once
+// the levels before it are done, from HASHDRAIN on.
+// The order to join the sources in, order[level] being the FROM clause position of the source at
+// the level. The first source is scanned, probing the hash joins of the others, each built from
+// the rows of its source that pass the terms on it alone. A plan costs its builds and the rows
+// going into and out of each join, so the big source should probe and the joins cutting the rows
+// down the most should come first. Orders of up to max_ordered_sources sources are searched in
+// full, by the cheapest plan joining each subset of them, longer ones greedily. Without
+// statistics on any of the sources the FROM order stays.
+auto join_order(std::span<const JoinSource> sources, std::span<const Expr* const> terms, const Database& db,
+                std::span<const CteBinding> ctes) -> std::vector<std::size_t> {
+    constexpr auto max_ordered_sources = std::size_t{12};
+    const auto count = sources.size();
+    const auto bit = [](std::size_t source) { return std::uint64_t{1} << source; };
+    auto order = std::vector<std::size_t>(count);
+    std::iota(order.begin(), order.end(), std::size_t{0});
+    auto statistics = std::vector<const TableStatistics*>{};
+    for (const auto& source : sources) {
+        statistics.push_back(source_statistics(db, ctes, source.schema->name));
+    }
+    if (std::ranges::none_of(statistics, [](const TableStatistics* s) { return s != nullptr; })) {
+        return order;
+    }
+
+    // the rows each source builds or probes with, after the terms on it alone
+    auto rows = std::vector<double>(count);
+    for (auto source = std::size_t{0}; source < count; ++source) {
+        rows[source] = statistics[source] ? statistics[source]->rows : guessed_rows;
+    }
+    // a = b between two sources leaves 1 / the larger number of distinct values of the two sides
+    const auto distinct = [&](const Expr& side) -> std::optional<double> {
+        const auto* ref = std::get_if<ColumnRef>(&side.value);
+        const auto mask = source_mask(sources, side);
+        if (!ref || !std::has_single_bit(mask)) {
+            return std::nullopt;
+        }
+        const auto source = static_cast<std::size_t>(std::countr_zero(mask));
+        if (const auto* column = column_statistics(*sources[source].schema, statistics[source], ref->name)) {
+            return column->distinct;
+        }
+        if (ref->name == "rowid" && statistics[source]) {
+            return statistics[source]->rows;
+        }
+        return std::nullopt;
+    };
+    struct JoinTerm {
+        std::uint64_t mask;
+        double selectivity;
+    };
+    auto join_terms = std::vector<JoinTerm>{};
+    for (const auto* term : terms) {
+        const auto mask = source_mask(sources, *term);
+        if (mask == 0) {
+            continue;
+        }
+        if (std::has_single_bit(mask)) {
+            const auto source = static_cast<std::size_t>(std::countr_zero(mask));
+            rows[source] *= term_selectivity(*sources[source].schema, statistics[source], *term);
+            continue;
+        }
+        auto selectivity = guessed_term;
+        if (const auto* binary = std::get_if<BinaryExpr>(&term->value); binary && binary->op == BinaryOperator::EQUAL) {
+            const auto lhs = distinct(*binary->lhs);
+            const auto rhs = distinct(*binary->rhs);
+            selectivity = lhs || rhs ? 1.0 / std::max({lhs.value_or(1.0), rhs.value_or(1.0), 1.0}) : guessed_equal;
+        }
+        join_terms.push_back(JoinTerm{.mask = mask, .selectivity = selectivity});
+    }
+
+    // the rows coming out of joining the source to the ones in before, and what that costs
+    const auto joined_rows = [&](std::uint64_t before, double rows_before, std::size_t source) {
+        const auto after = before | bit(source);
+        auto result = rows_before * rows[source];
+        for (const auto& term : join_terms) {
+            if ((term.mask & ~after) == 0 && (term.mask & ~before) != 0) {
+                result *= term.selectivity;
+            }
+        }
+        return result;
+    };
+    const auto join_cost = [&](double rows_before, std::size_t source, double rows_after) {
+        return hash_build_cost * rows[source] + rows_before + rows_after;
+    };
+
+    if (count <= max_ordered_sources) {
+        struct Plan {
+            double cost = std::numeric_limits<double>::infinity();
+            double rows = 0;
+            // the source joined last
+            std::size_t last = 0;
+        };
+        auto plans = std::vector<Plan>(std::size_t{1} << count);
+        for (auto source = std::size_t{0}; source < count; ++source) {
+            plans[bit(source)] = Plan{.cost = 0, .rows = rows[source], .last = source};
+        }
+        for (auto mask = std::uint64_t{1}; mask < plans.size(); ++mask) {
+            const auto plan = plans[mask];
+            for (auto source = std::size_t{0}; source < count; ++source) {
+                if (std::isinf(plan.cost) || (mask & bit(source)) != 0) {
+                    continue;
+                }
+                const auto rows_after = joined_rows(mask, plan.rows, source);
+                const auto cost = plan.cost + join_cost(plan.rows, source, rows_after);
+                if (auto& next = plans[mask | bit(source)]; cost < next.cost) {
+                    next = Plan{.cost = cost, .rows = rows_after, .last = source};
+                }
+            }
+        }
+        auto mask = std::uint64_t{plans.size() - 1};
+        for (auto level = count; level-- > 0;) {
+            order[level] = plans[mask].last;
+            mask &= ~bit(order[level]);
+        }
+        return order;
+    }
+
+    // the biggest source probes, then the join leaving the fewest rows comes next
+    order.clear();
+    order.push_back(static_cast<std::size_t>(std::ranges::max_element(rows) - rows.begin()));
+    auto joined = bit(order.front());
+    auto current = rows[order.front()];
+    while (order.size() < count) {
+        auto best = std::optional<std::pair<std::size_t, double>>{};
+        for (auto source = std::size_t{0}; source < count; ++source) {
+            if ((joined & bit(source)) != 0) {
+                continue;
+            }
+            const auto rows_after = joined_rows(joined, current, source);
+            if (!best || rows_after < best->second) {
+                best = std::pair{source, rows_after};
+            }
+        }
+        order.push_back(best->first);
+        joined |= bit(best->first);
+        current = best->second;
+    }
+    return order;
 }
-inline auto generate_bytecode(const InsertStmt& statement) -> SqlBytecodeProgram {
+
+auto generate_join_bytecode(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> SqlBytecodeProgram {
+    SqlBytecodeProgram program{};
+
+    constexpr auto max_sources = std::size_t{64};
+    if (statement.sources.size() > max_sources) {
+        fail("At most {} tables can be joined", max_sources);
+    }
+    auto sources = std::vector<JoinSource>{};
+    for (const auto& source : statement.sources) {
+        const auto& table = std::get<AliasedTable>(source);
+        const auto& schema = source_schema(db, ctes, table.table.table_name);
+        sources.push_back(JoinSource{.schema = &schema, .name = table.alias.value_or(schema.name)});
+    }
+    // ON constraints are WHERE terms as far as inner joins go. Each term runs as soon as the
+    // sources it reads are there, or while building a source's table when it only reads that
+    // source, equalities between a source and the ones before it are the keys of its join.
+    auto terms = std::vector<const Expr*>{};
+    if (statement.where) {
+        split_conjunction(*statement.where, terms);
+    }
+    for (const auto& join : statement.joins) {
+        if (join.on) {
+            split_conjunction(*join.on, terms);
+        }
+    }
+
+    // the sources by level, in the order the cost model joins them in, see join_order
+    const auto order = join_order(sources, terms, db, ctes);
+    auto from_clause = std::move(sources);
+    sources.clear();
+    for (const auto position : order) {
+        sources.push_back(std::move(from_clause[position]));
+    }
+    const auto level_count = sources.size();
+    const auto source_named = [&](std::string_view name) -> JoinSource& {
+        const auto it = std::ranges::find(sources, name, &JoinSource::name);
+        if (it == sources.end()) {
+            fail("No such table: '{}'", name);
+        }
+        return *it;
+    };
+
+    // the columns every source has to load, and the registers of the result row
+    const auto use_columns = [&](const Expr& expr) {
+        for_each_column(expr, [&](const ColumnRef& ref) {
+            const auto resolved = resolve(sources, ref);
+            sources[resolved.source].use(resolved.column);
+        });
+    };
+    const auto use_all_columns = [](JoinSource& source) {
+        for (auto column = std::size_t{0}; column < source.schema->columns.size(); ++column) {
+            source.use(column);
+        }
+        return static_cast<std::int64_t>(source.schema->columns.size());
+    };
+    auto result_count = std::int64_t{0};
+    for (const auto& projection : statement.projections) {
+        std::visit(overloaded{
+            [&](const StarColumn&) {
+                for (auto& source : sources) {
+                    result_count += use_all_columns(source);
+                }
+            },
+            [&](const TableStarColumn& column) { result_count += use_all_columns(source_named(column.table_name)); },
+            [&](const ExprColumn& column) {
+                use_columns(column.expr);
+                ++result_count;
+            }
+        }, projection);
+    }
+
+    auto keys = std::vector<std::vector<JoinKey>>(level_count);
+    auto build_filters = std::vector<std::vector<const Expr*>>(level_count);
+    auto filters = std::vector<std::vector<const Expr*>>(level_count);
+    for (const auto* term : terms) {
+        use_columns(*term);
+        const auto mask = source_mask(sources, *term);
+        const auto level = mask == 0 ? std::size_t{0} : static_cast<std::size_t>(std::bit_width(mask) - 1);
+        const auto level_bit = std::uint64_t{1} << level;
+        if (level == 0) {
+            filters[0].push_back(term);
+            continue;
+        }
+        if (mask == level_bit) {
+            build_filters[level].push_back(term);
+            continue;
+        }
+        if (const auto* binary = std::get_if<BinaryExpr>(&term->value); binary && binary->op == BinaryOperator::EQUAL) {
+            const auto lhs = source_mask(sources, *binary->lhs);
+            const auto rhs = source_mask(sources, *binary->rhs);
+            if (lhs == level_bit && rhs != 0 && rhs < level_bit) {
+                keys[level].push_back(JoinKey{.probe = binary->rhs, .build = binary->lhs});
+                continue;
+            }
+            if (rhs == level_bit && lhs != 0 && lhs < level_bit) {
+                keys[level].push_back(JoinKey{.probe = binary->lhs, .build = binary->rhs});
+                continue;
+            }
+        }
+        filters[level].push_back(term);
+    }
+
+    // the result row, the sources' columns, the keys, then the temporaries
+    auto next_register = result_count;
+    for (auto& source : sources) {
+        source.first_register = next_register;
+        next_register += source.width();
+    }
+    auto first_key = std::vector<std::int64_t>(level_count);
+    for (auto level = std::size_t{1}; level < level_count; ++level) {
+        first_key[level] = next_register;
+        next_register += static_cast<std::int64_t>(keys[level].size());
+    }
+
+    auto prologue = SqlBytecodeProgram{};
+    prologue.push_back(Instruction(Opcode::TRANSACTION, 0, 0, 0, {}));
+    prologue.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    auto expressions = ExpressionCompiler{program, prologue, next_register, [&](const ColumnRef& ref, std::int64_t target) {
+        const auto resolved = resolve(sources, ref);
+        return Instruction(Opcode::COPY, sources[resolved.source].register_of(resolved.column), target, 0, {});
+    }};
+    const auto load_columns = [&](std::size_t level) {
+        const auto& source = sources[level];
+        const auto cursor = static_cast<std::int64_t>(level);
+        for (const auto& column : source.columns) {
+            program.push_back(column ? Instruction(Opcode::COLUMN, cursor, static_cast<std::int64_t>(*column), source.register_of(column), {})
+                                     : Instruction(Opcode::ROWID, cursor, source.register_of(column), 0, {}));
+        }
+    };
+    // jumps to the close, from the prologue for a WHERE that never holds
+    auto skip_loop = std::vector<std::size_t>{};
+    const auto compile_filter = [&](const Expr& term, std::vector<std::size_t>& skip_row) {
+        const auto operand = expressions.compile(term);
+        if (operand.constant) {
+            if (truth(*operand.constant) != true) {
+                skip_loop.push_back(prologue.size());
+                prologue.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+            }
+        } else if (operand.invariant) {
+            skip_loop.push_back(prologue.size());
+            prologue.push_back(Instruction(Opcode::IFNOT, operand.reg, 0, 0, {}));
+        } else {
+            skip_row.push_back(program.size());
+            program.push_back(Instruction(Opcode::IFNOT, operand.reg, 0, 0, {}));
+        }
+    };
+    const auto join_of = [](std::size_t level) { return static_cast<std::int64_t>(level - 1); };
+    const auto key_width = [&](std::size_t level) { return static_cast<std::uint16_t>(keys[level].size()); };
+
+    program.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+    for (auto level = std::size_t{0}; level < level_count; ++level) {
+        program.push_back(Instruction(Opcode::OPENREAD, static_cast<std::int64_t>(level), 0, columnar_width(*sources[level].schema),
+                                      program.constant(sources[level].schema->name)));
+    }
+    for (auto level = std::size_t{1}; level < level_count; ++level) {
+        auto open = Instruction(Opcode::HASHOPEN, join_of(level), sources[0].first_register, sources[level].first_register, {});
+        open.P5 = static_cast<std::uint16_t>(sources[level].width());
+        program.push_back(open);
+    }
+
+    // the plan: a scan of source 0 probing the hash join of every other source, each built from
+    // a scan. The steps count the rows at the start of their loops, patched in once they're there.
+    const auto label = [&](std::size_t level) { return source_label(std::get<AliasedTable>(statement.sources[order[level]])); };
+    const auto explain_probe = program.size();
+    program.push_back(Instruction(Opcode::EXPLAIN, 1, 0, 0, program.constant(fmt::format("SCAN {}", label(0)))));
+    auto explain_join = std::vector<std::size_t>(level_count);
+    auto explain_build = std::vector<std::size_t>(level_count);
+    for (auto level = std::size_t{1}; level < level_count; ++level) {
+        auto on = std::vector<std::string>{};
+        for (const auto& key : keys[level]) {
+            on.push_back(fmt::format("{}=?", to_string(*key.build)));
+        }
+        const auto step = static_cast<std::int64_t>(2 * level);
+        explain_join[level] = program.size();
+        program.push_back(Instruction(Opcode::EXPLAIN, step, 0, 0, program.constant(
+            on.empty() ? fmt::format("HASH JOIN {}", label(level)) : fmt::format("HASH JOIN {} ({})", label(level), fmt::join(on, " AND ")))));
+        explain_build[level] = program.size();
+        program.push_back(Instruction(Opcode::EXPLAIN, step + 1, step, 0, program.constant(fmt::format("SCAN {}", label(level)))));
+    }
+
+    for (auto level = std::size_t{1}; level < level_count; ++level) {
+        const auto cursor = static_cast<std::int64_t>(level);
+        const auto rewind = program.size();
+        program.push_back(Instruction(Opcode::REWIND, cursor, 0, 0, {}));
+        const auto loop = static_cast<std::int64_t>(program.size());
+        program[explain_build[level]].P3 = loop;
+        load_columns(level);
+        auto skip_row = std::vector<std::size_t>{};
+        for (const auto* term : build_filters[level]) {
+            compile_filter(*term, skip_row);
+        }
+        for (auto i = std::size_t{0}; i < keys[level].size(); ++i) {
+            expressions.compile_into(*keys[level][i].build, first_key[level] + static_cast<std::int64_t>(i));
+        }
+        auto insert = Instruction(Opcode::HASHINSERT, join_of(level), first_key[level], 0, {});
+        insert.P5 = key_width(level);
+        program.push_back(std::move(insert));
+        for (const auto jump : skip_row) {
+            program[jump].P2 = static_cast<std::int64_t>(program.size());
+        }
+        program.push_back(Instruction(Opcode::NEXT, cursor, loop, 0, {}));
+        program[rewind].P2 = static_cast<std::int64_t>(program.size());
+    }
+
+    // skip_row[level] jumps to the instruction moving on from the level's current row
+    auto skip_row = std::vector<std::vector<std::size_t>>(level_count);
+    auto match = std::vector<std::int64_t>(level_count);
+    const auto rewind = program.size();
+    program.push_back(Instruction(Opcode::REWIND, 0, 0, 0, {}));
+    const auto loop = static_cast<std::int64_t>(program.size());
+    program[explain_probe].P3 = loop;
+    load_columns(0);
+    for (auto level = std::size_t{0}; level < level_count; ++level) {
+        if (level > 0) {
+            for (auto i = std::size_t{0}; i < keys[level].size(); ++i) {
+                expressions.compile_into(*keys[level][i].probe, first_key[level] + static_cast<std::int64_t>(i));
+            }
+            skip_row[level - 1].push_back(program.size());
+            auto probe = Instruction(Opcode::HASHPROBE, join_of(level), 0, first_key[level], {});
+            probe.P5 = key_width(level);
+            program.push_back(std::move(probe));
+            match[level] = static_cast<std::int64_t>(program.size());
+            program[explain_join[level]].P3 = match[level];
+        }
+        for (const auto* term : filters[level]) {
+            compile_filter(*term, skip_row[level]);
+        }
+    }
+
+    auto reg = std::int64_t{0};
+    const auto copy_all_columns = [&](const JoinSource& source) {
+        for (auto column = std::size_t{0}; column < source.schema->columns.size(); ++column) {
+            program.push_back(Instruction(Opcode::COPY, source.register_of(column), reg++, 0, {}));
+        }
+    };
+    for (const auto& projection : statement.projections) {
+        std::visit(overloaded{
+            [&](const StarColumn&) {
+                // in the FROM clause's order, whatever the join order
+                for (auto position = std::size_t{0}; position < level_count; ++position) {
+                    copy_all_columns(sources[static_cast<std::size_t>(std::ranges::find(order, position) - order.begin())]);
+                }
+            },
+            [&](const TableStarColumn& column) { copy_all_columns(source_named(column.table_name)); },
+            [&](const ExprColumn& column) { expressions.compile_into(column.expr, reg++); }
+        }, projection);
+    }
+    program.push_back(Instruction(Opcode::RESULTROW, 0, result_count, 0, {}));
+
+    // HASHNEXT's drained target is the HASHDRAIN of the next join, patched once it's there
+    auto drained = std::vector<std::size_t>(level_count);
+    auto next = std::vector<std::int64_t>(level_count);
+    for (auto level = level_count - 1; level > 0; --level) {
+        next[level] = static_cast<std::int64_t>(program.size());
+        drained[level] = program.size();
+        program.push_back(Instruction(Opcode::HASHNEXT, join_of(level), match[level], 0, {}));
+    }
+    next[0] = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::NEXT, 0, loop, 0, {}));
+    program[rewind].P2 = static_cast<std::int64_t>(program.size());
+    for (auto level = std::size_t{1}; level < level_count; ++level) {
+        if (level > 1) {
+            program[drained[level - 1]].P3 = static_cast<std::int64_t>(program.size());
+        }
+        program.push_back(Instruction(Opcode::HASHDRAIN, join_of(level), match[level], 0, {}));
+    }
+    const auto close = static_cast<std::int64_t>(program.size());
+    program[drained[level_count - 1]].P3 = close;
+    for (auto level = std::size_t{0}; level < level_count; ++level) {
+        program.push_back(Instruction(Opcode::CLOSE, static_cast<std::int64_t>(level), 0, 0, {}));
+    }
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    for (auto level = std::size_t{0}; level < level_count; ++level) {
+        for (const auto jump : skip_row[level]) {
+            program[jump].P2 = next[level];
+        }
+    }
+    for (const auto jump : skip_loop) {
+        prologue[jump].P2 = close;
+    }
+    attach_ctes(program, prologue, ctes, db);
+    program.front().P2 = static_cast<std::int64_t>(program.size());
+    program.append(prologue);
+    program.push_back(Instruction(Opcode::GOTO, 0, 1, 0, {}));
+
+    return program;
+}
+
+} // namespace
+
+auto opcode_name(Opcode opcode) -> std::string_view {
+    static constexpr auto names = std::to_array<std::string_view>({
+        "Noop", "Halt", "VerifyCookie", "Transaction", "OpenWrite", "NewRecno", "Integer", "MakeRecord",
+        "PutIntKey", "Close", "Commit", "CreateTable", "OpenRead", "Rewind", "Next", "Column", "Rowid",
+        "ResultRow", "Variable", "Scan", "Goto", "Null", "Real", "String", "Add", "Subtract", "Multiply",
+        "Divide", "Remainder", "Concat", "Eq", "Ne", "Lt", "Le", "Gt", "Ge", "And", "Or", "Not", "Negate",
+        "IfNot", "Copy", "Function", "CreateIndex", "OpenIndex", "CloseIndex", "MakeKey", "IdxInsert",
+        "IdxDelete", "NoConflict", "IdxSeek", "IdxGE", "IdxNext", "IdxRowid", "SeekRowid", "Delete",
+        "HashOpen", "HashInsert", "HashProbe", "HashNext", "HashDrain", "AggOpen", "AggStep", "AggNext", "SorterOpen", "SorterInsert", "SorterNext",
+        "MustBeInt", "IfPos", "DecrJumpZero", "InitCoroutine", "Yield", "EndCoroutine", "OpenEphemeral", "Analyze",
+        "TypeCheck", "ZoneFilter", "Explain", "ProfileRow", "Blob"
+    });
+    static_assert(names.size() == opcode_count);
+    return names[static_cast<std::size_t>(opcode)];
+}
+
+auto SqlBytecodeProgram::constant(Value value) -> std::uint32_t {
+    auto* text = std::get_if<std::string>(&value);
+    if (text) {
+        if (const auto it = strings.find(*text); it != strings.end()) {
+            return it->second;
+        }
+    }
+    const auto index = static_cast<std::uint32_t>(constants.size());
+    if (text) {
+        strings.emplace(*text, index);
+    }
+    constants.push_back(std::move(value));
+    return index;
+}
+
+auto SqlBytecodeProgram::append(const SqlBytecodeProgram& other) -> void {
+    code.reserve(code.size() + other.size());
+    for (auto instr : other) {
+        if (instr.P4 != 0) {
+            instr.P4 = constant(other.operand(instr.P4));
+        }
+        code.push_back(instr);
+    }
+}
+
+namespace {
+
+// the result columns of a SELECT as expressions, a star as the columns it stands for
+auto result_expressions(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> std::vector<ExprColumn> {
+    auto columns = std::vector<ExprColumn>{};
+    const auto append_all = [&](const TableSchema& schema, std::string_view name) {
+        for (const auto& column : schema.columns) {
+            columns.push_back(ExprColumn{.expr = Expr{ColumnRef{.name = column.name, .table = name}}, .alias = std::nullopt});
+        }
+    };
+    for (const auto& projection : statement.projections) {
+        std::visit(overloaded{
+            [&](const StarColumn&) {
+                for (const auto& source : statement.sources) {
+                    const auto& table = std::get<AliasedTable>(source);
+                    append_all(source_schema(db, ctes, table.table.table_name), table.alias.value_or(table.table.table_name));
+                }
+            },
+            [&](const TableStarColumn& column) {
+                const auto it = std::ranges::find_if(statement.sources, [&](const TableOrSubquery& source) {
+                    const auto& table = std::get<AliasedTable>(source);
+                    return table.alias.value_or(table.table.table_name) == column.table_name;
+                });
+                if (it == statement.sources.end()) {
+                    fail("No such table: '{}'", column.table_name);
+                }
+                append_all(source_schema(db, ctes, std::get<AliasedTable>(*it).table.table_name), column.table_name);
+            },
+            [&](const ExprColumn& column) { columns.push_back(column); }
+        }, projection);
+    }
+    return columns;
+}
+
+// GROUP BY and the aggregate functions: the SELECT without them runs as a co-routine yielding the
+// GROUP BY terms, the carried columns and the aggregate functions' arguments of every row, which
+// go into a HashAggregate. Its groups make the result rows:
+//         GOTO prologue
+//         AGGOPEN 0, keys, carried, functions
+//         INITCOROUTINE r, ..           (the SELECT, see embed)
+//  loop:  YIELD r, done
+//         AGGSTEP 0, loop, row
+//  done:  EXPLAIN                       (USE HASH TABLE FOR GROUP BY)
+//  next:  AGGNEXT 0, close, group
+//         the HAVING -> next, then the result columns, RESULTROW
+//         GOTO next
+//  close: COMMIT, HALT
+// The carried columns are the ones read outside the aggregate functions and the GROUP BY terms,
+// which have the values of the group's first row, like sqlite's bare columns.
+auto generate_aggregate(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> SqlBytecodeProgram {
+    for (const auto& term : statement.group_by) {
+        if (contains_aggregate(term)) {
+            fail("Aggregate functions are not allowed in the GROUP BY clause");
+        }
+    }
+    auto outputs = std::vector<Expr>{};
+    for (auto& column : result_expressions(statement, db, ctes)) {
+        outputs.push_back(std::move(column.expr));
+    }
+
+    auto aggregates = std::vector<const FunctionCall*>{};
+    auto carried = std::vector<ColumnRef>{};
+    auto collect = std::function<void(const Expr&)>{};
+    collect = [&](const Expr& expr) {
+        if (std::ranges::find(statement.group_by, expr) != statement.group_by.end()) {
+            return;
+        }
+        std::visit(overloaded{
+            [&](const ColumnRef& ref) {
+                if (std::ranges::find(carried, ref) == carried.end()) {
+                    carried.push_back(ref);
+                }
+            },
+            [&](const UnaryExpr& unary) { collect(*unary.operand); },
+            [&](const BinaryExpr& binary) {
+                collect(*binary.lhs);
+                collect(*binary.rhs);
+            },
+            [&](const FunctionCall& call) {
+                if (!find_aggregate(call.name, call.arguments.size(), call.star)) {
+                    for (const auto& argument : call.arguments) {
+                        collect(argument);
+                    }
+                    return;
+                }
+                if (std::ranges::any_of(call.arguments, [](const Expr& argument) { return contains_aggregate(argument); })) {
+                    fail("Misuse of aggregate function {}()", call.name);
+                }
+                if (std::ranges::none_of(aggregates, [&](const FunctionCall* other) { return *other == call; })) {
+                    aggregates.push_back(&call);
+                }
+            },
+            [](const auto&) {}
+        }, expr.value);
+    };
+    for (const auto& output : outputs) {
+        collect(output);
+    }
+    if (statement.having) {
+        collect(*statement.having);
+    }
+
+    // the SELECT yielding the keys, the carried columns and the arguments
+    auto select = SelectStmt{
+        .modifier = SelectModifier::NONE,
+        .projections = std::pmr::vector<ResultColumn>{},
+        .sources = statement.sources,
+        .joins = statement.joins,
+        .where = statement.where,
+        .group_by = std::pmr::vector<Expr>{},
+        .having = std::nullopt,
+        .order_by = std::pmr::vector<OrderingTerm>{},
+        .limit = std::nullopt,
+        .offset = std::nullopt
+    };
+    for (const auto& term : statement.group_by) {
+        select.projections.push_back(ExprColumn{.expr = term, .alias = std::nullopt});
+    }
+    for (const auto& ref : carried) {
+        select.projections.push_back(ExprColumn{.expr = Expr{ref}, .alias = std::nullopt});
+    }
+    auto functions = std::string{};
+    for (const auto* call : aggregates) {
+        const auto function = *find_aggregate(call->name, call->arguments.size(), call->star);
+        functions += static_cast<char>(function);
+        if (function != AggregateFunction::COUNT_ROWS) {
+            select.projections.push_back(ExprColumn{.expr = call->arguments.front(), .alias = std::nullopt});
+        }
+    }
+    const auto row_width = static_cast<std::int64_t>(select.projections.size());
+    if (select.projections.empty()) {
+        // count(*) alone reads nothing but the rows
+        select.projections.push_back(ExprColumn{.expr = Expr{NullLiteral{}}, .alias = std::nullopt});
+    }
+
+    SqlBytecodeProgram program{};
+    auto prologue = SqlBytecodeProgram{};
+    prologue.push_back(Instruction(Opcode::TRANSACTION, 0, 0, 0, {}));
+    prologue.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    constexpr auto aggregation = 0;
+    const auto key_count = static_cast<std::int64_t>(statement.group_by.size());
+    const auto carried_count = static_cast<std::int64_t>(carried.size());
+    program.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::AGGOPEN, aggregation, key_count, carried_count, program.constant(functions)));
+    const auto rows = inline_coroutine(program, generate_select(select, db, ctes), 0);
+
+    const auto loop = program.size();
+    program.push_back(Instruction(Opcode::YIELD, rows.reg, 0, 0, {}));
+    program.push_back(Instruction(Opcode::AGGSTEP, aggregation, static_cast<std::int64_t>(loop), rows.row, {}, static_cast<std::uint16_t>(row_width)));
+    program[loop].P2 = static_cast<std::int64_t>(program.size());
+
+    // the group's registers, the result row's, then the temporaries
+    const auto used = Usage{}.add(program);
+    const auto group = used.registers;
+    const auto group_width = key_count + carried_count + static_cast<std::int64_t>(aggregates.size());
+    const auto result = group + group_width;
+    auto next_register = result + static_cast<std::int64_t>(outputs.size());
+    auto expressions = ExpressionCompiler{program, prologue, next_register, [&](const ColumnRef& ref, std::int64_t target) {
+        const auto it = std::ranges::find(carried, ref);
+        return Instruction(Opcode::COPY, group + key_count + (it - carried.begin()), target, 0, {});
+    }, [&](const Expr& expr) -> std::optional<std::int64_t> {
+        if (const auto it = std::ranges::find(statement.group_by, expr); it != statement.group_by.end()) {
+            return group + (it - statement.group_by.begin());
+        }
+        if (const auto* call = std::get_if<FunctionCall>(&expr.value)) {
+            const auto it = std::ranges::find_if(aggregates, [&](const FunctionCall* aggregate) { return *aggregate == *call; });
+            if (it != aggregates.end()) {
+                return group + key_count + carried_count + (it - aggregates.begin());
+            }
+        }
+        return std::nullopt;
+    }};
+
+    const auto explain = program.size();
+    if (key_count > 0) {
+        program.push_back(Instruction(Opcode::EXPLAIN, used.steps, 0, 0, program.constant(std::string{"USE HASH TABLE FOR GROUP BY"})));
+    }
+    const auto next = static_cast<std::int64_t>(program.size());
+    auto aggregate_next = Instruction(Opcode::AGGNEXT, aggregation, 0, group, {});
+    aggregate_next.P5 = static_cast<std::uint16_t>(group_width);
+    program.push_back(aggregate_next);
+    if (key_count > 0) {
+        program[explain].P3 = static_cast<std::int64_t>(program.size());
+    }
+    if (statement.having) {
+        const auto condition = expressions.to_register(expressions.compile(*statement.having));
+        program.push_back(Instruction(Opcode::IFNOT, condition, next, 0, {}));
+    }
+    for (auto i = std::size_t{0}; i < outputs.size(); ++i) {
+        expressions.compile_into(outputs[i], result + static_cast<std::int64_t>(i));
+    }
+    program.push_back(Instruction(Opcode::RESULTROW, result, static_cast<std::int64_t>(outputs.size()), 0, {}));
+    program.push_back(Instruction(Opcode::GOTO, 0, next, 0, {}));
+    program[static_cast<std::size_t>(next)].P2 = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    program.front().P2 = static_cast<std::int64_t>(program.size());
+    program.append(prologue);
+    program.push_back(Instruction(Opcode::GOTO, 0, 1, 0, {}));
+    return program;
+}
+
+// SELECT DISTINCT: the SELECT without it runs as a co-routine, its rows go into a HashAggregate
+// keyed by the whole row, which hands back every row starting a group. The rows of the groups
+// that spilled come out once the SELECT is done:
+//         TRANSACTION, VERIFY_COOKIE
+//         AGGOPEN 0, width, 0, '', 1
+//         INITCOROUTINE r, ..
+//  loop:  YIELD r, done
+//         AGGSTEP 0, loop, row
+//         RESULTROW row
+//         GOTO loop
+//  done:  AGGNEXT 0, close, row
+//         RESULTROW row
+//         GOTO done
+//  close: COMMIT, HALT
+auto generate_distinct(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> SqlBytecodeProgram {
+    auto select = statement;
+    select.modifier = SelectModifier::NONE;
+
+    SqlBytecodeProgram program{};
+    program.push_back(Instruction(Opcode::TRANSACTION, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    constexpr auto aggregation = 0;
+    const auto open = program.size();
+    program.push_back(Instruction(Opcode::AGGOPEN, aggregation, 0, 0, {}, 1));
+    const auto rows = inline_coroutine(program, generate_select(select, db, ctes), 0);
+    program[open].P2 = rows.width;
+    const auto width = static_cast<std::uint16_t>(rows.width);
+
+    const auto explain = program.size();
+    program.push_back(Instruction(Opcode::EXPLAIN, Usage{}.add(program).steps, 0, 0, program.constant(std::string{"USE HASH TABLE FOR DISTINCT"})));
+    const auto loop = program.size();
+    program.push_back(Instruction(Opcode::YIELD, rows.reg, 0, 0, {}));
+    program.push_back(Instruction(Opcode::AGGSTEP, aggregation, static_cast<std::int64_t>(loop), rows.row, {}, width));
+    program[explain].P3 = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::RESULTROW, rows.row, rows.width, 0, {}));
+    program.push_back(Instruction(Opcode::GOTO, 0, static_cast<std::int64_t>(loop), 0, {}));
+    const auto done = static_cast<std::int64_t>(program.size());
+    program[loop].P2 = done;
+    program.push_back(Instruction(Opcode::AGGNEXT, aggregation, 0, rows.row, {}, width));
+    program.push_back(Instruction(Opcode::RESULTROW, rows.row, rows.width, 0, {}));
+    program.push_back(Instruction(Opcode::GOTO, 0, done, 0, {}));
+    program[static_cast<std::size_t>(done)].P2 = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+    return program;
+}
+
+// ORDER BY, LIMIT and OFFSET: the SELECT without them runs as a co-routine yielding the result
+// columns, then the ORDER BY terms that aren't among them. A term is among them as its number, its
+// alias or the same expression. With an ORDER BY the rows go into a Sorter keyed by the terms,
+// which keeps no more than the LIMIT and the OFFSET let out:
+//         GOTO prologue
+//         INITCOROUTINE r, ..
+//         IFNOT limit, close            (with a LIMIT)
+//         SORTOPEN 0, width, limit
+//  loop:  YIELD r, done
+//         MAKEKEY terms, key            (their values copied next to each other first, if they
+//         SORTINSERT 0, key, row         aren't already)
+//         GOTO loop
+//  done:  EXPLAIN                       (USE SORTER FOR ORDER BY)
+//  next:  SORTNEXT 0, close, row
+//         IFPOS offset, next, 1         (with an OFFSET)
+//         RESULTROW row
+//         DECRJUMPZERO limit, close     (with a LIMIT)
+//         GOTO next
+//  close: COMMIT, HALT
+// Without an ORDER BY the YIELD is the next: instead. The prologue loads the LIMIT and the OFFSET
+// (0 without one), a MUSTBEINT each.
+auto generate_ordered(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> SqlBytecodeProgram {
+    const auto outputs = result_expressions(statement, db, ctes);
+    const auto width = static_cast<std::int64_t>(outputs.size());
+    auto select = statement;
+    select.order_by.clear();
+    select.limit = std::nullopt;
+    select.offset = std::nullopt;
+
+    // the column of the co-routine's row each term sorts by
+    auto columns = std::vector<std::int64_t>{};
+    auto orders = std::string{};
+    auto extra = std::vector<Expr>{};
+    for (const auto& term : statement.order_by) {
+        orders += term.order == SortOrder::DESC ? 'D' : 'A';
+        if (const auto* number = std::get_if<IntegerLiteral>(&term.expr.value)) {
+            if (number->value < 1 || number->value > width) {
+                fail("ORDER BY term out of range - should be between 1 and {}", width);
+            }
+            columns.push_back(number->value - 1);
+            continue;
+        }
+        // an alias goes before a column of the sources with the same name
+        const auto* ref = std::get_if<ColumnRef>(&term.expr.value);
+        auto it = std::ranges::find_if(outputs, [&](const ExprColumn& column) { return ref && !ref->table && column.alias == ref->name; });
+        if (it == outputs.end()) {
+            it = std::ranges::find(outputs, term.expr, &ExprColumn::expr);
+        }
+        if (it != outputs.end()) {
+            columns.push_back(it - outputs.begin());
+            continue;
+        }
+        if (statement.modifier == SelectModifier::DISTINCT) {
+            // a column of its own would be part of what's DISTINCT
+            fail("ORDER BY term does not match any column in the result set");
+        }
+        if (const auto found = std::ranges::find(extra, term.expr); found != extra.end()) {
+            columns.push_back(width + (found - extra.begin()));
+            continue;
+        }
+        columns.push_back(width + static_cast<std::int64_t>(extra.size()));
+        extra.push_back(term.expr);
+        select.projections.push_back(ExprColumn{.expr = term.expr, .alias = std::nullopt});
+    }
+
+    SqlBytecodeProgram program{};
+    auto prologue = SqlBytecodeProgram{};
+    prologue.push_back(Instruction(Opcode::TRANSACTION, 0, 0, 0, {}));
+    prologue.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    constexpr auto sorter = 0;
+    program.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+    const auto rows = inline_coroutine(program, generate_select(select, db, ctes), 0);
+
+    const auto used = Usage{}.add(program);
+    // the LIMIT and the OFFSET next to it, as SORTOPEN reads them, then the key and its terms
+    const auto limit = used.registers;
+    const auto offset = limit + 1;
+    const auto key = limit + 2;
+    auto next_register = key + 1;
+    auto expressions = ExpressionCompiler{prologue, prologue, next_register, [](const ColumnRef& ref, std::int64_t) -> Instruction {
+        fail("No such column: '{}'", ref.name);
+    }};
+    // the instructions jumping to close:
+    auto to_close = std::vector<std::size_t>{};
+    if (statement.limit) {
+        expressions.compile_into(*statement.limit, limit);
+        prologue.push_back(Instruction(Opcode::MUSTBEINT, limit, 0, 0, {}));
+        if (statement.offset) {
+            expressions.compile_into(*statement.offset, offset);
+            prologue.push_back(Instruction(Opcode::MUSTBEINT, offset, 0, 0, {}));
+        } else {
+            prologue.push_back(Instruction(Opcode::INTEGER, 0, offset, 0, {}));
+        }
+        to_close.push_back(program.size());
+        program.push_back(Instruction(Opcode::IFNOT, limit, 0, 0, {}));
+    }
+
+    auto next = std::int64_t{0};
+    if (statement.order_by.empty()) {
+        next = static_cast<std::int64_t>(program.size());
+        to_close.push_back(program.size());
+        program.push_back(Instruction(Opcode::YIELD, rows.reg, 0, 0, {}));
+    } else {
+        const auto has_limit = static_cast<std::uint16_t>(statement.limit ? 1 : 0);
+        program.push_back(Instruction(Opcode::SORTOPEN, sorter, width, limit, {}, has_limit));
+        const auto loop = program.size();
+        program.push_back(Instruction(Opcode::YIELD, rows.reg, 0, 0, {}));
+        const auto term_count = static_cast<std::int64_t>(columns.size());
+        auto terms = rows.row + columns.front();
+        for (auto i = std::size_t{1}; i < columns.size(); ++i) {
+            if (columns[i] != columns.front() + static_cast<std::int64_t>(i)) {
+                terms = next_register;
+                next_register += term_count;
+                for (auto j = std::size_t{0}; j < columns.size(); ++j) {
+                    program.push_back(Instruction(Opcode::COPY, rows.row + columns[j], terms + static_cast<std::int64_t>(j), 0, {}));
+                }
+                break;
+            }
+        }
+        program.push_back(Instruction(Opcode::MAKEKEY, terms, term_count, key, program.constant(orders)));
+        program.push_back(Instruction(Opcode::SORTINSERT, sorter, key, rows.row, {}, static_cast<std::uint16_t>(width)));
+        program.push_back(Instruction(Opcode::GOTO, 0, static_cast<std::int64_t>(loop), 0, {}));
+        program[loop].P2 = static_cast<std::int64_t>(program.size());
+
+        const auto explain = program.size();
+        program.push_back(Instruction(Opcode::EXPLAIN, used.steps, 0, 0, program.constant(std::string{"USE SORTER FOR ORDER BY"})));
+        next = static_cast<std::int64_t>(program.size());
+        to_close.push_back(program.size());
+        program.push_back(Instruction(Opcode::SORTNEXT, sorter, 0, rows.row, {}, static_cast<std::uint16_t>(width)));
+        program[explain].P3 = static_cast<std::int64_t>(program.size());
+    }
+    if (statement.offset) {
+        program.push_back(Instruction(Opcode::IFPOS, offset, next, 1, {}));
+    }
+    program.push_back(Instruction(Opcode::RESULTROW, rows.row, width, 0, {}));
+    if (statement.limit) {
+        to_close.push_back(program.size());
+        program.push_back(Instruction(Opcode::DECRJUMPZERO, limit, 0, 0, {}));
+    }
+    program.push_back(Instruction(Opcode::GOTO, 0, next, 0, {}));
+    for (const auto address : to_close) {
+        program[address].P2 = static_cast<std::int64_t>(program.size());
+    }
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    program.front().P2 = static_cast<std::int64_t>(program.size());
+    program.append(prologue);
+    program.push_back(Instruction(Opcode::GOTO, 0, 1, 0, {}));
+    return program;
+}
+
+auto generate_select(const SelectStmt& statement, const Database& db, std::span<const CteBinding> ctes) -> SqlBytecodeProgram {
+    SqlBytecodeProgram program{};
+    /* example:
+    sqlite> explain select b, a, 1 + 2 from t where a > ?;
+            0|Init|0|12|0
+            1|OpenRead|0|2|0
+            2|Rewind|0|11|0
+            3|Column|0|0|4
+            4|Le|5|10|4
+            5|Column|0|1|1
+            6|Column|0|0|2
+            7|Integer|3|3|0
+            8|ResultRow|1|3|0
+            9|Next|0|3|0
+            10|Halt|0|0|0
+            11|Transaction|0|0|1
+            12|Variable|1|5|0
+            13|Goto|0|1|0
+
+    the Init of sqlite jumps to a prologue behind the Halt, which loads whatever doesn't change
+    from row to row (the constant projection as well here) and jumps back to the start
+
+    with an index on t(a) the loop runs over the index entries in the range instead, see IndexRange:
+            1|OpenRead|0|2|0
+            2|OpenIndex|0|0|0|t_a
+            3|IdxSeek|0|13|5        (the entries >= the start key in r5, made in the prologue)
+            4|IdxGe|0|13|6          (up to the end key in r6)
+            5|IdxRowid|0|7|0
+            6|SeekRowid|0|12|7
+            ...
+            12|IdxNext|0|4|0
+    */
+
+    if (!statement.order_by.empty() || statement.limit) {
+        return generate_ordered(statement, db, ctes);
+    }
+    if (statement.modifier == SelectModifier::DISTINCT) {
+        return generate_distinct(statement, db, ctes);
+    }
+    const auto aggregates = std::ranges::any_of(statement.projections, [](const ResultColumn& projection) {
+        const auto* column = std::get_if<ExprColumn>(&projection);
+        return column && contains_aggregate(column->expr);
+    });
+    if (aggregates || !statement.group_by.empty()) {
+        return generate_aggregate(statement, db, ctes);
+    }
+    if (statement.sources.size() > 1) {
+        return generate_join_bytecode(statement, db, ctes);
+    }
+    const auto& source = std::get<AliasedTable>(statement.sources.front());
+    const auto& schema = source_schema(db, ctes, source.table.table_name);
+    const auto source_name = source.alias.value_or(schema.name);
+
+    constexpr auto cursor = 0;
+    constexpr auto index_cursor = 0;
+    // the result row's registers come first, the expressions' temporaries after them
+    auto result_count = std::int64_t{0};
+    for (const auto& projection : statement.projections) {
+        result_count += std::holds_alternative<ExprColumn>(projection) ? 1 : static_cast<std::int64_t>(schema.columns.size());
+    }
+    auto next_register = result_count;
+
+    auto prologue = SqlBytecodeProgram{};
+    prologue.push_back(Instruction(Opcode::TRANSACTION, 0, 0, 0, {}));
+    prologue.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    auto expressions = ExpressionCompiler{program, prologue, next_register, [&](const ColumnRef& ref, std::int64_t target) {
+        if (ref.table && *ref.table != source_name) {
+            fail("No such column: '{}.{}'", *ref.table, ref.name);
+        }
+        if (const auto index = schema.column_index(ref.name)) {
+            return Instruction(Opcode::COLUMN, cursor, static_cast<std::int64_t>(*index), target, {});
+        }
+        if (ref.name == "rowid") {
+            return Instruction(Opcode::ROWID, cursor, target, 0, {});
+        }
+        fail("No such column: '{}'", ref.name);
+    }};
+
+    auto terms = std::vector<const Expr*>{};
+    if (statement.where) {
+        split_conjunction(*statement.where, terms);
+    }
+    const auto range = choose_index(schema, source_statistics(db, ctes, schema.name), terms);
+
+    // jumps to the loop's NEXT (rows failing the WHERE) and to its end (from the loop's start, or
+    // from the prologue for a WHERE that never holds)
+    auto skip_row = std::vector<std::size_t>{};
+    auto exit_loop = std::vector<std::size_t>{};
+    auto skip_loop = std::vector<std::size_t>{};
+
+    program.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::OPENREAD, cursor, 0, columnar_width(schema), program.constant(schema.name)));
+    // the plan's only step, counting the rows the loop runs for
+    const auto explain = program.size();
+    program.push_back(Instruction(Opcode::EXPLAIN, 1, 0, 0, program.constant(range ? search_detail(source_label(source), *range)
+                                                                                   : fmt::format("SCAN {}", source_label(source)))));
+    auto loop_start = std::int64_t{0};
+    if (range) {
+        // the prologue makes the keys bounding the range from the values, in consecutive registers
+        const auto& index = *range->index;
+        const auto orders = sort_orders(index);
+        const auto first_value = next_register;
+        const auto equal_count = static_cast<std::int64_t>(range->equal.size());
+        next_register += equal_count + 1;
+        const auto make_key = [&](const Expr* bound, bool past_prefix) {
+            if (bound) {
+                expressions.compile_into(*bound, first_value + equal_count);
+            }
+            const auto count = equal_count + (bound ? 1 : 0);
+            const auto key = next_register++;
+            auto key_orders = orders.substr(0, static_cast<std::size_t>(count));
+            if (past_prefix) {
+                key_orders += '+';
+            }
+            prologue.push_back(Instruction(Opcode::MAKEKEY, first_value, count, key, prologue.constant(std::move(key_orders))));
+            return key;
+        };
+        for (auto i = std::int64_t{0}; i < equal_count; ++i) {
+            expressions.compile_into(*range->equal[static_cast<std::size_t>(i)], first_value + i);
+        }
+        // the start is past the entries equal to an exclusive lower bound, the end past the ones
+        // equal to an inclusive upper bound, or past all the equal ones without an upper bound
+        const auto start_key = make_key(range->lower, range->lower && !range->lower_inclusive);
+        const auto has_end = range->upper || equal_count > 0;
+        const auto end_key = has_end ? make_key(range->upper, !range->upper || range->upper_inclusive) : 0;
+
+        const auto rowid = next_register++;
+        program.push_back(Instruction(Opcode::OPENINDEX, index_cursor, 0, 0, program.constant(index.name)));
+        exit_loop.push_back(program.size());
+        program.push_back(Instruction(Opcode::IDXSEEK, index_cursor, 0, start_key, {}));
+        loop_start = static_cast<std::int64_t>(program.size());
+        if (has_end) {
+            exit_loop.push_back(program.size());
+            program.push_back(Instruction(Opcode::IDXGE, index_cursor, 0, end_key, {}));
+        }
+        program.push_back(Instruction(Opcode::IDXROWID, index_cursor, rowid, 0, {}));
+        program[explain].P3 = static_cast<std::int64_t>(program.size());
+        skip_row.push_back(program.size());
+        program.push_back(Instruction(Opcode::SEEKROWID, cursor, 0, rowid, {}));
+    } else {
+        // the segments of a COLUMNAR table the WHERE's comparisons rule out aren't read at all
+        for (const auto* term : terms) {
+            const auto comparison = column_comparison(*term);
+            const auto column = comparison && schema.columnar ? schema.column_index(comparison->column) : std::nullopt;
+            if (!column) {
+                continue;
+            }
+            const auto value = expressions.to_register(expressions.compile(*comparison->value));
+            auto filter = Instruction(Opcode::ZONEFILTER, cursor, static_cast<std::int64_t>(*column), value, {});
+            filter.P5 = static_cast<std::uint16_t>(zone_comparison(comparison->op));
+            program.push_back(filter);
+        }
+        // a plain scan, so the VM can run the loop in batches
+        exit_loop.push_back(program.size());
+        program.push_back(Instruction(Opcode::SCAN, cursor, 0, 0, {}));
+        loop_start = static_cast<std::int64_t>(program.size());
+        program[explain].P3 = loop_start;
+    }
+
+    for (const auto* term : terms) {
+        const auto operand = expressions.compile(*term);
+        if (operand.constant) {
+            if (truth(*operand.constant) != true) {
+                skip_loop.push_back(prologue.size());
+                prologue.push_back(Instruction(Opcode::GOTO, 0, 0, 0, {}));
+            }
+        } else if (operand.invariant) {
+            skip_loop.push_back(prologue.size());
+            prologue.push_back(Instruction(Opcode::IFNOT, operand.reg, 0, 0, {}));
+        } else {
+            skip_row.push_back(program.size());
+            program.push_back(Instruction(Opcode::IFNOT, operand.reg, 0, 0, {}));
+        }
+    }
+
+    auto reg = std::int64_t{0};
+    auto emit_all_columns = [&] {
+        for (auto column = std::size_t{0}; column < schema.columns.size(); ++column) {
+            program.push_back(Instruction(Opcode::COLUMN, cursor, static_cast<std::int64_t>(column), reg++, {}));
+        }
+    };
+    for (const auto& projection : statement.projections) {
+        std::visit(overloaded{
+            [&](const StarColumn&) {
+                emit_all_columns();
+            },
+            [&](const TableStarColumn& column) {
+                if (column.table_name != source_name) {
+                    fail("No such table: '{}'", column.table_name);
+                }
+                emit_all_columns();
+            },
+            [&](const ExprColumn& column) {
+                expressions.compile_into(column.expr, reg++);
+            }
+        }, projection);
+    }
+    program.push_back(Instruction(Opcode::RESULTROW, 0, result_count, 0, {}));
+
+    const auto next = static_cast<std::int64_t>(program.size());
+    if (range) {
+        program.push_back(Instruction(Opcode::IDXNEXT, index_cursor, loop_start, 0, {}));
+    } else {
+        program.push_back(Instruction(Opcode::NEXT, cursor, loop_start, 0, {}));
+    }
+    const auto close = static_cast<std::int64_t>(program.size());
+    if (range) {
+        program.push_back(Instruction(Opcode::CLOSEINDEX, index_cursor, 0, 0, {}));
+    }
+    program.push_back(Instruction(Opcode::CLOSE, cursor, 0, 0, {}));
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    for (const auto jump : skip_row) {
+        program[jump].P2 = next;
+    }
+    for (const auto jump : exit_loop) {
+        program[jump].P2 = close;
+    }
+    for (const auto jump : skip_loop) {
+        prologue[jump].P2 = close;
+    }
+    attach_ctes(program, prologue, ctes, db);
+    program.front().P2 = static_cast<std::int64_t>(program.size());
+    program.append(prologue);
+    program.push_back(Instruction(Opcode::GOTO, 0, 1, 0, {}));
+
+    return program;
+}
+
+// INSERT ... SELECT runs the SELECT as a co-routine and inserts every row it yields right away,
+// after filling the temporary tables of the materialized CTEs the same way. The SELECT reads the
+// tables as they were before the statement, so it never sees the rows it inserts:
+//         0|Transaction|0|1|0
+//         1|VerifyCookie|..
+//         2|OpenWrite|0|0|0|t
+//         3|InitCoroutine|0|..|4
+//         4|Goto|..                (the SELECT, its RESULTROW a YIELD and its HALT an ENDCOROUTINE)
+//         ...
+//  loop:  Yield|0|done|0
+//         NewRecno, then the UNIQUE checks, the record and the index entries as for VALUES
+//         Goto|0|loop
+//  done:  CloseIndex.., Close, Commit, Halt
+auto generate_insert_select(const InsertStmt& statement, const SelectStmt& select, const TableSchema& schema,
+                            const Database& db) -> SqlBytecodeProgram {
+    const auto ctes = statement.with_clause ? cte_bindings(*statement.with_clause, select, db) : std::vector<CteBinding>{};
+    const auto column_count = result_columns(select, db, ctes).size();
+    if (column_count != schema.columns.size()) {
+        fail("Table '{}' has {} columns but {} values were supplied", schema.name, schema.columns.size(), column_count);
+    }
+
+    SqlBytecodeProgram program{};
+    program.push_back(Instruction(Opcode::TRANSACTION, 0, 1, 0, {}));
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+
+    // the materialized CTEs in the order they're declared, each may read the ones before it
+    for (auto i = std::size_t{0}; i < ctes.size(); ++i) {
+        const auto& binding = ctes[i];
+        if (!binding.table) {
+            continue;
+        }
+        const auto used = Usage{}.add(program);
+        const auto explain = program.size();
+        program.push_back(Instruction(Opcode::EXPLAIN, used.steps, 0, 0, program.constant(fmt::format("MATERIALIZE {}", binding.schema.name))));
+        program.push_back(Instruction(Opcode::OPENEPHEMERAL, used.cursors, *binding.table, 0, program.constant(binding.schema.name)));
+        const auto rows = inline_coroutine(program, generate_select(binding.cte->select_stmt, db, std::span{ctes}.first(i)), used.steps);
+        program[explain].P3 = append_rows(program, rows, used.cursors);
+        program.push_back(Instruction(Opcode::CLOSE, used.cursors, 0, 0, {}));
+    }
+
+    constexpr auto cursor = 0;
+    program.push_back(Instruction(Opcode::OPENWRITE, cursor, 0, columnar_width(schema), program.constant(schema.name)));
+    for (auto i = std::size_t{0}; i < schema.indexes.size(); ++i) {
+        program.push_back(Instruction(Opcode::OPENINDEX, static_cast<std::int64_t>(i), 1, 0, program.constant(schema.indexes[i].name)));
+    }
+    const auto rows = inline_coroutine(program, generate_select(select, db, ctes), 0);
+
+    // the row's values are where the SELECT yields them
+    const auto first_register = Usage{}.add(program).registers;
+    const auto registers = InsertRegisters{
+        .rowid = first_register,
+        .first_value = rows.row,
+        .record = first_register + 1,
+        .first_key = first_register + 2,
+        .entry = first_register + 2 + max_entry_size(schema),
+        .replaced = first_register + 3 + max_entry_size(schema)
+    };
+    const auto loop = program.size();
+    program.push_back(Instruction(Opcode::YIELD, rows.reg, 0, 0, {}));
+    program.push_back(Instruction(Opcode::NEWRECNO, cursor, registers.rowid, 0, {}));
+    insert_row(program, schema, conflict_method(statement.operation), registers);
+    program.push_back(Instruction(Opcode::GOTO, 0, static_cast<std::int64_t>(loop), 0, {}));
+    program[loop].P2 = static_cast<std::int64_t>(program.size());
+
+    for (auto i = std::size_t{0}; i < schema.indexes.size(); ++i) {
+        program.push_back(Instruction(Opcode::CLOSEINDEX, static_cast<std::int64_t>(i), 0, 0, {}));
+    }
+    program.push_back(Instruction(Opcode::CLOSE, cursor, 0, 0, {}));
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    for (auto& instr : program) {
+        if (instr.opcode == Opcode::OPENREAD) {
+            instr.P2 = 1;
+        } else if (instr.opcode == Opcode::OPENINDEX && instr.P2 == 0) {
+            instr.P3 = 1;
+        }
+    }
+    return program;
+}
+
+} // namespace
+
+auto generate_bytecode(const SelectStmt& statement, const Database& db) -> SqlBytecodeProgram {
+    return generate_select(statement, db, {});
+}
+
+auto generate_bytecode(const CreateTableStmt& statement, const Database& db) -> SqlBytecodeProgram {
+    SqlBytecodeProgram program{};
+    /* CREATE TABLE ... AS SELECT fills the table from the SELECT running as a co-routine, a row
+    at a time, appending every row with the next rowid:
+            2|CreateTable|0|15|0|t2(a, b)
+            3|OpenWrite|0|0|0|t2
+            4|InitCoroutine|0|9|5
+            5|Goto|0|..                (the SELECT, its RESULTROW a YIELD and its HALT an ENDCOROUTINE)
+            ...
+            9|Yield|0|14|0
+            10|MakeRecord|1|2|3
+            11|NewRecno|0|4|0
+            12|PutIntKey|0|3|4
+            13|Goto|0|9|0
+    */
+
+    auto schema = TableSchema{.name = std::string{statement.table.table_name}, .columns = {}};
+    for (const auto& column : statement.column_definitions) {
+        auto type = std::optional<std::string>{};
+        if (column.type_name) {
+            type = std::string{*column.type_name};
+        }
+        schema.columns.push_back(ColumnSchema{.name = std::string{column.column_name}, .type = std::move(type)});
+    }
+    for (auto i = std::size_t{0}; i < schema.columns.size(); ++i) {
+        if (schema.column_index(schema.columns[i].name) != i) {
+            fail("Duplicate column name: '{}'", schema.columns[i].name);
+        }
+    }
+    if (statement.as_select) {
+        schema.columns = result_columns(*statement.as_select, db, {});
+        unique_column_names(schema.columns);
+    }
+    for (const auto option : statement.table_options) {
+        switch (option) {
+            case TableOption::WITHOUT_ROWID:
+                // there are no PRIMARY KEYs to key the rows by instead
+                fail("PRIMARY KEY missing on table '{}'", schema.name);
+            case TableOption::STRICT:
+                schema.strict = true;
+                break;
+            case TableOption::COLUMNAR:
+                schema.columnar = true;
+                break;
+        }
+    }
+    if (schema.columnar && !schema.strict) {
+        fail("COLUMNAR table '{}' has to be STRICT", schema.name);
+    }
+    if (schema.strict) {
+        for (const auto& column : schema.columns) {
+            if (!column.type) {
+                fail("Missing datatype for '{}.{}'", schema.name, column.name);
+            }
+            if (!strict_column_type(*column.type)) {
+                fail("Unknown datatype for '{}.{}': '{}'", schema.name, column.name, *column.type);
+            }
+        }
+    }
+
+    program.push_back(Instruction(Opcode::TRANSACTION, 0, 1, 0, {}));
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    const auto create = program.size();
+    program.push_back(Instruction(Opcode::CREATETABLE, statement.if_not_exists_clause, 0, 0, program.constant(schema.definition())));
+    if (statement.as_select) {
+        constexpr auto cursor = 0;
+        program.push_back(Instruction(Opcode::OPENWRITE, cursor, 0, columnar_width(schema), program.constant(schema.name)));
+        const auto rows = inline_coroutine(program, generate_select(*statement.as_select, db, {}), 0);
+        append_rows(program, rows, cursor);
+        program.push_back(Instruction(Opcode::CLOSE, cursor, 0, 0, {}));
+    }
+    program[create].P2 = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    return program;
+}
+
+auto generate_bytecode(const InsertStmt& statement, const Database& db) -> SqlBytecodeProgram {
     SqlBytecodeProgram program{};
     /* example:
     sqlite> explain insert into main values(1,2);
@@ -21,35 +2563,248 @@ inline auto generate_bytecode(const InsertStmt& statement) -> SqlBytecodeProgram
             7|PutIntKey|0|1|
             8|Close|0|0|
             9|Commit|0|0|
+
+    the stack slots of the example above map onto registers:
+    r0 - rowid, r1..rN - column values, rN+1 - the assembled record, the expressions' temporaries after it
     */
 
-    program.push_back(Instruction(Opcode::TRANSACTION, 0, 0, {}));
-    program.push_back(Instruction(Opcode::VERIFY_COOKIE, 0, 0, {}));
-    program.push_back(Instruction(Opcode::NEWRECNO, 0, 0, {}));
-    program.push_back(Instruction(Opcode::OPENWRITE, 0, 0, statement.table.table.table_name));
+    if (statement.column_names && !statement.column_names->empty()) {
+        fail("INSERT with an explicit column list is not supported yet");
+    }
+    if (std::holds_alternative<DefaultValues>(statement.tuples)) {
+        fail("INSERT ... DEFAULT VALUES is not supported yet");
+    }
+    const auto& schema = db.schema(statement.table.table.table_name);
+    if (const auto* select = std::get_if<SelectStmt>(&statement.tuples)) {
+        return generate_insert_select(statement, *select, schema, db);
+    }
+    const auto& values = std::get<InsertStmtValuesExpr>(statement.tuples);
+    for (const auto& row : values.rows) {
+        if (row.size() != schema.columns.size()) {
+            fail("Table '{}' has {} columns but {} values were supplied",
+                 schema.name, schema.columns.size(), row.size());
+        }
+    }
+
+    constexpr auto cursor = 0;
+    const auto column_count = static_cast<std::int64_t>(schema.columns.size());
+    const auto registers = InsertRegisters{
+        .rowid = 0,
+        .first_value = 1,
+        .record = 1 + column_count,
+        .first_key = 2 + column_count,
+        .entry = 2 + column_count + max_entry_size(schema),
+        .replaced = 3 + column_count + max_entry_size(schema)
+    };
+    auto next_register = registers.replaced + 1;
+
+    // every row is computed right where it's inserted, so there's no prologue to hoist code into
+    auto expressions = ExpressionCompiler{program, program, next_register, [](const ColumnRef& column, std::int64_t) -> Instruction {
+        fail("Column reference '{}' is not allowed in VALUES", column.name);
+    }};
 
-    program.push_back(Instruction(Opcode::INTEGER, 0, 0, {}));
-    program.push_back(Instruction(Opcode::INTEGER, 0, 0, {}));
-    program.push_back(Instruction(Opcode::MAKERECORD, 0, 0, {}));
+    // all rows go in with a single transaction, every row reuses the same registers
+    program.push_back(Instruction(Opcode::TRANSACTION, 0, 1, 0, {}));
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    program.push_back(Instruction(Opcode::OPENWRITE, cursor, 0, columnar_width(schema), program.constant(schema.name)));
+    for (auto i = std::size_t{0}; i < schema.indexes.size(); ++i) {
+        program.push_back(Instruction(Opcode::OPENINDEX, static_cast<std::int64_t>(i), 1, 0, program.constant(schema.indexes[i].name)));
+    }
 
-    program.push_back(Instruction(Opcode::PUTINTKEY, 0, 1, {}));
-    program.push_back(Instruction(Opcode::CLOSE, 0, 0, {}));
-    program.push_back(Instruction(Opcode::COMMIT, 0, 0, {}));
+    for (const auto& row : values.rows) {
+        program.push_back(Instruction(Opcode::NEWRECNO, cursor, registers.rowid, 0, {}));
+        auto reg = registers.first_value;
+        for (const auto& expr : row) {
+            expressions.compile_into(expr, reg++);
+        }
+        insert_row(program, schema, conflict_method(statement.operation), registers);
+    }
+
+    for (auto i = std::size_t{0}; i < schema.indexes.size(); ++i) {
+        program.push_back(Instruction(Opcode::CLOSEINDEX, static_cast<std::int64_t>(i), 0, 0, {}));
+    }
+    program.push_back(Instruction(Opcode::CLOSE, cursor, 0, 0, {}));
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
 
     return program;
 }
 
-auto generate_bytecode(const Statement& statement) -> SqlBytecodeProgram {
-    return std::visit(overloaded{
-        [](const SelectStmt& stmt) {
-            return generate_bytecode(stmt);
+auto generate_bytecode(const CreateIndexStmt& statement, const Database& db) -> SqlBytecodeProgram {
+    SqlBytecodeProgram program{};
+    /* the new index is filled from a scan of its table:
+            0|Transaction|0|1|0
+            1|VerifyCookie|7|0|0
+            2|CreateIndex|0|15|0|t_a ON t(a)
+            3|OpenRead|0|0|0|t
+            4|OpenIndex|0|1|0|t_a
+            5|Explain|1|0|7|SCAN t
+            6|Rewind|0|13|0
+            7|Column|0|0|0
+            8|Rowid|0|1|0
+            9|MakeKey|0|2|2|AA
+            10|IdxInsert|0|2|0
+            11|Next|0|7|0
+            ...
+    a UNIQUE index checks every entry with a NOCONFLICT before inserting it
+    */
+
+    const auto& table = db.schema(statement.table_name);
+    auto index = IndexSchema{
+        .name = std::string{statement.index_name},
+        .table = table.name,
+        .columns = {},
+        .unique = statement.unique
+    };
+    for (const auto& column : statement.columns) {
+        if (!table.column_index(column.column_name)) {
+            fail("No such column: '{}'", column.column_name);
+        }
+        index.columns.push_back(IndexColumnSchema{.name = std::string{column.column_name}, .descending = column.order == SortOrder::DESC});
+    }
+
+    constexpr auto cursor = 0;
+    constexpr auto index_cursor = 0;
+    constexpr auto first_key_reg = 0;
+    const auto entry_reg = static_cast<std::int64_t>(index.columns.size()) + 1;
+    const auto row = [&](std::optional<std::size_t> column, std::int64_t target) {
+        return column ? Instruction(Opcode::COLUMN, cursor, static_cast<std::int64_t>(*column), target, {})
+                      : Instruction(Opcode::ROWID, cursor, target, 0, {});
+    };
+
+    program.push_back(Instruction(Opcode::TRANSACTION, 0, 1, 0, {}));
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    const auto create = program.size();
+    program.push_back(Instruction(Opcode::CREATEINDEX, statement.if_not_exists_clause, 0, 0, program.constant(index.definition())));
+    program.push_back(Instruction(Opcode::OPENREAD, cursor, 0, columnar_width(table), program.constant(table.name)));
+    program.push_back(Instruction(Opcode::OPENINDEX, index_cursor, 1, 0, program.constant(index.name)));
+    program.push_back(Instruction(Opcode::EXPLAIN, 1, 0, static_cast<std::int64_t>(program.size()) + 2, program.constant(fmt::format("SCAN {}", table.name))));
+    const auto rewind = program.size();
+    program.push_back(Instruction(Opcode::REWIND, cursor, 0, 0, {}));
+    const auto loop_start = static_cast<std::int64_t>(program.size());
+
+    const auto size = load_index_entry(program, table, index, row, first_key_reg, true);
+    if (index.unique) {
+        auto check = Instruction(Opcode::NOCONFLICT, index_cursor, static_cast<std::int64_t>(program.size()) + 2, first_key_reg, program.constant(sort_orders(index)));
+        check.P5 = static_cast<std::uint16_t>(size - 1);
+        program.push_back(check);
+        program.push_back(Instruction(Opcode::HALT, 1, 0, 0, program.constant(unique_failure(index))));
+    }
+    program.push_back(Instruction(Opcode::MAKEKEY, first_key_reg, size, entry_reg, program.constant(sort_orders(index) + 'A')));
+    program.push_back(Instruction(Opcode::IDXINSERT, index_cursor, entry_reg, 0, {}));
+    program.push_back(Instruction(Opcode::NEXT, cursor, loop_start, 0, {}));
+
+    program[rewind].P2 = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::CLOSEINDEX, index_cursor, 0, 0, {}));
+    program.push_back(Instruction(Opcode::CLOSE, cursor, 0, 0, {}));
+    program[create].P2 = static_cast<std::int64_t>(program.size());
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    return program;
+}
+
+auto generate_bytecode(const ExplainStmt& statement, const Database& db) -> SqlBytecodeProgram {
+    /* like sqlite, EXPLAIN and EXPLAIN QUERY PLAN return rows made of constants:
+            addr|opcode|p1|p2|p3|p4|p5, one per instruction of the statement's program
+            id|parent|detail, one per EXPLAIN instruction
+
+    EXPLAIN ANALYZE runs the statement's program first, with its HALT turned into a jump to the
+    listing and its result rows dropped, then lists its instructions with PROFILEROW:
+            0..n-1  the statement
+            n       ProfileRow|0|0, ResultRow|0|10
+            ...     the same for every instruction up to n-1
+                    Halt
+    */
+    auto explained = generate_bytecode(*statement.statement, db);
+    SqlBytecodeProgram program{};
+
+    if (statement.mode == ExplainMode::ANALYZE) {
+        const auto listing = static_cast<std::int64_t>(explained.size());
+        for (auto& instr : explained) {
+            if (instr.opcode == Opcode::HALT && instr.P1 == 0) {
+                instr = Instruction(Opcode::GOTO, 0, listing, 0, {});
+            } else if (instr.opcode == Opcode::RESULTROW) {
+                instr = Instruction(Opcode::NOOP, 0, 0, 0, {});
+            }
+        }
+        program = std::move(explained);
+        for (auto addr = std::int64_t{0}; addr < listing; ++addr) {
+            program.push_back(Instruction(Opcode::PROFILEROW, addr, 0, 0, {}));
+            program.push_back(Instruction(Opcode::RESULTROW, 0, profile_row_width, 0, {}));
+        }
+        program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+        return program;
+    }
+
+    // the listing has to describe the program the statement would run
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    for (auto addr = std::size_t{0}; addr < explained.size(); ++addr) {
+        const auto& instr = explained[addr];
+        if (statement.mode == ExplainMode::QUERY_PLAN) {
+            if (instr.opcode == Opcode::EXPLAIN) {
+                program.push_back(Instruction(Opcode::INTEGER, instr.P1, 0, 0, {}));
+                program.push_back(Instruction(Opcode::INTEGER, instr.P2, 1, 0, {}));
+                program.push_back(Instruction(Opcode::STRING, 0, 2, 0, program.constant(explained.operand(instr.P4))));
+                program.push_back(Instruction(Opcode::RESULTROW, 0, 3, 0, {}));
+            }
+            continue;
+        }
+        program.push_back(Instruction(Opcode::INTEGER, static_cast<std::int64_t>(addr), 0, 0, {}));
+        program.push_back(Instruction(Opcode::STRING, 0, 1, 0, program.constant(std::string{opcode_name(instr.opcode)})));
+        program.push_back(Instruction(Opcode::INTEGER, instr.P1, 2, 0, {}));
+        program.push_back(Instruction(Opcode::INTEGER, instr.P2, 3, 0, {}));
+        program.push_back(Instruction(Opcode::INTEGER, instr.P3, 4, 0, {}));
+        if (instr.P4 == 0) {
+            program.push_back(Instruction(Opcode::NULL_, 0, 5, 0, {}));
+        } else {
+            const auto& operand = explained.operand(instr.P4);
+            const auto opcode = std::holds_alternative<Blob>(operand) ? Opcode::BLOB : Opcode::STRING;
+            program.push_back(Instruction(opcode, 0, 5, 0, program.constant(operand)));
+        }
+        program.push_back(Instruction(Opcode::INTEGER, instr.P5, 6, 0, {}));
+        program.push_back(Instruction(Opcode::RESULTROW, 0, 7, 0, {}));
+    }
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+
+    return program;
+}
+
+auto generate_bytecode(const AnalyzeStmt& statement, const Database& db) -> SqlBytecodeProgram {
+    SqlBytecodeProgram program{};
+    const auto target = statement.target ? std::string{statement.target->table_name} : std::string{};
+    program.push_back(Instruction(Opcode::TRANSACTION, 0, 1, 0, {}));
+    program.push_back(Instruction(Opcode::VERIFY_COOKIE, db.schema_cookie(), 0, 0, {}));
+    program.push_back(Instruction(Opcode::ANALYZE, 0, 0, 0, program.constant(target)));
+    program.push_back(Instruction(Opcode::COMMIT, 0, 0, 0, {}));
+    program.push_back(Instruction(Opcode::HALT, 0, 0, 0, {}));
+    return program;
+}
+
+auto generate_bytecode(const Statement& statement, const Database& db) -> SqlBytecodeProgram {
+    auto program = std::visit(overloaded{
+        [&](const SelectStmt& stmt) {
+            return generate_bytecode(stmt, db);
         },
-        [](const CreateTableStmt& stmt) {
-            return generate_bytecode(stmt);
+        [&](const CreateTableStmt& stmt) {
+            return generate_bytecode(stmt, db);
         },
-        [](const InsertStmt& stmt) {
-            return generate_bytecode(stmt);
+        [&](const InsertStmt& stmt) {
+            return generate_bytecode(stmt, db);
+        },
+        [&](const CreateIndexStmt& stmt) {
+            return generate_bytecode(stmt, db);
+        },
+        [&](const ExplainStmt& stmt) {
+            return generate_bytecode(stmt, db);
+        },
+        [&](const AnalyzeStmt& stmt) {
+            return generate_bytecode(stmt, db);
         }
     }, statement);
-
+    // an EXPLAIN lists the program of its statement, which is optimized already
+    if (!std::holds_alternative<ExplainStmt>(statement)) {
+        optimize(program);
+    }
+    return program;
 }
@@ -1,33 +1,216 @@
 #pragma once
 
 #include "IR.hpp"
+#include "database.hpp"
+#include "value.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
-enum class Opcode {
+// Register based, operands follow sqlite3's layout: P1-P3 are integers
+// (register indices, cursor numbers, immediate values), P4 carries a string or blob operand.
+enum class Opcode : std::uint8_t {
     NOOP,
-    HALT,
-    VERIFY_COOKIE,
-    TRANSACTION,
-    OPENWRITE,
-    NEWRECNO,
-    INTEGER,
-    MAKERECORD,
-    PUTINTKEY,
-    CLOSE,
-    COMMIT
+    HALT,           // P1 - nonzero to fail with the error message in P4
+    VERIFY_COOKIE,  // P1 - expected schema cookie
+    TRANSACTION,    // P2 - nonzero for a write transaction
+    OPENWRITE,      // P1 - cursor, P3 - the table's column count if it's COLUMNAR, 0 otherwise, P4 - table name
+    NEWRECNO,       // P1 - cursor, P2 - destination register
+    INTEGER,        // P1 - value, P2 - destination register
+    MAKERECORD,     // P1 - first register, P2 - register count, P3 - destination register
+    PUTINTKEY,      // P1 - cursor, P2 - record register, P3 - rowid register
+    CLOSE,          // P1 - cursor
+    COMMIT,
+    CREATETABLE,    // P1 - nonzero for IF NOT EXISTS, P2 - jump target if the table already existed,
+                    // P4 - table definition, see TableSchema::definition
+    OPENREAD,       // P1 - cursor, P2 - nonzero to read the table as the transaction began, without the
+                    // changes the statement makes (see Transaction::initial_snapshot), P3 - as for OPENWRITE,
+                    // P4 - table name
+    REWIND,         // P1 - cursor, P2 - jump target if the table is empty
+    NEXT,           // P1 - cursor, P2 - jump target if the cursor moved to another row
+    COLUMN,         // P1 - cursor, P2 - column index, P3 - destination register
+    ROWID,          // P1 - cursor, P2 - destination register
+    RESULTROW,      // P1 - first register, P2 - register count
+    VARIABLE,       // P1 - parameter number (from 1), P2 - destination register
+    SCAN,           // P1 - cursor, P2 - jump target once the scan is done. A REWIND that hands the
+                    // loop up to the cursor's NEXT to the batch executor when it can run it, see BatchScan
+
+    // expressions, see operators.hpp for the semantics of the operations
+    GOTO,           // P2 - jump target
+    NULL_,          // P2 - destination register
+    REAL,           // P1 - the value's bits, P2 - destination register
+    STRING,         // P2 - destination register, P4 - value
+    ADD,            // P1 - left operand register, P2 - right operand register, P3 - destination register
+    SUBTRACT,       //   same as ADD
+    MULTIPLY,       //   same as ADD
+    DIVIDE,         //   same as ADD
+    REMAINDER,      //   same as ADD
+    CONCAT,         //   same as ADD
+    EQ,             // P1 - left operand register, P2 - right operand register, P3 - destination register
+    NE,             //   set to 1, 0 or NULL
+    LT,             //   same as EQ
+    LE,             //   same as EQ
+    GT,             //   same as EQ
+    GE,             //   same as EQ
+    AND,            // P1 - left operand register, P2 - right operand register, P3 - destination register
+    OR,             //   same as AND
+    NOT,            // P1 - operand register, P2 - destination register
+    NEGATE,         // P1 - operand register, P2 - destination register
+    IFNOT,          // P1 - register, P2 - jump target if the register is false or NULL
+    COPY,           // P1 - source register, P2 - destination register
+    FUNCTION,       // P1 - function id, see find_function, P2 - first argument register,
+                    // P3 - destination register, P4 - function name, P5 - argument count
+
+    // indexes, see IndexBTree for their entries. Index cursors are numbered apart from table cursors.
+    CREATEINDEX,    // P1 - nonzero for IF NOT EXISTS, P2 - jump target if the index already existed,
+                    // P4 - index definition, see IndexSchema::definition
+    OPENINDEX,      // P1 - index cursor, P2 - nonzero for writing, P3 - nonzero to read the index as the
+                    // transaction began, as for OPENREAD, P4 - index name
+    CLOSEINDEX,     // P1 - index cursor
+    MAKEKEY,        // P1 - first register, P2 - register count, P3 - destination register, P4 - the
+                    // registers' sort orders, 'A' or 'D' each, a trailing '+' appends key_prefix_end
+    IDXINSERT,      // P1 - index cursor, P2 - entry register
+    IDXDELETE,      // P1 - index cursor, P2 - entry register
+    NOCONFLICT,     // P1 - index cursor, P2 - jump target if no entry starts with the key of the values,
+                    // P3 - first value register, P4 - sort orders as for MAKEKEY, P5 - value count.
+                    // Values with a NULL never conflict, otherwise the cursor is left on the conflicting entry
+    IDXSEEK,        // P1 - index cursor, P2 - jump target if no entry is >= the key, P3 - key register
+    IDXGE,          // P1 - index cursor, P2 - jump target if the entry is >= the key, P3 - key register
+    IDXNEXT,        // P1 - index cursor, P2 - jump target if the cursor moved to another entry
+    IDXROWID,       // P1 - index cursor, P2 - destination register
+    SEEKROWID,      // P1 - cursor, P2 - jump target if there's no such row, P3 - rowid register
+    DELETE,         // P1 - cursor, deletes the row it is on
+
+    // hash joins, see HashJoin. They're numbered apart from the cursors too, and pair the probe row
+    // in the registers from P2 of their HASHOPEN on with the build row in the registers after it
+    HASHOPEN,       // P1 - hash join, P2 - first register of the probe row, P3 - first register of the
+                    // build row, P5 - build row width
+    HASHINSERT,     // P1 - hash join, P2 - first key register, P5 - key width, adds the build row
+    HASHPROBE,      // P1 - hash join, P2 - jump target if no build row matches (yet), P3 - first key
+                    // register, P5 - key width, loads the first matching build row
+    HASHNEXT,       // P1 - hash join, P2 - jump target if the join moved to another pair, which it
+                    // loads, P3 - jump target once the join is drained
+    HASHDRAIN,      // P1 - hash join, P2 - jump target if a spilled probe row has a match, loads the pair
+
+    // hash aggregations for GROUP BY and DISTINCT, see HashAggregate, numbered apart from the rest too
+    AGGOPEN,        // P1 - aggregation, P2 - key width, P3 - carried width, P4 - the aggregate functions, an
+                    // AggregateFunction each, P5 - nonzero to hand back the rows starting a group
+    AGGSTEP,        // P1 - aggregation, P2 - jump target, unless the row is one to hand back, P3 - first
+                    // register of the row, P5 - row width, adds the row to its group
+    AGGNEXT,        // P1 - aggregation, P2 - jump target once there's no group left, P3 - first destination
+                    // register, P5 - result width, loads the next group
+
+    // sorts for ORDER BY, see Sorter, numbered apart from the rest as well
+    SORTOPEN,       // P1 - sorter, P2 - row width, P3 - the registers of the LIMIT and then the OFFSET, used if
+                    // P5 is nonzero. A negative LIMIT is none, a negative OFFSET 0
+    SORTINSERT,     // P1 - sorter, P2 - key register, see MAKEKEY, P3 - first register of the row, P5 - row width
+    SORTNEXT,       // P1 - sorter, P2 - jump target once there's no row left, P3 - first destination register,
+                    // P5 - row width, loads the next row in order
+    // the counters of LIMIT and OFFSET
+    MUSTBEINT,      // P1 - register, fails unless it holds an INTEGER or a REAL with an integer value, which
+                    // it becomes
+    IFPOS,          // P1 - register, P2 - jump target if it's positive, P3 - what it's decremented by then
+    DECRJUMPZERO,   // P1 - register, decremented, P2 - jump target if it's 0 then
+
+    // co-routines, a SELECT run a row at a time by the code reading its rows, as in sqlite. The
+    // register P1 of all three holds where the side that isn't running stopped, the two sides hand
+    // control back and forth with YIELD.
+    INITCOROUTINE,  // P1 - register, P2 - jump target, past the co-routine's code, P3 - the co-routine's
+                    // first instruction, where the first YIELD to it goes
+    YIELD,          // P1 - register, P2 - jump target once the co-routine is done, P3 - jump target once it
+                    // yields a row, 0 for the next instruction. The co-routine's own YIELDs have neither
+    ENDCOROUTINE,   // P1 - register, ends the co-routine, jumping to the P2 of the YIELD that ran it
+    // temporary tables, private to the execution and dropped once it ends
+    OPENEPHEMERAL,  // P1 - cursor, P2 - temporary table, created empty when it's first opened, P4 - the
+                    // name the statement reads it by
+    ANALYZE,        // P4 - the table or index whose table to gather statistics on, every table if it's
+                    // empty, see Database::analyze
+
+    // STRICT and COLUMNAR tables
+    TYPECHECK,      // P1 - register, converted to the column's type, failing if it can't be, P2 - the type, a
+                    // ColumnType, P4 - the column, "table.column"
+    ZONEFILTER,     // P1 - cursor, P2 - column, P3 - value register, P5 - a ZoneComparison. Has the cursor on a
+                    // COLUMNAR table skip the segments no row of which holds "column op value" for, see ColumnarCursor
+
+    // EXPLAIN, see ExplainMode
+    EXPLAIN,        // P1 - plan step, P2 - the step it is part of (0 for none), P3 - the instruction running
+                    // once per row the step produces, P4 - what the step does. A no-op, the EXPLAINs of a
+                    // program are its query plan
+    PROFILEROW,     // P1 - instruction, P2 - first of profile_row_width destination registers, loads the
+                    // instruction's EXPLAIN ANALYZE row. The VM profiles programs with a PROFILEROW
+
+    BLOB            // P2 - destination register, P4 - value. The optimizer folds MAKERECORDs of constants into these
 };
+inline constexpr auto opcode_count = static_cast<std::size_t>(Opcode::BLOB) + 1;
 
+// addr, opcode, P1, P2, P3, P4, P5, executions, cycles and, for an EXPLAIN, the rows of its step
+inline constexpr std::int64_t profile_row_width = 10;
+
+// as in sqlite's EXPLAIN output, e.g. "OpenRead"
+[[nodiscard]] auto opcode_name(Opcode opcode) -> std::string_view;
+
+// Two to a cache line: the string and blob operands live in the program's constant pool, P4 is
+// their index there.
 struct Instruction {
-    Opcode opcode;
-    std::int64_t P1;
-    std::uint64_t P2;
-    std::string P3;
+    Instruction() = default;
+    Instruction(Opcode opcode, std::int64_t P1, std::int64_t P2, std::int64_t P3, std::uint32_t P4 = 0, std::uint16_t P5 = 0)
+        : opcode(opcode), P5(P5), P4(P4), P1(P1), P2(P2), P3(P3) {}
+
+    Opcode opcode = Opcode::NOOP;
+    std::uint16_t P5 = 0;
+    std::uint32_t P4 = 0;
+    std::int64_t P1 = 0;
+    std::int64_t P2 = 0;
+    std::int64_t P3 = 0;
 };
+static_assert(sizeof(Instruction) == 32);
+
+// The instructions of a program, used like a vector of them, and the constants their P4s refer to.
+class SqlBytecodeProgram {
+public:
+    SqlBytecodeProgram() : constants{Value{std::string{}}}, strings{{std::string{}, 0}} {}
 
-using SqlBytecodeProgram = std::vector<Instruction>;
+    // the P4 of value, equal strings share an entry. 0 is the empty string, the P4 of the
+    // instructions that have none
+    [[nodiscard]] auto constant(Value value) -> std::uint32_t;
+    [[nodiscard]] auto operand(std::uint32_t P4) const -> const Value& { return constants[P4]; }
+    // the P4 of an instruction whose operand is TEXT, a name or a definition
+    [[nodiscard]] auto text(std::uint32_t P4) const -> const std::string& { return std::get<std::string>(constants[P4]); }
+
+    // appends the instructions of other, with their P4s moved over to this pool. Jump targets are
+    // left as they are, they have to be relocated by the caller
+    auto append(const SqlBytecodeProgram& other) -> void;
+
+    auto push_back(const Instruction& instr) -> void { code.push_back(instr); }
+    [[nodiscard]] auto size() const -> std::size_t { return code.size(); }
+    [[nodiscard]] auto empty() const -> bool { return code.empty(); }
+    [[nodiscard]] auto data() const -> const Instruction* { return code.data(); }
+    [[nodiscard]] auto operator[](std::size_t address) -> Instruction& { return code[address]; }
+    [[nodiscard]] auto operator[](std::size_t address) const -> const Instruction& { return code[address]; }
+    [[nodiscard]] auto front() -> Instruction& { return code.front(); }
+    [[nodiscard]] auto back() const -> const Instruction& { return code.back(); }
+    [[nodiscard]] auto begin() { return code.begin(); }
+    [[nodiscard]] auto end() { return code.end(); }
+    [[nodiscard]] auto begin() const { return code.begin(); }
+    [[nodiscard]] auto end() const { return code.end(); }
+    // for rewriting the program as a whole, see optimize
+    [[nodiscard]] auto instructions() -> std::vector<Instruction>& { return code; }
+
+private:
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::unordered_map<std::string, std::uint32_t> strings;
+};
 
-inline auto generate_bytecode(const Statement& statement) -> SqlBytecodeProgram;
-inline auto generate_bytecode(const SelectStmt& statement) -> SqlBytecodeProgram;
-inline auto generate_bytecode(const CreateTableStmt& statement) -> SqlBytecodeProgram;
-inline auto generate_bytecode(const InsertStmt& statement) -> SqlBytecodeProgram;
+// the program is compiled against db's current schema, VERIFY_COOKIE checks it's still the same one
+auto generate_bytecode(const Statement& statement, const Database& db) -> SqlBytecodeProgram;
+auto generate_bytecode(const SelectStmt& statement, const Database& db) -> SqlBytecodeProgram;
+auto generate_bytecode(const CreateTableStmt& statement, const Database& db) -> SqlBytecodeProgram;
+auto generate_bytecode(const InsertStmt& statement, const Database& db) -> SqlBytecodeProgram;
+auto generate_bytecode(const CreateIndexStmt& statement, const Database& db) -> SqlBytecodeProgram;
+auto generate_bytecode(const ExplainStmt& statement, const Database& db) -> SqlBytecodeProgram;
+auto generate_bytecode(const AnalyzeStmt& statement, const Database& db) -> SqlBytecodeProgram;
@@ -0,0 +1,118 @@
+#include "catalog.hpp"
+#include "common.hpp"
+#include <fmt/ranges.h>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <utility>
+
+auto strict_column_type(std::string_view type) -> std::optional<ColumnType> {
+    constexpr auto types = std::to_array<std::pair<std::string_view, ColumnType>>({
+        {"INT", ColumnType::INTEGER},
+        {"INTEGER", ColumnType::INTEGER},
+        {"REAL", ColumnType::REAL},
+        {"TEXT", ColumnType::TEXT},
+        {"BLOB", ColumnType::BLOB},
+        {"ANY", ColumnType::ANY}
+    });
+    for (const auto& [name, column_type] : types) {
+        if (std::ranges::equal(name, type, [](char a, char b) { return a == std::toupper(static_cast<unsigned char>(b)); })) {
+            return column_type;
+        }
+    }
+    return std::nullopt;
+}
+
+auto TableSchema::column_index(std::string_view column) const -> std::optional<std::size_t> {
+    for (auto i = std::size_t{0}; i < columns.size(); ++i) {
+        if (columns[i].name == column) return i;
+    }
+    return std::nullopt;
+}
+
+auto TableSchema::definition() const -> std::string {
+    auto column_strs = std::vector<std::string>{};
+    column_strs.reserve(columns.size());
+    for (const auto& column : columns) {
+        column_strs.push_back(column.type ? fmt::format("{} {}", column.name, *column.type) : column.name);
+    }
+    return fmt::format("{}({}){}{}", name, fmt::join(column_strs, ", "), strict ? " STRICT" : "", columnar ? ", COLUMNAR" : "");
+}
+
+auto TableSchema::from_definition(std::string_view definition) -> TableSchema {
+    const auto open = definition.find('(');
+    const auto close = definition.rfind(')');
+    if (open == std::string_view::npos || close == std::string_view::npos || close < open) {
+        fail("Malformed table definition '{}'", definition);
+    }
+
+    auto schema = TableSchema{.name = std::string{definition.substr(0, open)}, .columns = {}};
+    const auto options = definition.substr(close + 1);
+    if (options == " STRICT" || options == " STRICT, COLUMNAR") {
+        schema.strict = true;
+        schema.columnar = options.ends_with("COLUMNAR");
+    } else if (!options.empty()) {
+        fail("Malformed table definition '{}'", definition);
+    }
+    auto rest = definition.substr(open + 1, close - open - 1);
+    while (!rest.empty()) {
+        const auto comma = rest.find(", ");
+        const auto column = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 2);
+
+        const auto space = column.find(' ');
+        if (space == std::string_view::npos) {
+            schema.columns.push_back(ColumnSchema{.name = std::string{column}, .type = std::nullopt});
+        } else {
+            schema.columns.push_back(ColumnSchema{
+                .name = std::string{column.substr(0, space)},
+                .type = std::string{column.substr(space + 1)}
+            });
+        }
+    }
+    return schema;
+}
+
+auto IndexSchema::definition() const -> std::string {
+    auto column_strs = std::vector<std::string>{};
+    column_strs.reserve(columns.size());
+    for (const auto& column : columns) {
+        column_strs.push_back(column.descending ? fmt::format("{} DESC", column.name) : column.name);
+    }
+    return fmt::format("{}{} ON {}({})", unique ? "UNIQUE " : "", name, table, fmt::join(column_strs, ", "));
+}
+
+auto IndexSchema::from_definition(std::string_view definition) -> IndexSchema {
+    constexpr auto unique_prefix = std::string_view{"UNIQUE "};
+    constexpr auto on = std::string_view{" ON "};
+
+    auto schema = IndexSchema{};
+    if (definition.starts_with(unique_prefix)) {
+        schema.unique = true;
+        definition.remove_prefix(unique_prefix.size());
+    }
+    const auto on_at = definition.find(on);
+    const auto open = definition.find('(');
+    if (on_at == std::string_view::npos || open == std::string_view::npos || open < on_at || definition.back() != ')') {
+        fail("Malformed index definition '{}'", definition);
+    }
+    schema.name = definition.substr(0, on_at);
+    schema.table = definition.substr(on_at + on.size(), open - on_at - on.size());
+
+    auto rest = definition.substr(open + 1, definition.size() - open - 2);
+    while (!rest.empty()) {
+        const auto comma = rest.find(", ");
+        const auto column = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 2);
+
+        const auto space = column.find(' ');
+        schema.columns.push_back(IndexColumnSchema{
+            .name = std::string{column.substr(0, space)},
+            .descending = space != std::string_view::npos
+        });
+    }
+    if (schema.columns.empty()) {
+        fail("Malformed index definition '{}'", definition);
+    }
+    return schema;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "operators.hpp"
+#include "pager.hpp"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ColumnSchema {
+    std::string name;
+    std::optional<std::string> type;
+};
+
+struct IndexColumnSchema {
+    std::string name;
+    bool descending = false;
+};
+
+struct IndexSchema {
+    std::string name;
+    std::string table;
+    std::vector<IndexColumnSchema> columns;
+    bool unique = false;
+    PageId root = 0;
+
+    // "[UNIQUE ]name ON table(column, column DESC, ...)", the form stored in the schema table and
+    // in CREATEINDEX's P4
+    [[nodiscard]] auto definition() const -> std::string;
+    [[nodiscard]] static auto from_definition(std::string_view definition) -> IndexSchema;
+};
+
+// the type of a STRICT table's column, nullopt for a type name it can't have
+[[nodiscard]] auto strict_column_type(std::string_view type) -> std::optional<ColumnType>;
+
+struct TableSchema {
+    std::string name;
+    std::vector<ColumnSchema> columns;
+    PageId root = 0;
+    // in the order they were created
+    std::vector<IndexSchema> indexes{};
+    // every column has a type, see strict_column_type, which its values are converted to
+    bool strict = false;
+    // the rows are stored in compressed column segments, see ColumnarCursor. Only STRICT tables are
+    bool columnar = false;
+
+    [[nodiscard]] auto column_index(std::string_view column) const -> std::optional<std::size_t>;
+
+    // "name(column type, column, ...)" followed by " STRICT" or " STRICT, COLUMNAR", the form
+    // stored in the schema table and in CREATETABLE's P4
+    [[nodiscard]] auto definition() const -> std::string;
+    [[nodiscard]] static auto from_definition(std::string_view definition) -> TableSchema;
+};
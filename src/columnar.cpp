@@ -0,0 +1,678 @@
+#include "columnar.hpp"
+#include "common.hpp"
+#include "operators.hpp"
+#include "record.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+
+namespace {
+
+constexpr auto segment_tag = std::uint8_t{0};
+constexpr auto null_bitmap_flag = std::uint8_t{1};
+// a TEXT or BLOB longer than this gets no zone map, which would crowd out the cell
+constexpr auto max_zone_value_size = std::size_t{64};
+
+auto null_value() -> const Value& {
+    static const auto null = Value{};
+    return null;
+}
+
+// the order of a dictionary, which tells every value apart: REALs by their bits, 1 from 1.0
+struct ExactOrder {
+    auto operator()(const Value& lhs, const Value& rhs) const -> bool {
+        const auto* a = std::get_if<double>(&lhs);
+        const auto* b = std::get_if<double>(&rhs);
+        if (a && b) {
+            return std::bit_cast<std::uint64_t>(*a) < std::bit_cast<std::uint64_t>(*b);
+        }
+        return lhs < rhs;
+    }
+};
+
+auto same(const Value& lhs, const Value& rhs) -> bool {
+    return !ExactOrder{}(lhs, rhs) && !ExactOrder{}(rhs, lhs);
+}
+
+auto append_varint(Blob& out, std::uint64_t value) -> void {
+    auto bytes = std::array<std::uint8_t, max_varint_size>{};
+    const auto size = put_varint(bytes.data(), value);
+    out.insert(out.end(), bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(size));
+}
+
+// a record, prefixed by its size
+auto append_record(Blob& out, std::span<const Value> values) -> void {
+    const auto record = encode_record(values);
+    append_varint(out, record.size());
+    out.insert(out.end(), record.begin(), record.end());
+}
+
+// Reads the parts of a chunk or a cell in order, failing on any that runs past its end.
+class Reader {
+public:
+    explicit Reader(std::span<const std::uint8_t> bytes) : bytes(bytes) {}
+
+    auto byte() -> std::uint8_t { return take(1).front(); }
+    auto varint() -> std::uint64_t {
+        auto value = std::uint64_t{};
+        const auto size = get_varint(bytes.subspan(position), value);
+        if (size == 0) {
+            fail("Malformed segment");
+        }
+        position += size;
+        return value;
+    }
+    auto take(std::size_t size) -> std::span<const std::uint8_t> {
+        if (size > bytes.size() - position) {
+            fail("Malformed segment");
+        }
+        position += size;
+        return bytes.subspan(position - size, size);
+    }
+    auto record() -> std::vector<Value> { return decode_record(take(varint())); }
+    [[nodiscard]] auto offset() const -> std::size_t { return position; }
+
+private:
+    std::span<const std::uint8_t> bytes;
+    std::size_t position = 0;
+};
+
+// width bits per value, the first value in the low bits of the first byte
+auto pack(std::span<const std::uint64_t> values, int width, Blob& out) -> void {
+    const auto start = out.size();
+    out.resize(start + (values.size() * static_cast<std::size_t>(width) + 7) / 8);
+    auto bit = std::size_t{0};
+    for (auto value : values) {
+        for (auto remaining = width; remaining > 0;) {
+            const auto shift = static_cast<int>(bit % 8);
+            const auto taken = std::min(8 - shift, remaining);
+            out[start + bit / 8] |= static_cast<std::uint8_t>((value & ((1u << taken) - 1)) << shift);
+            value >>= taken;
+            bit += static_cast<std::size_t>(taken);
+            remaining -= taken;
+        }
+    }
+}
+
+auto unpack(Reader& reader, std::size_t count, int width) -> std::vector<std::uint64_t> {
+    if (width > 64) {
+        fail("Malformed segment");
+    }
+    const auto bytes = reader.take((count * static_cast<std::size_t>(width) + 7) / 8);
+    auto values = std::vector<std::uint64_t>(count);
+    auto bit = std::size_t{0};
+    for (auto& value : values) {
+        for (auto filled = 0; filled < width;) {
+            const auto shift = static_cast<int>(bit % 8);
+            const auto taken = std::min(8 - shift, width - filled);
+            value |= static_cast<std::uint64_t>((bytes[bit / 8] >> shift) & ((1u << taken) - 1)) << filled;
+            bit += static_cast<std::size_t>(taken);
+            filled += taken;
+        }
+    }
+    return values;
+}
+
+auto encode_values(std::span<const Value> values, SegmentEncoding encoding) -> Blob {
+    auto out = Blob{static_cast<std::uint8_t>(encoding)};
+    switch (encoding) {
+        case SegmentEncoding::PLAIN:
+            append_record(out, values);
+            break;
+        case SegmentEncoding::DICTIONARY: {
+            auto codes = std::map<Value, std::uint64_t, ExactOrder>{};
+            auto dictionary = std::vector<Value>{};
+            auto indexes = std::vector<std::uint64_t>{};
+            for (const auto& value : values) {
+                const auto [it, added] = codes.try_emplace(value, dictionary.size());
+                if (added) {
+                    dictionary.push_back(value);
+                }
+                indexes.push_back(it->second);
+            }
+            const auto width = static_cast<int>(std::bit_width(std::max(dictionary.size(), std::size_t{1}) - 1));
+            append_record(out, dictionary);
+            out.push_back(static_cast<std::uint8_t>(width));
+            pack(indexes, width, out);
+            break;
+        }
+        case SegmentEncoding::RUN_LENGTH: {
+            auto runs = std::vector<Value>{};
+            auto lengths = std::vector<std::uint64_t>{};
+            for (const auto& value : values) {
+                if (!runs.empty() && same(runs.back(), value)) {
+                    ++lengths.back();
+                } else {
+                    runs.push_back(value);
+                    lengths.push_back(1);
+                }
+            }
+            append_record(out, runs);
+            for (const auto length : lengths) {
+                append_varint(out, length);
+            }
+            break;
+        }
+        case SegmentEncoding::FRAME_OF_REFERENCE: {
+            auto reference = std::numeric_limits<std::int64_t>::max();
+            for (const auto& value : values) {
+                reference = std::min(reference, std::get<std::int64_t>(value));
+            }
+            auto offsets = std::vector<std::uint64_t>{};
+            auto largest = std::uint64_t{0};
+            for (const auto& value : values) {
+                // wraps around for the widest ranges, which the unsigned offsets hold all the same
+                offsets.push_back(static_cast<std::uint64_t>(std::get<std::int64_t>(value)) - static_cast<std::uint64_t>(reference));
+                largest = std::max(largest, offsets.back());
+            }
+            const auto bits = std::bit_cast<std::array<std::uint8_t, 8>>(reference);
+            out.insert(out.end(), bits.begin(), bits.end());
+            const auto width = static_cast<int>(std::bit_width(largest));
+            out.push_back(static_cast<std::uint8_t>(width));
+            pack(offsets, width, out);
+            break;
+        }
+    }
+    return out;
+}
+
+auto decode_values(Reader& reader, std::size_t count) -> std::vector<Value> {
+    auto values = std::vector<Value>{};
+    switch (static_cast<SegmentEncoding>(reader.byte())) {
+        case SegmentEncoding::PLAIN:
+            values = reader.record();
+            break;
+        case SegmentEncoding::DICTIONARY: {
+            const auto dictionary = reader.record();
+            const auto width = reader.byte();
+            for (const auto index : unpack(reader, count, width)) {
+                if (index >= dictionary.size()) {
+                    fail("Malformed segment");
+                }
+                values.push_back(dictionary[index]);
+            }
+            break;
+        }
+        case SegmentEncoding::RUN_LENGTH:
+            for (const auto& run : reader.record()) {
+                const auto length = reader.varint();
+                if (length > count - values.size()) {
+                    fail("Malformed segment");
+                }
+                values.insert(values.end(), length, run);
+            }
+            break;
+        case SegmentEncoding::FRAME_OF_REFERENCE: {
+            auto bits = std::array<std::uint8_t, 8>{};
+            std::ranges::copy(reader.take(bits.size()), bits.begin());
+            const auto reference = static_cast<std::uint64_t>(std::bit_cast<std::int64_t>(bits));
+            const auto width = reader.byte();
+            for (const auto offset : unpack(reader, count, width)) {
+                values.push_back(static_cast<std::int64_t>(reference + offset));
+            }
+            break;
+        }
+        default:
+            fail("Malformed segment");
+    }
+    if (values.size() != count) {
+        fail("Malformed segment");
+    }
+    return values;
+}
+
+// the column's chunk, its values in the smallest encoding
+auto encode_chunk(std::span<const Value> column) -> Blob {
+    auto values = std::vector<Value>{};
+    auto bitmap = Blob((column.size() + 7) / 8);
+    for (auto row = std::size_t{0}; row < column.size(); ++row) {
+        if (std::holds_alternative<Null>(column[row])) {
+            bitmap[row / 8] |= static_cast<std::uint8_t>(1u << (row % 8));
+        } else {
+            values.push_back(column[row]);
+        }
+    }
+
+    auto best = encode_values(values, SegmentEncoding::PLAIN);
+    const auto integers = std::ranges::all_of(values, [](const Value& value) { return std::holds_alternative<std::int64_t>(value); });
+    for (const auto encoding : {SegmentEncoding::DICTIONARY, SegmentEncoding::RUN_LENGTH, SegmentEncoding::FRAME_OF_REFERENCE}) {
+        if (encoding == SegmentEncoding::FRAME_OF_REFERENCE && (!integers || values.empty())) {
+            continue;
+        }
+        if (auto encoded = encode_values(values, encoding); encoded.size() < best.size()) {
+            best = std::move(encoded);
+        }
+    }
+
+    const auto has_nulls = values.size() < column.size();
+    auto chunk = Blob{has_nulls ? null_bitmap_flag : std::uint8_t{0}};
+    if (has_nulls) {
+        chunk.insert(chunk.end(), bitmap.begin(), bitmap.end());
+    }
+    chunk.insert(chunk.end(), best.begin(), best.end());
+    return chunk;
+}
+
+auto decode_chunk(std::span<const std::uint8_t> bytes, std::size_t rows) -> std::vector<Value> {
+    auto reader = Reader{bytes};
+    const auto flags = reader.byte();
+    auto bitmap = std::span<const std::uint8_t>{};
+    auto count = rows;
+    if (flags & null_bitmap_flag) {
+        bitmap = reader.take((rows + 7) / 8);
+        for (auto row = std::size_t{0}; row < rows; ++row) {
+            count -= (bitmap[row / 8] >> (row % 8)) & 1u;
+        }
+    }
+    auto values = decode_values(reader, count);
+    if (bitmap.empty()) {
+        return values;
+    }
+    auto column = std::vector<Value>(rows);
+    auto value = values.begin();
+    for (auto row = std::size_t{0}; row < rows; ++row) {
+        if (((bitmap[row / 8] >> (row % 8)) & 1u) == 0) {
+            column[row] = std::move(*value++);
+        }
+    }
+    return column;
+}
+
+// the min and max of the column's values, NULL for both if they all are NULL, nullopt if a value
+// is too large to keep in a cell
+auto zone_map(std::span<const Value> column) -> std::optional<std::pair<Value, Value>> {
+    auto zone = std::pair<Value, Value>{};
+    for (const auto& value : column) {
+        if (std::holds_alternative<Null>(value)) {
+            continue;
+        }
+        const auto* text = std::get_if<std::string>(&value);
+        const auto* blob = std::get_if<Blob>(&value);
+        const auto* real = std::get_if<double>(&value);
+        if ((text && text->size() > max_zone_value_size) || (blob && blob->size() > max_zone_value_size) || (real && std::isnan(*real))) {
+            return std::nullopt;
+        }
+        if (std::holds_alternative<Null>(zone.first)) {
+            zone = {value, value};
+        } else if (*compare(value, zone.first) < 0) {
+            zone.first = value;
+        } else if (*compare(value, zone.second) > 0) {
+            zone.second = value;
+        }
+    }
+    return zone;
+}
+
+auto segment_cell(std::size_t rows, PageId first_page, std::span<const Blob> chunks,
+                  std::span<const std::optional<std::pair<Value, Value>>> zones) -> Blob {
+    auto cell = Blob{segment_tag};
+    append_varint(cell, rows);
+    append_varint(cell, first_page);
+    append_varint(cell, chunks.size());
+    auto bounds = std::vector<Value>{};
+    for (auto column = std::size_t{0}; column < chunks.size(); ++column) {
+        append_varint(cell, chunks[column].size());
+        cell.push_back(zones[column] ? 1 : 0);
+        if (zones[column]) {
+            bounds.push_back(zones[column]->first);
+            bounds.push_back(zones[column]->second);
+        }
+    }
+    append_record(cell, bounds);
+    return cell;
+}
+
+// Writes the rows, from first_rowid on, as a segment. False if its cell doesn't fit into the
+// tree even without zone maps, for a table of too many columns.
+auto write_segment(BTree& tree, std::int64_t first_rowid, std::size_t rows, std::span<const std::vector<Value>> columns) -> bool {
+    auto chunks = std::vector<Blob>{};
+    auto zones = std::vector<std::optional<std::pair<Value, Value>>>{};
+    auto size = std::size_t{0};
+    for (const auto& column : columns) {
+        chunks.push_back(encode_chunk(column));
+        zones.push_back(zone_map(column));
+        size += chunks.back().size();
+    }
+
+    auto cell = segment_cell(rows, 0, chunks, zones);
+    if (cell.size() + size <= BTree::max_payload_size) {
+        for (const auto& chunk : chunks) {
+            cell.insert(cell.end(), chunk.begin(), chunk.end());
+        }
+        tree.insert(first_rowid + static_cast<std::int64_t>(rows) - 1, cell);
+        return true;
+    }
+
+    // page numbers take a varint of up to 5 bytes
+    auto& pager = tree.pages();
+    const auto first_page = pager.page_count();
+    cell = segment_cell(rows, first_page, chunks, zones);
+    if (cell.size() > BTree::max_payload_size) {
+        std::ranges::fill(zones, std::nullopt);
+        cell = segment_cell(rows, first_page, chunks, zones);
+        if (cell.size() > BTree::max_payload_size) {
+            return false;
+        }
+    }
+    // the writer allocates pages one after the other, from the end of the file
+    auto data = Blob{};
+    for (const auto& chunk : chunks) {
+        data.insert(data.end(), chunk.begin(), chunk.end());
+    }
+    for (auto offset = std::size_t{0}; offset < data.size(); offset += page_size) {
+        const auto id = pager.allocate();
+        if (id != first_page + offset / page_size) {
+            fail("Cannot allocate consecutive pages for a segment");
+        }
+        const auto count = std::min(page_size, data.size() - offset);
+        std::memcpy(pager.write(id).data.data(), data.data() + offset, count);
+    }
+    tree.insert(first_rowid + static_cast<std::int64_t>(rows) - 1, cell);
+    return true;
+}
+
+auto may_match(const std::pair<Value, Value>& zone, const ZoneFilter& filter) -> bool {
+    // a comparison with NULL never holds
+    if (std::holds_alternative<Null>(zone.first) || std::holds_alternative<Null>(filter.value)) {
+        return false;
+    }
+    const auto low = *compare(zone.first, filter.value);
+    const auto high = *compare(zone.second, filter.value);
+    switch (filter.comparison) {
+        case ZoneComparison::EQUAL: return low <= 0 && high >= 0;
+        case ZoneComparison::LESS: return low < 0;
+        case ZoneComparison::LESS_EQUAL: return low <= 0;
+        case ZoneComparison::GREATER: return high > 0;
+        case ZoneComparison::GREATER_EQUAL: return high >= 0;
+    }
+    return true;
+}
+
+} // namespace
+
+auto is_segment(std::span<const std::uint8_t> payload) -> bool {
+    return !payload.empty() && payload.front() == segment_tag;
+}
+
+// ===================================
+// Segment
+// ===================================
+Segment::Segment(std::span<const std::uint8_t> payload, std::int64_t key, std::size_t column_count) {
+    auto reader = Reader{payload};
+    reader.byte();
+    row_count = reader.varint();
+    first_page = static_cast<PageId>(reader.varint());
+    const auto columns_stored = reader.varint();
+    if (row_count == 0 || row_count > segment_rows || columns_stored > column_count) {
+        fail("Malformed segment");
+    }
+    first = key - static_cast<std::int64_t>(row_count) + 1;
+    offsets.push_back(0);
+    auto zoned = std::vector<bool>{};
+    for (auto column = std::size_t{0}; column < columns_stored; ++column) {
+        offsets.push_back(offsets.back() + reader.varint());
+        zoned.push_back(reader.byte() != 0);
+    }
+    const auto bounds = reader.record();
+    auto bound = bounds.begin();
+    for (const auto has_zone : zoned) {
+        if (!has_zone) {
+            zones.emplace_back();
+            continue;
+        }
+        if (bounds.end() - bound < 2) {
+            fail("Malformed segment");
+        }
+        zones.emplace_back(std::pair{bound[0], bound[1]});
+        bound += 2;
+    }
+    data_start = reader.offset();
+    if (first_page == 0 && data_start + offsets.back() > payload.size()) {
+        fail("Malformed segment");
+    }
+}
+
+auto Segment::passes(std::span<const ZoneFilter> filters) const -> bool {
+    return std::ranges::all_of(filters, [&](const ZoneFilter& filter) {
+        if (filter.column >= zones.size()) {
+            return true;
+        }
+        const auto& zone = zones[filter.column];
+        return !zone || may_match(*zone, filter);
+    });
+}
+
+auto Segment::column(std::span<const std::uint8_t> payload, const BTree& tree, const Snapshot* snapshot,
+                     std::size_t n) -> std::vector<Value> {
+    // the columns added after the segment was written are NULL in it
+    if (n + 1 >= offsets.size()) {
+        return std::vector<Value>(row_count);
+    }
+    const auto start = offsets[n];
+    const auto size = offsets[n + 1] - start;
+    if (first_page == 0) {
+        return decode_chunk(payload.subspan(data_start + start, size), row_count);
+    }
+    // the chunk may span pages
+    auto& pager = tree.pages();
+    chunk.resize(size);
+    for (auto copied = std::size_t{0}; copied < size;) {
+        const auto offset = start + copied;
+        const auto page = pager.read(first_page + static_cast<PageId>(offset / page_size), snapshot);
+        const auto count = std::min(size - copied, page_size - offset % page_size);
+        std::memcpy(chunk.data() + copied, page.page().data.data() + offset % page_size, count);
+        copied += count;
+    }
+    return decode_chunk(chunk, row_count);
+}
+
+ColumnarCursor::ColumnarCursor(std::size_t column_count)
+    : column_count(column_count), columns(column_count), decoded(column_count), rows(column_count) {}
+
+auto ColumnarCursor::first(BTreeCursor& cursor) -> bool {
+    flush(cursor);
+    return settle(cursor, cursor.first());
+}
+
+auto ColumnarCursor::next(BTreeCursor& cursor) -> bool {
+    if (segment && position + 1 < segment->rows()) {
+        ++position;
+        return true;
+    }
+    return settle(cursor, cursor.next());
+}
+
+auto ColumnarCursor::seek(BTreeCursor& cursor, std::int64_t rowid) -> bool {
+    flush(cursor);
+    if (!cursor.seek(rowid)) {
+        segment.reset();
+        return false;
+    }
+    if (!is_segment(cursor.payload())) {
+        segment.reset();
+        return cursor.rowid() == rowid;
+    }
+    enter(cursor);
+    if (rowid < segment->first_rowid()) {
+        return false;
+    }
+    position = static_cast<std::size_t>(rowid - segment->first_rowid());
+    return true;
+}
+
+auto ColumnarCursor::rowid(const BTreeCursor& cursor) const -> std::int64_t {
+    return segment ? segment->first_rowid() + static_cast<std::int64_t>(position) : cursor.rowid();
+}
+
+auto ColumnarCursor::column(const BTreeCursor& cursor, std::size_t n) -> const Value& {
+    if (n >= column_count) {
+        return null_value();
+    }
+    if (!decoded[n]) {
+        columns[n] = segment->column(cursor.payload(), cursor.btree(), cursor.view(), n);
+        decoded[n] = true;
+    }
+    return columns[n][position];
+}
+
+auto ColumnarCursor::max_rowid(BTreeCursor& cursor) -> std::int64_t {
+    return writing && row_count > 0 ? rows_first + static_cast<std::int64_t>(row_count) - 1 : cursor.btree().max_rowid();
+}
+
+auto ColumnarCursor::insert(BTreeCursor& cursor, std::int64_t rowid, std::span<const std::uint8_t> record) -> void {
+    if (!writing) {
+        load_tail(cursor);
+    }
+    if (rowid != rows_first + static_cast<std::int64_t>(row_count)) {
+        // not the next row, it goes in on its own, in place of the row with the rowid if there's one
+        if (seek(cursor, rowid) && segment) {
+            erase(cursor);
+        }
+        cursor.insert(rowid, record);
+        return;
+    }
+    auto view = RecordView{record};
+    for (auto column = std::size_t{0}; column < column_count; ++column) {
+        rows[column].push_back(to_value(view.column(column)));
+    }
+    if (++row_count == segment_rows) {
+        write_rows(cursor);
+    }
+}
+
+auto ColumnarCursor::erase(BTreeCursor& cursor) -> void {
+    if (!segment) {
+        cursor.erase();
+        return;
+    }
+    for (auto column = std::size_t{0}; column < column_count; ++column) {
+        this->column(cursor, column);
+    }
+    const auto first_rowid = segment->first_rowid();
+    const auto count = segment->rows();
+    const auto erased = position;
+    auto values = std::move(columns);
+    columns.assign(column_count, {});
+    decoded.assign(column_count, false);
+    segment.reset();
+
+    cursor.erase();
+    auto row = std::vector<Value>(column_count);
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        if (i == erased) {
+            continue;
+        }
+        for (auto column = std::size_t{0}; column < column_count; ++column) {
+            row[column] = std::move(values[column][i]);
+        }
+        cursor.btree().insert(first_rowid + static_cast<std::int64_t>(i), encode_record(row));
+    }
+}
+
+auto ColumnarCursor::flush(BTreeCursor& cursor) -> void {
+    if (!writing) {
+        return;
+    }
+    if (row_count >= min_segment_rows) {
+        write_rows(cursor);
+    } else {
+        // the folded rows are records already
+        auto row = std::vector<Value>(column_count);
+        for (auto i = folded; i < row_count; ++i) {
+            for (auto column = std::size_t{0}; column < column_count; ++column) {
+                row[column] = std::move(rows[column][i]);
+            }
+            cursor.btree().insert(rows_first + static_cast<std::int64_t>(i), encode_record(row));
+        }
+    }
+    clear_rows();
+    writing = false;
+}
+
+auto ColumnarCursor::settle(BTreeCursor& cursor, bool ok) -> bool {
+    for (; ok; ok = cursor.next()) {
+        if (!is_segment(cursor.payload())) {
+            segment.reset();
+            return true;
+        }
+        enter(cursor);
+        if (segment->passes(filters)) {
+            position = 0;
+            return true;
+        }
+    }
+    segment.reset();
+    return false;
+}
+
+auto ColumnarCursor::enter(const BTreeCursor& cursor) -> void {
+    if (segment && segment->key() == cursor.rowid()) {
+        return;
+    }
+    segment.emplace(cursor.payload(), cursor.rowid(), column_count);
+    position = 0;
+    decoded.assign(column_count, false);
+}
+
+auto ColumnarCursor::load_tail(BTreeCursor& cursor) -> void {
+    clear_rows();
+    writing = true;
+    const auto last = cursor.btree().max_rowid();
+    rows_first = last + 1;
+    if (last == 0) {
+        return;
+    }
+    // there are fewer than min_segment_rows records at the end, unless the segments didn't fit
+    const auto window = static_cast<std::int64_t>(min_segment_rows);
+    const auto start = last > std::numeric_limits<std::int64_t>::min() + window ? last - window + 1 : last;
+    for (auto ok = cursor.seek(start); ok; ok = cursor.next()) {
+        const auto rowid = cursor.rowid();
+        if (is_segment(cursor.payload()) || (row_count > 0 && rowid != rows_first + static_cast<std::int64_t>(row_count))) {
+            clear_rows();
+            rows_first = rowid + 1;
+            if (is_segment(cursor.payload())) {
+                continue;
+            }
+        }
+        if (row_count == 0) {
+            rows_first = rowid;
+        }
+        auto view = RecordView{cursor.payload()};
+        for (auto column = std::size_t{0}; column < column_count; ++column) {
+            rows[column].push_back(to_value(view.column(column)));
+        }
+        ++row_count;
+    }
+    folded = row_count;
+    segment.reset();
+}
+
+auto ColumnarCursor::write_rows(BTreeCursor& cursor) -> void {
+    for (auto i = std::size_t{0}; i < folded; ++i) {
+        cursor.btree().erase(rows_first + static_cast<std::int64_t>(i));
+    }
+    if (!write_segment(cursor.btree(), rows_first, row_count, rows)) {
+        auto row = std::vector<Value>(column_count);
+        for (auto i = std::size_t{0}; i < row_count; ++i) {
+            for (auto column = std::size_t{0}; column < column_count; ++column) {
+                row[column] = std::move(rows[column][i]);
+            }
+            cursor.btree().insert(rows_first + static_cast<std::int64_t>(i), encode_record(row));
+        }
+    }
+    rows_first += static_cast<std::int64_t>(row_count);
+    clear_rows();
+    segment.reset();
+}
+
+auto ColumnarCursor::clear_rows() -> void {
+    for (auto& column : rows) {
+        column.clear();
+    }
+    row_count = 0;
+    folded = 0;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include "btree.hpp"
+#include "pager.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// the most rows a segment holds
+inline constexpr std::size_t segment_rows = 1024;
+// the fewest a statement writes a segment of, the rows it leaves over otherwise stay records
+inline constexpr std::size_t min_segment_rows = 64;
+
+// how a segment's column stores its values other than NULL, see ColumnarCursor
+enum class SegmentEncoding : std::uint8_t {
+    PLAIN,              // a record of the values
+    DICTIONARY,         // a record of the distinct values, then the index of each value, bit-packed
+    RUN_LENGTH,         // a record of the values of the runs, then the length of each run, varints
+    FRAME_OF_REFERENCE  // INTEGERs only: the smallest, 8 bytes, then each value less that, bit-packed
+};
+
+// "column op value", skipping the segments no row of which it can hold for, see ZONEFILTER
+enum class ZoneComparison : std::uint8_t { EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+struct ZoneFilter {
+    std::size_t column;
+    ZoneComparison comparison;
+    Value value;
+};
+
+// whether a payload of a COLUMNAR table is a segment rather than a record
+[[nodiscard]] auto is_segment(std::span<const std::uint8_t> payload) -> bool;
+
+// A segment's cell, parsed, see ColumnarCursor. A batch scan (see BatchScan) reads the segments
+// of the leaves it has pinned through it, a column at a time.
+class Segment {
+public:
+    // payload - the cell, key - its rowid, the one of the segment's last row
+    Segment(std::span<const std::uint8_t> payload, std::int64_t key, std::size_t column_count);
+
+    [[nodiscard]] auto key() const -> std::int64_t { return first + static_cast<std::int64_t>(row_count) - 1; }
+    [[nodiscard]] auto first_rowid() const -> std::int64_t { return first; }
+    [[nodiscard]] auto rows() const -> std::size_t { return row_count; }
+    // whether the zone maps leave rows the filters may hold for
+    [[nodiscard]] auto passes(std::span<const ZoneFilter> filters) const -> bool;
+    // the values of column n of the cell, NULL for a column added after the segment was written
+    [[nodiscard]] auto column(std::span<const std::uint8_t> payload, const BTree& tree, const Snapshot* snapshot,
+                              std::size_t n) -> std::vector<Value>;
+
+private:
+    std::int64_t first = 0;
+    std::size_t row_count = 0;
+    // 0 for chunks in the cell, from data_start on
+    PageId first_page = 0;
+    std::size_t data_start = 0;
+    // where each column's chunk starts, and where the last one ends
+    std::vector<std::size_t> offsets;
+    // per column, the min and max of its values if it has a zone map, both NULL if they all are
+    std::vector<std::optional<std::pair<Value, Value>>> zones;
+    // a chunk spanning pages, copied together
+    Blob chunk;
+};
+
+// A COLUMNAR table keeps its rows in the rowid B-tree other tables do, but mostly as segments: up
+// to segment_rows rows of consecutive rowids in a single cell, under the last of them. The cell
+// starts with a 0 byte, where a record starts with its header size, then has
+//     [row count][first page][column count][chunk size, zone map flag x column count]
+//     [a record of the min and max of every column with a zone map]
+// and is followed by the column chunks, each of them the column's values: a flags byte (bit 0
+// for a NULL bitmap), the encoding, the bitmap of the NULLs if there's one, then the other values
+// in the smallest of the encodings that apply. With a first page of 0 the chunks fit into the
+// cell after it, otherwise they fill the pages from the first page on, which are consecutive.
+// A STRICT table's column holds values of a single storage class, so frame of reference applies
+// to its INTEGERs, dictionaries and runs compare values exactly, and a zone map's min and max
+// bound every value of the column the way the comparisons of a WHERE order them.
+//
+// The rows an INSERT adds are held back by the cursor it writes through and written out as a
+// segment every segment_rows of them. At the end of the statement the rows left over become a
+// segment too if there are min_segment_rows, records otherwise - which the next INSERT picks up
+// again, the records at the end of the table go into its first segment. Deleting a segment's row
+// turns the segment back into records, without the row.
+//
+// Reading, the cursor steps through a segment's rows without moving the table's BTreeCursor off
+// its cell, and decodes a column of the segment at the first read of it, so a scan decodes only
+// the columns it reads. Segments whose zone maps rule out a filter's comparison are skipped.
+class ColumnarCursor {
+public:
+    explicit ColumnarCursor(std::size_t column_count);
+
+    // Each of these returns whether the cursor ended up on a row, which may be a record at
+    // cursor.payload(), as for a table that isn't COLUMNAR, or a segment's. first() and next()
+    // skip the segments the filters rule out, the records are left to the WHERE.
+    auto first(BTreeCursor& cursor) -> bool;
+    auto next(BTreeCursor& cursor) -> bool;
+    // positions on the row with the rowid, false if there's none
+    auto seek(BTreeCursor& cursor, std::int64_t rowid) -> bool;
+
+    [[nodiscard]] auto in_segment() const -> bool { return segment.has_value(); }
+    [[nodiscard]] auto rowid(const BTreeCursor& cursor) const -> std::int64_t;
+    // of the segment's row it's on, NULL for columns past the table's
+    auto column(const BTreeCursor& cursor, std::size_t n) -> const Value&;
+    auto add_filter(ZoneFilter filter) -> void { filters.push_back(std::move(filter)); }
+    [[nodiscard]] auto columns_in_table() const -> std::size_t { return column_count; }
+    [[nodiscard]] auto zone_filters() const -> std::span<const ZoneFilter> { return filters; }
+
+    // Writing, in a write transaction: the rows inserted are in the table once flush() wrote them
+    // out, positioning the cursor does that first.
+    [[nodiscard]] auto max_rowid(BTreeCursor& cursor) -> std::int64_t;
+    auto insert(BTreeCursor& cursor, std::int64_t rowid, std::span<const std::uint8_t> record) -> void;
+    // deletes the row it's on, the cursor has to be repositioned afterwards
+    auto erase(BTreeCursor& cursor) -> void;
+    auto flush(BTreeCursor& cursor) -> void;
+
+private:
+    // after the cursor moved, ok if it's on a row: settles on the first row that isn't in a segment
+    // the filters rule out
+    auto settle(BTreeCursor& cursor, bool ok) -> bool;
+    // parses the segment cell the cursor is on, unless it's the one parsed already
+    auto enter(const BTreeCursor& cursor) -> void;
+    // the records at the end of the table, which the rows inserted are appended to
+    auto load_tail(BTreeCursor& cursor) -> void;
+    // writes the held back rows out as a segment, or as records if a cell can't describe them
+    auto write_rows(BTreeCursor& cursor) -> void;
+    auto clear_rows() -> void;
+
+    std::size_t column_count;
+    std::vector<ZoneFilter> filters;
+
+    std::optional<Segment> segment;
+    std::size_t position = 0;
+    // the columns of the segment read so far, and which they are
+    std::vector<std::vector<Value>> columns;
+    std::vector<bool> decoded;
+
+    // the rows held back, a vector per column, from rowid rows_first on. The first folded of them
+    // are the records load_tail() found, which are still in the table.
+    bool writing = false;
+    std::int64_t rows_first = 0;
+    std::size_t row_count = 0;
+    std::size_t folded = 0;
+    std::vector<std::vector<Value>> rows;
+};
@@ -1,7 +1,18 @@
 #pragma once
+#include <fmt/base.h>
+#include <fmt/format.h>
+#include <stdexcept>
 
 template <class... Ts> struct overloaded : Ts... {
     using Ts::operator()...;
 };
 template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
+struct SqlError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+template <typename... Args>
+[[noreturn]] void fail(fmt::format_string<Args...> fmtstr, Args&&... args) {
+    throw SqlError{fmt::format(fmtstr, std::forward<Args>(args)...)};
+}
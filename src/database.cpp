@@ -0,0 +1,342 @@
+#include "database.hpp"
+#include "common.hpp"
+#include "record.hpp"
+#include <array>
+
+namespace {
+
+constexpr PageId schema_root = 1;
+// the third column of an index's schema table row, tables don't have one
+constexpr auto index_entry = std::string_view{"index"};
+
+} // namespace
+
+Database::Database(const std::string& path, const WalOptions& options, const PagerOptions& pager_options)
+    : pager(path, options, pager_options) {
+    if (pager.page_count() == 1) {
+        if (BTree::create(pager) != schema_root) {
+            fail("Failed to initialize the schema table");
+        }
+        pager.commit();
+    }
+    load_schema();
+}
+
+// ===================================
+// Transaction
+// ===================================
+Transaction::~Transaction() {
+    if (writer.owns_lock()) {
+        try {
+            rollback();
+        } catch (const SqlError&) {
+            // a rollback has nothing left to report
+        }
+    }
+}
+
+auto Transaction::initial_snapshot() -> const Snapshot* {
+    // the writer is the only one committing, so the last commit is still the one it began after
+    if (!view) {
+        view.emplace(db->pager.writer_snapshot());
+    }
+    return &*view;
+}
+
+auto Transaction::commit() -> void {
+    // a read transaction has nothing to write, and so nothing to sync either
+    view.reset();
+    if (writer.owns_lock()) {
+        const auto commit = db->commit();
+        // the next writer goes ahead while this commit syncs, so its commit can join the sync
+        writer.unlock();
+        db->pager.sync(commit);
+    }
+}
+
+auto Transaction::rollback() -> void {
+    if (writer.owns_lock()) {
+        db->rollback();
+        writer.unlock();
+    }
+    view.reset();
+}
+
+// ===================================
+// Database
+// ===================================
+auto Database::begin(bool write) -> Transaction {
+    if (!write) {
+        auto view = std::optional{pager.snapshot()};
+        // the statements are compiled against the newest schema, a change to it that is still
+        // syncing is waited for
+        while (view->header().schema_cookie != pager.committed().schema_cookie) {
+            view.reset();
+            pager.sync(pager.last_commit());
+            view.emplace(pager.snapshot());
+        }
+        const auto cookie = view->header().schema_cookie;
+        return Transaction{*this, std::move(view), {}, cookie};
+    }
+    if (pager.read_only()) {
+        fail("Cannot write to a database opened read-only");
+    }
+    auto writer = std::unique_lock{writer_mutex};
+    writing = true;
+    return Transaction{*this, std::nullopt, std::move(writer), pager.schema_cookie()};
+}
+
+auto Database::commit() -> std::uint64_t {
+    const auto commit = pager.publish();
+    writing = false;
+    analyzed = false;
+    created_tables.clear();
+    created_indexes.clear();
+    return commit;
+}
+
+auto Database::rollback() -> void {
+    pager.rollback();
+    writing = false;
+    // the tables and indexes the transaction created are gone, and the append paths of the
+    // others may lead to discarded pages
+    const auto lock = std::unique_lock{schema_mutex};
+    for (const auto& name : created_indexes) {
+        const auto& index = index_trees.at(name);
+        for (auto& [table_name, table] : schemas) {
+            std::erase_if(table.indexes, [&](const IndexSchema& schema) { return schema.root == index.root(); });
+        }
+        index_trees.erase(name);
+    }
+    for (const auto& name : created_tables) {
+        schemas.erase(name);
+        trees.erase(name);
+    }
+    created_tables.clear();
+    created_indexes.clear();
+    for (auto& [name, tree] : trees) {
+        tree.forget_append_path();
+    }
+    // back to the committed statistics
+    if (analyzed) {
+        load_statistics();
+        analyzed = false;
+    }
+}
+
+auto Database::set_worker_count(std::size_t threads) -> void {
+    const auto lock = std::scoped_lock{pool_mutex};
+    workers = std::max(threads, std::size_t{1});
+    // a scan still running keeps the old pool alive
+    pool.reset();
+}
+
+auto Database::thread_pool() -> std::shared_ptr<ThreadPool> {
+    const auto lock = std::scoped_lock{pool_mutex};
+    if (!pool) {
+        pool = std::make_shared<ThreadPool>(workers);
+    }
+    return pool;
+}
+
+auto Database::load_schema() -> void {
+    schemas.clear();
+    trees.clear();
+    index_trees.clear();
+
+    auto schema_tree = BTree{pager, schema_root};
+    auto cursor = BTreeCursor{schema_tree};
+    for (auto ok = cursor.first(); ok; ok = cursor.next()) {
+        const auto row = decode_record(cursor.payload());
+        if (row.size() < 2 || !std::holds_alternative<std::string>(row[0]) || !std::holds_alternative<std::int64_t>(row[1])) {
+            fail("Malformed schema table entry");
+        }
+        if (row.size() > 2 && row[2] == Value{std::string{statistics_entry}}) {
+            continue;
+        }
+        if (row.size() > 3) {
+            fail("Malformed schema table entry");
+        }
+        const auto root = static_cast<PageId>(std::get<std::int64_t>(row[1]));
+
+        if (row.size() == 3) {
+            if (row[2] != Value{std::string{index_entry}}) {
+                fail("Malformed schema table entry");
+            }
+            auto index = IndexSchema::from_definition(std::get<std::string>(row[0]));
+            index.root = root;
+            const auto table = schemas.find(index.table);
+            if (table == schemas.end()) {
+                fail("Malformed schema table entry - index '{}' is on a missing table", index.name);
+            }
+            index_trees.try_emplace(index.name, pager, index.root);
+            table->second.indexes.push_back(std::move(index));
+            continue;
+        }
+
+        auto table = TableSchema::from_definition(std::get<std::string>(row[0]));
+        table.root = root;
+        trees.try_emplace(table.name, pager, table.root);
+        schemas.emplace(table.name, std::move(table));
+    }
+    load_statistics();
+}
+
+auto Database::load_statistics() -> void {
+    table_statistics.clear();
+    auto schema_tree = BTree{pager, schema_root};
+    auto cursor = BTreeCursor{schema_tree};
+    for (auto ok = cursor.first(); ok; ok = cursor.next()) {
+        const auto row = decode_record(cursor.payload());
+        if (row.size() <= 2 || row[2] != Value{std::string{statistics_entry}}) {
+            continue;
+        }
+        const auto& name = std::get<std::string>(row[0]);
+        const auto table = schemas.find(name);
+        if (table == schemas.end()) {
+            fail("Malformed schema table entry - statistics of a missing table '{}'", name);
+        }
+        decode_statistics(table->second, row, table_statistics[name]);
+    }
+}
+
+auto Database::create_table(std::string_view definition, bool if_not_exists) -> bool {
+    if (!writing) {
+        fail("Cannot create a table outside of a write transaction");
+    }
+
+    auto table = TableSchema::from_definition(definition);
+    if (schemas.contains(table.name)) {
+        if (if_not_exists) return false;
+        fail("Table '{}' already exists", table.name);
+    }
+    if (index_trees.contains(table.name)) {
+        fail("There is already an index named '{}'", table.name);
+    }
+
+    table.root = BTree::create(pager);
+    const auto row = std::array<Value, 2>{table.definition(), static_cast<std::int64_t>(table.root)};
+    auto schema_tree = BTree{pager, schema_root};
+    schema_tree.insert(schema_tree.max_rowid() + 1, encode_record(row));
+    pager.set_schema_cookie(pager.schema_cookie() + 1);
+
+    const auto lock = std::unique_lock{schema_mutex};
+    created_tables.push_back(table.name);
+    trees.try_emplace(table.name, pager, table.root);
+    schemas.emplace(table.name, std::move(table));
+    return true;
+}
+
+auto Database::create_index(std::string_view definition, bool if_not_exists) -> bool {
+    if (!writing) {
+        fail("Cannot create an index outside of a write transaction");
+    }
+
+    auto index = IndexSchema::from_definition(definition);
+    if (index_trees.contains(index.name)) {
+        if (if_not_exists) return false;
+        fail("Index '{}' already exists", index.name);
+    }
+    if (schemas.contains(index.name)) {
+        fail("There is already a table named '{}'", index.name);
+    }
+    const auto table = schemas.find(index.table);
+    if (table == schemas.end()) {
+        fail("No such table: '{}'", index.table);
+    }
+
+    index.root = IndexBTree::create(pager);
+    const auto row = std::array<Value, 3>{index.definition(), static_cast<std::int64_t>(index.root), std::string{index_entry}};
+    auto schema_tree = BTree{pager, schema_root};
+    schema_tree.insert(schema_tree.max_rowid() + 1, encode_record(row));
+    pager.set_schema_cookie(pager.schema_cookie() + 1);
+
+    const auto lock = std::unique_lock{schema_mutex};
+    created_indexes.push_back(index.name);
+    index_trees.try_emplace(index.name, pager, index.root);
+    table->second.indexes.push_back(std::move(index));
+    return true;
+}
+
+auto Database::analyze(std::string_view name) -> void {
+    if (!writing) {
+        fail("Cannot analyze outside of a write transaction");
+    }
+
+    auto tables = std::vector<const TableSchema*>{};
+    if (name.empty()) {
+        for (const auto& [table_name, table] : schemas) {
+            tables.push_back(&table);
+        }
+    } else if (const auto table = schemas.find(std::string{name}); table != schemas.end()) {
+        tables.push_back(&table->second);
+    } else {
+        for (const auto& [table_name, table] : schemas) {
+            if (std::ranges::find(table.indexes, name, &IndexSchema::name) != table.indexes.end()) {
+                tables.push_back(&table);
+            }
+        }
+        if (tables.empty()) {
+            fail("No such table or index: '{}'", name);
+        }
+    }
+
+    auto schema_tree = BTree{pager, schema_root};
+    for (const auto* table : tables) {
+        auto statistics = analyze_table(trees.at(table->name), *table, [&](const IndexSchema& index) -> IndexBTree& {
+            return index_trees.at(index.name);
+        });
+
+        // the table's previous statistics make way for the new ones
+        auto stale = std::vector<std::int64_t>{};
+        auto cursor = BTreeCursor{schema_tree};
+        for (auto ok = cursor.first(); ok; ok = cursor.next()) {
+            const auto row = decode_record(cursor.payload());
+            if (row.size() > 2 && row[2] == Value{std::string{statistics_entry}} && row[0] == Value{table->name}) {
+                stale.push_back(cursor.rowid());
+            }
+        }
+        for (const auto rowid : stale) {
+            schema_tree.erase(rowid);
+        }
+        for (const auto& row : encode_statistics(*table, statistics)) {
+            schema_tree.insert(schema_tree.max_rowid() + 1, row);
+        }
+
+        const auto lock = std::unique_lock{schema_mutex};
+        table_statistics[table->name] = std::move(statistics);
+    }
+    pager.set_schema_cookie(pager.schema_cookie() + 1);
+    analyzed = true;
+}
+
+auto Database::statistics(std::string_view table) const -> const TableStatistics* {
+    const auto it = table_statistics.find(std::string{table});
+    return it == table_statistics.end() ? nullptr : &it->second;
+}
+
+auto Database::schema(std::string_view name) const -> const TableSchema& {
+    const auto it = schemas.find(std::string{name});
+    if (it == schemas.end()) {
+        fail("No such table: '{}'", name);
+    }
+    return it->second;
+}
+
+auto Database::table(std::string_view name) -> BTree& {
+    const auto lock = schema_lock();
+    const auto it = trees.find(std::string{name});
+    if (it == trees.end()) {
+        fail("No such table: '{}'", name);
+    }
+    return it->second;
+}
+
+auto Database::index(std::string_view name) -> IndexBTree& {
+    const auto lock = schema_lock();
+    const auto it = index_trees.find(std::string{name});
+    if (it == index_trees.end()) {
+        fail("No such index: '{}'", name);
+    }
+    return it->second;
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include "btree.hpp"
+#include "catalog.hpp"
+#include "hash_aggregate.hpp"
+#include "hash_join.hpp"
+#include "index.hpp"
+#include "pager.hpp"
+#include "sorter.hpp"
+#include "statistics.hpp"
+#include "thread_pool.hpp"
+#include "wal.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Database;
+
+// A transaction, from Database::begin until it's committed, rolled back or destroyed. A read
+// transaction reads a snapshot of the database as it was committed when it began, see Pager,
+// so it neither waits for the writer nor sees its changes. The write transaction reads the
+// newest pages, its own changes included, and has the database to itself among writers.
+class Transaction {
+public:
+    Transaction(Transaction&&) noexcept = default;
+    auto operator=(Transaction&&) -> Transaction& = delete;
+    // rolls back a write transaction that is still open
+    ~Transaction();
+
+    [[nodiscard]] auto write() const -> bool { return writer.owns_lock(); }
+    // what the transaction reads its pages as of, null for the write transaction
+    [[nodiscard]] auto snapshot() const -> const Snapshot* { return view && !write() ? &*view : nullptr; }
+    // the database as it was committed when the transaction began, without the write
+    // transaction's own changes, for a statement reading the tables it writes to. The write
+    // transaction takes it on first use.
+    [[nodiscard]] auto initial_snapshot() -> const Snapshot*;
+    // the schema the transaction sees
+    [[nodiscard]] auto schema_cookie() const -> std::int64_t { return cookie; }
+
+    // a write transaction lets the next writer in once its commit is published, and returns
+    // once it's durable
+    auto commit() -> void;
+    auto rollback() -> void;
+
+private:
+    friend class Database;
+
+    Transaction(Database& db, std::optional<Snapshot> view, std::unique_lock<std::mutex> writer, std::int64_t cookie)
+        : db(&db), view(std::move(view)), writer(std::move(writer)), cookie(cookie) {}
+
+    Database* db;
+    std::optional<Snapshot> view;
+    std::unique_lock<std::mutex> writer;
+    std::int64_t cookie;
+};
+
+// A database file: the pager, the schema and the B-trees of its tables and indexes.
+// The schema lives in its own B-tree rooted at page 1, one row per table - (definition, root page) -
+// and one per index - (definition, root page, 'index'), next to the statistics of the analyzed
+// tables, see encode_statistics.
+//
+// Any number of threads may run transactions at once, with one writer at a time, see Transaction.
+// The tables and indexes are only ever added, by the writer, so the references schema(), table()
+// and index() return stay valid, unless the transaction that created them rolls back.
+class Database {
+public:
+    // an empty path opens a private in-memory database, which has no write-ahead log
+    explicit Database(const std::string& path = {}, const WalOptions& options = {}, const PagerOptions& pager_options = {});
+
+    // a write transaction waits for the one running to end
+    [[nodiscard]] auto begin(bool write) -> Transaction;
+
+    // the schema as of the last commit
+    [[nodiscard]] auto schema_cookie() const -> std::int64_t { return pager.committed().schema_cookie; }
+    [[nodiscard]] auto cache_stats() const -> CacheStats { return pager.cache_stats(); }
+    [[nodiscard]] auto wal_stats() const -> WalStats { return pager.wal_stats(); }
+    // the buffer pool's budget, a statement's temporary tables get one of the same size each
+    [[nodiscard]] auto cache_size() const -> std::size_t { return pager.cache_size(); }
+    // returns whether the table was created
+    auto create_table(std::string_view definition, bool if_not_exists) -> bool;
+    // returns whether the index was created, it starts out empty
+    auto create_index(std::string_view definition, bool if_not_exists) -> bool;
+    // holds off the writer adding tables and indexes, for reading through schema()
+    [[nodiscard]] auto schema_lock() const -> std::shared_lock<std::shared_mutex> { return std::shared_lock{schema_mutex}; }
+    // the caller holds schema_lock(), unless it's the writer
+    [[nodiscard]] auto schema(std::string_view name) const -> const TableSchema&;
+    [[nodiscard]] auto table(std::string_view name) -> BTree&;
+    [[nodiscard]] auto index(std::string_view name) -> IndexBTree&;
+    // Replaces the statistics of the table, or of an index's table, every table's for an empty
+    // name. The new statistics take effect for the statements compiled afterwards, the schema
+    // cookie changes.
+    auto analyze(std::string_view name) -> void;
+    // null for a table that was never analyzed, under schema_lock() like schema()
+    [[nodiscard]] auto statistics(std::string_view table) const -> const TableStatistics*;
+
+    // the memory a hash join may keep its build side in before spilling it, see HashJoin
+    [[nodiscard]] auto join_memory_budget() const -> std::size_t { return join_budget; }
+    auto set_join_memory_budget(std::size_t bytes) -> void { join_budget = bytes; }
+    // the memory a hash aggregation may keep its groups in before spilling rows, see HashAggregate
+    [[nodiscard]] auto aggregate_memory_budget() const -> std::size_t { return aggregate_budget; }
+    auto set_aggregate_memory_budget(std::size_t bytes) -> void { aggregate_budget = bytes; }
+    // the memory an ORDER BY may keep its rows in before writing sorted runs out, see Sorter
+    [[nodiscard]] auto sort_memory_budget() const -> std::size_t { return sort_budget; }
+    auto set_sort_memory_budget(std::size_t bytes) -> void { sort_budget = bytes; }
+    // how many threads a scan may run on, 1 keeps every statement on the calling thread
+    [[nodiscard]] auto worker_count() const -> std::size_t { return workers; }
+    // takes effect for the scans started afterwards
+    auto set_worker_count(std::size_t threads) -> void;
+    // the pool of worker_count() threads, started on first use
+    [[nodiscard]] auto thread_pool() -> std::shared_ptr<ThreadPool>;
+
+private:
+    friend class Transaction;
+
+    auto load_schema() -> void;
+    auto load_statistics() -> void;
+    // publishes the writer's changes, returns the commit to sync, see Pager::publish
+    auto commit() -> std::uint64_t;
+    auto rollback() -> void;
+
+    Pager pager;
+    // guards the maps, which the readers look up while the writer adds to them
+    mutable std::shared_mutex schema_mutex;
+    std::unordered_map<std::string, TableSchema> schemas;
+    std::unordered_map<std::string, BTree> trees;
+    std::unordered_map<std::string, IndexBTree> index_trees;
+    std::unordered_map<std::string, TableStatistics> table_statistics;
+    std::size_t join_budget = default_join_memory_budget;
+    std::size_t aggregate_budget = default_aggregate_memory_budget;
+    std::size_t sort_budget = default_sort_memory_budget;
+    std::size_t workers = std::max(std::thread::hardware_concurrency(), 1u);
+    std::mutex pool_mutex;
+    std::shared_ptr<ThreadPool> pool;
+
+    std::mutex writer_mutex;
+    // the writer's: whether it's running, whether it ran ANALYZE, and the tables and indexes it created
+    bool writing = false;
+    bool analyzed = false;
+    std::vector<std::string> created_tables;
+    std::vector<std::string> created_indexes;
+};
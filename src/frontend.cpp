@@ -0,0 +1,61 @@
+#include "frontend.hpp"
+#include "common.hpp"
+#include "parser.hpp"
+#include "printers.hpp"
+#include <algorithm>
+
+#include "GrammarLexer.h"
+#include "GrammarParser.h"
+
+auto parse_frontend(std::string_view name) -> Frontend {
+    if (name == "native") return Frontend::NATIVE;
+    if (name == "antlr")  return Frontend::ANTLR;
+    if (name == "checked") return Frontend::CHECKED;
+    fail("Unknown parser '{}' - expected native, antlr or checked", name);
+}
+
+namespace {
+
+auto parse_antlr(std::string_view sql, const StatementConsumer& use) -> void {
+    antlr4::ANTLRInputStream input(sql);
+    GrammarLexer lexer(&input);
+    antlr4::CommonTokenStream tokens(&lexer);
+    GrammarParser parser(&tokens);
+    auto* tree = parser.program();
+    if (lexer.getNumberOfSyntaxErrors() > 0 || parser.getNumberOfSyntaxErrors() > 0) {
+        fail("Syntax error in '{}'", sql);
+    }
+
+    auto IR_generator = SqlGrammarVisitor{sql};
+    const auto statement = IR_generator.build(tree);
+    use(statement, IR_generator.parameters());
+}
+
+auto parse_native(std::string_view sql, const StatementConsumer& use) -> void {
+    auto parser = Parser{sql};
+    const auto statement = parser.parse();
+    use(statement, parser.parameters());
+}
+
+auto parse_checked(std::string_view sql, const StatementConsumer& use) -> void {
+    auto native = Parser{sql};
+    const auto statement = native.parse();
+
+    parse_antlr(sql, [&](const Statement& reference, std::span<const std::string_view> parameters) {
+        if (statement != reference || !std::ranges::equal(native.parameters(), parameters)) {
+            fail("The native and the ANTLR parser disagree on '{}':\n  native: {}\n  antlr:  {}",
+                 sql, to_string(statement), to_string(reference));
+        }
+    });
+    use(statement, native.parameters());
+}
+
+} // namespace
+
+auto parse(std::string_view sql, Frontend frontend, const StatementConsumer& use) -> void {
+    switch (frontend) {
+        case Frontend::NATIVE:  return parse_native(sql, use);
+        case Frontend::ANTLR:   return parse_antlr(sql, use);
+        case Frontend::CHECKED: return parse_checked(sql, use);
+    }
+}
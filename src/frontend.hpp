@@ -0,0 +1,21 @@
+#pragma once
+#include "IR.hpp"
+#include <functional>
+#include <span>
+#include <string_view>
+
+// Which parser turns SQL text into the IR.
+enum class Frontend {
+    NATIVE,   // the hand written lexer and parser, see Parser
+    ANTLR,    // the parser generated from grammar/Grammar.g4
+    CHECKED   // both, failing if they don't produce the same IR
+};
+
+// "native", "antlr" or "checked"
+[[nodiscard]] auto parse_frontend(std::string_view name) -> Frontend;
+
+// receives the IR and the names of its bind parameters, both only valid for the duration of the call
+using StatementConsumer = std::function<void(const Statement&, std::span<const std::string_view>)>;
+
+// parses a single statement, throws SqlError on syntax errors
+auto parse(std::string_view sql, Frontend frontend, const StatementConsumer& use) -> void;
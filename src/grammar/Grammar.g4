@@ -6,11 +6,23 @@ options {
     caseInsensitive = true;
 }
 
-program : SEMI* sql_stmt SEMI* ;
+program : SEMI* sql_stmt SEMI* EOF ;
 
+// https://sqlite.org/lang_explain.html, ANALYZE runs the statement and profiles it
 sql_stmt
+    : (EXPLAIN (QUERY PLAN | ANALYZE)?)? explainable_stmt
+    | analyze_stmt
+    ;
+
+// https://sqlite.org/lang_analyze.html, the name is a table's or an index's
+analyze_stmt
+    : ANALYZE ((schema_name DOT)? table_name)?
+    ;
+
+explainable_stmt
     : select_stmt
     | create_table_stmt
+    | create_index_stmt
     | insert_stmt
     ;
 
@@ -18,18 +30,22 @@ sql_stmt
 insert_stmt
     : with_clause? (REPLACE | (INSERT (OR confilct_resolution_method)?)) INTO (schema_name DOT)? table_name (AS table_alias)?
         (LPAREN column_name (COMMA column_name)* RPAREN)?
-        ( (VALUES LPAREN expr (COMMA expr)* RPAREN)
+        ( (VALUES value_row (COMMA value_row)*)
         | select_stmt
         | (DEFAULT VALUES)
         )
     ;
 
+value_row
+    : LPAREN expr (COMMA expr)* RPAREN
+    ;
+
 confilct_resolution_method
     : (ABORT | FAIL | IGNORE | REPLACE | ROLLBACK)
     ;
 
 with_clause
-    : WITH RECURSIVE? common_table_expression (COMMA common_table_expression)
+    : WITH RECURSIVE? common_table_expression (COMMA common_table_expression)*
     ;
 
 // https://sqlite.org/syntax/common-table-expression.html
@@ -44,6 +60,16 @@ create_table_stmt
 
 column_def : column_name type_name? column_constraint* ;
 
+// https://sqlite.org/lang_createindex.html
+create_index_stmt
+    : CREATE UNIQUE? INDEX (IF NOT EXISTS)? (schema_name DOT)? index_name ON table_name LPAREN indexed_column (COMMA indexed_column)* RPAREN
+    ;
+
+// TODO: COLLATE and expressions, https://sqlite.org/syntax/indexed-column.html
+indexed_column
+    : column_name (ASC | DESC)?
+    ;
+
 type_name
     : IDENTIFIER
     ;
@@ -59,14 +85,39 @@ conflict_clause
 
 
 table_options
+    : table_option (COMMA table_option)*
+    ;
+
+// COLUMNAR isn't sqlite's, it stores the rows in compressed column segments, see ColumnarCursor
+table_option
     : WITHOUT ROWID
     | STRICT
-    | COMMA table_options
+    | COLUMNAR
     ;
 
 // TODO: Implement the rest of https://www.sqlite.org/lang_select.html
 select_stmt
-    : SELECT (DISTINCT | ALL)? result_column (COMMA result_column)* FROM table_or_subquery (COMMA table_or_subquery)*
+    : SELECT (DISTINCT | ALL)? result_column (COMMA result_column)* FROM join_clause (WHERE expr)?
+      (GROUP BY expr (COMMA expr)* (HAVING expr)?)?
+      (ORDER BY ordering_term (COMMA ordering_term)*)? (LIMIT expr (OFFSET expr)?)?
+    ;
+
+ordering_term
+    : expr (ASC | DESC)?
+    ;
+
+// TODO: LEFT, RIGHT, FULL and NATURAL joins and USING, https://sqlite.org/syntax/join-clause.html
+join_clause
+    : table_or_subquery (join_operator table_or_subquery join_constraint?)*
+    ;
+
+join_operator
+    : COMMA
+    | (INNER | CROSS)? JOIN
+    ;
+
+join_constraint
+    : ON expr
     ;
 
 // https://sqlite.org/syntax/result-column.html
@@ -82,7 +133,27 @@ table_or_subquery
     ;
 
 // TODO: Implement the rest of https://sqlite.org/syntax/expr.html
+// the operators go from the tightest binding to the loosest, as in https://sqlite.org/lang_expr.html#operators
 expr
+    : NUMERIC_LITERAL
+    | STRING_LITERAL
+    | NULL
+    | BIND_PARAMETER
+    | function_name LPAREN (expr (COMMA expr)* | STAR)? RPAREN
+    | (table_name DOT)? IDENTIFIER
+    | LPAREN expr RPAREN
+    | (MINUS | PLUS) expr
+    | expr PIPE2 expr
+    | expr (STAR | DIV | MOD) expr
+    | expr (PLUS | MINUS) expr
+    | expr (LT | LT_EQ | GT | GT_EQ) expr
+    | expr (ASSIGN | EQ | NOT_EQ1 | NOT_EQ2) expr
+    | NOT expr
+    | expr AND expr
+    | expr OR expr
+    ;
+
+function_name
     : IDENTIFIER
     ;
 
@@ -102,6 +173,10 @@ table_name
     : IDENTIFIER
     ;
 
+index_name
+    : IDENTIFIER
+    ;
+
 column_name
     : IDENTIFIER
     ;
@@ -115,6 +190,14 @@ DISTINCT : 'DISTINCT';
 ALL : 'ALL';
 AS : 'AS';
 FROM : 'FROM';
+GROUP : 'GROUP';
+HAVING : 'HAVING';
+ORDER : 'ORDER';
+LIMIT : 'LIMIT';
+OFFSET : 'OFFSET';
+JOIN : 'JOIN';
+INNER : 'INNER';
+CROSS : 'CROSS';
 
 CREATE : 'CREATE';
 TEMP : 'TEMP';
@@ -124,6 +207,11 @@ IF : 'IF';
 NOT : 'NOT';
 EXISTS : 'EXISTS';
 ON : 'ON';
+INDEX : 'INDEX';
+UNIQUE : 'UNIQUE';
+ASC : 'ASC';
+BY : 'BY';
+DESC : 'DESC';
 CONFLICT : 'CONFLICT';
 ROLLBACK : 'ROLLBACK';
 ABORT : 'ABORT';
@@ -137,12 +225,19 @@ MATERIALIZED : 'MATERIALIZED';
 WITH : 'WITH';
 RECURSIVE : 'RECURSIVE';
 STRICT : 'STRICT';
+COLUMNAR : 'COLUMNAR';
+EXPLAIN : 'EXPLAIN';
+QUERY : 'QUERY';
+PLAN : 'PLAN';
+ANALYZE : 'ANALYZE';
 
 INSERT : 'INSERT';
 INTO : 'INTO';
 VALUES : 'VALUES';
 DEFAULT : 'DEFAULT';
 OR : 'OR';
+AND : 'AND';
+WHERE : 'WHERE';
 
 LPAREN : '(';
 RPAREN : ')';
@@ -150,9 +245,41 @@ COMMA : ',';
 DOT : '.';
 STAR : '*';
 SEMI : ';';
+PLUS : '+';
+MINUS : '-';
+DIV : '/';
+MOD : '%';
+PIPE2 : '||';
+LT : '<';
+LT_EQ : '<=';
+GT : '>';
+GT_EQ : '>=';
+ASSIGN : '=';
+EQ : '==';
+NOT_EQ1 : '!=';
+NOT_EQ2 : '<>';
 
 IDENTIFIER
     : LETTER ID_CHAR*
     ;
 
+NUMERIC_LITERAL
+    : DIGIT+ ('.' DIGIT*)? ('E' [+-]? DIGIT+)?
+    ;
+
+// a quote inside the literal is written twice
+STRING_LITERAL
+    : '\'' (~'\'' | '\'\'')* '\''
+    ;
+
+// https://sqlite.org/lang_expr.html#parameters
+BIND_PARAMETER
+    : '?' DIGIT*
+    | ':' ID_CHAR+
+    ;
+
 WHITESPACE: [ \r\n\t]+ -> skip;
+
+// https://sqlite.org/lang_comment.html, a block comment may run to the end of the input
+SINGLE_LINE_COMMENT: '--' ~[\r\n]* -> skip;
+MULTILINE_COMMENT: '/*' .*? ('*/' | EOF) -> skip;
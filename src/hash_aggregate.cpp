@@ -0,0 +1,303 @@
+#include "hash_aggregate.hpp"
+#include "common.hpp"
+#include "index.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr auto initial_slots = std::size_t{16};
+
+// a value's share of a HashAggregate's memory
+auto value_memory(const Value& value) -> std::size_t {
+    auto size = sizeof(Value);
+    if (const auto* text = std::get_if<std::string>(&value)) {
+        size += text->size();
+    } else if (const auto* blob = std::get_if<Blob>(&value)) {
+        size += blob->size();
+    }
+    return size;
+}
+
+// as for HashJoin, each level takes the next 4 bits of the hash from the top, the slots use the
+// bottom ones
+auto partition_of(std::size_t hash, std::size_t level) -> std::size_t {
+    static_assert(HashAggregate::partition_count == 16 && HashAggregate::max_level * 4 <= 60);
+    return static_cast<std::size_t>(static_cast<std::uint64_t>(hash) >> (60 - 4 * level)) & (HashAggregate::partition_count - 1);
+}
+
+} // namespace
+
+HashAggregate::HashAggregate(std::size_t key_width, std::size_t carried_width, std::span<const AggregateFunction> functions,
+                             bool hand_back, std::size_t memory_budget)
+    : key_width(key_width), carried_width(carried_width), functions(functions.begin(), functions.end()),
+      hand_back(hand_back), memory_budget(memory_budget), slots(initial_slots, empty_slot) {
+    argument_count = static_cast<std::size_t>(std::ranges::count_if(functions, [](AggregateFunction function) {
+        return function != AggregateFunction::COUNT_ROWS;
+    }));
+}
+
+auto HashAggregate::add(std::span<const Value> row) -> bool {
+    key_buffer.clear();
+    for (const auto& value : row.first(key_width)) {
+        append_key_column(key_buffer, value, false);
+    }
+    return add_encoded(key_buffer, row) && hand_back;
+}
+
+auto HashAggregate::next(std::span<Value> result) -> bool {
+    if (!finished) {
+        finished = true;
+        close_spill();
+        if (key_width == 0 && hashes.empty()) {
+            const auto nulls = std::vector<Value>(row_width());
+            key_buffer.clear();
+            new_group(key_buffer, key_hash(key_buffer), nulls);
+        }
+        // the groups handed back as they started are done
+        position = hand_back ? static_cast<std::uint32_t>(hashes.size()) : 0;
+    }
+    const auto next = next_group();
+    if (!next) {
+        return false;
+    }
+
+    const auto group = static_cast<std::size_t>(*next);
+    const auto width = key_width + carried_width;
+    std::ranges::move(values.begin() + static_cast<std::ptrdiff_t>(group * width),
+                      values.begin() + static_cast<std::ptrdiff_t>((group + 1) * width), result.begin());
+    auto* state = accumulators.data() + group * functions.size();
+    for (auto i = std::size_t{0}; i < functions.size(); ++i) {
+        auto& accumulator = state[i];
+        auto& out = result[width + i];
+        switch (functions[i]) {
+            case AggregateFunction::COUNT_ROWS:
+            case AggregateFunction::COUNT:
+                out = accumulator.count;
+                break;
+            case AggregateFunction::AVG:
+                out = accumulator.count == 0 ? Value{} : divide(::add(Value{0.0}, accumulator.value), Value{accumulator.count});
+                break;
+            case AggregateFunction::SUM:
+            case AggregateFunction::MIN:
+            case AggregateFunction::MAX:
+                // NULL for no values
+                out = std::move(accumulator.value);
+                break;
+        }
+    }
+    return true;
+}
+
+auto HashAggregate::partial(std::size_t parts) const -> HashAggregate {
+    return HashAggregate{key_width, carried_width, functions, false, memory_budget / std::max(parts, std::size_t{1})};
+}
+
+auto HashAggregate::add_part(HashAggregate& part) -> void {
+    combining = true;
+    part.finished = true;
+    part.close_spill();
+    part.position = 0;
+    // the group's key and carried values, then the value and the count of each accumulator
+    const auto width = key_width + carried_width;
+    auto row = std::vector<Value>(width + 2 * functions.size());
+    while (const auto group = part.next_group()) {
+        const auto start = part.key_starts[*group];
+        const auto end = *group + 1 < part.key_starts.size() ? part.key_starts[*group + 1] : part.keys.size();
+        key_buffer.assign(part.keys.begin() + start, part.keys.begin() + static_cast<std::ptrdiff_t>(end));
+        const auto first = part.values.begin() + static_cast<std::ptrdiff_t>(*group * width);
+        std::ranges::move(first, first + static_cast<std::ptrdiff_t>(width), row.begin());
+        auto* state = part.accumulators.data() + static_cast<std::size_t>(*group) * functions.size();
+        for (auto i = std::size_t{0}; i < functions.size(); ++i) {
+            row[width + 2 * i] = std::move(state[i].value);
+            row[width + 2 * i + 1] = state[i].count;
+        }
+        add_encoded(key_buffer, row);
+    }
+}
+
+auto HashAggregate::add_encoded(const Blob& key, std::span<const Value> row) -> bool {
+    const auto hash = key_hash(key);
+    const auto mask = slots.size() - 1;
+    for (auto slot = hash & mask; slots[slot] != empty_slot; slot = (slot + 1) & mask) {
+        const auto group = slots[slot] - 1;
+        const auto start = key_starts[group];
+        const auto end = group + 1 < key_starts.size() ? key_starts[group + 1] : keys.size();
+        if (hashes[group] == hash && std::ranges::equal(keys.begin() + start, keys.begin() + static_cast<std::ptrdiff_t>(end), key.begin(), key.end())) {
+            accumulate(group, row.subspan(key_width + carried_width));
+            return false;
+        }
+    }
+
+    // once a key spilled, none may start a group in memory, or a group could come out twice
+    if (!spill.empty() || (memory > memory_budget && level <= max_level)) {
+        if (spill.empty()) {
+            spill.resize(partition_count);
+            for (auto& partition : spill) {
+                partition.rows = std::make_unique<SpillFile>();
+                partition.level = level;
+            }
+            has_spilled = true;
+        }
+        spill[partition_of(hash, level)].rows->write(key, row);
+        return false;
+    }
+    accumulate(new_group(key, hash, row), row.subspan(key_width + carried_width));
+    return true;
+}
+
+auto HashAggregate::new_group(const Blob& key, std::size_t hash, std::span<const Value> row) -> std::uint32_t {
+    if (hashes.size() + 1 == UINT32_MAX) {
+        fail("Too many groups in an aggregation");
+    }
+    if ((hashes.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+    const auto group = static_cast<std::uint32_t>(hashes.size());
+    const auto mask = slots.size() - 1;
+    auto slot = hash & mask;
+    while (slots[slot] != empty_slot) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = group + 1;
+
+    constexpr auto group_memory = 2 * sizeof(std::uint32_t) + sizeof(std::size_t) + sizeof(std::uint32_t);
+    memory += group_memory + key.size() + functions.size() * sizeof(Accumulator);
+    hashes.push_back(hash);
+    key_starts.push_back(static_cast<std::uint32_t>(keys.size()));
+    keys.insert(keys.end(), key.begin(), key.end());
+    for (const auto& value : row.first(key_width + carried_width)) {
+        memory += value_memory(value);
+        values.push_back(value);
+    }
+    accumulators.resize(accumulators.size() + functions.size());
+    return group;
+}
+
+auto HashAggregate::accumulate(std::uint32_t group, std::span<const Value> arguments) -> void {
+    auto* state = accumulators.data() + static_cast<std::size_t>(group) * functions.size();
+    if (combining) {
+        // a group's first part brings its values along, later ones only ever add to them
+        for (auto i = std::size_t{0}; i < functions.size(); ++i) {
+            const auto count = std::get<std::int64_t>(arguments[2 * i + 1]);
+            if (count > 0) {
+                fold(functions[i], state[i], arguments[2 * i]);
+                state[i].count += count;
+            }
+        }
+        return;
+    }
+    auto argument = arguments.begin();
+    for (const auto function : functions) {
+        auto& accumulator = *state++;
+        if (function == AggregateFunction::COUNT_ROWS) {
+            ++accumulator.count;
+            continue;
+        }
+        const auto& value = *argument++;
+        if (std::holds_alternative<Null>(value)) {
+            continue;
+        }
+        fold(function, accumulator, value);
+        ++accumulator.count;
+    }
+}
+
+auto HashAggregate::fold(AggregateFunction function, Accumulator& accumulator, const Value& value) -> void {
+    switch (function) {
+        case AggregateFunction::SUM:
+        case AggregateFunction::AVG: {
+            // integers add up to an integer, anything else makes the sum REAL
+            const auto& sum = accumulator.count == 0 ? Value{std::int64_t{0}} : accumulator.value;
+            const auto* lhs = std::get_if<std::int64_t>(&sum);
+            const auto* rhs = std::get_if<std::int64_t>(&value);
+            auto result = std::int64_t{};
+            if (lhs && rhs && __builtin_add_overflow(*lhs, *rhs, &result)) {
+                // like sqlite, an integer sum() fails while avg() carries on in REAL
+                if (function == AggregateFunction::SUM) {
+                    fail("Integer overflow");
+                }
+                accumulator.value = ::add(Value{static_cast<double>(*lhs)}, value);
+            } else if (lhs && rhs) {
+                accumulator.value = result;
+            } else {
+                accumulator.value = ::add(sum, rhs ? value : ::add(Value{0.0}, value));
+            }
+            break;
+        }
+        case AggregateFunction::MIN:
+        case AggregateFunction::MAX: {
+            const auto sign = function == AggregateFunction::MIN ? -1 : 1;
+            if (accumulator.count == 0 || *compare(value, accumulator.value) * sign > 0) {
+                memory += value_memory(value);
+                memory -= value_memory(accumulator.value);
+                accumulator.value = value;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+auto HashAggregate::grow() -> void {
+    slots.assign(slots.size() * 2, empty_slot);
+    const auto mask = slots.size() - 1;
+    for (auto group = std::size_t{0}; group < hashes.size(); ++group) {
+        auto slot = hashes[group] & mask;
+        while (slots[slot] != empty_slot) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = static_cast<std::uint32_t>(group + 1);
+    }
+}
+
+auto HashAggregate::clear_table() -> void {
+    // swapped out to give the memory back, clear() keeps the capacity
+    slots = std::vector<std::uint32_t>(initial_slots, empty_slot);
+    hashes = {};
+    key_starts = {};
+    keys = {};
+    values = {};
+    accumulators = {};
+    memory = 0;
+}
+
+auto HashAggregate::close_spill() -> void {
+    for (auto& partition : spill) {
+        if (partition.rows->rows() > 0) {
+            partitions.push_back(std::move(partition));
+        }
+    }
+    spill.clear();
+}
+
+auto HashAggregate::load_partition() -> bool {
+    auto key = Blob{};
+    auto row = std::vector<Value>{};
+    while (!partitions.empty()) {
+        auto partition = std::move(partitions.back());
+        partitions.pop_back();
+        clear_table();
+        level = partition.level + 1;
+        partition.rows->rewind();
+        while (partition.rows->read(key, row)) {
+            add_encoded(key, row);
+        }
+        close_spill();
+        if (!hashes.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto HashAggregate::next_group() -> std::optional<std::uint32_t> {
+    while (position == hashes.size()) {
+        if (!load_partition()) {
+            return std::nullopt;
+        }
+        position = 0;
+    }
+    return position++;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "hash_join.hpp"
+#include "operators.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+// how much memory a hash aggregation keeps its groups in by default, see HashAggregate
+inline constexpr std::size_t default_aggregate_memory_budget = std::size_t{64} << 20;
+
+// GROUP BY and DISTINCT: rows go in, and a row per group comes out, made of the group's key, the
+// values its first row had in the carried columns and the results of the aggregate functions over
+// its rows. Keys are encoded like index keys (see append_key_column), so the rows whose key
+// values compare equal make a group, and the NULLs make one too.
+//
+// The groups live in an open addressing hash table. Once they outgrow the memory budget they stay
+// there and keep aggregating their rows, but a row starting a new group is written to one of
+// partition_count temporary files by the hash of its key. The groups in memory come out first,
+// then the partitions are aggregated one at a time, a partition's own new groups spilling the
+// same way with the next bits of the hash, up to max_level times.
+//
+// A parallel aggregation gives each morsel a partial HashAggregate, and add_part() combines the
+// groups of each into the final one, in morsel order so the groups, their carried values and
+// their order are those of a single scan.
+class HashAggregate {
+public:
+    // The rows are the key_width key values, then the carried_width carried values, then the
+    // argument of each function but COUNT_ROWS. With hand_back, a DISTINCT hands back the rows
+    // starting a group as they go in, and next() skips the groups they started.
+    HashAggregate(std::size_t key_width, std::size_t carried_width, std::span<const AggregateFunction> functions,
+                  bool hand_back, std::size_t memory_budget);
+
+    // whether it's a row to hand back, one starting a group in memory
+    auto add(std::span<const Value> row) -> bool;
+    // after the last add: loads the next group into result_width values, false once there's none.
+    // Without a key, an aggregate of no rows at all is a group still.
+    auto next(std::span<Value> result) -> bool;
+
+    // an empty aggregation like this one for a share of the rows, with a parts-th of the memory
+    // budget, handing nothing back
+    [[nodiscard]] auto partial(std::size_t parts) const -> HashAggregate;
+    // instead of the rows of add(): combines the groups of a partial aggregation into these
+    auto add_part(HashAggregate& part) -> void;
+
+    [[nodiscard]] auto hands_back() const -> bool { return hand_back; }
+    [[nodiscard]] auto row_width() const -> std::size_t { return key_width + carried_width + argument_count; }
+    [[nodiscard]] auto result_width() const -> std::size_t { return key_width + carried_width + functions.size(); }
+    [[nodiscard]] auto spilled() const -> bool { return has_spilled; }
+
+    static constexpr std::size_t partition_count = 16;
+    static constexpr std::size_t max_level = 8;
+
+private:
+    // a function's running state: the sum, minimum or maximum, and the values counted
+    struct Accumulator {
+        Value value;
+        std::int64_t count = 0;
+    };
+
+    struct Partition {
+        std::unique_ptr<SpillFile> rows;
+        // how many times its rows were split, as for HashJoin
+        std::size_t level = 0;
+    };
+
+    // adds the encoded key's row, starting a group for a new key while there's room
+    auto add_encoded(const Blob& key, std::span<const Value> row) -> bool;
+    auto new_group(const Blob& key, std::size_t hash, std::span<const Value> row) -> std::uint32_t;
+    // arguments - a partial aggregation's value and count per function when combining
+    auto accumulate(std::uint32_t group, std::span<const Value> arguments) -> void;
+    // adds a value that isn't NULL to a SUM, AVG, MIN or MAX, leaving the count alone
+    auto fold(AggregateFunction function, Accumulator& accumulator, const Value& value) -> void;
+    auto grow() -> void;
+    auto clear_table() -> void;
+    // moves the rows spilled while filling the table to the partitions still to aggregate
+    auto close_spill() -> void;
+    // the next partition's groups in the table, false once every partition is done
+    auto load_partition() -> bool;
+    // the group next() loads next, nullopt once there's none
+    auto next_group() -> std::optional<std::uint32_t>;
+
+    static constexpr std::uint32_t empty_slot = 0;
+
+    std::size_t key_width;
+    std::size_t carried_width;
+    std::vector<AggregateFunction> functions;
+    std::size_t argument_count = 0;
+    bool hand_back;
+    std::size_t memory_budget;
+    // whether the rows are the groups of partial aggregations, see add_part
+    bool combining = false;
+
+    // group + 1 per slot, at most half of them taken, found by linear probing from the hash
+    std::vector<std::uint32_t> slots;
+    // per group: its key's hash, its key at key_starts[group] in keys, its key and carried
+    // values, and an accumulator per function
+    std::vector<std::size_t> hashes;
+    std::vector<std::uint32_t> key_starts;
+    Blob keys;
+    std::vector<Value> values;
+    std::vector<Accumulator> accumulators;
+    std::size_t memory = 0;
+    Blob key_buffer;
+
+    // the level the table's new groups spill at, and the partitions they spilled to
+    std::size_t level = 0;
+    std::vector<Partition> spill;
+    // the partitions not aggregated yet, the next group next() loads
+    std::vector<Partition> partitions;
+    bool finished = false;
+    std::uint32_t position = 0;
+    bool has_spilled = false;
+};
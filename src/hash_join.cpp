@@ -0,0 +1,269 @@
+#include "hash_join.hpp"
+#include "common.hpp"
+#include "index.hpp"
+#include "record.hpp"
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+namespace {
+
+// a row's share of a HashJoin's memory: its values, its key and its chain link, plus what a new
+// key costs the hash map (node and bucket)
+auto row_memory(std::span<const std::uint8_t> key, std::span<const Value> row) -> std::size_t {
+    constexpr auto map_entry = std::size_t{64};
+    auto size = map_entry + sizeof(Blob) + key.size() + sizeof(std::uint32_t);
+    for (const auto& value : row) {
+        size += sizeof(Value);
+        if (const auto* text = std::get_if<std::string>(&value)) {
+            size += text->size();
+        } else if (const auto* blob = std::get_if<Blob>(&value)) {
+            size += blob->size();
+        }
+    }
+    return size;
+}
+
+// the partition of a key after it was split level times, each level takes the next 4 bits of
+// the hash from the top, the hash table's buckets use the bottom ones
+auto partition_of(std::span<const std::uint8_t> key, std::size_t level) -> std::size_t {
+    static_assert(HashJoin::partition_count == 16 && HashJoin::max_level * 4 <= 60);
+    const auto hash = static_cast<std::uint64_t>(key_hash(key));
+    return static_cast<std::size_t>(hash >> (60 - 4 * level)) & (HashJoin::partition_count - 1);
+}
+
+} // namespace
+
+auto key_hash(std::span<const std::uint8_t> key) -> std::size_t {
+    return std::hash<std::string_view>{}(std::string_view{reinterpret_cast<const char*>(key.data()), key.size()});
+}
+
+// ===================================
+// SpillFile
+// ===================================
+SpillFile::SpillFile() : file(std::tmpfile()) {
+    if (!file) {
+        fail("Failed to create a temporary file: {}", std::strerror(errno));
+    }
+}
+
+SpillFile::~SpillFile() {
+    std::fclose(file);
+}
+
+auto SpillFile::write(std::span<const std::uint8_t> key, std::span<const Value> row) -> void {
+    // [key size][key][record size][record], sizes as u32 in native byte order
+    const auto record = encode_record(row);
+    const auto key_size = static_cast<std::uint32_t>(key.size());
+    const auto record_size = static_cast<std::uint32_t>(record.size());
+    if (std::fwrite(&key_size, sizeof(key_size), 1, file) != 1 ||
+        std::fwrite(key.data(), 1, key.size(), file) != key.size() ||
+        std::fwrite(&record_size, sizeof(record_size), 1, file) != 1 ||
+        std::fwrite(record.data(), 1, record.size(), file) != record.size()) {
+        fail("Failed to write a temporary file: {}", std::strerror(errno));
+    }
+    ++row_count;
+    memory += row_memory(key, row);
+}
+
+auto SpillFile::rewind() -> void {
+    if (std::fflush(file) != 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+        fail("Failed to rewind a temporary file: {}", std::strerror(errno));
+    }
+}
+
+auto SpillFile::read(Blob& key, std::vector<Value>& row) -> bool {
+    auto key_size = std::uint32_t{};
+    if (std::fread(&key_size, sizeof(key_size), 1, file) != 1) {
+        if (std::ferror(file)) {
+            fail("Failed to read a temporary file: {}", std::strerror(errno));
+        }
+        return false;
+    }
+    key.resize(key_size);
+    auto record_size = std::uint32_t{};
+    if (std::fread(key.data(), 1, key.size(), file) != key.size() ||
+        std::fread(&record_size, sizeof(record_size), 1, file) != 1) {
+        fail("Temporary file is truncated");
+    }
+    buffer.resize(record_size);
+    if (std::fread(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        fail("Temporary file is truncated");
+    }
+    row = decode_record(buffer);
+    return true;
+}
+
+// ===================================
+// HashJoin
+// ===================================
+auto HashJoin::KeyHash::operator()(const Blob& key) const -> std::size_t {
+    return key_hash(key);
+}
+
+HashJoin::HashJoin(std::size_t build_width, std::size_t memory_budget)
+    : row_width(build_width), memory_budget(memory_budget) {}
+
+auto HashJoin::encode_key(std::span<const Value> key) -> bool {
+    key_buffer.clear();
+    for (const auto& value : key) {
+        if (std::holds_alternative<Null>(value)) {
+            return false;
+        }
+        append_key_column(key_buffer, value, false);
+    }
+    return true;
+}
+
+auto HashJoin::insert(std::span<const Value> key, std::span<const Value> row) -> void {
+    if (!encode_key(key)) {
+        return;
+    }
+    if (!partitions.empty()) {
+        partitions[partition_of(key_buffer, 0)].build->write(key_buffer, row);
+        return;
+    }
+    add_to_table(key_buffer, row);
+    if (memory > memory_budget) {
+        spill();
+    }
+}
+
+auto HashJoin::probe(std::span<const Value> key, std::span<const Value> row) -> bool {
+    match = no_row;
+    if (!encode_key(key)) {
+        return false;
+    }
+    if (!partitions.empty()) {
+        auto& partition = partitions[partition_of(key_buffer, 0)];
+        // no build row can match the ones of an empty partition
+        if (partition.build->rows() > 0) {
+            partition.probe->write(key_buffer, row);
+        }
+        return false;
+    }
+    if (const auto it = heads.find(key_buffer); it != heads.end()) {
+        match = it->second;
+    }
+    return match != no_row;
+}
+
+auto HashJoin::next() -> bool {
+    if (match != no_row) {
+        match = chain[match];
+        if (match != no_row) {
+            return true;
+        }
+    }
+    return drain_started && advance_drain();
+}
+
+auto HashJoin::drain() -> bool {
+    if (drain_started || partitions.empty()) {
+        return false;
+    }
+    drain_started = true;
+    clear_table();
+    return advance_drain();
+}
+
+auto HashJoin::build_row() const -> std::span<const Value> {
+    return {rows.data() + static_cast<std::size_t>(match) * row_width, row_width};
+}
+
+auto HashJoin::add_to_table(const Blob& key, std::span<const Value> row) -> void {
+    if (chain.size() == no_row) {
+        fail("Too many rows on the build side of a join");
+    }
+    const auto id = static_cast<std::uint32_t>(chain.size());
+    memory += row_memory(key, row);
+    rows.insert(rows.end(), row.begin(), row.end());
+    // the new row goes to the front of its key's chain, which only changes the order of matches
+    const auto [it, inserted] = heads.try_emplace(key, id);
+    chain.push_back(inserted ? no_row : std::exchange(it->second, id));
+}
+
+auto HashJoin::clear_table() -> void {
+    // swapped out to give the memory back, clear() keeps the capacity
+    heads = {};
+    chain = {};
+    rows = {};
+    memory = 0;
+    match = no_row;
+}
+
+auto HashJoin::make_partitions(std::size_t level) const -> std::vector<Partition> {
+    auto result = std::vector<Partition>(partition_count);
+    for (auto& partition : result) {
+        partition.build = std::make_unique<SpillFile>();
+        partition.probe = std::make_unique<SpillFile>();
+        partition.level = level;
+    }
+    return result;
+}
+
+auto HashJoin::spill() -> void {
+    partitions = make_partitions(0);
+    for (const auto& [key, head] : heads) {
+        for (auto row = head; row != no_row; row = chain[row]) {
+            partitions[partition_of(key, 0)].build->write(key, {rows.data() + static_cast<std::size_t>(row) * row_width, row_width});
+        }
+    }
+    clear_table();
+}
+
+auto HashJoin::split(Partition& partition) -> void {
+    const auto level = partition.level + 1;
+    auto parts = make_partitions(level);
+    auto key = Blob{};
+    auto row = std::vector<Value>{};
+    partition.build->rewind();
+    while (partition.build->read(key, row)) {
+        parts[partition_of(key, level)].build->write(key, row);
+    }
+    partition.probe->rewind();
+    while (partition.probe->read(key, row)) {
+        parts[partition_of(key, level)].probe->write(key, row);
+    }
+    partition = {};
+    for (auto& part : parts) {
+        partitions.push_back(std::move(part));
+    }
+}
+
+auto HashJoin::advance_drain() -> bool {
+    auto key = Blob{};
+    for (;;) {
+        if (drained_probes) {
+            while (drained_probes->read(key, spilled_probe_row)) {
+                if (const auto it = heads.find(key); it != heads.end()) {
+                    match = it->second;
+                    return true;
+                }
+            }
+            drained_probes.reset();
+            clear_table();
+        }
+        if (partitions.empty()) {
+            return false;
+        }
+
+        auto partition = std::move(partitions.back());
+        partitions.pop_back();
+        if (partition.build->rows() == 0 || partition.probe->rows() == 0) {
+            continue;
+        }
+        if (partition.build->memory_size() > memory_budget && partition.level < max_level) {
+            split(partition);
+            continue;
+        }
+        auto row = std::vector<Value>{};
+        partition.build->rewind();
+        while (partition.build->read(key, row)) {
+            add_to_table(key, row);
+        }
+        drained_probes = std::move(partition.probe);
+        drained_probes->rewind();
+    }
+}
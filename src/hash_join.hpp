@@ -0,0 +1,119 @@
+#pragma once
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// how much of its build side a hash join keeps in memory by default, see HashJoin
+inline constexpr std::size_t default_join_memory_budget = std::size_t{64} << 20;
+
+// the hash of a key encoded like an index key, see append_key_column
+[[nodiscard]] auto key_hash(std::span<const std::uint8_t> key) -> std::size_t;
+
+// A temporary file of (key, row) pairs, written in one go and then read back in order. The
+// file is gone once it's closed.
+class SpillFile {
+public:
+    SpillFile();
+    ~SpillFile();
+    SpillFile(const SpillFile&) = delete;
+    auto operator=(const SpillFile&) -> SpillFile& = delete;
+
+    auto write(std::span<const std::uint8_t> key, std::span<const Value> row) -> void;
+    // back to the first pair, for reading
+    auto rewind() -> void;
+    // false past the last pair
+    auto read(Blob& key, std::vector<Value>& row) -> bool;
+
+    [[nodiscard]] auto rows() const -> std::size_t { return row_count; }
+    // what the rows written so far take up in a HashJoin's memory
+    [[nodiscard]] auto memory_size() const -> std::size_t { return memory; }
+
+private:
+    std::FILE* file;
+    Blob buffer;
+    std::size_t row_count = 0;
+    std::size_t memory = 0;
+};
+
+// Inner equi-join: every probe row is paired with every build row that has the same key. Keys are
+// encoded like index keys (see append_key_column), so two keys match exactly when '=' holds for
+// each of their values, and a key with a NULL never matches anything.
+//
+// The build rows go into an in-memory hash table. If they outgrow the memory budget it becomes
+// a grace hash join: the build rows, and every probe row after them, are split by the hash of
+// their key into partition_count temporary files each, and drain() joins one partition at a time
+// once the probe side is done. A partition that still doesn't fit is split again with the next
+// bits of the hash, up to max_level times, which is as far as it can go for a skewed key.
+class HashJoin {
+public:
+    HashJoin(std::size_t build_width, std::size_t memory_budget);
+
+    // every build row goes in before the first probe
+    auto insert(std::span<const Value> key, std::span<const Value> row) -> void;
+    // positions on the first build row matching the probe row, false if there is none - or none
+    // yet for a spilled join, which keeps the probe row until drain()
+    auto probe(std::span<const Value> key, std::span<const Value> row) -> bool;
+    // the next pair, of the probe row that was just probed, or of any spilled one while draining
+    auto next() -> bool;
+    // after the last probe: positions on the first pair of the spilled probe rows, false if
+    // there's none (or the join never spilled)
+    auto drain() -> bool;
+
+    // whether drain() was called, the probe row is then the one read back from its partition
+    [[nodiscard]] auto draining() const -> bool { return drain_started; }
+    [[nodiscard]] auto spilled() const -> bool { return !partitions.empty() || drain_started; }
+    [[nodiscard]] auto probe_row() const -> std::span<const Value> { return spilled_probe_row; }
+    [[nodiscard]] auto build_row() const -> std::span<const Value>;
+    [[nodiscard]] auto build_width() const -> std::size_t { return row_width; }
+
+    static constexpr std::size_t partition_count = 16;
+    static constexpr std::size_t max_level = 8;
+
+private:
+    struct KeyHash {
+        auto operator()(const Blob& key) const -> std::size_t;
+    };
+
+    struct Partition {
+        std::unique_ptr<SpillFile> build;
+        std::unique_ptr<SpillFile> probe;
+        // how many times its rows were split, which picks the bits of the hash that split them next
+        std::size_t level = 0;
+    };
+
+    // false if the key has a NULL
+    auto encode_key(std::span<const Value> key) -> bool;
+    auto add_to_table(const Blob& key, std::span<const Value> row) -> void;
+    auto clear_table() -> void;
+    auto spill() -> void;
+    auto split(Partition& partition) -> void;
+    [[nodiscard]] auto make_partitions(std::size_t level) const -> std::vector<Partition>;
+    // the next probe row of the drained partitions that has a match
+    auto advance_drain() -> bool;
+
+    static constexpr std::uint32_t no_row = UINT32_MAX;
+
+    std::size_t row_width;
+    std::size_t memory_budget;
+
+    // the in-memory hash table: the first row of each key, chained to the other rows with that
+    // key, the rows are row_width values each
+    std::unordered_map<Blob, std::uint32_t, KeyHash> heads;
+    std::vector<std::uint32_t> chain;
+    std::vector<Value> rows;
+    std::size_t memory = 0;
+    std::uint32_t match = no_row;
+    Blob key_buffer;
+
+    // set once the build side outgrew memory_budget, the partitions not drained yet after that
+    std::vector<Partition> partitions;
+    bool drain_started = false;
+    std::unique_ptr<SpillFile> drained_probes;
+    std::vector<Value> spilled_probe_row;
+};
@@ -0,0 +1,468 @@
+#include "index.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// ===================================
+// keys
+// ===================================
+constexpr std::uint8_t null_tag = 0x10;
+constexpr std::uint8_t number_tag = 0x20;
+constexpr std::uint8_t text_tag = 0x30;
+constexpr std::uint8_t blob_tag = 0x40;
+
+auto append_u64(Blob& key, std::uint64_t value) -> void {
+    for (auto shift = 56; shift >= 0; shift -= 8) {
+        key.push_back(static_cast<std::uint8_t>(value >> shift));
+    }
+}
+
+auto append_integer(Blob& key, std::int64_t value) -> void {
+    append_u64(key, static_cast<std::uint64_t>(value) ^ (1ULL << 63));
+}
+
+auto append_number(Blob& key, double approximate, std::int64_t exact) -> void {
+    key.push_back(number_tag);
+    // -0.0 == 0.0
+    auto bits = std::bit_cast<std::uint64_t>(approximate == 0.0 ? 0.0 : approximate);
+    // negative doubles order backwards by their bits, positive ones after every negative one
+    bits = bits >> 63 ? ~bits : bits ^ (1ULL << 63);
+    append_u64(key, bits);
+    append_integer(key, exact);
+}
+
+auto append_bytes(Blob& key, std::uint8_t tag, std::span<const std::uint8_t> bytes) -> void {
+    key.push_back(tag);
+    for (const auto byte : bytes) {
+        key.push_back(byte);
+        if (byte == 0x00) {
+            key.push_back(0xFF);
+        }
+    }
+    key.push_back(0x00);
+    key.push_back(0x00);
+}
+
+auto truncate(double value) -> std::int64_t {
+    constexpr auto limit = 9223372036854775808.0;
+    if (value >= limit) return std::numeric_limits<std::int64_t>::max();
+    if (value < -limit) return std::numeric_limits<std::int64_t>::min();
+    return static_cast<std::int64_t>(value);
+}
+
+// <0, 0 or >0, a prefix sorts first
+auto compare_keys(std::span<const std::uint8_t> a, std::span<const std::uint8_t> b) -> int {
+    const auto common = std::min(a.size(), b.size());
+    if (common > 0) {
+        if (const auto order = std::memcmp(a.data(), b.data(), common); order != 0) {
+            return order;
+        }
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+}
+
+// ===================================
+// nodes
+// ===================================
+constexpr std::uint8_t leaf_type = 3;
+constexpr std::uint8_t interior_type = 4;
+
+// node header, as in BTree: type (u8), unused (u8), cell count (u16), content start (u16),
+// unused (u16), right (u32) - the right sibling of a leaf or the rightmost child of an interior node
+constexpr std::size_t header_size = 16;
+constexpr std::size_t type_offset = 0;
+constexpr std::size_t count_offset = 2;
+constexpr std::size_t content_offset = 4;
+constexpr std::size_t right_offset = 8;
+
+constexpr std::size_t offset_size = sizeof(std::uint16_t);
+constexpr std::size_t size_prefix = sizeof(std::uint16_t);
+constexpr std::size_t max_cell_overhead = offset_size + sizeof(PageId) + size_prefix;
+
+static_assert(page_size <= UINT16_MAX + 1, "page offsets have to fit in 16 bits");
+static_assert(3 * (max_cell_overhead + IndexBTree::max_entry_size) <= page_size - header_size,
+              "a node has to fit at least three cells for splits to work");
+
+template <typename T>
+auto load(const Page& page, std::size_t offset) -> T {
+    auto value = T{};
+    std::memcpy(&value, page.data.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+auto store(Page& page, std::size_t offset, T value) -> void {
+    std::memcpy(page.data.data() + offset, &value, sizeof(T));
+}
+
+auto node_type(const Page& page) -> std::uint8_t { return load<std::uint8_t>(page, type_offset); }
+auto cell_count(const Page& page) -> std::size_t { return load<std::uint16_t>(page, count_offset); }
+auto set_cell_count(Page& page, std::size_t count) -> void { store(page, count_offset, static_cast<std::uint16_t>(count)); }
+auto content_start(const Page& page) -> std::size_t {
+    // 0 stands for page_size, which doesn't fit in 16 bits when pages are 64KiB
+    const auto start = load<std::uint16_t>(page, content_offset);
+    return start == 0 ? page_size : start;
+}
+auto set_content_start(Page& page, std::size_t start) -> void { store(page, content_offset, static_cast<std::uint16_t>(start)); }
+auto right(const Page& page) -> PageId { return load<PageId>(page, right_offset); }
+auto set_right(Page& page, PageId id) -> void { store(page, right_offset, id); }
+
+auto init_node(Page& page, std::uint8_t type) -> void {
+    std::memset(page.data.data(), 0, header_size);
+    store(page, type_offset, type);
+    set_content_start(page, page_size);
+}
+
+// interior cells start with their child page
+auto child_size(std::uint8_t type) -> std::size_t { return type == interior_type ? sizeof(PageId) : 0; }
+
+auto cell_offset(const Page& page, std::size_t i) -> std::size_t {
+    return load<std::uint16_t>(page, header_size + i * offset_size);
+}
+
+auto key(const Page& page, std::size_t i) -> std::span<const std::uint8_t> {
+    const auto offset = cell_offset(page, i) + child_size(node_type(page));
+    const auto size = load<std::uint16_t>(page, offset);
+    return {page.data.data() + offset + size_prefix, size};
+}
+
+auto child(const Page& page, std::size_t i) -> PageId { return load<PageId>(page, cell_offset(page, i)); }
+auto set_child(Page& page, std::size_t i, PageId id) -> void { store(page, cell_offset(page, i), id); }
+
+auto cell_space(std::uint8_t type, std::size_t key_size) -> std::size_t {
+    return offset_size + child_size(type) + size_prefix + key_size;
+}
+
+auto free_space(const Page& page) -> std::size_t {
+    return content_start(page) - header_size - cell_count(page) * offset_size;
+}
+
+// free space after defragmentation
+auto reclaimable_space(const Page& page) -> std::size_t {
+    auto used = header_size;
+    for (auto i = std::size_t{0}; i < cell_count(page); ++i) {
+        used += cell_space(node_type(page), key(page, i).size());
+    }
+    return page_size - used;
+}
+
+// inserts a cell at position i, the caller has to make sure it fits in free_space
+auto insert_cell(Page& page, std::size_t i, PageId cell_child, std::span<const std::uint8_t> k) -> void {
+    const auto n = cell_count(page);
+    const auto extra = child_size(node_type(page));
+    auto* const data = page.data.data();
+
+    const auto start = content_start(page) - extra - size_prefix - k.size();
+    if (extra != 0) {
+        store(page, start, cell_child);
+    }
+    store(page, start + extra, static_cast<std::uint16_t>(k.size()));
+    if (!k.empty()) {
+        std::memcpy(data + start + extra + size_prefix, k.data(), k.size());
+    }
+
+    std::memmove(data + header_size + (i + 1) * offset_size, data + header_size + i * offset_size, (n - i) * offset_size);
+    store(page, header_size + i * offset_size, static_cast<std::uint16_t>(start));
+    set_content_start(page, start);
+    set_cell_count(page, n + 1);
+}
+
+// removes the cell at position i, its bytes stay behind until defragment()
+auto remove_cell(Page& page, std::size_t i) -> void {
+    const auto n = cell_count(page);
+    auto* const data = page.data.data();
+    std::memmove(data + header_size + i * offset_size, data + header_size + (i + 1) * offset_size, (n - i - 1) * offset_size);
+    set_cell_count(page, n - 1);
+}
+
+auto defragment(Page& page) -> void {
+    const auto copy = page;
+    const auto type = node_type(copy);
+    init_node(page, type);
+    set_right(page, right(copy));
+    for (auto i = std::size_t{0}; i < cell_count(copy); ++i) {
+        insert_cell(page, i, type == interior_type ? child(copy, i) : 0, key(copy, i));
+    }
+}
+
+// makes room for a cell with a key of the given size if the page has it, returns whether it does
+auto make_room(Page& page, std::size_t key_size) -> bool {
+    const auto needed = cell_space(node_type(page), key_size);
+    if (free_space(page) < needed && reclaimable_space(page) >= needed) {
+        defragment(page);
+    }
+    return free_space(page) >= needed;
+}
+
+// index of the first key >= k, cell_count if there's none
+auto lower_bound(const Page& page, std::span<const std::uint8_t> k) -> std::size_t {
+    auto lo = std::size_t{0};
+    auto hi = cell_count(page);
+    while (lo < hi) {
+        const auto mid = lo + (hi - lo) / 2;
+        if (compare_keys(key(page, mid), k) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// child to descend into when looking for k
+auto child_for(const Page& page, std::span<const std::uint8_t> k) -> PageId {
+    const auto i = lower_bound(page, k);
+    return i == cell_count(page) ? right(page) : child(page, i);
+}
+
+auto read_keys(const Page& page) -> std::vector<std::vector<std::uint8_t>> {
+    auto keys = std::vector<std::vector<std::uint8_t>>{};
+    keys.reserve(cell_count(page) + 1);
+    for (auto i = std::size_t{0}; i < cell_count(page); ++i) {
+        const auto k = key(page, i);
+        keys.emplace_back(k.begin(), k.end());
+    }
+    return keys;
+}
+
+// the position splitting the cells in two halves of about the same size, each with at least one cell
+auto split_point(const std::vector<std::vector<std::uint8_t>>& keys) -> std::size_t {
+    auto total = std::size_t{0};
+    for (const auto& k : keys) {
+        total += k.size() + max_cell_overhead;
+    }
+    auto split_at = std::size_t{0};
+    auto left_bytes = std::size_t{0};
+    while (split_at + 1 < keys.size() && left_bytes + (keys[split_at].size() + max_cell_overhead) / 2 < total / 2) {
+        left_bytes += keys[split_at].size() + max_cell_overhead;
+        ++split_at;
+    }
+    return std::max(split_at, std::size_t{1});
+}
+
+} // namespace
+
+auto append_key_column(Blob& key, const Value& value, bool descending) -> void {
+    const auto start = key.size();
+    std::visit(overloaded{
+        [&](const Null&) { key.push_back(null_tag); },
+        [&](std::int64_t v) { append_number(key, static_cast<double>(v), v); },
+        [&](double v) { append_number(key, v, truncate(v)); },
+        [&](const std::string& v) {
+            append_bytes(key, text_tag, {reinterpret_cast<const std::uint8_t*>(v.data()), v.size()});
+        },
+        [&](const Blob& v) { append_bytes(key, blob_tag, v); }
+    }, value);
+    if (descending) {
+        std::for_each(key.begin() + static_cast<std::ptrdiff_t>(start), key.end(), [](std::uint8_t& byte) { byte = ~byte; });
+    }
+}
+
+auto entry_rowid(std::span<const std::uint8_t> entry) -> std::int64_t {
+    auto value = std::uint64_t{0};
+    for (const auto byte : entry.last(sizeof(std::int64_t))) {
+        value = (value << 8) | byte;
+    }
+    return static_cast<std::int64_t>(value ^ (1ULL << 63));
+}
+
+auto key_column_size(std::span<const std::uint8_t> key, bool descending) -> std::size_t {
+    const auto flip = descending ? std::uint8_t{0xFF} : std::uint8_t{0x00};
+    if (key.empty()) {
+        fail("Malformed index key");
+    }
+    switch (key[0] ^ flip) {
+        case null_tag:
+            return 1;
+        case number_tag:
+            return 1 + 2 * sizeof(std::uint64_t);
+        case text_tag:
+        case blob_tag:
+            // up to the 0x00 0x00 terminator, an escaped 0x00 is followed by 0xFF
+            for (auto i = std::size_t{1}; i + 1 < key.size(); ++i) {
+                if ((key[i] ^ flip) == 0x00) {
+                    if ((key[i + 1] ^ flip) == 0x00) {
+                        return i + 2;
+                    }
+                    ++i;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    fail("Malformed index key");
+}
+
+auto IndexBTree::create(Pager& pager) -> PageId {
+    const auto id = pager.allocate();
+    init_node(pager.write(id), leaf_type);
+    return id;
+}
+
+auto IndexBTree::insert(std::span<const std::uint8_t> entry) -> void {
+    if (entry.size() > max_entry_size) {
+        fail("Index entry too large - {} bytes, at most {} are supported", entry.size(), max_entry_size);
+    }
+
+    const auto split = insert_into(root_page, entry);
+    if (split) {
+        // the root keeps its page number, its old contents move to a new left child
+        const auto left = pager.allocate();
+        auto& root = pager.write(root_page);
+        pager.write(left) = root;
+        init_node(root, interior_type);
+        insert_cell(root, 0, left, split->separator);
+        set_right(root, split->right);
+    }
+}
+
+auto IndexBTree::erase(std::span<const std::uint8_t> entry) -> bool {
+    auto id = root_page;
+    while (node_type(pager.read(id)) == interior_type) {
+        id = child_for(pager.read(id), entry);
+    }
+    const auto i = lower_bound(pager.read(id), entry);
+    if (i == cell_count(pager.read(id)) || compare_keys(key(pager.read(id), i), entry) != 0) {
+        return false;
+    }
+    remove_cell(pager.write(id), i);
+    return true;
+}
+
+auto IndexBTree::insert_into(PageId page_id, std::span<const std::uint8_t> entry) -> std::optional<Split> {
+    const auto& page = pager.read(page_id);
+    if (node_type(page) == leaf_type) {
+        return insert_into_leaf(page_id, entry);
+    }
+
+    const auto i = lower_bound(page, entry);
+    const auto n = cell_count(page);
+    const auto left = i == n ? right(page) : child(page, i);
+    const auto split = insert_into(left, entry);
+    if (!split) {
+        return std::nullopt;
+    }
+
+    // the child at position i was split into (left, split->right) around split->separator
+    auto& node = pager.write(page_id);
+    if (make_room(node, split->separator.size())) {
+        insert_cell(node, i, left, split->separator);
+        if (i == n) {
+            set_right(node, split->right);
+        } else {
+            set_child(node, i + 1, split->right);
+        }
+        return std::nullopt;
+    }
+
+    // full interior node - split it in half and push the middle key up
+    auto keys = read_keys(node);
+    auto children = std::vector<PageId>{};
+    children.reserve(n + 2);
+    for (auto j = std::size_t{0}; j < n; ++j) {
+        children.push_back(child(node, j));
+    }
+    children.push_back(right(node));
+    keys.insert(keys.begin() + static_cast<std::ptrdiff_t>(i), split->separator);
+    children.insert(children.begin() + static_cast<std::ptrdiff_t>(i + 1), split->right);
+
+    const auto mid = split_point(keys);
+    const auto new_page = pager.allocate();
+    auto& left_node = pager.write(page_id);
+    auto& right_node = pager.write(new_page);
+    init_node(left_node, interior_type);
+    init_node(right_node, interior_type);
+
+    for (auto j = std::size_t{0}; j < mid; ++j) {
+        insert_cell(left_node, j, children[j], keys[j]);
+    }
+    set_right(left_node, children[mid]);
+    for (auto j = mid + 1; j < keys.size(); ++j) {
+        insert_cell(right_node, j - mid - 1, children[j], keys[j]);
+    }
+    set_right(right_node, children.back());
+
+    return Split{.separator = std::move(keys[mid]), .right = new_page};
+}
+
+auto IndexBTree::insert_into_leaf(PageId page_id, std::span<const std::uint8_t> entry) -> std::optional<Split> {
+    auto& page = pager.write(page_id);
+    const auto i = lower_bound(page, entry);
+    if (i < cell_count(page) && compare_keys(key(page, i), entry) == 0) {
+        return std::nullopt;
+    }
+    if (make_room(page, entry.size())) {
+        insert_cell(page, i, 0, entry);
+        return std::nullopt;
+    }
+
+    auto keys = read_keys(page);
+    keys.emplace(keys.begin() + static_cast<std::ptrdiff_t>(i), entry.begin(), entry.end());
+    const auto split_at = split_point(keys);
+
+    const auto new_page = pager.allocate();
+    auto& right_leaf = pager.write(new_page);
+    auto& left_leaf = pager.write(page_id);
+    init_node(right_leaf, leaf_type);
+    set_right(right_leaf, right(left_leaf));
+    init_node(left_leaf, leaf_type);
+    set_right(left_leaf, new_page);
+    for (auto j = std::size_t{0}; j < split_at; ++j) {
+        insert_cell(left_leaf, j, 0, keys[j]);
+    }
+    for (auto j = split_at; j < keys.size(); ++j) {
+        insert_cell(right_leaf, j - split_at, 0, keys[j]);
+    }
+
+    return Split{.separator = std::move(keys[split_at - 1]), .right = new_page};
+}
+
+// ===================================
+// cursor
+// ===================================
+auto IndexCursor::enter(PageId id) -> void {
+    leaf = id;
+    page = id == 0 ? PageRef{} : tree->pager.read(id, snapshot);
+}
+
+auto IndexCursor::settle() -> bool {
+    while (leaf != 0 && position >= cell_count(page)) {
+        enter(right(page));
+        position = 0;
+    }
+    return leaf != 0;
+}
+
+auto IndexCursor::first() -> bool {
+    auto id = tree->root_page;
+    for (auto node = tree->pager.read(id, snapshot); node_type(node) == interior_type; node = tree->pager.read(id, snapshot)) {
+        id = cell_count(node) == 0 ? right(node) : child(node, 0);
+    }
+    enter(id);
+    position = 0;
+    return settle();
+}
+
+auto IndexCursor::seek(std::span<const std::uint8_t> k) -> bool {
+    auto id = tree->root_page;
+    for (auto node = tree->pager.read(id, snapshot); node_type(node) == interior_type; node = tree->pager.read(id, snapshot)) {
+        id = child_for(node, k);
+    }
+    enter(id);
+    position = static_cast<std::uint16_t>(lower_bound(page, k));
+    return settle();
+}
+
+auto IndexCursor::next() -> bool {
+    ++position;
+    return settle();
+}
+
+auto IndexCursor::entry() const -> std::span<const std::uint8_t> {
+    return key(page, position);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "pager.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Index keys are byte strings that memcmp orders the way compare() (operators.hpp) orders their
+// values, column by column - NULL < INTEGER and REAL < TEXT < BLOB, numbers by value whatever
+// their storage class. Every column's encoding starts with a type tag and is prefix free, so a
+// DESC column is simply stored with all of its bytes inverted. An index entry is the key of the
+// indexed columns followed by the row's rowid, which makes every entry unique.
+//  - NULL:          0x10
+//  - INTEGER, REAL: 0x20, the value as an order preserving double (8 bytes), then the exact value
+//                   as a big endian INTEGER with its sign bit flipped (8 bytes, the truncated
+//                   value for a REAL) to tell apart integers that round to the same double
+//  - TEXT, BLOB:    0x30 / 0x40, the bytes with 0x00 escaped as 0x00 0xFF, then 0x00 0x00
+auto append_key_column(Blob& key, const Value& value, bool descending) -> void;
+// sorts after every column encoding, appended to a prefix it makes a key that sorts after
+// every entry starting with that prefix and before any other greater entry
+inline constexpr std::uint8_t key_prefix_end = 0xFF;
+// the rowid at the end of an index entry
+[[nodiscard]] auto entry_rowid(std::span<const std::uint8_t> entry) -> std::int64_t;
+// the size of the column encoding the key starts with
+[[nodiscard]] auto key_column_size(std::span<const std::uint8_t> key, bool descending) -> std::size_t;
+
+// B+tree of index entries, compared with memcmp (a shorter key sorts first). Entries are the
+// whole cell, there is no payload. Same node layout as BTree except that keys have variable
+// sizes, so they're stored in the cells and only their offsets form the sorted array:
+//  - leaf:     [header][cell offset (u16) x n] ... free ... [cells: key size (u16), key]
+//  - interior: [header][cell offset (u16) x n] ... free ... [cells: child (u32), key size (u16), key]
+//              child i holds the keys <= key i, the header's right pointer the rest
+// Deleting leaves nodes as they are, even empty ones - cursors step over them and the
+// separators above stay valid bounds.
+class IndexBTree {
+public:
+    IndexBTree(Pager& pager, PageId root) : pager(pager), root_page(root) {}
+
+    // allocates an empty tree and returns its root page
+    [[nodiscard]] static auto create(Pager& pager) -> PageId;
+
+    [[nodiscard]] auto root() const -> PageId { return root_page; }
+
+    // inserting an entry that's already there does nothing
+    auto insert(std::span<const std::uint8_t> entry) -> void;
+    // returns whether the entry was there
+    auto erase(std::span<const std::uint8_t> entry) -> bool;
+
+    static constexpr std::size_t max_entry_size = page_size / 4 - 16;
+
+private:
+    friend class IndexCursor;
+
+    struct Split {
+        std::vector<std::uint8_t> separator;
+        PageId right;
+    };
+
+    auto insert_into(PageId page, std::span<const std::uint8_t> entry) -> std::optional<Split>;
+    auto insert_into_leaf(PageId page, std::span<const std::uint8_t> entry) -> std::optional<Split>;
+
+    Pager& pager;
+    PageId root_page;
+};
+
+// Position within the leaf level of an IndexBTree, which keeps its leaf pinned. Entry views point
+// into the page and stay valid until the cursor moves to another leaf or the tree is modified.
+// Like BTreeCursor, reads the tree as of the snapshot if there is one.
+class IndexCursor {
+public:
+    explicit IndexCursor(IndexBTree& tree, const Snapshot* snapshot = nullptr) : tree(&tree), snapshot(snapshot) {}
+
+    // each of these returns whether the cursor ended up on an entry
+    auto first() -> bool;
+    // positions on the first entry >= key
+    auto seek(std::span<const std::uint8_t> key) -> bool;
+    auto next() -> bool;
+
+    [[nodiscard]] auto index() const -> IndexBTree& { return *tree; }
+    [[nodiscard]] auto valid() const -> bool { return leaf != 0; }
+    [[nodiscard]] auto entry() const -> std::span<const std::uint8_t>;
+
+private:
+    // moves to the leaf, 0 for none
+    auto enter(PageId id) -> void;
+    auto settle() -> bool;
+
+    IndexBTree* tree;
+    const Snapshot* snapshot;
+    PageId leaf = 0;
+    PageRef page;
+    std::uint16_t position = 0;
+};
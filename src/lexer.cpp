@@ -0,0 +1,232 @@
+#include "lexer.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace {
+
+// sorted for the binary search in keyword()
+constexpr auto keywords = std::to_array<std::pair<std::string_view, TokenType>>({
+    {"ABORT", TokenType::ABORT},
+    {"ALL", TokenType::ALL},
+    {"ANALYZE", TokenType::ANALYZE},
+    {"AND", TokenType::AND},
+    {"AS", TokenType::AS},
+    {"ASC", TokenType::ASC},
+    {"BY", TokenType::BY},
+    {"COLUMNAR", TokenType::COLUMNAR},
+    {"CONFLICT", TokenType::CONFLICT},
+    {"CREATE", TokenType::CREATE},
+    {"CROSS", TokenType::CROSS},
+    {"DEFAULT", TokenType::DEFAULT},
+    {"DESC", TokenType::DESC},
+    {"DISTINCT", TokenType::DISTINCT},
+    {"EXISTS", TokenType::EXISTS},
+    {"EXPLAIN", TokenType::EXPLAIN},
+    {"FAIL", TokenType::FAIL},
+    {"FROM", TokenType::FROM},
+    {"GROUP", TokenType::GROUP},
+    {"HAVING", TokenType::HAVING},
+    {"IF", TokenType::IF},
+    {"IGNORE", TokenType::IGNORE},
+    {"INDEX", TokenType::INDEX},
+    {"INNER", TokenType::INNER},
+    {"INSERT", TokenType::INSERT},
+    {"INTO", TokenType::INTO},
+    {"JOIN", TokenType::JOIN},
+    {"LIMIT", TokenType::LIMIT},
+    {"MATERIALIZED", TokenType::MATERIALIZED},
+    {"NOT", TokenType::NOT},
+    {"NULL", TokenType::NULL_},
+    {"OFFSET", TokenType::OFFSET},
+    {"ON", TokenType::ON},
+    {"OR", TokenType::OR},
+    {"ORDER", TokenType::ORDER},
+    {"PLAN", TokenType::PLAN},
+    {"QUERY", TokenType::QUERY},
+    {"RECURSIVE", TokenType::RECURSIVE},
+    {"REPLACE", TokenType::REPLACE},
+    {"ROLLBACK", TokenType::ROLLBACK},
+    {"ROWID", TokenType::ROWID},
+    {"SELECT", TokenType::SELECT},
+    {"STRICT", TokenType::STRICT},
+    {"TABLE", TokenType::TABLE},
+    {"TEMP", TokenType::TEMP},
+    {"TEMPORARY", TokenType::TEMPORARY},
+    {"UNIQUE", TokenType::UNIQUE},
+    {"VALUES", TokenType::VALUES},
+    {"WHERE", TokenType::WHERE},
+    {"WITH", TokenType::WITH},
+    {"WITHOUT", TokenType::WITHOUT},
+});
+static_assert(std::ranges::is_sorted(keywords, {}, &std::pair<std::string_view, TokenType>::first));
+
+constexpr auto max_keyword_size = std::string_view{"MATERIALIZED"}.size();
+
+constexpr auto is_letter(char c) -> bool { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+constexpr auto is_digit(char c) -> bool { return c >= '0' && c <= '9'; }
+constexpr auto is_id_char(char c) -> bool { return is_letter(c) || is_digit(c) || c == '_' || c == '$'; }
+constexpr auto is_space(char c) -> bool { return c == ' ' || c == '\r' || c == '\n' || c == '\t'; }
+
+auto keyword(std::string_view word) -> TokenType {
+    if (word.size() > max_keyword_size) {
+        return TokenType::IDENTIFIER;
+    }
+    auto upper = std::array<char, max_keyword_size>{};
+    std::ranges::transform(word, upper.begin(), [](char c) { return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c; });
+    const auto key = std::string_view{upper.data(), word.size()};
+
+    const auto it = std::ranges::lower_bound(keywords, key, {}, &std::pair<std::string_view, TokenType>::first);
+    return it != keywords.end() && it->first == key ? it->second : TokenType::IDENTIFIER;
+}
+
+} // namespace
+
+auto Lexer::next() -> Token {
+    // whitespace and comments, a block comment may run to the end of the input
+    for (;;) {
+        while (position < sql.size() && is_space(sql[position])) {
+            ++position;
+        }
+        const auto rest = sql.substr(position);
+        if (rest.starts_with("--")) {
+            position = std::min(sql.find('\n', position), sql.size());
+        } else if (rest.starts_with("/*")) {
+            const auto end = sql.find("*/", position + 2);
+            position = end == std::string_view::npos ? sql.size() : end + 2;
+        } else {
+            break;
+        }
+    }
+    if (position == sql.size()) {
+        return Token{TokenType::END, {}};
+    }
+
+    const auto start = position;
+    const auto take = [&](TokenType type) {
+        return Token{type, sql.substr(start, position - start)};
+    };
+    const auto accept = [&](char expected) {
+        if (position < sql.size() && sql[position] == expected) {
+            ++position;
+            return true;
+        }
+        return false;
+    };
+    const auto skip_while = [&](auto predicate) {
+        while (position < sql.size() && predicate(sql[position])) {
+            ++position;
+        }
+    };
+
+    const auto c = sql[position++];
+    switch (c) {
+        case '(': return take(TokenType::LPAREN);
+        case ')': return take(TokenType::RPAREN);
+        case ',': return take(TokenType::COMMA);
+        case '.': return take(TokenType::DOT);
+        case '*': return take(TokenType::STAR);
+        case ';': return take(TokenType::SEMI);
+        case '+': return take(TokenType::PLUS);
+        case '-': return take(TokenType::MINUS);
+        case '/': return take(TokenType::DIV);
+        case '%': return take(TokenType::MOD);
+        case '<':
+            if (accept('=')) return take(TokenType::LT_EQ);
+            if (accept('>')) return take(TokenType::NOT_EQ2);
+            return take(TokenType::LT);
+        case '>':
+            return take(accept('=') ? TokenType::GT_EQ : TokenType::GT);
+        case '=':
+            return take(accept('=') ? TokenType::EQ : TokenType::ASSIGN);
+        case '!':
+            if (accept('=')) return take(TokenType::NOT_EQ1);
+            break;
+        case '|':
+            if (accept('|')) return take(TokenType::PIPE2);
+            break;
+        case '\'':
+            // '' stands for a quote and doesn't end the literal
+            while (position < sql.size()) {
+                if (sql[position++] == '\'' && !accept('\'')) {
+                    return take(TokenType::STRING_LITERAL);
+                }
+            }
+            fail("Unterminated string literal at offset {}", start);
+        case '?':
+            skip_while(is_digit);
+            return take(TokenType::BIND_PARAMETER);
+        case ':':
+            skip_while(is_id_char);
+            if (position - start == 1) {
+                fail("Unrecognized token ':' at offset {}", start);
+            }
+            return take(TokenType::BIND_PARAMETER);
+        default:
+            break;
+    }
+
+    if (is_letter(c)) {
+        skip_while(is_id_char);
+        auto token = take(TokenType::IDENTIFIER);
+        token.type = keyword(token.text);
+        return token;
+    }
+    if (is_digit(c)) {
+        skip_while(is_digit);
+        if (accept('.')) {
+            skip_while(is_digit);
+        }
+        // the exponent only belongs to the number if it has digits, "1e" is a number and a name
+        if (position < sql.size() && (sql[position] == 'e' || sql[position] == 'E')) {
+            auto exponent = position + 1;
+            if (exponent < sql.size() && (sql[exponent] == '+' || sql[exponent] == '-')) {
+                ++exponent;
+            }
+            if (exponent < sql.size() && is_digit(sql[exponent])) {
+                position = exponent;
+                skip_while(is_digit);
+            }
+        }
+        return take(TokenType::NUMERIC_LITERAL);
+    }
+    fail("Unrecognized token '{}' at offset {}", c, start);
+}
+
+auto to_string(TokenType type) -> std::string_view {
+    switch (type) {
+        case TokenType::END:             return "end of input";
+        case TokenType::IDENTIFIER:      return "an identifier";
+        case TokenType::NUMERIC_LITERAL: return "a number";
+        case TokenType::STRING_LITERAL:  return "a string";
+        case TokenType::BIND_PARAMETER:  return "a parameter";
+        case TokenType::LPAREN:          return "'('";
+        case TokenType::RPAREN:          return "')'";
+        case TokenType::COMMA:           return "','";
+        case TokenType::DOT:             return "'.'";
+        case TokenType::STAR:            return "'*'";
+        case TokenType::SEMI:            return "';'";
+        case TokenType::PLUS:            return "'+'";
+        case TokenType::MINUS:           return "'-'";
+        case TokenType::DIV:             return "'/'";
+        case TokenType::MOD:             return "'%'";
+        case TokenType::PIPE2:           return "'||'";
+        case TokenType::LT:              return "'<'";
+        case TokenType::LT_EQ:           return "'<='";
+        case TokenType::GT:              return "'>'";
+        case TokenType::GT_EQ:           return "'>='";
+        case TokenType::ASSIGN:          return "'='";
+        case TokenType::EQ:              return "'=='";
+        case TokenType::NOT_EQ1:         return "'!='";
+        case TokenType::NOT_EQ2:         return "'<>'";
+        default:
+            break;
+    }
+    for (const auto& [text, keyword_type] : keywords) {
+        if (keyword_type == type) {
+            return text;
+        }
+    }
+    return "[UNKNOWN TOKEN]";
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// The tokens of grammar/Grammar.g4, keywords are matched case insensitively and always win
+// over IDENTIFIER, exactly like in the ANTLR lexer.
+enum class TokenType : std::uint8_t {
+    END,
+    IDENTIFIER,
+    NUMERIC_LITERAL,
+    STRING_LITERAL,
+    BIND_PARAMETER,
+
+    LPAREN,
+    RPAREN,
+    COMMA,
+    DOT,
+    STAR,
+    SEMI,
+    PLUS,
+    MINUS,
+    DIV,
+    MOD,
+    PIPE2,
+    LT,
+    LT_EQ,
+    GT,
+    GT_EQ,
+    ASSIGN,
+    EQ,
+    NOT_EQ1,
+    NOT_EQ2,
+
+    ABORT,
+    ALL,
+    ANALYZE,
+    AND,
+    AS,
+    ASC,
+    BY,
+    COLUMNAR,
+    CONFLICT,
+    CREATE,
+    CROSS,
+    DEFAULT,
+    DESC,
+    DISTINCT,
+    EXISTS,
+    EXPLAIN,
+    FAIL,
+    FROM,
+    GROUP,
+    HAVING,
+    IF,
+    IGNORE,
+    INDEX,
+    INNER,
+    INSERT,
+    INTO,
+    JOIN,
+    LIMIT,
+    MATERIALIZED,
+    NOT,
+    NULL_,
+    OFFSET,
+    ON,
+    OR,
+    ORDER,
+    PLAN,
+    QUERY,
+    RECURSIVE,
+    REPLACE,
+    ROLLBACK,
+    ROWID,
+    SELECT,
+    STRICT,
+    TABLE,
+    TEMP,
+    TEMPORARY,
+    UNIQUE,
+    VALUES,
+    WHERE,
+    WITH,
+    WITHOUT
+};
+
+struct Token {
+    TokenType type;
+    // a view into the lexed text, empty for END
+    std::string_view text;
+};
+
+// Single pass, allocation free lexer, tokens are produced on demand.
+class Lexer {
+public:
+    explicit Lexer(std::string_view sql) : sql(sql) {}
+
+    // the next token, END once the input is exhausted
+    auto next() -> Token;
+    // where the next token starts searching, for error messages
+    [[nodiscard]] auto offset() const -> std::size_t { return position; }
+
+private:
+    std::string_view sql;
+    std::size_t position = 0;
+};
+
+[[nodiscard]] auto to_string(TokenType type) -> std::string_view;
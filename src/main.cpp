@@ -1,39 +1,186 @@
-#include <any>
+#include <charconv>
 #include <cmath>
+#include <csignal>
 #include <concepts>
+#include <cstdio>
 #include <fmt/base.h>
 #include <fmt/format.h>
+#include <fstream>
+#include <iostream>
 #include <optional>
+#include <sstream>
+#include <string_view>
+#include <unistd.h>
 
 #include "IR.hpp"
+#include "bytecode_gen.hpp"
+#include "database.hpp"
+#include "frontend.hpp"
 #include "printers.hpp"
+#include "script.hpp"
+#include "server.hpp"
+#include "vm.hpp"
 
-#include "GrammarLexer.h"
-#include "GrammarParser.h"
+namespace {
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        fmt::println("Usage: {} <input query>", argv[0]);
-        return 1;
+struct ScriptOptions {
+    Frontend frontend = Frontend::NATIVE;
+    // print the IR of every statement before its rows
+    bool echo = false;
+    // stop at the first statement that fails instead of going on with the next one
+    bool bail = false;
+};
+
+// Runs the statements of the script one after the other on the same database, returns whether
+// they all succeeded. The shell's commands, ".quit" and ".exit", end the script.
+auto run_script(ScriptReader& script, Database& db, const ScriptOptions& options) -> bool {
+    auto vm = VirtualMachine{db};
+    auto succeeded = true;
+    while (const auto sql = script.next()) {
+        if (sql->starts_with('.')) {
+            if (*sql == ".quit" || *sql == ".exit") {
+                break;
+            }
+            fmt::println(stderr, "Unknown command '{}' - expected .quit or .exit", *sql);
+            continue;
+        }
+        try {
+            parse(*sql, options.frontend, [&](const Statement& statement, std::span<const std::string_view>) {
+                if (options.echo) {
+                    fmt::println("{}", to_string(statement));
+                }
+                vm.execute(generate_bytecode(statement, db), [](std::span<const Value> row) {
+                    fmt::println("{}", to_string(row));
+                });
+            });
+        } catch (const SqlError& e) {
+            std::fflush(stdout);
+            fmt::println(stderr, "Error on line {}: {}", script.line(), e.what());
+            succeeded = false;
+            if (options.bail) {
+                break;
+            }
+        }
     }
+    return succeeded;
+}
+
+Server* running_server = nullptr;
+
+auto stop_server(int) -> void {
+    running_server->stop();
+}
 
-    std::string line = argv[1];
-    SqlGrammarVisitor IR_generator;
+} // namespace
 
-    fmt::println("Input: {}", line);
+int main(int argc, char** argv) {
+    constexpr auto parser_flag = std::string_view{"--parser="};
+    constexpr auto cache_size_flag = std::string_view{"--cache-size="};
+    constexpr auto mmap_flag = std::string_view{"--mmap"};
+    constexpr auto cache_stats_flag = std::string_view{"--cache-stats"};
+    constexpr auto file_flag = std::string_view{"--file="};
+    constexpr auto repl_flag = std::string_view{"--repl"};
+    constexpr auto bail_flag = std::string_view{"--bail"};
+    constexpr auto listen_flag = std::string_view{"--listen="};
 
-    antlr4::ANTLRInputStream input(line);
-    GrammarLexer lexer(&input);
-    antlr4::CommonTokenStream tokens(&lexer);
-    GrammarParser parser(&tokens);
-    antlr4::tree::ParseTree *tree = parser.program();
+    auto frontend_name = std::string_view{"native"};
+    auto pager_options = PagerOptions{};
+    auto print_cache_stats = false;
+    auto script_path = std::optional<std::string>{};
+    auto repl = false;
+    auto bail = false;
+    auto listen_address = std::optional<std::string>{};
+    auto arg = 1;
+    for (; arg < argc && std::string_view{argv[arg]}.starts_with("--"); ++arg) {
+        const auto flag = std::string_view{argv[arg]};
+        if (flag.starts_with(parser_flag)) {
+            frontend_name = flag.substr(parser_flag.size());
+        } else if (flag.starts_with(cache_size_flag)) {
+            const auto value = flag.substr(cache_size_flag.size());
+            if (std::from_chars(value.data(), value.data() + value.size(), pager_options.cache_size).ec != std::errc{}) {
+                fmt::println(stderr, "Invalid cache size '{}'", value);
+                return 1;
+            }
+        } else if (flag == mmap_flag) {
+            pager_options.mmap = true;
+        } else if (flag == cache_stats_flag) {
+            print_cache_stats = true;
+        } else if (flag.starts_with(file_flag)) {
+            script_path = flag.substr(file_flag.size());
+        } else if (flag == repl_flag) {
+            repl = true;
+        } else if (flag == bail_flag) {
+            bail = true;
+        } else if (flag.starts_with(listen_flag)) {
+            listen_address = flag.substr(listen_flag.size());
+        } else {
+            break;
+        }
+    }
+    // with neither a query nor a script the statements come from stdin
+    const auto from_stdin = repl || argc == arg;
+    const auto query_given = !script_path && !listen_address && !from_stdin;
+    const auto positional = argc - arg;
+    if (query_given ? positional != 1 && positional != 2 : positional > 1) {
+        fmt::println("Usage: {} [--parser=native|antlr|checked] [--cache-size=<bytes>] [--mmap] [--cache-stats] [--bail]\n"
+                     "          <input query> | --file=<script> | --repl | --listen=<socket path|port>  [database file]\n"
+                     "The input query and the script may hold several statements separated by ';', a script\n"
+                     "of - is read from stdin. Without either, or with --repl, statements are read from stdin,\n"
+                     "interactively if it's a terminal. --listen serves the database to clients on a Unix domain\n"
+                     "socket, or a port at 127.0.0.1, see server.hpp for the protocol.", argv[0]);
+        return 1;
+    }
+    const auto db_path = std::string{positional == (query_given ? 2 : 1) ? argv[argc - 1] : ""};
 
+    auto succeeded = true;
     try {
-        auto result_any = IR_generator.visit(tree);
-        auto statement = std::any_cast<Statement>(result_any);
-        fmt::println("{}", to_string(statement));
+        auto options = ScriptOptions{.frontend = parse_frontend(frontend_name), .echo = query_given, .bail = bail};
+        Database db{db_path, {}, pager_options};
+
+        if (listen_address) {
+            auto server = Server{db, ServerOptions{.address = *listen_address, .frontend = options.frontend}};
+            running_server = &server;
+            std::signal(SIGINT, stop_server);
+            std::signal(SIGTERM, stop_server);
+            fmt::println(stderr, "Listening on {}", *listen_address);
+            server.run();
+            std::signal(SIGINT, SIG_DFL);
+            std::signal(SIGTERM, SIG_DFL);
+        } else if (query_given) {
+            const auto query = std::string{argv[arg]};
+            fmt::println("Input: {}", query);
+            auto input = std::istringstream{query};
+            auto script = ScriptReader{input};
+            succeeded = run_script(script, db, options);
+        } else if (script_path && *script_path != "-") {
+            auto input = std::ifstream{*script_path};
+            if (!input) {
+                fail("Cannot open script '{}'", *script_path);
+            }
+            auto script = ScriptReader{input};
+            succeeded = run_script(script, db, options);
+        } else if (isatty(STDIN_FILENO) != 0) {
+            fmt::println("Enter SQL statements terminated with a \";\", .quit to exit");
+            auto script = ScriptReader{std::cin, [](bool continuation) {
+                fmt::print("{}", continuation ? "   ...> " : "db> ");
+                std::fflush(stdout);
+            }};
+            run_script(script, db, options);
+        } else {
+            // lets std::cin buffer, so the script is read in chunks rather than a byte at a time
+            std::ios::sync_with_stdio(false);
+            auto script = ScriptReader{std::cin};
+            succeeded = run_script(script, db, options);
+        }
+
+        if (print_cache_stats) {
+            const auto stats = db.cache_stats();
+            fmt::println(stderr, "cache: {} hits, {} misses, {} evictions, {} pages read ahead",
+                         stats.hits, stats.misses, stats.evictions, stats.read_ahead);
+        }
     } catch(const SqlError& e) {
         fmt::println(stderr, "{}", e.what());
+        return 1;
     }
-    return 0;
+    return succeeded ? 0 : 1;
 }
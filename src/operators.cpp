@@ -0,0 +1,645 @@
+#include "operators.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+
+constexpr auto min_integer = std::numeric_limits<std::int64_t>::min();
+constexpr auto max_integer = std::numeric_limits<std::int64_t>::max();
+
+constexpr auto is_digit(char c) -> bool { return c >= '0' && c <= '9'; }
+
+auto as_text(const Blob& blob) -> std::string_view {
+    return {reinterpret_cast<const char*>(blob.data()), blob.size()};
+}
+
+// the longest prefix of the text that reads as a number, 0 if there is none - how sqlite
+// converts TEXT for arithmetic ('12abc' + 1 is 13)
+auto text_to_number(std::string_view text) -> Value {
+    auto position = text.find_first_not_of(" \t\n\r");
+    if (position == std::string_view::npos) {
+        return std::int64_t{0};
+    }
+    const auto start = position;
+    if (text[position] == '+' || text[position] == '-') {
+        ++position;
+    }
+    const auto digits_start = position;
+    while (position < text.size() && is_digit(text[position])) {
+        ++position;
+    }
+    auto digits = position - digits_start;
+    auto is_real = false;
+    if (position < text.size() && text[position] == '.') {
+        ++position;
+        const auto fraction_start = position;
+        while (position < text.size() && is_digit(text[position])) {
+            ++position;
+        }
+        digits += position - fraction_start;
+        is_real = true;
+    }
+    if (digits == 0) {
+        return std::int64_t{0};
+    }
+    if (position < text.size() && (text[position] == 'e' || text[position] == 'E')) {
+        auto exponent = position + 1;
+        if (exponent < text.size() && (text[exponent] == '+' || text[exponent] == '-')) {
+            ++exponent;
+        }
+        if (exponent < text.size() && is_digit(text[exponent])) {
+            while (exponent < text.size() && is_digit(text[exponent])) {
+                ++exponent;
+            }
+            position = exponent;
+            is_real = true;
+        }
+    }
+
+    const auto number = text.substr(start, position - start);
+    if (!is_real) {
+        // from_chars doesn't take a leading '+'
+        const auto unsigned_number = number.front() == '+' ? number.substr(1) : number;
+        auto integer = std::int64_t{};
+        const auto [ptr, ec] = std::from_chars(unsigned_number.data(), unsigned_number.data() + unsigned_number.size(), integer);
+        if (ec == std::errc{}) {
+            return integer;
+        }
+    }
+    // strtod copes with overflow and underflow the way sqlite does
+    return std::strtod(std::string{number}.c_str(), nullptr);
+}
+
+// the number a TEXT reads as as a whole, spaces around it aside - what sqlite's numeric affinity
+// converts, where '12abc' stays TEXT
+auto numeric_text(std::string_view text) -> std::optional<Value> {
+    const auto start = text.find_first_not_of(" \t\n\r");
+    if (start == std::string_view::npos) {
+        return std::nullopt;
+    }
+    text = text.substr(start, text.find_last_not_of(" \t\n\r") + 1 - start);
+    // strtod reads "inf", "nan" and hexadecimal too, which sqlite doesn't
+    if (text.find_first_not_of("0123456789+-.eE") != std::string_view::npos || text.find_first_of("0123456789") == std::string_view::npos) {
+        return std::nullopt;
+    }
+    const auto unsigned_number = text.front() == '+' ? text.substr(1) : text;
+    auto integer = std::int64_t{};
+    const auto [ptr, ec] = std::from_chars(unsigned_number.data(), unsigned_number.data() + unsigned_number.size(), integer);
+    if (ec == std::errc{} && ptr == unsigned_number.data() + unsigned_number.size()) {
+        return Value{integer};
+    }
+    const auto number = std::string{text};
+    char* end = nullptr;
+    const auto real = std::strtod(number.c_str(), &end);
+    if (end != number.c_str() + number.size()) {
+        return std::nullopt;
+    }
+    return Value{real};
+}
+
+// INTEGER or REAL, NULL stays NULL
+auto to_numeric(const Value& value) -> Value {
+    return std::visit(overloaded{
+        [](const Null&) -> Value { return Null{}; },
+        [](std::int64_t v) -> Value { return v; },
+        [](double v) -> Value { return v; },
+        [](const std::string& v) -> Value { return text_to_number(v); },
+        [](const Blob& v) -> Value { return text_to_number(as_text(v)); }
+    }, value);
+}
+
+// of a value that went through to_numeric
+auto as_real(const Value& numeric) -> double {
+    if (const auto* integer = std::get_if<std::int64_t>(&numeric)) {
+        return static_cast<double>(*integer);
+    }
+    return std::get<double>(numeric);
+}
+
+// of a value that went through to_numeric, REALs are truncated and saturate
+auto as_integer(const Value& numeric) -> std::int64_t {
+    if (const auto* integer = std::get_if<std::int64_t>(&numeric)) {
+        return *integer;
+    }
+    const auto real = std::get<double>(numeric);
+    if (std::isnan(real)) {
+        return 0;
+    }
+    if (real <= -9223372036854775808.0) {
+        return min_integer;
+    }
+    if (real >= 9223372036854775808.0) {
+        return max_integer;
+    }
+    return static_cast<std::int64_t>(real);
+}
+
+// NaN isn't a value sqlite ever produces, it turns into NULL
+auto real_result(double value) -> Value {
+    if (std::isnan(value)) {
+        return Null{};
+    }
+    return value;
+}
+
+auto to_text(const Value& value) -> std::string {
+    return std::visit(overloaded{
+        [](const Null&) -> std::string { return {}; },
+        [](std::int64_t v) -> std::string { return std::to_string(v); },
+        [](double v) -> std::string { return real_to_text(v); },
+        [](const std::string& v) -> std::string { return v; },
+        [](const Blob& v) -> std::string { return std::string{as_text(v)}; }
+    }, value);
+}
+
+// integer_op returns nullopt when the INTEGER result doesn't fit, the operation is then done in REAL
+template <typename IntegerOp, typename RealOp>
+auto arithmetic(const Value& lhs, const Value& rhs, IntegerOp integer_op, RealOp real_op) -> Value {
+    if (std::holds_alternative<Null>(lhs) || std::holds_alternative<Null>(rhs)) {
+        return Null{};
+    }
+    const auto a = to_numeric(lhs);
+    const auto b = to_numeric(rhs);
+    if (std::holds_alternative<std::int64_t>(a) && std::holds_alternative<std::int64_t>(b)) {
+        if (auto result = integer_op(std::get<std::int64_t>(a), std::get<std::int64_t>(b))) {
+            return *std::move(result);
+        }
+    }
+    return real_op(as_real(a), as_real(b));
+}
+
+auto compare_integer_real(std::int64_t integer, double real) -> int {
+    if (real < -9223372036854775808.0) {
+        return 1;
+    }
+    if (real >= 9223372036854775808.0) {
+        return -1;
+    }
+    const auto truncated = static_cast<std::int64_t>(real);
+    if (integer != truncated) {
+        return integer < truncated ? -1 : 1;
+    }
+    // reals this large are whole numbers, so the fraction is exact
+    const auto as_double = static_cast<double>(truncated);
+    return real > as_double ? -1 : real < as_double ? 1 : 0;
+}
+
+template <typename T>
+auto three_way(const T& a, const T& b) -> int {
+    return a < b ? -1 : b < a ? 1 : 0;
+}
+
+auto storage_class_rank(const Value& value) -> int {
+    return std::visit(overloaded{
+        [](const Null&) { return 0; },
+        [](std::int64_t) { return 1; },
+        [](double) { return 1; },
+        [](const std::string&) { return 2; },
+        [](const Blob&) { return 3; }
+    }, value);
+}
+
+// ===================================
+// scalar functions
+// ===================================
+
+auto utf8_length(std::string_view text) -> std::int64_t {
+    return static_cast<std::int64_t>(std::ranges::count_if(text, [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    }));
+}
+
+// the byte offset of the character count characters after offset
+auto utf8_advance(std::string_view text, std::size_t offset, std::int64_t count) -> std::size_t {
+    for (; count > 0 && offset < text.size(); --count) {
+        ++offset;
+        while (offset < text.size() && (static_cast<unsigned char>(text[offset]) & 0xC0) == 0x80) {
+            ++offset;
+        }
+    }
+    return offset;
+}
+
+auto any_null(std::span<const Value> arguments) -> bool {
+    return std::ranges::any_of(arguments, [](const Value& v) { return std::holds_alternative<Null>(v); });
+}
+
+auto abs_function(std::span<const Value> arguments) -> Value {
+    return std::visit(overloaded{
+        [](const Null&) -> Value { return Null{}; },
+        [](std::int64_t v) -> Value {
+            if (v == min_integer) {
+                fail("Integer overflow");
+            }
+            return v < 0 ? -v : v;
+        },
+        [](double v) -> Value { return std::fabs(v); },
+        [&](const auto&) -> Value { return std::fabs(as_real(to_numeric(arguments[0]))); }
+    }, arguments[0]);
+}
+
+auto coalesce_function(std::span<const Value> arguments) -> Value {
+    const auto it = std::ranges::find_if(arguments, [](const Value& v) { return !std::holds_alternative<Null>(v); });
+    return it == arguments.end() ? Value{} : *it;
+}
+
+auto length_function(std::span<const Value> arguments) -> Value {
+    return std::visit(overloaded{
+        [](const Null&) -> Value { return Null{}; },
+        [](const Blob& v) -> Value { return static_cast<std::int64_t>(v.size()); },
+        [](const std::string& v) -> Value { return utf8_length(v); },
+        [&](const auto&) -> Value { return utf8_length(to_text(arguments[0])); }
+    }, arguments[0]);
+}
+
+// ASCII only, like sqlite without ICU
+template <char first, char last, int shift>
+auto change_case(std::span<const Value> arguments) -> Value {
+    if (std::holds_alternative<Null>(arguments[0])) {
+        return Null{};
+    }
+    auto text = to_text(arguments[0]);
+    for (auto& c : text) {
+        if (c >= first && c <= last) {
+            c = static_cast<char>(c + shift);
+        }
+    }
+    return text;
+}
+
+// the multi-argument scalar max() and min(), NULL if any argument is NULL
+template <int sign>
+auto extremum_function(std::span<const Value> arguments) -> Value {
+    if (any_null(arguments)) {
+        return Null{};
+    }
+    const auto* best = &arguments[0];
+    for (const auto& argument : arguments.subspan(1)) {
+        if (sign * *compare(argument, *best) > 0) {
+            best = &argument;
+        }
+    }
+    return *best;
+}
+
+auto nullif_function(std::span<const Value> arguments) -> Value {
+    return compare(arguments[0], arguments[1]) == 0 ? Value{} : arguments[0];
+}
+
+auto round_function(std::span<const Value> arguments) -> Value {
+    if (any_null(arguments)) {
+        return Null{};
+    }
+    const auto digits = arguments.size() == 2 ? std::clamp<std::int64_t>(as_integer(to_numeric(arguments[1])), 0, 30) : 0;
+    const auto value = as_real(to_numeric(arguments[0]));
+    // past 2^52 there's no fraction left to round
+    if (std::fabs(value) >= 4503599627370496.0) {
+        return value;
+    }
+    if (digits == 0) {
+        return std::trunc(value + std::copysign(0.5, value));
+    }
+    return std::strtod(fmt::format("{:.{}f}", value, digits).c_str(), nullptr);
+}
+
+// sqlite's substr(), including its handling of negative and zero positions and lengths
+auto substr_function(std::span<const Value> arguments) -> Value {
+    if (any_null(arguments)) {
+        return Null{};
+    }
+    const auto is_blob = std::holds_alternative<Blob>(arguments[0]);
+    const auto text_value = is_blob ? std::string{} : to_text(arguments[0]);
+    const auto text = is_blob ? as_text(std::get<Blob>(arguments[0])) : std::string_view{text_value};
+    const auto length = is_blob ? static_cast<std::int64_t>(text.size()) : utf8_length(text);
+
+    auto start = as_integer(to_numeric(arguments[1]));
+    auto count = arguments.size() == 3 ? as_integer(to_numeric(arguments[2])) : max_integer;
+    const auto negative_count = count < 0;
+    if (negative_count) {
+        count = count == min_integer ? max_integer : -count;
+    }
+    if (start < 0) {
+        start += length;
+        if (start < 0) {
+            count = std::max<std::int64_t>(count + start, 0);
+            start = 0;
+        }
+    } else if (start > 0) {
+        --start;
+    } else if (count > 0) {
+        --count;
+    }
+    if (negative_count) {
+        start -= count;
+        if (start < 0) {
+            count += start;
+            start = 0;
+        }
+    }
+
+    if (is_blob) {
+        const auto first = static_cast<std::size_t>(std::min(start, length));
+        const auto size = static_cast<std::size_t>(std::min(count, length - static_cast<std::int64_t>(first)));
+        const auto* bytes = std::get<Blob>(arguments[0]).data() + first;
+        return Blob(bytes, bytes + size);
+    }
+    const auto first = utf8_advance(text, 0, start);
+    const auto last = utf8_advance(text, first, count);
+    return std::string{text.substr(first, last - first)};
+}
+
+auto typeof_function(std::span<const Value> arguments) -> Value {
+    return std::visit(overloaded{
+        [](const Null&) { return std::string{"null"}; },
+        [](std::int64_t) { return std::string{"integer"}; },
+        [](double) { return std::string{"real"}; },
+        [](const std::string&) { return std::string{"text"}; },
+        [](const Blob&) { return std::string{"blob"}; }
+    }, arguments[0]);
+}
+
+struct ScalarFunction {
+    std::string_view name;
+    std::size_t min_arguments;
+    std::size_t max_arguments;
+    Value (*call)(std::span<const Value>);
+};
+
+constexpr auto variadic = std::numeric_limits<std::size_t>::max();
+
+constexpr ScalarFunction functions[] = {
+    {"abs", 1, 1, abs_function},
+    {"coalesce", 2, variadic, coalesce_function},
+    {"ifnull", 2, 2, coalesce_function},
+    {"length", 1, 1, length_function},
+    {"lower", 1, 1, change_case<'A', 'Z', 'a' - 'A'>},
+    {"max", 2, variadic, extremum_function<1>},
+    {"min", 2, variadic, extremum_function<-1>},
+    {"nullif", 2, 2, nullif_function},
+    {"round", 1, 2, round_function},
+    {"substr", 2, 3, substr_function},
+    {"typeof", 1, 1, typeof_function},
+    {"upper", 1, 1, change_case<'a', 'z', 'A' - 'a'>},
+};
+
+auto equals_ignoring_case(std::string_view a, std::string_view b) -> bool {
+    const auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; };
+    return std::ranges::equal(a, b, {}, lower, lower);
+}
+
+} // namespace
+
+auto add(const Value& lhs, const Value& rhs) -> Value {
+    return arithmetic(lhs, rhs,
+        [](std::int64_t a, std::int64_t b) -> std::optional<Value> {
+            auto result = std::int64_t{};
+            if (__builtin_add_overflow(a, b, &result)) {
+                return std::nullopt;
+            }
+            return result;
+        },
+        [](double a, double b) { return real_result(a + b); });
+}
+
+auto subtract(const Value& lhs, const Value& rhs) -> Value {
+    return arithmetic(lhs, rhs,
+        [](std::int64_t a, std::int64_t b) -> std::optional<Value> {
+            auto result = std::int64_t{};
+            if (__builtin_sub_overflow(a, b, &result)) {
+                return std::nullopt;
+            }
+            return result;
+        },
+        [](double a, double b) { return real_result(a - b); });
+}
+
+auto multiply(const Value& lhs, const Value& rhs) -> Value {
+    return arithmetic(lhs, rhs,
+        [](std::int64_t a, std::int64_t b) -> std::optional<Value> {
+            auto result = std::int64_t{};
+            if (__builtin_mul_overflow(a, b, &result)) {
+                return std::nullopt;
+            }
+            return result;
+        },
+        [](double a, double b) { return real_result(a * b); });
+}
+
+auto divide(const Value& lhs, const Value& rhs) -> Value {
+    return arithmetic(lhs, rhs,
+        [](std::int64_t a, std::int64_t b) -> std::optional<Value> {
+            if (b == 0) {
+                return Value{};
+            }
+            if (a == min_integer && b == -1) {
+                return std::nullopt;
+            }
+            return a / b;
+        },
+        [](double a, double b) -> Value {
+            if (b == 0.0) {
+                return Null{};
+            }
+            return real_result(a / b);
+        });
+}
+
+auto modulo(const Value& lhs, const Value& rhs) -> Value {
+    if (std::holds_alternative<Null>(lhs) || std::holds_alternative<Null>(rhs)) {
+        return Null{};
+    }
+    // done on integers, the result is REAL if either operand is
+    const auto a = to_numeric(lhs);
+    const auto b = to_numeric(rhs);
+    const auto divisor = as_integer(b);
+    if (divisor == 0) {
+        return Null{};
+    }
+    const auto result = divisor == -1 ? 0 : as_integer(a) % divisor;
+    if (std::holds_alternative<double>(a) || std::holds_alternative<double>(b)) {
+        return static_cast<double>(result);
+    }
+    return result;
+}
+
+auto negate(const Value& operand) -> Value {
+    const auto numeric = to_numeric(operand);
+    if (const auto* integer = std::get_if<std::int64_t>(&numeric)) {
+        if (*integer == min_integer) {
+            return -static_cast<double>(*integer);
+        }
+        return -*integer;
+    }
+    if (const auto* real = std::get_if<double>(&numeric)) {
+        return -*real;
+    }
+    return Null{};
+}
+
+auto concat(const Value& lhs, const Value& rhs) -> Value {
+    if (std::holds_alternative<Null>(lhs) || std::holds_alternative<Null>(rhs)) {
+        return Null{};
+    }
+    return to_text(lhs) + to_text(rhs);
+}
+
+auto compare(const Value& lhs, const Value& rhs) -> std::optional<int> {
+    if (std::holds_alternative<Null>(lhs) || std::holds_alternative<Null>(rhs)) {
+        return std::nullopt;
+    }
+    const auto lhs_rank = storage_class_rank(lhs);
+    const auto rhs_rank = storage_class_rank(rhs);
+    if (lhs_rank != rhs_rank) {
+        return lhs_rank - rhs_rank;
+    }
+    return std::visit(overloaded{
+        [](std::int64_t a, std::int64_t b) { return three_way(a, b); },
+        [](double a, double b) { return three_way(a, b); },
+        [](std::int64_t a, double b) { return compare_integer_real(a, b); },
+        [](double a, std::int64_t b) { return -compare_integer_real(b, a); },
+        // BINARY collation, bytes compared as unsigned
+        [](const std::string& a, const std::string& b) { return a.compare(b); },
+        [](const Blob& a, const Blob& b) {
+            const auto common = std::min(a.size(), b.size());
+            const auto order = common == 0 ? 0 : std::memcmp(a.data(), b.data(), common);
+            return order != 0 ? order : three_way(a.size(), b.size());
+        },
+        [](const auto&, const auto&) { return 0; }
+    }, lhs, rhs);
+}
+
+auto to_column_type(const Value& value, ColumnType type) -> std::optional<Value> {
+    if (std::holds_alternative<Null>(value) || type == ColumnType::ANY) {
+        return value;
+    }
+    switch (type) {
+        case ColumnType::INTEGER:
+        case ColumnType::REAL: {
+            const auto* text = std::get_if<std::string>(&value);
+            const auto numeric = text ? numeric_text(*text) : std::optional<Value>{value};
+            if (!numeric || std::holds_alternative<Blob>(*numeric)) {
+                return std::nullopt;
+            }
+            if (type == ColumnType::REAL) {
+                return Value{as_real(*numeric)};
+            }
+            if (const auto* real = std::get_if<double>(&*numeric)) {
+                // only whole numbers within range make it, 2^63 doesn't
+                if (*real < -9223372036854775808.0 || *real >= 9223372036854775808.0 || std::trunc(*real) != *real) {
+                    return std::nullopt;
+                }
+                return Value{static_cast<std::int64_t>(*real)};
+            }
+            return numeric;
+        }
+        case ColumnType::TEXT:
+            if (std::holds_alternative<Blob>(value)) {
+                return std::nullopt;
+            }
+            return Value{to_text(value)};
+        case ColumnType::BLOB:
+            if (!std::holds_alternative<Blob>(value)) {
+                return std::nullopt;
+            }
+            return value;
+        case ColumnType::ANY:
+            break;
+    }
+    return value;
+}
+
+auto truth(const Value& value) -> std::optional<bool> {
+    return std::visit(overloaded{
+        [](const Null&) -> std::optional<bool> { return std::nullopt; },
+        [](std::int64_t v) -> std::optional<bool> { return v != 0; },
+        [](double v) -> std::optional<bool> { return v != 0.0; },
+        [&](const auto&) -> std::optional<bool> { return truth(to_numeric(value)); }
+    }, value);
+}
+
+auto logical_and(const Value& lhs, const Value& rhs) -> Value {
+    const auto a = truth(lhs);
+    const auto b = truth(rhs);
+    if (a == false || b == false) {
+        return std::int64_t{0};
+    }
+    if (!a || !b) {
+        return Null{};
+    }
+    return std::int64_t{1};
+}
+
+auto logical_or(const Value& lhs, const Value& rhs) -> Value {
+    const auto a = truth(lhs);
+    const auto b = truth(rhs);
+    if (a == true || b == true) {
+        return std::int64_t{1};
+    }
+    if (!a || !b) {
+        return Null{};
+    }
+    return std::int64_t{0};
+}
+
+auto logical_not(const Value& operand) -> Value {
+    if (const auto value = truth(operand)) {
+        return std::int64_t{!*value};
+    }
+    return Null{};
+}
+
+auto real_to_text(double value) -> std::string {
+    if (std::isinf(value)) {
+        return value < 0 ? "-Inf" : "Inf";
+    }
+    auto text = fmt::format("{:.15g}", value);
+    const auto exponent = text.find('e');
+    const auto mantissa = text.substr(0, exponent);
+    if (mantissa.find('.') == std::string::npos) {
+        text.insert(mantissa.size(), ".0");
+    }
+    return text;
+}
+
+auto find_function(std::string_view name, std::size_t argument_count) -> std::size_t {
+    const auto* it = std::ranges::find_if(functions, [&](const ScalarFunction& f) { return equals_ignoring_case(f.name, name); });
+    if (it == std::end(functions)) {
+        fail("No such function: '{}'", name);
+    }
+    if (argument_count < it->min_arguments || argument_count > it->max_arguments) {
+        fail("Wrong number of arguments to function {}()", name);
+    }
+    return static_cast<std::size_t>(it - std::begin(functions));
+}
+
+auto call_function(std::size_t id, std::span<const Value> arguments) -> Value {
+    return functions[id].call(arguments);
+}
+
+auto find_aggregate(std::string_view name, std::size_t argument_count, bool star) -> std::optional<AggregateFunction> {
+    if (equals_ignoring_case(name, "count") && (star || argument_count == 0)) {
+        return AggregateFunction::COUNT_ROWS;
+    }
+    if (star) {
+        fail("Wrong number of arguments to function {}()", name);
+    }
+    if (argument_count != 1) {
+        return std::nullopt;
+    }
+    constexpr auto aggregates = std::to_array<std::pair<std::string_view, AggregateFunction>>({
+        {"avg", AggregateFunction::AVG},
+        {"count", AggregateFunction::COUNT},
+        {"max", AggregateFunction::MAX},
+        {"min", AggregateFunction::MIN},
+        {"sum", AggregateFunction::SUM},
+    });
+    const auto it = std::ranges::find_if(aggregates, [&](const auto& aggregate) { return equals_ignoring_case(aggregate.first, name); });
+    return it == aggregates.end() ? std::nullopt : std::optional{it->second};
+}
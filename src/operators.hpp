@@ -0,0 +1,56 @@
+#pragma once
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// sqlite's semantics for the SQL operators (https://sqlite.org/lang_expr.html), shared by the VM
+// and by constant folding. Operands are used as they are, there is no column affinity yet.
+
+// Arithmetic converts TEXT and BLOB operands to numbers first, NULL in any operand gives NULL.
+// Integer results that overflow become REAL, a division by zero gives NULL.
+[[nodiscard]] auto add(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto subtract(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto multiply(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto divide(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto modulo(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto negate(const Value& operand) -> Value;
+[[nodiscard]] auto concat(const Value& lhs, const Value& rhs) -> Value;
+
+// <0, 0 or >0 with NULL < INTEGER and REAL < TEXT < BLOB, nullopt if either side is NULL
+[[nodiscard]] auto compare(const Value& lhs, const Value& rhs) -> std::optional<int>;
+
+// the column types of a STRICT table (https://sqlite.org/stricttables.html), the chars spell them in
+// the P2 of TYPECHECK
+enum class ColumnType : char { INTEGER = 'I', REAL = 'R', TEXT = 'T', BLOB = 'B', ANY = 'A' };
+
+// The value as it's stored in a STRICT table's column of the type: converted the way sqlite's
+// affinity for the type converts it, nullopt if it can't be losslessly ('1.5' into an INTEGER, a
+// BLOB into a TEXT). NULL goes into any column.
+[[nodiscard]] auto to_column_type(const Value& value, ColumnType type) -> std::optional<Value>;
+
+// a value used as a condition, nullopt for NULL
+[[nodiscard]] auto truth(const Value& value) -> std::optional<bool>;
+// three valued logic, the results are 1, 0 or NULL
+[[nodiscard]] auto logical_and(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto logical_or(const Value& lhs, const Value& rhs) -> Value;
+[[nodiscard]] auto logical_not(const Value& operand) -> Value;
+
+// the way sqlite prints a REAL, always with a '.' or an exponent so it doesn't read back as an INTEGER
+[[nodiscard]] auto real_to_text(double value) -> std::string;
+
+// Scalar functions (https://sqlite.org/lang_corefunc.html) are resolved while compiling, the VM
+// calls them by the returned id. Fails for unknown functions and wrong argument counts.
+[[nodiscard]] auto find_function(std::string_view name, std::size_t argument_count) -> std::size_t;
+[[nodiscard]] auto call_function(std::size_t id, std::span<const Value> arguments) -> Value;
+
+// Aggregate functions (https://sqlite.org/lang_aggfunc.html), run over the rows of a group by
+// HashAggregate. Each reads one argument, but count(*). The values spell them in the P4 of AGGOPEN.
+enum class AggregateFunction : char { COUNT_ROWS = '*', COUNT = 'c', SUM = 's', AVG = 'a', MIN = 'm', MAX = 'M' };
+
+// nullopt for a scalar function, min() and max() with more than one argument are. Fails for a
+// star anywhere but in count(*).
+[[nodiscard]] auto find_aggregate(std::string_view name, std::size_t argument_count, bool star) -> std::optional<AggregateFunction>;
@@ -0,0 +1,663 @@
+#include "optimizer.hpp"
+#include "record.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct RegisterRange {
+    std::int64_t first = 0;
+    std::int64_t count = 0;
+
+    [[nodiscard]] auto end() const -> std::int64_t { return first + count; }
+};
+
+// the registers an instruction reads and writes
+struct Effects {
+    std::array<RegisterRange, 2> reads{};
+    // written whichever way the instruction goes
+    RegisterRange writes{};
+    // written only on some of the ways, a hash join loading a pair
+    RegisterRange may_write{};
+};
+
+// the registers a hash join pairs its rows in, from its HASHOPEN
+struct JoinRows {
+    std::int64_t probe_row = 0;
+    std::int64_t build_row = 0;
+    std::int64_t build_width = 0;
+};
+
+auto join_rows(std::span<const Instruction> code) -> std::vector<JoinRows> {
+    auto joins = std::vector<JoinRows>{};
+    for (const auto& instr : code) {
+        if (instr.opcode == Opcode::HASHOPEN) {
+            joins.resize(std::max(joins.size(), static_cast<std::size_t>(instr.P1) + 1));
+            joins[static_cast<std::size_t>(instr.P1)] = JoinRows{.probe_row = instr.P2, .build_row = instr.P3, .build_width = instr.P5};
+        }
+    }
+    return joins;
+}
+
+auto effects(const Instruction& instr, std::span<const JoinRows> joins) -> Effects {
+    const auto one = [](std::int64_t reg) { return RegisterRange{.first = reg, .count = 1}; };
+    const auto join = [&] { return joins[static_cast<std::size_t>(instr.P1)]; };
+    switch (instr.opcode) {
+        case Opcode::NEWRECNO:
+        case Opcode::INTEGER:
+        case Opcode::ROWID:
+        case Opcode::VARIABLE:
+        case Opcode::NULL_:
+        case Opcode::REAL:
+        case Opcode::STRING:
+        case Opcode::BLOB:
+        case Opcode::IDXROWID:
+            return Effects{.writes = one(instr.P2)};
+        case Opcode::COLUMN:
+            return Effects{.writes = one(instr.P3)};
+        case Opcode::MAKERECORD:
+        case Opcode::MAKEKEY:
+            return Effects{.reads = {RegisterRange{instr.P1, instr.P2}}, .writes = one(instr.P3)};
+        case Opcode::PUTINTKEY:
+            return Effects{.reads = {one(instr.P2), one(instr.P3)}};
+        case Opcode::RESULTROW:
+            return Effects{.reads = {RegisterRange{instr.P1, instr.P2}}};
+        case Opcode::ADD:
+        case Opcode::SUBTRACT:
+        case Opcode::MULTIPLY:
+        case Opcode::DIVIDE:
+        case Opcode::REMAINDER:
+        case Opcode::CONCAT:
+        case Opcode::EQ:
+        case Opcode::NE:
+        case Opcode::LT:
+        case Opcode::LE:
+        case Opcode::GT:
+        case Opcode::GE:
+        case Opcode::AND:
+        case Opcode::OR:
+            return Effects{.reads = {one(instr.P1), one(instr.P2)}, .writes = one(instr.P3)};
+        case Opcode::NOT:
+        case Opcode::NEGATE:
+        case Opcode::COPY:
+            return Effects{.reads = {one(instr.P1)}, .writes = one(instr.P2)};
+        case Opcode::IFNOT:
+            return Effects{.reads = {one(instr.P1)}};
+        case Opcode::FUNCTION:
+            return Effects{.reads = {RegisterRange{instr.P2, instr.P5}}, .writes = one(instr.P3)};
+        case Opcode::IDXINSERT:
+        case Opcode::IDXDELETE:
+            return Effects{.reads = {one(instr.P2)}};
+        case Opcode::NOCONFLICT:
+            return Effects{.reads = {RegisterRange{instr.P3, instr.P5}}};
+        case Opcode::IDXSEEK:
+        case Opcode::IDXGE:
+        case Opcode::SEEKROWID:
+            return Effects{.reads = {one(instr.P3)}};
+        case Opcode::HASHINSERT:
+            return Effects{.reads = {RegisterRange{instr.P2, instr.P5}, RegisterRange{join().build_row, join().build_width}}};
+        case Opcode::HASHPROBE:
+            return Effects{
+                .reads = {RegisterRange{instr.P3, instr.P5}, RegisterRange{join().probe_row, join().build_row - join().probe_row}},
+                .may_write = RegisterRange{join().build_row, join().build_width}
+            };
+        case Opcode::HASHNEXT:
+        case Opcode::HASHDRAIN:
+            return Effects{.may_write = RegisterRange{join().probe_row, join().build_row + join().build_width - join().probe_row}};
+        case Opcode::AGGSTEP:
+            return Effects{.reads = {RegisterRange{instr.P3, instr.P5}}};
+        case Opcode::AGGNEXT:
+        case Opcode::SORTNEXT:
+            return Effects{.may_write = RegisterRange{instr.P3, instr.P5}};
+        case Opcode::SORTOPEN:
+            return Effects{.reads = {RegisterRange{instr.P3, instr.P5 != 0 ? 2 : 0}}};
+        case Opcode::SORTINSERT:
+            return Effects{.reads = {one(instr.P2), RegisterRange{instr.P3, instr.P5}}};
+        case Opcode::MUSTBEINT:
+        case Opcode::TYPECHECK:
+        case Opcode::DECRJUMPZERO:
+            return Effects{.reads = {one(instr.P1)}, .writes = one(instr.P1)};
+        case Opcode::ZONEFILTER:
+            return Effects{.reads = {one(instr.P3)}};
+        case Opcode::IFPOS:
+            return Effects{.reads = {one(instr.P1)}, .may_write = one(instr.P1)};
+        case Opcode::PROFILEROW:
+            return Effects{.writes = RegisterRange{instr.P2, profile_row_width}};
+        case Opcode::INITCOROUTINE:
+            return Effects{.writes = one(instr.P1)};
+        case Opcode::YIELD:
+            return Effects{.reads = {one(instr.P1)}, .writes = one(instr.P1)};
+        case Opcode::ENDCOROUTINE:
+            return Effects{.reads = {one(instr.P1)}};
+        default:
+            return Effects{};
+    }
+}
+
+// jumps to P2, when some condition holds
+auto jumps(Opcode opcode) -> bool {
+    switch (opcode) {
+        case Opcode::REWIND:
+        case Opcode::NEXT:
+        case Opcode::SCAN:
+        case Opcode::IFNOT:
+        case Opcode::CREATETABLE:
+        case Opcode::CREATEINDEX:
+        case Opcode::NOCONFLICT:
+        case Opcode::IDXSEEK:
+        case Opcode::IDXGE:
+        case Opcode::IDXNEXT:
+        case Opcode::SEEKROWID:
+        case Opcode::HASHPROBE:
+        case Opcode::HASHDRAIN:
+        case Opcode::AGGSTEP:
+        case Opcode::AGGNEXT:
+        case Opcode::SORTNEXT:
+        case Opcode::IFPOS:
+        case Opcode::DECRJUMPZERO:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Where control goes from the YIELDs and ENDCOROUTINEs of a program, which depends on the other
+// side of their co-routine: the YIELDs reading its rows (those with a P2) go to its start and to
+// after every YIELD of its own, its YIELDs go to where every reading YIELD continues with a row,
+// its ENDCOROUTINE to where they go once it's done.
+using Handovers = std::unordered_map<std::size_t, std::vector<std::size_t>>;
+
+auto handovers(std::span<const Instruction> code) -> Handovers {
+    auto result = Handovers{};
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        const auto& instr = code[address];
+        if (instr.opcode != Opcode::YIELD && instr.opcode != Opcode::ENDCOROUTINE) {
+            continue;
+        }
+        auto& successors = result[address];
+        const auto reads_rows = instr.opcode == Opcode::YIELD && instr.P2 != 0;
+        for (auto other = std::size_t{0}; other < code.size(); ++other) {
+            const auto& side = code[other];
+            if (side.P1 != instr.P1) {
+                continue;
+            }
+            if (reads_rows) {
+                if (side.opcode == Opcode::INITCOROUTINE) {
+                    successors.push_back(static_cast<std::size_t>(side.P3));
+                } else if (side.opcode == Opcode::YIELD && side.P2 == 0) {
+                    successors.push_back(other + 1);
+                }
+            } else if (side.opcode == Opcode::YIELD && side.P2 != 0) {
+                if (instr.opcode == Opcode::ENDCOROUTINE) {
+                    successors.push_back(static_cast<std::size_t>(side.P2));
+                } else {
+                    successors.push_back(side.P3 != 0 ? static_cast<std::size_t>(side.P3) : other + 1);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// the instructions control may go to from the one at address
+template <typename Visit>
+auto for_each_successor(const Instruction& instr, std::size_t address, const Handovers& flow, Visit visit) -> void {
+    switch (instr.opcode) {
+        case Opcode::HALT:
+            return;
+        case Opcode::GOTO:
+        case Opcode::INITCOROUTINE:
+            visit(static_cast<std::size_t>(instr.P2));
+            return;
+        case Opcode::YIELD:
+        case Opcode::ENDCOROUTINE:
+            for (const auto next : flow.at(address)) {
+                visit(next);
+            }
+            return;
+        case Opcode::HASHNEXT:
+            visit(static_cast<std::size_t>(instr.P2));
+            visit(static_cast<std::size_t>(instr.P3));
+            break;
+        default:
+            if (jumps(instr.opcode)) {
+                visit(static_cast<std::size_t>(instr.P2));
+            }
+            break;
+    }
+    visit(address + 1);
+}
+
+// the operands holding instruction addresses, null for the ones an instruction doesn't have
+auto addresses(Instruction& instr) -> std::array<std::int64_t*, 2> {
+    switch (instr.opcode) {
+        case Opcode::GOTO: return {&instr.P2, nullptr};
+        case Opcode::HASHNEXT: return {&instr.P2, &instr.P3};
+        case Opcode::EXPLAIN: return {&instr.P3, nullptr};
+        case Opcode::PROFILEROW: return {&instr.P1, nullptr};
+        case Opcode::INITCOROUTINE: return {&instr.P2, &instr.P3};
+        // the co-routine's own YIELDs have none
+        case Opcode::YIELD: return {instr.P2 != 0 ? &instr.P2 : nullptr, instr.P3 != 0 ? &instr.P3 : nullptr};
+        default: return {jumps(instr.opcode) ? &instr.P2 : nullptr, nullptr};
+    }
+}
+
+// the addresses some instruction jumps to, where the straight lines of instructions start
+auto jump_targets(std::span<const Instruction> code) -> std::vector<bool> {
+    const auto flow = handovers(code);
+    auto targets = std::vector<bool>(code.size() + 1);
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        for_each_successor(code[address], address, flow, [&](std::size_t next) {
+            if (next != address + 1 && next < targets.size()) {
+                targets[next] = true;
+            }
+        });
+    }
+    return targets;
+}
+
+// drops the marked instructions, returns whether there were any
+auto remove(std::vector<Instruction>& code, const std::vector<bool>& removed) -> bool {
+    // where every address ends up, a dropped instruction's is the next kept one's
+    auto moved_to = std::vector<std::int64_t>(code.size() + 1);
+    auto kept = std::int64_t{0};
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        moved_to[address] = kept;
+        kept += removed[address] ? 0 : 1;
+    }
+    moved_to[code.size()] = kept;
+    if (static_cast<std::size_t>(kept) == code.size()) {
+        return false;
+    }
+
+    auto out = std::size_t{0};
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        if (removed[address]) {
+            continue;
+        }
+        auto instr = code[address];
+        for (auto* target : addresses(instr)) {
+            if (target && *target >= 0 && static_cast<std::size_t>(*target) < moved_to.size()) {
+                *target = moved_to[static_cast<std::size_t>(*target)];
+            }
+        }
+        code[out++] = instr;
+    }
+    code.resize(out);
+    return true;
+}
+
+auto is_constant_load(Opcode opcode) -> bool {
+    return opcode == Opcode::INTEGER || opcode == Opcode::REAL || opcode == Opcode::STRING
+        || opcode == Opcode::BLOB || opcode == Opcode::NULL_;
+}
+
+auto loaded_constant(const SqlBytecodeProgram& program, const Instruction& instr) -> Value {
+    switch (instr.opcode) {
+        case Opcode::INTEGER: return instr.P1;
+        case Opcode::REAL: return std::bit_cast<double>(instr.P1);
+        case Opcode::STRING:
+        case Opcode::BLOB: return program.operand(instr.P4);
+        default: return Null{};
+    }
+}
+
+// The registers live at every instruction - read by some instruction it may lead to before
+// anything overwrites them - found by iterating backwards over the program until nothing changes.
+class Liveness {
+public:
+    Liveness(std::span<const Instruction> code, std::span<const JoinRows> joins) : code(code), flow(handovers(code)) {
+        auto registers = std::int64_t{0};
+        auto program_effects = std::vector<Effects>{};
+        program_effects.reserve(code.size());
+        for (const auto& instr : code) {
+            const auto& instr_effects = program_effects.emplace_back(effects(instr, joins));
+            for (const auto& range : instr_effects.reads) {
+                registers = std::max(registers, range.end());
+            }
+            registers = std::max({registers, instr_effects.writes.end(), instr_effects.may_write.end()});
+        }
+        words = (static_cast<std::size_t>(registers) + 63) / 64;
+        live_in.assign((code.size() + 1) * words, 0);
+
+        auto out = std::vector<std::uint64_t>(words);
+        for (auto changed = true; changed;) {
+            changed = false;
+            for (auto address = code.size(); address-- > 0;) {
+                live_out(address, out);
+                const auto& instr_effects = program_effects[address];
+                for (auto reg = instr_effects.writes.first; reg < instr_effects.writes.end(); ++reg) {
+                    out[static_cast<std::size_t>(reg) / 64] &= ~(std::uint64_t{1} << (reg % 64));
+                }
+                for (const auto& range : instr_effects.reads) {
+                    for (auto reg = range.first; reg < range.end(); ++reg) {
+                        out[static_cast<std::size_t>(reg) / 64] |= std::uint64_t{1} << (reg % 64);
+                    }
+                }
+                auto* in = live_in.data() + address * words;
+                if (!std::ranges::equal(out, std::span{in, words})) {
+                    std::ranges::copy(out, in);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // read after the instruction at address, before it's written again
+    [[nodiscard]] auto live_after(std::size_t address, std::int64_t reg) const -> bool {
+        auto live = false;
+        for_each_successor(code[address], address, flow, [&](std::size_t next) { live = live || live_before(next, reg); });
+        return live;
+    }
+
+    [[nodiscard]] auto live_before(std::size_t address, std::int64_t reg) const -> bool {
+        const auto word = static_cast<std::size_t>(reg) / 64;
+        if (address > code.size() || reg < 0 || word >= words) {
+            return false;
+        }
+        return (live_in[address * words + word] >> (reg % 64) & 1) != 0;
+    }
+
+private:
+    auto live_out(std::size_t address, std::vector<std::uint64_t>& out) const -> void {
+        std::ranges::fill(out, 0);
+        for_each_successor(code[address], address, flow, [&](std::size_t next) {
+            if (next <= code.size()) {
+                for (auto word = std::size_t{0}; word < words; ++word) {
+                    out[word] |= live_in[next * words + word];
+                }
+            }
+        });
+    }
+
+    std::span<const Instruction> code;
+    Handovers flow;
+    std::size_t words = 0;
+    // words bits per instruction, and for the end of the program, where nothing is live
+    std::vector<std::uint64_t> live_in;
+};
+
+// A schema cookie stays verified until the transaction ends or the program changes the schema
+// itself, so only the first check of a transaction has to run. Found by a forward pass, the cookie
+// verified on every path to an instruction.
+auto drop_verified_cookies(std::vector<Instruction>& code) -> bool {
+    const auto flow = handovers(code);
+    auto verified = std::vector<std::optional<std::int64_t>>(code.size() + 1);
+    auto reached = std::vector<bool>(code.size() + 1);
+    auto pending = std::vector<std::size_t>{0};
+    reached[0] = true;
+    while (!pending.empty()) {
+        const auto address = pending.back();
+        pending.pop_back();
+        if (address >= code.size()) {
+            continue;
+        }
+        const auto& instr = code[address];
+        auto cookie = verified[address];
+        if (instr.opcode == Opcode::VERIFY_COOKIE) {
+            cookie = instr.P1;
+        } else if (instr.opcode == Opcode::COMMIT || instr.opcode == Opcode::CREATETABLE || instr.opcode == Opcode::CREATEINDEX) {
+            cookie.reset();
+        }
+        for_each_successor(instr, address, flow, [&](std::size_t next) {
+            if (next >= reached.size()) {
+                return;
+            }
+            if (!reached[next]) {
+                reached[next] = true;
+                verified[next] = cookie;
+                pending.push_back(next);
+            } else if (verified[next] && verified[next] != cookie) {
+                verified[next].reset();
+                pending.push_back(next);
+            }
+        });
+    }
+
+    auto removed = std::vector<bool>(code.size());
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        removed[address] = code[address].opcode == Opcode::VERIFY_COOKIE && reached[address] && verified[address] == code[address].P1;
+    }
+    return remove(code, removed);
+}
+
+enum class CursorKind : std::uint8_t { NONE, TABLE, INDEX };
+
+auto cursor_kind(Opcode opcode) -> CursorKind {
+    switch (opcode) {
+        case Opcode::OPENWRITE:
+        case Opcode::OPENREAD:
+        case Opcode::OPENEPHEMERAL:
+        case Opcode::CLOSE:
+        case Opcode::NEWRECNO:
+        case Opcode::PUTINTKEY:
+        case Opcode::REWIND:
+        case Opcode::NEXT:
+        case Opcode::COLUMN:
+        case Opcode::ROWID:
+        case Opcode::SCAN:
+        case Opcode::SEEKROWID:
+        case Opcode::DELETE:
+        case Opcode::ZONEFILTER:
+            return CursorKind::TABLE;
+        case Opcode::OPENINDEX:
+        case Opcode::CLOSEINDEX:
+        case Opcode::IDXINSERT:
+        case Opcode::IDXDELETE:
+        case Opcode::NOCONFLICT:
+        case Opcode::IDXSEEK:
+        case Opcode::IDXGE:
+        case Opcode::IDXNEXT:
+        case Opcode::IDXROWID:
+            return CursorKind::INDEX;
+        default:
+            return CursorKind::NONE;
+    }
+}
+
+auto opens(Opcode opcode) -> bool {
+    return opcode == Opcode::OPENWRITE || opcode == Opcode::OPENREAD || opcode == Opcode::OPENINDEX || opcode == Opcode::OPENEPHEMERAL;
+}
+
+auto closes(Opcode opcode) -> bool {
+    return opcode == Opcode::CLOSE || opcode == Opcode::CLOSEINDEX;
+}
+
+// moves the cursor to a row (or entry) of its own, wherever it was before
+auto positions(Opcode opcode) -> bool {
+    return opcode == Opcode::REWIND || opcode == Opcode::SCAN || opcode == Opcode::SEEKROWID
+        || opcode == Opcode::NEWRECNO || opcode == Opcode::IDXSEEK;
+}
+
+auto drop_cursor_reopens(std::vector<Instruction>& code) -> bool {
+    const auto same_cursor = [](const Instruction& a, const Instruction& b) {
+        return cursor_kind(a.opcode) == cursor_kind(b.opcode) && a.P1 == b.P1;
+    };
+    const auto targets = jump_targets(code);
+    auto removed = std::vector<bool>(code.size());
+
+    // a cursor only opened and closed
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        const auto& open = code[address];
+        if (!opens(open.opcode)) {
+            continue;
+        }
+        const auto used = std::ranges::any_of(code, [&](const Instruction& instr) {
+            return !opens(instr.opcode) && !closes(instr.opcode) && same_cursor(instr, open);
+        });
+        if (!used) {
+            for (auto other = std::size_t{0}; other < code.size(); ++other) {
+                removed[other] = removed[other] || ((opens(code[other].opcode) || closes(code[other].opcode)) && same_cursor(code[other], open));
+            }
+        }
+    }
+
+    // CLOSE c, OPENREAD c with the same table: the cursor can stay open as long as the first thing
+    // done with it next moves it to a row of its own
+    for (auto address = std::size_t{0}; address + 1 < code.size(); ++address) {
+        const auto& close = code[address];
+        const auto& open = code[address + 1];
+        if (!closes(close.opcode) || !opens(open.opcode) || !same_cursor(close, open) || targets[address + 1] || removed[address]) {
+            continue;
+        }
+        // the cursor as it was opened before, which has to be on the same tree the same way
+        const auto previous = std::find_if(std::make_reverse_iterator(code.begin() + static_cast<std::ptrdiff_t>(address)), code.rend(),
+                                           [&](const Instruction& instr) { return instr.opcode == open.opcode && same_cursor(instr, open); });
+        if (previous == code.rend() || previous->P2 != open.P2 || previous->P4 != open.P4) {
+            continue;
+        }
+        const auto next_use = std::find_if(code.begin() + static_cast<std::ptrdiff_t>(address) + 2, code.end(),
+                                           [&](const Instruction& instr) { return same_cursor(instr, open); });
+        if (next_use != code.end() && positions(next_use->opcode)) {
+            removed[address] = true;
+            removed[address + 1] = true;
+        }
+    }
+    return remove(code, removed);
+}
+
+// MAKERECORD of registers that hold constants whenever it runs -> BLOB of the record
+auto fold_records(SqlBytecodeProgram& program) -> void {
+    auto& code = program.instructions();
+    const auto joins = join_rows(code);
+    const auto targets = jump_targets(code);
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        const auto& make = code[address];
+        if (make.opcode != Opcode::MAKERECORD) {
+            continue;
+        }
+        // the constant loaded last into each of the registers, back to where the straight line
+        // of instructions leading up to the MAKERECORD starts
+        const auto values_range = RegisterRange{make.P1, make.P2};
+        auto values = std::vector<std::optional<Value>>(static_cast<std::size_t>(make.P2));
+        auto missing = values.size();
+        for (auto load = address; missing > 0 && load-- > 0 && !targets[load + 1];) {
+            const auto& instr = code[load];
+            const auto instr_effects = effects(instr, joins);
+            const auto written = instr_effects.writes;
+            const auto overlaps = [&](RegisterRange range) {
+                return range.count > 0 && range.first < values_range.end() && values_range.first < range.end();
+            };
+            if (overlaps(instr_effects.may_write) || instr.opcode == Opcode::GOTO || instr.opcode == Opcode::HALT || instr.opcode == Opcode::YIELD) {
+                break;
+            }
+            if (!overlaps(written)) {
+                continue;
+            }
+            if (!is_constant_load(instr.opcode)) {
+                break;
+            }
+            auto& value = values[static_cast<std::size_t>(written.first - values_range.first)];
+            if (!value) {
+                value = loaded_constant(program, instr);
+                --missing;
+            }
+        }
+        if (missing > 0) {
+            continue;
+        }
+        auto record = std::vector<Value>{};
+        record.reserve(values.size());
+        for (auto& value : values) {
+            record.push_back(*std::move(value));
+        }
+        code[address] = Instruction(Opcode::BLOB, 0, make.P3, 0, program.constant(encode_record(record)));
+    }
+}
+
+// Constant loads in a loop go to the end of the prologue, if their register holds nothing else,
+// ever. The program has to be laid out as the generator lays out SELECTs: GOTO prologue first,
+// GOTO 1 last.
+auto hoist_constants(std::vector<Instruction>& code) -> bool {
+    if (code.size() < 2 || code.front().opcode != Opcode::GOTO || code.back().opcode != Opcode::GOTO || code.back().P2 != 1) {
+        return false;
+    }
+    const auto prologue = static_cast<std::size_t>(code.front().P2);
+    const auto joins = join_rows(code);
+    const auto flow = handovers(code);
+
+    // the instructions between a jump back and its target
+    auto in_loop = std::vector<bool>(code.size());
+    for (auto address = std::size_t{0}; address < prologue; ++address) {
+        for_each_successor(code[address], address, flow, [&](std::size_t next) {
+            if (next <= address) {
+                std::fill(in_loop.begin() + static_cast<std::ptrdiff_t>(next), in_loop.begin() + static_cast<std::ptrdiff_t>(address) + 1, true);
+            }
+        });
+    }
+    auto writers = std::vector<std::size_t>{};
+    for (const auto& instr : code) {
+        const auto instr_effects = effects(instr, joins);
+        for (const auto& range : {instr_effects.writes, instr_effects.may_write}) {
+            if (range.count > 0) {
+                writers.resize(std::max(writers.size(), static_cast<std::size_t>(range.end())));
+                for (auto reg = range.first; reg < range.end(); ++reg) {
+                    ++writers[static_cast<std::size_t>(reg)];
+                }
+            }
+        }
+    }
+
+    const auto liveness = Liveness{code, joins};
+    auto hoisted = std::vector<Instruction>{};
+    auto removed = std::vector<bool>(code.size());
+    for (auto address = std::size_t{1}; address < prologue; ++address) {
+        const auto& instr = code[address];
+        // a register nobody reads before the load runs, which the load alone writes
+        if (in_loop[address] && is_constant_load(instr.opcode) && writers[static_cast<std::size_t>(instr.P2)] == 1
+            && !liveness.live_before(0, instr.P2)) {
+            hoisted.push_back(instr);
+            removed[address] = true;
+        }
+    }
+    if (!remove(code, removed)) {
+        return false;
+    }
+    code.insert(code.end() - 1, hoisted.begin(), hoisted.end());
+    return true;
+}
+
+// loads without side effects, dropped when nothing reads what they load
+auto is_pure_load(Opcode opcode) -> bool {
+    return is_constant_load(opcode) || opcode == Opcode::COPY || opcode == Opcode::COLUMN || opcode == Opcode::ROWID;
+}
+
+auto drop_dead_loads(std::vector<Instruction>& code) -> bool {
+    const auto joins = join_rows(code);
+    const auto liveness = Liveness{code, joins};
+    auto removed = std::vector<bool>(code.size());
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        if (is_pure_load(code[address].opcode)) {
+            removed[address] = !liveness.live_after(address, effects(code[address], joins).writes.first);
+        }
+    }
+    return remove(code, removed);
+}
+
+// the NOOPs the co-routines of embedded SELECTs leave behind, see INITCOROUTINE
+auto drop_noops(std::vector<Instruction>& code) -> bool {
+    auto removed = std::vector<bool>(code.size());
+    for (auto address = std::size_t{0}; address < code.size(); ++address) {
+        removed[address] = code[address].opcode == Opcode::NOOP;
+    }
+    return remove(code, removed);
+}
+
+} // namespace
+
+auto optimize(SqlBytecodeProgram& program) -> void {
+    auto& code = program.instructions();
+    drop_noops(code);
+    drop_verified_cookies(code);
+    drop_cursor_reopens(code);
+    fold_records(program);
+    hoist_constants(code);
+    while (drop_dead_loads(code)) {
+    }
+}
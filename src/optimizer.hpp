@@ -0,0 +1,15 @@
+#pragma once
+#include "bytecode_gen.hpp"
+
+// Rewrites a program into a shorter one with the same results:
+//  - NOOPs are dropped
+//  - a VERIFY_COOKIE repeating a check that already ran in the same transaction is dropped
+//  - a cursor closed and right away reopened on the same tree stays open instead, and one
+//    nothing reads or writes through isn't opened at all
+//  - a MAKERECORD of constants becomes a BLOB, the record encoded once while optimizing
+//  - constant loads in loops move to the prologue, to run once per execution instead of once
+//    per row
+//  - loads into registers that are never read afterwards are dropped, such as the constants a
+//    folded record was made of
+// Jumps to dropped instructions go to the instruction after them.
+auto optimize(SqlBytecodeProgram& program) -> void;
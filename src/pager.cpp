@@ -0,0 +1,573 @@
+#include "pager.hpp"
+#include "common.hpp"
+#include "wal.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr auto magic = std::string_view{"bootleg-sql v1\0\0", 16};
+
+// byte offsets within page 0
+constexpr auto magic_offset = 0;
+constexpr auto page_size_offset = 16;
+constexpr auto page_count_offset = 20;
+constexpr auto schema_cookie_offset = 24;
+
+[[noreturn]] auto io_error(std::string_view what) -> void {
+    fail("I/O error while {}: {}", what, std::strerror(errno));
+}
+
+// the header of page 0, checking it's a database this build can read
+auto read_header(const Page& first, const std::string& path) -> FileHeader {
+    if (std::memcmp(first.data.data() + magic_offset, magic.data(), magic.size()) != 0) {
+        fail("'{}' is not a database file", path);
+    }
+    auto stored_page_size = std::uint32_t{};
+    std::memcpy(&stored_page_size, first.data.data() + page_size_offset, sizeof(stored_page_size));
+    if (stored_page_size != page_size) {
+        fail("'{}' uses {} byte pages, expected {}", path, stored_page_size, page_size);
+    }
+    auto header = FileHeader{};
+    std::memcpy(&header.page_count, first.data.data() + page_count_offset, sizeof(header.page_count));
+    std::memcpy(&header.schema_cookie, first.data.data() + schema_cookie_offset, sizeof(header.schema_cookie));
+    return header;
+}
+
+// an unlinked file in the temporary directory, gone once it's closed
+auto open_temporary_file() -> int {
+    auto name = (std::filesystem::temp_directory_path() / "bootleg-sql-XXXXXX").string();
+    const auto fd = ::mkstemp(name.data());
+    if (fd < 0) {
+        io_error("creating a temporary file");
+    }
+    ::unlink(name.c_str());
+    return fd;
+}
+
+// the fewest frames a pool has, whatever its budget, enough for the pages one B-tree operation pins
+constexpr auto min_frames = std::size_t{16};
+
+} // namespace
+
+Pager::Pager(const std::string& path, const WalOptions& options, const PagerOptions& pager_options)
+    : capacity(std::max(pager_options.cache_size / page_size, min_frames)) {
+    header = FileHeader{.page_count = 1, .schema_cookie = 0};
+    if (path.empty()) {
+        if (pager_options.mmap) {
+            fail("An in-memory database can't be memory mapped");
+        }
+        temporary = pager_options.temporary;
+        committed_header = header;
+        return;
+    }
+    if (pager_options.mmap) {
+        map(path);
+        return;
+    }
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        io_error("opening the database file");
+    }
+    wal = std::make_unique<Wal>(path + "-wal", fd, options);
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        io_error("reading the database file size");
+    }
+    auto first = Page{};
+    if (!wal->read(0, first)) {
+        if (st.st_size == 0) {
+            committed_header = FileHeader{.page_count = 0, .schema_cookie = 0};
+            write_header();
+            commit();
+            return;
+        }
+        if (::pread(fd, first.data.data(), page_size, 0) != static_cast<ssize_t>(page_size)) {
+            io_error("reading the file header");
+        }
+    }
+    header = read_header(first, path);
+    committed_header = header;
+}
+
+auto Pager::map(const std::string& path) -> void {
+    // the log is only ever emptied by a writer, which a read-only mapping can't be
+    struct stat st{};
+    if (::stat((path + "-wal").c_str(), &st) == 0 && st.st_size > 0) {
+        fail("'{}' has a write-ahead log to recover, it has to be opened for writing once first", path);
+    }
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        io_error("opening the database file");
+    }
+    if (::fstat(fd, &st) != 0) {
+        io_error("reading the database file size");
+    }
+    if (static_cast<std::size_t>(st.st_size) < page_size) {
+        fail("'{}' is not a database file", path);
+    }
+    mapping_size = static_cast<std::size_t>(st.st_size);
+    auto* const address = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        io_error("mapping the database file");
+    }
+    mapping = static_cast<std::uint8_t*>(address);
+    header = read_header(*reinterpret_cast<const Page*>(mapping), path);
+    if (static_cast<std::size_t>(header.page_count) * page_size > mapping_size) {
+        fail("'{}' is truncated, its header says it has {} pages", path, header.page_count);
+    }
+    committed_header = header;
+}
+
+Pager::~Pager() {
+    // checkpoints while the database file is still open
+    wal.reset();
+    if (mapping) {
+        ::munmap(mapping, mapping_size);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+auto Pager::read(PageId id, const Snapshot* snapshot) -> PageRef {
+    const auto page_count = snapshot ? snapshot->header().page_count : header.page_count;
+    if (id >= page_count) {
+        fail("Page {} is out of bounds, the database has {} pages", id, page_count);
+    }
+    if (mapping) {
+        return PageRef{reinterpret_cast<const Page*>(mapping + static_cast<std::size_t>(id) * page_size), nullptr};
+    }
+    auto& frame = fetch(id, snapshot);
+    return PageRef{&frame.page, &frame.pins};
+}
+
+auto Pager::fetch(PageId id, const Snapshot* snapshot) -> Frame& {
+    auto lock = std::unique_lock{mutex};
+    const auto pin = [&](Frame& frame) -> Frame& {
+        frame.pins.fetch_add(1, std::memory_order_relaxed);
+        frame.referenced = true;
+        ++stats.hits;
+        return frame;
+    };
+    if (snapshot) {
+        // replaced since the snapshot was taken
+        if (const auto it = old_versions.find(id); it != old_versions.end()) {
+            for (const auto& old : it->second) {
+                if (old.until > snapshot->version) {
+                    return pin(*old.frame);
+                }
+            }
+        }
+    } else if (const auto it = copies.find(id); it != copies.end()) {
+        return pin(*it->second);
+    }
+    if (const auto it = page_table.find(id); it != page_table.end()) {
+        auto& frame = pin(*it->second);
+        loaded.wait(lock, [&] { return !frame.loading; });
+        if (frame.failed) {
+            frame.pins.fetch_sub(1, std::memory_order_release);
+            fail("Failed to read page {}", id);
+        }
+        return frame;
+    }
+
+    ++stats.misses;
+    const auto take = [&](PageId page, bool referenced) -> Frame& {
+        auto& frame = claim();
+        frame.id = page;
+        frame.pins.store(1, std::memory_order_relaxed);
+        frame.used = true;
+        frame.referenced = referenced;
+        frame.dirty = false;
+        frame.failed = false;
+        page_table[page] = &frame;
+        return frame;
+    };
+    auto& frame = take(id, true);
+    if (fd < 0 || id >= committed_header.page_count) {
+        frame.page.data.fill(0);
+        return frame;
+    }
+
+    // the pages following a sequential miss, as far as they're in the file and not cached yet,
+    // only referenced by the clock if somebody actually reads them
+    read_ahead = id == last_miss + 1 ? std::clamp(read_ahead * 2, std::size_t{1}, max_read_ahead) : 0;
+    auto run = std::vector<Frame*>{&frame};
+    for (auto next = id + 1; run.size() <= read_ahead && next < committed_header.page_count; ++next) {
+        if (page_table.contains(next) || (wal && wal->contains(next))) {
+            break;
+        }
+        run.push_back(&take(next, false));
+    }
+    for (auto* const page : run) {
+        page->loading = true;
+    }
+    last_miss = static_cast<PageId>(id + run.size() - 1);
+    stats.read_ahead += run.size() - 1;
+
+    lock.unlock();
+    auto error = std::exception_ptr{};
+    try {
+        if (wal && wal->read(id, frame.page)) {
+            read_pages(std::span{run}.subspan(1));
+        } else {
+            read_pages(run);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    lock.lock();
+
+    for (auto* const page : run) {
+        page->loading = false;
+        if (error) {
+            page->failed = true;
+            page->used = false;
+            page_table.erase(page->id);
+        }
+        if (page != &frame) {
+            page->pins.fetch_sub(1, std::memory_order_release);
+        }
+    }
+    loaded.notify_all();
+    if (error) {
+        frame.pins.fetch_sub(1, std::memory_order_release);
+        std::rethrow_exception(error);
+    }
+    return frame;
+}
+
+auto Pager::read_pages(std::span<Frame* const> run) const -> void {
+    if (run.empty()) {
+        return;
+    }
+    auto buffers = std::vector<iovec>{};
+    for (auto* const frame : run) {
+        buffers.push_back(iovec{.iov_base = frame->page.data.data(), .iov_len = page_size});
+    }
+    const auto offset = static_cast<off_t>(run.front()->id) * static_cast<off_t>(page_size);
+    const auto size = static_cast<ssize_t>(run.size() * page_size);
+    if (::preadv(fd, buffers.data(), static_cast<int>(buffers.size()), offset) != size) {
+        io_error("reading a page");
+    }
+}
+
+auto Pager::claim() -> Frame& {
+    while (!free_frames.empty()) {
+        auto& frame = *free_frames.back();
+        free_frames.pop_back();
+        // the clock may have handed it out already
+        if (!frame.used && !frame.dirty && !frame.unsynced && frame.pins.load(std::memory_order_acquire) == 0) {
+            return frame;
+        }
+    }
+    // without a file there's nowhere to reread an evicted page from, a temporary pager's clean
+    // pages are in its file
+    if ((fd < 0 && !temporary) || frames.size() < capacity) {
+        return *frames.emplace_back(std::make_unique<Frame>());
+    }
+    // the clock: a referenced page gets another round, an unreferenced one is evicted
+    for (auto step = std::size_t{0}; step < 2 * frames.size(); ++step) {
+        auto& frame = *frames[clock_hand];
+        clock_hand = (clock_hand + 1) % frames.size();
+        if (frame.pins.load(std::memory_order_acquire) > 0 || frame.dirty || frame.unsynced || frame.retained || frame.loading) {
+            continue;
+        }
+        if (!frame.used) {
+            return frame;
+        }
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        page_table.erase(frame.id);
+        frame.used = false;
+        ++stats.evictions;
+        return frame;
+    }
+    // every page is pinned or modified
+    return *frames.emplace_back(std::make_unique<Frame>());
+}
+
+auto Pager::write(PageId id) -> Page& {
+    if (mapping) {
+        fail("Cannot write to a read-only database");
+    }
+    if (id >= header.page_count) {
+        fail("Page {} is out of bounds, the database has {} pages", id, header.page_count);
+    }
+    // the committed version stays pinned, readers may still be reading it
+    auto& frame = fetch(id, nullptr);
+    const auto lock = std::scoped_lock{mutex};
+    if (frame.dirty) {
+        // a copy made before, or a page allocated by this transaction
+        frame.pins.fetch_sub(1, std::memory_order_release);
+        return frame.page;
+    }
+    auto& copy = claim();
+    copy.id = id;
+    copy.used = false;
+    copy.referenced = true;
+    copy.dirty = true;
+    copy.failed = false;
+    copy.page = frame.page;
+    copies.emplace(id, &copy);
+    return copy.page;
+}
+
+auto Pager::allocate() -> PageId {
+    if (mapping) {
+        fail("Cannot write to a read-only database");
+    }
+    const auto id = header.page_count++;
+    const auto lock = std::scoped_lock{mutex};
+    auto& frame = claim();
+    frame.id = id;
+    frame.used = true;
+    frame.referenced = true;
+    frame.dirty = true;
+    frame.failed = false;
+    frame.page.data.fill(0);
+    page_table[id] = &frame;
+    return id;
+}
+
+auto Pager::cache_stats() const -> CacheStats {
+    const auto lock = std::scoped_lock{mutex};
+    return stats;
+}
+
+auto Pager::wal_stats() const -> WalStats {
+    return wal ? WalStats{.commits = wal->commit_count(), .syncs = wal->sync_count()} : WalStats{};
+}
+
+auto Pager::committed() const -> FileHeader {
+    const auto lock = std::scoped_lock{mutex};
+    return committed_header;
+}
+
+auto Pager::snapshot() -> Snapshot {
+    const auto lock = std::scoped_lock{mutex};
+    if (unsynced.empty()) {
+        ++snapshots[version];
+        return Snapshot{*this, version, committed_header};
+    }
+    const auto durable = unsynced.front().version - 1;
+    ++snapshots[durable];
+    return Snapshot{*this, durable, unsynced.front().before};
+}
+
+auto Pager::writer_snapshot() -> Snapshot {
+    const auto lock = std::scoped_lock{mutex};
+    ++snapshots[version];
+    return Snapshot{*this, version, committed_header};
+}
+
+auto Pager::last_commit() const -> std::uint64_t {
+    const auto lock = std::scoped_lock{mutex};
+    return version;
+}
+
+Snapshot::~Snapshot() {
+    if (pager) {
+        pager->end_snapshot(version);
+    }
+}
+
+auto Pager::end_snapshot(std::uint64_t snapshot_version) -> void {
+    const auto lock = std::scoped_lock{mutex};
+    const auto it = snapshots.find(snapshot_version);
+    if (--it->second == 0) {
+        snapshots.erase(it);
+    }
+    collect_versions();
+}
+
+auto Pager::collect_versions() -> void {
+    // a version replaced by commit n is read by the snapshots of fewer than n commits, which
+    // snapshot() takes until commit n is durable
+    while (!retired.empty() && (snapshots.empty() || snapshots.begin()->first >= retired.front().first)
+           && (unsynced.empty() || unsynced.front().version > retired.front().first)) {
+        const auto id = retired.front().second;
+        retired.pop_front();
+        auto& versions = old_versions.at(id);
+        // unpinned it's free for claim() to reuse, pinned once the last reader lets go of it
+        versions.front().frame->retained = false;
+        versions.pop_front();
+        if (versions.empty()) {
+            old_versions.erase(id);
+        }
+    }
+}
+
+auto Pager::set_schema_cookie(std::int64_t cookie) -> void {
+    header.schema_cookie = cookie;
+    write_header();
+}
+
+auto Pager::write_header() -> void {
+    auto& page = write(0);
+    const auto size = static_cast<std::uint32_t>(page_size);
+    std::memcpy(page.data.data() + magic_offset, magic.data(), magic.size());
+    std::memcpy(page.data.data() + page_size_offset, &size, sizeof(size));
+    std::memcpy(page.data.data() + page_count_offset, &header.page_count, sizeof(header.page_count));
+    std::memcpy(page.data.data() + schema_cookie_offset, &header.schema_cookie, sizeof(header.schema_cookie));
+}
+
+auto Pager::commit() -> void {
+    sync(publish());
+}
+
+auto Pager::publish() -> std::uint64_t {
+    if (header.page_count != committed_header.page_count) {
+        write_header();
+    }
+
+    // every page the transaction modified, in the pool for as long as it's dirty
+    auto modified = std::vector<Wal::Frame>{};
+    {
+        const auto lock = std::scoped_lock{mutex};
+        for (const auto& [id, copy] : copies) {
+            modified.emplace_back(id, &copy->page);
+        }
+        std::ranges::sort(modified);
+        for (auto id = committed_header.page_count; id < header.page_count; ++id) {
+            modified.emplace_back(id, &page_table.at(id)->page);
+        }
+    }
+    const auto logged = wal && !modified.empty();
+    if (logged) {
+        last_ticket = wal->append(modified, header.page_count);
+    } else if (temporary) {
+        write_pages(modified);
+    }
+
+    // the copies replace the committed versions, which are kept for the running snapshots, all
+    // of them taken before this commit, and for the ones taken until it's durable. A commit that
+    // logged nothing is durable once the ones logged before it are.
+    const auto lock = std::scoped_lock{mutex};
+    const auto durable = !logged && unsynced.empty();
+    ++version;
+    auto published = std::vector<Frame*>{};
+    const auto publish_frame = [&](Frame& frame) {
+        frame.dirty = false;
+        if (logged) {
+            frame.unsynced = true;
+            published.push_back(&frame);
+        }
+    };
+    for (const auto& [id, copy] : copies) {
+        auto& slot = page_table.at(id);
+        auto& replaced = *slot;
+        replaced.used = false;
+        if (!snapshots.empty() || !durable) {
+            replaced.retained = true;
+            old_versions[id].push_back(OldVersion{.until = version, .frame = &replaced});
+            retired.emplace_back(version, id);
+        }
+        replaced.pins.fetch_sub(1, std::memory_order_release);
+        copy->used = true;
+        publish_frame(*copy);
+        slot = copy;
+    }
+    copies.clear();
+    for (auto id = committed_header.page_count; id < header.page_count; ++id) {
+        publish_frame(*page_table.at(id));
+    }
+    if (!durable) {
+        unsynced.push_back(UnsyncedCommit{.version = version, .ticket = last_ticket, .frames = std::move(published), .before = committed_header});
+    }
+    committed_header = header;
+    return version;
+}
+
+auto Pager::sync(std::uint64_t commit) -> void {
+    auto ticket = std::optional<std::uint64_t>{};
+    {
+        const auto lock = std::scoped_lock{mutex};
+        for (const auto& waiting : unsynced) {
+            if (waiting.version <= commit) {
+                ticket = waiting.ticket;
+            }
+        }
+    }
+    if (!ticket) {
+        return;
+    }
+    wal->wait_durable(*ticket);
+    {
+        // the log has them now, they can be evicted, and the new snapshots see them
+        const auto lock = std::scoped_lock{mutex};
+        while (!unsynced.empty() && unsynced.front().version <= commit) {
+            for (auto* const frame : unsynced.front().frames) {
+                frame->unsynced = false;
+            }
+            unsynced.pop_front();
+        }
+        collect_versions();
+    }
+    // the commit is durable at this point, whatever the checkpoint does
+    wal->checkpoint_if_needed();
+}
+
+auto Pager::write_pages(std::span<const std::pair<PageId, const Page*>> pages) -> void {
+    if (pages.empty()) {
+        return;
+    }
+    if (fd < 0) {
+        fd = open_temporary_file();
+    }
+    for (const auto& [id, page] : pages) {
+        const auto offset = static_cast<off_t>(id) * static_cast<off_t>(page_size);
+        if (::pwrite(fd, page->data.data(), page_size, offset) != static_cast<ssize_t>(page_size)) {
+            io_error("writing a temporary page");
+        }
+    }
+}
+
+auto Pager::spill() -> void {
+    if (!temporary) {
+        return;
+    }
+    auto modified = std::size_t{0};
+    {
+        const auto lock = std::scoped_lock{mutex};
+        modified = copies.size() + (header.page_count - committed_header.page_count);
+    }
+    if (modified >= capacity / 2) {
+        commit();
+    }
+}
+
+auto Pager::rollback() -> void {
+    const auto lock = std::scoped_lock{mutex};
+    for (const auto& [id, copy] : copies) {
+        copy->dirty = false;
+        free_frames.push_back(copy);
+        page_table.at(id)->pins.fetch_sub(1, std::memory_order_release);
+    }
+    copies.clear();
+    for (auto id = committed_header.page_count; id < header.page_count; ++id) {
+        auto& frame = *page_table.at(id);
+        page_table.erase(id);
+        frame.used = false;
+        frame.dirty = false;
+        free_frames.push_back(&frame);
+    }
+    header = committed_header;
+}
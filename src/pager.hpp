@@ -0,0 +1,287 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct WalOptions;
+class Wal;
+class Pager;
+
+using PageId = std::uint32_t;
+inline constexpr std::size_t page_size = 4096;
+inline constexpr std::size_t cache_line_size = 64;
+
+struct alignas(cache_line_size) Page {
+    std::array<std::uint8_t, page_size> data;
+};
+
+// Page 0 of every database file, the rest of the page is unused.
+struct FileHeader {
+    std::uint32_t page_count;
+    std::int64_t schema_cookie;
+};
+
+inline constexpr std::size_t default_cache_size = std::size_t{64} << 20;
+
+struct PagerOptions {
+    // the memory the buffer pool may keep pages in, see Pager
+    std::size_t cache_size = default_cache_size;
+    // opens the database read-only and serves its pages straight from a memory mapping of the file
+    bool mmap = false;
+    // without a path: the pages of a temporary table, which go to an unlinked temporary file once
+    // they outgrow the pool, see Pager::spill
+    bool temporary = false;
+};
+
+struct CacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    // pages read along with a missed one because the misses looked sequential, not counted as misses
+    std::uint64_t read_ahead = 0;
+};
+
+// commits that reached the write-ahead log, and the fsyncs they took
+struct WalStats {
+    std::uint64_t commits = 0;
+    std::uint64_t syncs = 0;
+};
+
+// The database as committed at some point, for a reader running next to the writer, see Pager.
+// Ends when destroyed, which lets the pager drop the page versions only it could read.
+class Snapshot {
+public:
+    Snapshot(Snapshot&& other) noexcept
+        : pager(std::exchange(other.pager, nullptr)), version(other.version), committed(other.committed) {}
+    Snapshot(const Snapshot&) = delete;
+    auto operator=(const Snapshot&) -> Snapshot& = delete;
+    ~Snapshot();
+
+    [[nodiscard]] auto header() const -> const FileHeader& { return committed; }
+
+private:
+    friend class Pager;
+
+    Snapshot(Pager& pager, std::uint64_t version, FileHeader committed)
+        : pager(&pager), version(version), committed(committed) {}
+
+    Pager* pager;
+    // the number of commits it sees
+    std::uint64_t version;
+    FileHeader committed;
+};
+
+// A pinned page: it stays in memory, at the same address, for as long as the PageRef exists.
+// Converts to the page, so it can be passed wherever a const Page& is expected.
+class PageRef {
+public:
+    PageRef() = default;
+    // pins - the pin count to release, null for a page that is never evicted
+    PageRef(const Page* page, std::atomic<std::uint32_t>* pins) : target(page), pins(pins) {}
+    ~PageRef() { release(); }
+    PageRef(PageRef&& other) noexcept
+        : target(std::exchange(other.target, nullptr)), pins(std::exchange(other.pins, nullptr)) {}
+    auto operator=(PageRef&& other) noexcept -> PageRef& {
+        if (this != &other) {
+            release();
+            target = std::exchange(other.target, nullptr);
+            pins = std::exchange(other.pins, nullptr);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] auto page() const -> const Page& { return *target; }
+    operator const Page&() const { return *target; }
+
+private:
+    auto release() -> void {
+        if (pins) {
+            pins->fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    const Page* target = nullptr;
+    std::atomic<std::uint32_t>* pins = nullptr;
+};
+
+// Fixed size pages on top of a single file (or only in memory if no path is given).
+//
+// Pages are cached in a buffer pool of PagerOptions::cache_size bytes. A page is evicted once
+// the pool is full and the clock hand sweeps over it twice without anyone having read it in
+// between, unless it is pinned - by a PageRef - or modified by the running transaction. Those
+// have nowhere to go, so when every frame is one of them the pool grows past its budget
+// instead. A private in-memory database keeps all its pages, it has no file to reread them from.
+// Misses on consecutive pages, a scan over leaves that were appended in order, read the
+// following pages along with them, twice as many each time up to max_read_ahead.
+//
+// Changes are made to copies of the pages, kept in memory until commit() and dropped by
+// rollback(). A commit appends the modified pages to the write-ahead log, see Wal, and they reach
+// the database file on the next checkpoint. It's done in two steps so the writer needn't wait for
+// the sync: publish() makes the pages the committed ones and queues them for the log, sync()
+// waits until they're in it. Until then they stay in the pool, the log can't give them back.
+//
+// A temporary pager, see PagerOptions, has no database file until it needs one: spill() commits
+// its modified pages straight to an unlinked temporary file, without a log or syncing, once they
+// take up half of the pool, so it can evict them like any other page.
+//
+// Pages are versioned by commit, so readers can run next to the writer: a read through a Snapshot
+// sees the database as it was committed when the snapshot was taken, as of the last commit that
+// was synced, so a reader never sees what a crash could still take back. Neither the writer's copies
+// nor what it commits later are visible to it. A commit keeps the versions it replaces in memory
+// for as long as a snapshot taken before it may read them, and drops them once the last such
+// snapshot ends. Without a snapshot read() sees the newest pages, the writer's changes included.
+//
+// One thread writes at a time, read() may be called from any number of threads at once.
+class Pager {
+public:
+    Pager(const std::string& path, const WalOptions& options, const PagerOptions& pager_options = {});
+    ~Pager();
+    Pager(const Pager&) = delete;
+    auto operator=(const Pager&) -> Pager& = delete;
+
+    // the page as of the snapshot, or its newest version without one
+    [[nodiscard]] auto read(PageId id, const Snapshot* snapshot = nullptr) -> PageRef;
+    // the current transaction's copy of the page, which stays in memory until the transaction ends
+    [[nodiscard]] auto write(PageId id) -> Page&;
+    [[nodiscard]] auto allocate() -> PageId;
+
+    // the writer's view, its own changes included
+    [[nodiscard]] auto page_count() const -> PageId { return header.page_count; }
+    [[nodiscard]] auto schema_cookie() const -> std::int64_t { return header.schema_cookie; }
+    // the header as of the last commit, durable or not, safe to call from any thread
+    [[nodiscard]] auto committed() const -> FileHeader;
+    // a snapshot of the database as of the last durable commit
+    [[nodiscard]] auto snapshot() -> Snapshot;
+    // a snapshot of the database as of the last commit, durable or not, for the writer, whose
+    // changes build on it
+    [[nodiscard]] auto writer_snapshot() -> Snapshot;
+    // the number of the last commit, for sync()
+    [[nodiscard]] auto last_commit() const -> std::uint64_t;
+    auto set_schema_cookie(std::int64_t cookie) -> void;
+    [[nodiscard]] auto read_only() const -> bool { return mapping != nullptr; }
+    // the buffer pool's budget
+    [[nodiscard]] auto cache_size() const -> std::size_t { return capacity * page_size; }
+    [[nodiscard]] auto cache_stats() const -> CacheStats;
+    // all zero without a log
+    [[nodiscard]] auto wal_stats() const -> WalStats;
+
+    // publish() + sync()
+    auto commit() -> void;
+    // Makes the transaction's changes the newest committed pages and queues them for the log,
+    // returns the number of the commit for sync(). The next transaction may begin right away.
+    [[nodiscard]] auto publish() -> std::uint64_t;
+    // returns once the commit, and every one before it, is durable, from any thread
+    auto sync(std::uint64_t commit) -> void;
+    auto rollback() -> void;
+    // a temporary pager commits once its modified pages fill half of the pool, a no-op otherwise.
+    // Only while nobody holds on to a page write() returned, between B-tree operations.
+    auto spill() -> void;
+
+    static constexpr std::size_t max_read_ahead = 32;
+
+private:
+    friend class Snapshot;
+
+    struct Frame {
+        Page page;
+        PageId id = 0;
+        std::atomic<std::uint32_t> pins = 0;
+        // holds page id, and is in the page table
+        bool used = false;
+        // read since the clock hand last passed
+        bool referenced = false;
+        // a copy the current transaction modifies, or a page it allocated
+        bool dirty = false;
+        // a version a commit replaced, kept for the snapshots taken before it
+        bool retained = false;
+        // published by a commit that isn't in the log yet, which has nowhere to reread it from
+        bool unsynced = false;
+        // being read from disk, with the mutex released
+        bool loading = false;
+        bool failed = false;
+    };
+
+    // a published commit waiting for its sync, see publish()
+    struct UnsyncedCommit {
+        std::uint64_t version;
+        // the log's ticket for it, or for the last commit logged before it if it logged nothing
+        std::uint64_t ticket;
+        std::vector<Frame*> frames;
+        // the header as of the commit before it
+        FileHeader before;
+    };
+
+    // a page version replaced by commit number until, the one snapshots of fewer commits read
+    struct OldVersion {
+        std::uint64_t until;
+        Frame* frame;
+    };
+
+    // the frame holding the page as the snapshot sees it, pinned, reading it first on a miss
+    auto fetch(PageId id, const Snapshot* snapshot) -> Frame&;
+    // a frame to put a page in, evicting one if the pool is full, called with the mutex held
+    auto claim() -> Frame&;
+    // reads consecutive pages from the database file, in one go
+    auto read_pages(std::span<Frame* const> run) const -> void;
+    // writes a temporary pager's pages to its file, creating it first
+    auto write_pages(std::span<const std::pair<PageId, const Page*>> pages) -> void;
+    auto map(const std::string& path) -> void;
+    auto write_header() -> void;
+    auto end_snapshot(std::uint64_t version) -> void;
+    // drops the old versions no snapshot can read anymore, called with the mutex held
+    auto collect_versions() -> void;
+
+    int fd = -1;
+    bool temporary = false;
+    std::unique_ptr<Wal> wal;
+    // the writer's
+    FileHeader header{};
+    // guarded by the mutex from here on
+    FileHeader committed_header{};
+
+    // the read-only mapping of the whole file, null unless PagerOptions::mmap
+    std::uint8_t* mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    // guards the pool and the versions, so readers can read pages concurrently
+    mutable std::mutex mutex;
+    std::condition_variable loaded;
+    std::size_t capacity;
+    std::vector<std::unique_ptr<Frame>> frames;
+    std::unordered_map<PageId, Frame*> page_table;
+    // frames of pages a rollback dropped
+    std::vector<Frame*> free_frames;
+    std::size_t clock_hand = 0;
+    // the last missed page and how far the next sequential miss reads ahead
+    PageId last_miss = 0;
+    std::size_t read_ahead = 0;
+    CacheStats stats;
+
+    // the number of commits so far
+    std::uint64_t version = 0;
+    // oldest first
+    std::deque<UnsyncedCommit> unsynced;
+    // the writer's, the ticket of the last commit it logged
+    std::uint64_t last_ticket = 0;
+    // the versions of the running snapshots, with how many there are of each
+    std::map<std::uint64_t, std::size_t> snapshots;
+    // per page, oldest first
+    std::unordered_map<PageId, std::deque<OldVersion>> old_versions;
+    // the pages with old versions in the order they were replaced, which is the order they go in
+    std::deque<std::pair<std::uint64_t, PageId>> retired;
+
+    // the current transaction's copies of the committed pages it modified, the committed frames
+    // stay pinned until the transaction ends
+    std::unordered_map<PageId, Frame*> copies;
+};
@@ -0,0 +1,553 @@
+#include "parser.hpp"
+#include "common.hpp"
+#include <algorithm>
+
+namespace {
+
+struct BinaryToken {
+    TokenType token;
+    BinaryOperator op;
+};
+
+constexpr BinaryToken or_tokens[] = {{TokenType::OR, BinaryOperator::OR}};
+constexpr BinaryToken and_tokens[] = {{TokenType::AND, BinaryOperator::AND}};
+constexpr BinaryToken equality_tokens[] = {
+    {TokenType::ASSIGN, BinaryOperator::EQUAL},
+    {TokenType::EQ, BinaryOperator::EQUAL},
+    {TokenType::NOT_EQ1, BinaryOperator::NOT_EQUAL},
+    {TokenType::NOT_EQ2, BinaryOperator::NOT_EQUAL},
+};
+constexpr BinaryToken comparison_tokens[] = {
+    {TokenType::LT, BinaryOperator::LESS},
+    {TokenType::LT_EQ, BinaryOperator::LESS_EQUAL},
+    {TokenType::GT, BinaryOperator::GREATER},
+    {TokenType::GT_EQ, BinaryOperator::GREATER_EQUAL},
+};
+constexpr BinaryToken additive_tokens[] = {
+    {TokenType::PLUS, BinaryOperator::ADD},
+    {TokenType::MINUS, BinaryOperator::SUBTRACT},
+};
+constexpr BinaryToken multiplicative_tokens[] = {
+    {TokenType::STAR, BinaryOperator::MULTIPLY},
+    {TokenType::DIV, BinaryOperator::DIVIDE},
+    {TokenType::MOD, BinaryOperator::MODULO},
+};
+constexpr BinaryToken concat_tokens[] = {{TokenType::PIPE2, BinaryOperator::CONCAT}};
+
+// the left associative binary operators of the expr rule, from the loosest binding to the tightest
+constexpr auto binary_levels = std::to_array<std::span<const BinaryToken>>({
+    or_tokens, and_tokens, equality_tokens, comparison_tokens, additive_tokens, multiplicative_tokens, concat_tokens
+});
+// NOT binds looser than the equality operators and tighter than AND
+constexpr auto not_level = std::size_t{2};
+
+} // namespace
+
+Parser::Parser(std::string_view sql) : lexer(sql), current(lexer.next()), lookahead(lexer.next()) {}
+
+auto Parser::advance() -> Token {
+    const auto token = current;
+    current = lookahead;
+    lookahead = lexer.next();
+    return token;
+}
+
+auto Parser::peek() const -> Token {
+    auto ahead = lexer;
+    return ahead.next();
+}
+
+auto Parser::accept(TokenType type) -> bool {
+    if (current.type != type) {
+        return false;
+    }
+    advance();
+    return true;
+}
+
+auto Parser::expect(TokenType type) -> Token {
+    if (current.type != type) {
+        error(to_string(type));
+    }
+    return advance();
+}
+
+auto Parser::error(std::string_view expected) -> void {
+    const auto near = current.type == TokenType::END ? to_string(TokenType::END) : current.text;
+    fail("Syntax error near '{}' - expected {}", near, expected);
+}
+
+template <typename Rule>
+auto Parser::comma_list(Rule rule) {
+    auto vec = std::pmr::vector<decltype(rule())>{&arena};
+    do {
+        vec.push_back(rule());
+    } while (accept(TokenType::COMMA));
+    return vec;
+}
+
+auto Parser::identifier(std::string_view what) -> std::string_view {
+    if (current.type != TokenType::IDENTIFIER) {
+        error(what);
+    }
+    return advance().text;
+}
+
+auto Parser::qualified_table() -> Table {
+    auto table = Table{.table_name = identifier("a table name"), .schema_name = std::nullopt};
+    if (accept(TokenType::DOT)) {
+        table.schema_name = table.table_name;
+        table.table_name = identifier("a table name");
+    }
+    return table;
+}
+
+auto Parser::parse() -> Statement {
+    while (accept(TokenType::SEMI)) {}
+    auto statement = sql_stmt();
+    while (accept(TokenType::SEMI)) {}
+    if (current.type != TokenType::END) {
+        error(to_string(TokenType::END));
+    }
+    return statement;
+}
+
+auto Parser::sql_stmt() -> Statement {
+    if (current.type == TokenType::ANALYZE) {
+        return analyze_stmt();
+    }
+    if (!accept(TokenType::EXPLAIN)) {
+        return explainable_stmt();
+    }
+    auto mode = ExplainMode::PROGRAM;
+    if (accept(TokenType::QUERY)) {
+        expect(TokenType::PLAN);
+        mode = ExplainMode::QUERY_PLAN;
+    } else if (accept(TokenType::ANALYZE)) {
+        mode = ExplainMode::ANALYZE;
+    }
+    return ExplainStmt{.mode = mode, .statement = make_child(explainable_stmt(), &arena)};
+}
+
+auto Parser::explainable_stmt() -> Statement {
+    switch (current.type) {
+        case TokenType::SELECT:
+            return select_stmt();
+        case TokenType::CREATE:
+            if (lookahead.type == TokenType::UNIQUE || lookahead.type == TokenType::INDEX) {
+                return create_index_stmt();
+            }
+            return create_table_stmt();
+        case TokenType::WITH:
+        case TokenType::INSERT:
+        case TokenType::REPLACE:
+            return insert_stmt();
+        default:
+            error("SELECT, CREATE TABLE, CREATE INDEX, INSERT or REPLACE");
+    }
+}
+
+auto Parser::analyze_stmt() -> AnalyzeStmt {
+    expect(TokenType::ANALYZE);
+    if (current.type != TokenType::IDENTIFIER) {
+        return AnalyzeStmt{.target = std::nullopt};
+    }
+    return AnalyzeStmt{.target = qualified_table()};
+}
+
+auto Parser::insert_stmt() -> InsertStmt {
+    auto with = std::optional<WithClause>{};
+    if (current.type == TokenType::WITH) {
+        with = with_clause();
+    }
+
+    auto operation = InsertStmtOp{};
+    if (accept(TokenType::REPLACE)) {
+        operation = ReplaceContainer{};
+    } else {
+        expect(TokenType::INSERT);
+        auto insert = InsertContainer{};
+        if (accept(TokenType::OR)) {
+            insert.confilct_res_method = conflict_resolution_method();
+        }
+        operation = insert;
+    }
+
+    expect(TokenType::INTO);
+    auto table = AliasedTable{.table = qualified_table(), .alias = std::nullopt};
+    if (accept(TokenType::AS)) {
+        table.alias = identifier("a table alias");
+    }
+
+    auto column_names = std::optional<std::pmr::vector<ColumnName>>{};
+    if (accept(TokenType::LPAREN)) {
+        column_names = comma_list([&] { return identifier("a column name"); });
+        expect(TokenType::RPAREN);
+    }
+
+    auto tuples = InsertedTuples{DefaultValues{}};
+    if (accept(TokenType::VALUES)) {
+        tuples = InsertStmtValuesExpr{.rows = comma_list([&] { return value_row(); })};
+    } else if (current.type == TokenType::SELECT) {
+        tuples = select_stmt();
+    } else if (accept(TokenType::DEFAULT)) {
+        expect(TokenType::VALUES);
+    } else {
+        error("VALUES, SELECT or DEFAULT VALUES");
+    }
+
+    return InsertStmt{
+        .with_clause = std::move(with),
+        .operation = operation,
+        .table = table,
+        .column_names = std::move(column_names),
+        .tuples = std::move(tuples)
+    };
+}
+
+auto Parser::select_stmt() -> SelectStmt {
+    expect(TokenType::SELECT);
+    const auto modifier =
+        accept(TokenType::ALL)        ? SelectModifier::ALL
+        : accept(TokenType::DISTINCT) ? SelectModifier::DISTINCT
+        : SelectModifier::NONE;
+
+    auto projections = comma_list([&] { return result_column(); });
+    expect(TokenType::FROM);
+    auto statement = SelectStmt{
+        .modifier = modifier,
+        .projections = std::move(projections),
+        .sources = std::pmr::vector<TableOrSubquery>{&arena},
+        .joins = std::pmr::vector<JoinConstraint>{&arena},
+        .where = std::nullopt,
+        .group_by = std::pmr::vector<Expr>{&arena},
+        .having = std::nullopt,
+        .order_by = std::pmr::vector<OrderingTerm>{&arena},
+        .limit = std::nullopt,
+        .offset = std::nullopt
+    };
+    join_clause(statement);
+    if (accept(TokenType::WHERE)) {
+        statement.where = expr();
+    }
+    if (accept(TokenType::GROUP)) {
+        expect(TokenType::BY);
+        statement.group_by = comma_list([&] { return expr(); });
+        if (accept(TokenType::HAVING)) {
+            statement.having = expr();
+        }
+    }
+    if (accept(TokenType::ORDER)) {
+        expect(TokenType::BY);
+        statement.order_by = comma_list([&] { return ordering_term(); });
+    }
+    if (accept(TokenType::LIMIT)) {
+        statement.limit = expr();
+        if (accept(TokenType::OFFSET)) {
+            statement.offset = expr();
+        }
+    }
+    return statement;
+}
+
+auto Parser::ordering_term() -> OrderingTerm {
+    auto term = OrderingTerm{.expr = expr(), .order = SortOrder::ASC};
+    if (accept(TokenType::DESC)) {
+        term.order = SortOrder::DESC;
+    } else {
+        accept(TokenType::ASC);
+    }
+    return term;
+}
+
+auto Parser::join_clause(SelectStmt& statement) -> void {
+    // join_clause : table_or_subquery (join_operator table_or_subquery join_constraint?)*
+    statement.sources.push_back(table_or_subquery());
+    for (;;) {
+        auto join = JoinConstraint{.op = JoinOperator::COMMA, .on = std::nullopt};
+        if (accept(TokenType::COMMA)) {
+            join.op = JoinOperator::COMMA;
+        } else if (accept(TokenType::JOIN)) {
+            join.op = JoinOperator::JOIN;
+        } else if (accept(TokenType::INNER)) {
+            join.op = JoinOperator::INNER;
+            expect(TokenType::JOIN);
+        } else if (accept(TokenType::CROSS)) {
+            join.op = JoinOperator::CROSS;
+            expect(TokenType::JOIN);
+        } else {
+            return;
+        }
+        statement.sources.push_back(table_or_subquery());
+        if (accept(TokenType::ON)) {
+            join.on = expr();
+        }
+        statement.joins.push_back(std::move(join));
+    }
+}
+
+auto Parser::result_column() -> ResultColumn {
+    if (accept(TokenType::STAR)) {
+        return StarColumn{};
+    }
+    if (current.type == TokenType::IDENTIFIER && lookahead.type == TokenType::DOT && peek().type == TokenType::STAR) {
+        const auto table_name = advance().text;
+        advance();
+        expect(TokenType::STAR);
+        return TableStarColumn{.table_name = table_name};
+    }
+
+    auto column = ExprColumn{.expr = expr(), .alias = std::nullopt};
+    if (accept(TokenType::AS)) {
+        column.alias = identifier("a column alias");
+    }
+    return column;
+}
+
+auto Parser::table_or_subquery() -> TableOrSubquery {
+    auto table = AliasedTable{.table = qualified_table(), .alias = std::nullopt};
+    if (accept(TokenType::AS)) {
+        table.alias = identifier("a table alias");
+    }
+    return table;
+}
+
+auto Parser::create_table_stmt() -> CreateTableStmt {
+    expect(TokenType::CREATE);
+    const auto temporary = accept(TokenType::TEMP) || accept(TokenType::TEMPORARY);
+    expect(TokenType::TABLE);
+    const auto if_not_exists = accept(TokenType::IF);
+    if (if_not_exists) {
+        expect(TokenType::NOT);
+        expect(TokenType::EXISTS);
+    }
+    const auto table = qualified_table();
+
+    auto statement = CreateTableStmt{
+        .temporary = temporary,
+        .if_not_exists_clause = if_not_exists,
+        .table = table,
+        .column_definitions = std::pmr::vector<ColumnDef>{&arena},
+        .table_options = std::pmr::vector<TableOption>{&arena}
+    };
+    if (accept(TokenType::AS)) {
+        statement.as_select = select_stmt();
+        return statement;
+    }
+
+    expect(TokenType::LPAREN);
+    statement.column_definitions = comma_list([&] { return column_def(); });
+    expect(TokenType::RPAREN);
+    if (current.type == TokenType::WITHOUT || current.type == TokenType::STRICT || current.type == TokenType::COLUMNAR) {
+        statement.table_options = comma_list([&] { return table_option(); });
+    }
+    return statement;
+}
+
+auto Parser::create_index_stmt() -> CreateIndexStmt {
+    expect(TokenType::CREATE);
+    const auto unique = accept(TokenType::UNIQUE);
+    expect(TokenType::INDEX);
+    const auto if_not_exists = accept(TokenType::IF);
+    if (if_not_exists) {
+        expect(TokenType::NOT);
+        expect(TokenType::EXISTS);
+    }
+
+    auto schema_name = std::optional<std::string_view>{};
+    auto index_name = identifier("an index name");
+    if (accept(TokenType::DOT)) {
+        schema_name = index_name;
+        index_name = identifier("an index name");
+    }
+    expect(TokenType::ON);
+    const auto table_name = identifier("a table name");
+
+    expect(TokenType::LPAREN);
+    auto columns = comma_list([&] { return indexed_column(); });
+    expect(TokenType::RPAREN);
+
+    return CreateIndexStmt{
+        .unique = unique,
+        .if_not_exists_clause = if_not_exists,
+        .schema_name = schema_name,
+        .index_name = index_name,
+        .table_name = table_name,
+        .columns = std::move(columns)
+    };
+}
+
+auto Parser::indexed_column() -> IndexedColumn {
+    auto column = IndexedColumn{.column_name = identifier("a column name"), .order = SortOrder::ASC};
+    if (accept(TokenType::DESC)) {
+        column.order = SortOrder::DESC;
+    } else {
+        accept(TokenType::ASC);
+    }
+    return column;
+}
+
+auto Parser::column_def() -> ColumnDef {
+    auto column = ColumnDef{
+        .column_name = identifier("a column name"),
+        .type_name = std::nullopt,
+        .column_constraints = std::pmr::vector<ColumnConstraint>{&arena}
+    };
+    if (current.type == TokenType::IDENTIFIER) {
+        column.type_name = advance().text;
+    }
+
+    // column_constraint : NOT NULL conflict_clause is in the grammar, but nothing enforces it
+    if (current.type == TokenType::NOT) {
+        fail("Column constraints are not supported");
+    }
+    return column;
+}
+
+auto Parser::table_option() -> TableOption {
+    // table_option : WITHOUT ROWID | STRICT | COLUMNAR
+    if (accept(TokenType::WITHOUT)) {
+        expect(TokenType::ROWID);
+        return TableOption::WITHOUT_ROWID;
+    }
+    if (accept(TokenType::STRICT)) {
+        return TableOption::STRICT;
+    }
+    if (!accept(TokenType::COLUMNAR)) {
+        error("WITHOUT ROWID, STRICT or COLUMNAR");
+    }
+    return TableOption::COLUMNAR;
+}
+
+auto Parser::common_table_expression() -> CommonTableExpression {
+    const auto name = identifier("a table name");
+    auto column_names = std::pmr::vector<ColumnName>{&arena};
+    if (accept(TokenType::LPAREN)) {
+        column_names = comma_list([&] { return identifier("a column name"); });
+        expect(TokenType::RPAREN);
+    }
+    expect(TokenType::AS);
+
+    auto materialized = MateralizedSpecifier::NONE;
+    if (accept(TokenType::NOT)) {
+        expect(TokenType::MATERIALIZED);
+        materialized = MateralizedSpecifier::NOT_MATERIALIZED;
+    } else if (accept(TokenType::MATERIALIZED)) {
+        materialized = MateralizedSpecifier::MATERLIAZED;
+    }
+
+    expect(TokenType::LPAREN);
+    auto select = select_stmt();
+    expect(TokenType::RPAREN);
+
+    return CommonTableExpression{
+        .name = name,
+        .column_names = std::move(column_names),
+        .materliazed_specifier = materialized,
+        .select_stmt = std::move(select)
+    };
+}
+
+auto Parser::with_clause() -> WithClause {
+    expect(TokenType::WITH);
+    const auto recursive = accept(TokenType::RECURSIVE);
+    return WithClause{
+        .recursive = recursive,
+        .common_table_expressions = comma_list([&] { return common_table_expression(); })
+    };
+}
+
+auto Parser::value_row() -> std::pmr::vector<Expr> {
+    expect(TokenType::LPAREN);
+    auto row = comma_list([&] { return expr(); });
+    expect(TokenType::RPAREN);
+    return row;
+}
+
+auto Parser::conflict_resolution_method() -> ConflictResolutionMethod {
+    if (accept(TokenType::ABORT))    return ConflictResolutionMethod::ABORT;
+    if (accept(TokenType::FAIL))     return ConflictResolutionMethod::FAIL;
+    if (accept(TokenType::IGNORE))   return ConflictResolutionMethod::IGNORE;
+    if (accept(TokenType::REPLACE))  return ConflictResolutionMethod::REPLACE;
+    if (accept(TokenType::ROLLBACK)) return ConflictResolutionMethod::ROLLBACK;
+    error("ABORT, FAIL, IGNORE, REPLACE or ROLLBACK");
+}
+
+auto Parser::expr() -> Expr {
+    return binary_expr(0);
+}
+
+auto Parser::binary_expr(std::size_t level) -> Expr {
+    if (level == binary_levels.size()) {
+        return unary_expr();
+    }
+    auto lhs = binary_expr(level + 1);
+    for (;;) {
+        const auto tokens = binary_levels[level];
+        const auto it = std::ranges::find(tokens, current.type, &BinaryToken::token);
+        if (it == tokens.end()) {
+            return lhs;
+        }
+        advance();
+        auto rhs = binary_expr(level + 1);
+        lhs = Expr{BinaryExpr{
+            .op = it->op,
+            .lhs = make_child(std::move(lhs), &arena),
+            .rhs = make_child(std::move(rhs), &arena)
+        }};
+    }
+}
+
+auto Parser::unary_expr() -> Expr {
+    // a prefix operator takes everything binding tighter than itself as its operand
+    if (accept(TokenType::NOT)) {
+        return Expr{UnaryExpr{.op = UnaryOperator::NOT, .operand = make_child(binary_expr(not_level), &arena)}};
+    }
+    if (accept(TokenType::MINUS)) {
+        return Expr{UnaryExpr{.op = UnaryOperator::NEGATE, .operand = make_child(unary_expr(), &arena)}};
+    }
+    if (accept(TokenType::PLUS)) {
+        return Expr{UnaryExpr{.op = UnaryOperator::PLUS, .operand = make_child(unary_expr(), &arena)}};
+    }
+    return primary_expr();
+}
+
+auto Parser::primary_expr() -> Expr {
+    switch (current.type) {
+        case TokenType::IDENTIFIER: {
+            const auto name = advance().text;
+            if (accept(TokenType::DOT)) {
+                return Expr{ColumnRef{.name = identifier("a column name"), .table = name}};
+            }
+            if (!accept(TokenType::LPAREN)) {
+                return Expr{ColumnRef{.name = name}};
+            }
+            auto call = FunctionCall{.name = name, .arguments = std::pmr::vector<Expr>{&arena}};
+            if (accept(TokenType::STAR)) {
+                call.star = true;
+                expect(TokenType::RPAREN);
+            } else if (!accept(TokenType::RPAREN)) {
+                call.arguments = comma_list([&] { return expr(); });
+                expect(TokenType::RPAREN);
+            }
+            return Expr{std::move(call)};
+        }
+        case TokenType::NUMERIC_LITERAL:
+            return numeric_literal(advance().text);
+        case TokenType::STRING_LITERAL:
+            return string_literal(advance().text, &arena);
+        case TokenType::NULL_:
+            advance();
+            return Expr{NullLiteral{}};
+        case TokenType::BIND_PARAMETER:
+            return Expr{parameter_list.add(advance().text)};
+        case TokenType::LPAREN: {
+            advance();
+            auto inner = expr();
+            expect(TokenType::RPAREN);
+            return inner;
+        }
+        default:
+            error("an expression");
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "IR.hpp"
+#include "lexer.hpp"
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+
+// Recursive descent parser for the language of grammar/Grammar.g4, one function per grammar rule.
+// It builds the same IR as SqlGrammarVisitor straight from the tokens, without a token stream or
+// a parse tree in between.
+class Parser {
+public:
+    explicit Parser(std::string_view sql);
+    Parser(const Parser&) = delete;
+    auto operator=(const Parser&) -> Parser& = delete;
+
+    // the result lives in this parser's arena and points into sql
+    [[nodiscard]] auto parse() -> Statement;
+
+    // names of the statement's bind parameters, parameter i is at i - 1, see Parameter
+    [[nodiscard]] auto parameters() const -> std::span<const std::string_view> { return parameter_list.names(); }
+
+private:
+    auto sql_stmt() -> Statement;
+    auto explainable_stmt() -> Statement;
+    auto analyze_stmt() -> AnalyzeStmt;
+    auto insert_stmt() -> InsertStmt;
+    auto select_stmt() -> SelectStmt;
+    // fills in the statement's sources and joins
+    auto join_clause(SelectStmt& statement) -> void;
+    auto ordering_term() -> OrderingTerm;
+    auto create_table_stmt() -> CreateTableStmt;
+    auto create_index_stmt() -> CreateIndexStmt;
+    auto indexed_column() -> IndexedColumn;
+    auto column_def() -> ColumnDef;
+    auto table_option() -> TableOption;
+    auto result_column() -> ResultColumn;
+    auto table_or_subquery() -> TableOrSubquery;
+    auto common_table_expression() -> CommonTableExpression;
+    auto with_clause() -> WithClause;
+    auto value_row() -> std::pmr::vector<Expr>;
+    auto conflict_resolution_method() -> ConflictResolutionMethod;
+    auto expr() -> Expr;
+    // the operators of binary_levels[level] and the ones binding tighter
+    auto binary_expr(std::size_t level) -> Expr;
+    auto unary_expr() -> Expr;
+    auto primary_expr() -> Expr;
+    // (schema_name DOT)? table_name
+    auto qualified_table() -> Table;
+    auto identifier(std::string_view what) -> std::string_view;
+
+    // rule (COMMA rule)*
+    template <typename Rule>
+    auto comma_list(Rule rule);
+
+    auto advance() -> Token;
+    // the token after lookahead
+    [[nodiscard]] auto peek() const -> Token;
+    auto accept(TokenType type) -> bool;
+    auto expect(TokenType type) -> Token;
+    [[noreturn]] auto error(std::string_view expected) -> void;
+
+    Lexer lexer;
+    Token current;
+    // the token after current, telling "t.*" and "s.t" apart from a lone name, and
+    // CREATE TABLE from CREATE INDEX
+    Token lookahead;
+
+    // statements small enough to fit here don't touch the heap at all
+    std::array<std::byte, 4096> initial_buffer;
+    std::pmr::monotonic_buffer_resource arena{initial_buffer.data(), initial_buffer.size()};
+    ParameterList parameter_list{&arena};
+};
@@ -3,6 +3,7 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include "common.hpp"
+#include "operators.hpp"
 
 auto conflict_method_to_string(ConflictResolutionMethod method) -> std::string {
     switch (method) {
@@ -15,10 +16,64 @@ auto conflict_method_to_string(ConflictResolutionMethod method) -> std::string {
     }
 }
 
-auto to_string(const Expr& expression) -> std::string { return expression.name; }
+auto operator_to_string(BinaryOperator op) -> std::string_view {
+    switch (op) {
+        case BinaryOperator::CONCAT:        return "||";
+        case BinaryOperator::MULTIPLY:      return "*";
+        case BinaryOperator::DIVIDE:        return "/";
+        case BinaryOperator::MODULO:        return "%";
+        case BinaryOperator::ADD:           return "+";
+        case BinaryOperator::SUBTRACT:      return "-";
+        case BinaryOperator::LESS:          return "<";
+        case BinaryOperator::LESS_EQUAL:    return "<=";
+        case BinaryOperator::GREATER:       return ">";
+        case BinaryOperator::GREATER_EQUAL: return ">=";
+        case BinaryOperator::EQUAL:         return "=";
+        case BinaryOperator::NOT_EQUAL:     return "<>";
+        case BinaryOperator::AND:           return "AND";
+        case BinaryOperator::OR:            return "OR";
+        default: return "[UNKNOWN OPERATOR]";
+    }
+}
+
+// every operation is parenthesized, so the text parses back into the same tree
+auto to_string(const Expr& expression) -> std::string {
+    return std::visit(overloaded{
+        [](const ColumnRef& column) {
+            if (column.table) return fmt::format("{}.{}", *column.table, column.name);
+            return std::string{column.name};
+        },
+        [](const IntegerLiteral& literal)     { return std::to_string(literal.value); },
+        [](const RealLiteral& literal)        { return real_to_text(literal.value); },
+        [](const StringLiteral& literal) {
+            auto quoted = std::string{"'"};
+            for (const auto c : literal.value) {
+                quoted += c == '\'' ? "''" : std::string_view{&c, 1};
+            }
+            return quoted + "'";
+        },
+        [](const NullLiteral&)                { return std::string{"NULL"}; },
+        [](const Parameter& parameter)        { return parameter.name.empty() ? std::string{"?"} : std::string{parameter.name}; },
+        [](const UnaryExpr& unary) {
+            const auto op = unary.op == UnaryOperator::NEGATE ? "-" : unary.op == UnaryOperator::PLUS ? "+" : "NOT ";
+            return fmt::format("({}{})", op, to_string(*unary.operand));
+        },
+        [](const BinaryExpr& binary) {
+            return fmt::format("({} {} {})", to_string(*binary.lhs), operator_to_string(binary.op), to_string(*binary.rhs));
+        },
+        [](const FunctionCall& call) {
+            if (call.star) return fmt::format("{}(*)", call.name);
+            std::vector<std::string> argument_strs;
+            argument_strs.reserve(call.arguments.size());
+            for (const auto& argument : call.arguments) argument_strs.push_back(to_string(argument));
+            return fmt::format("{}({})", call.name, fmt::join(argument_strs, ", "));
+        }
+    }, expression.value);
+}
 
 auto to_string(const Table& table) -> std::string {
-    return fmt::format("{}{}", table.schema_name ? *table.schema_name : "", table.table_name);
+    if (table.schema_name) return fmt::format("{}.{}", *table.schema_name, table.table_name);
+    return std::string{table.table_name};
 }
 
 auto to_string(const ResultColumn& rc) -> std::string {
@@ -51,19 +106,48 @@ auto to_string(const SelectStmt& statement) -> std::string {
     proj_strings.reserve(statement.projections.size());
     for (const auto& rc : statement.projections) proj_strings.push_back(to_string(rc));
 
-    std::vector<std::string> src_strings;
-    src_strings.reserve(statement.sources.size());
-    for (const auto& s : statement.sources) src_strings.push_back(to_string(s));
+    auto from_str = to_string(statement.sources.front());
+    for (auto i = std::size_t{0}; i < statement.joins.size(); ++i) {
+        const auto& join = statement.joins[i];
+        const auto op_str =
+            (join.op == JoinOperator::COMMA) ? ", "
+          : (join.op == JoinOperator::INNER) ? " INNER JOIN "
+          : (join.op == JoinOperator::CROSS) ? " CROSS JOIN "
+          : /*(join.op == JoinOperator::JOIN)*/ " JOIN ";
+        from_str += fmt::format("{}{}", op_str, to_string(statement.sources[i + 1]));
+        if (join.on) from_str += fmt::format(" ON {}", to_string(*join.on));
+    }
+
+    const auto where_str = statement.where ? fmt::format(" WHERE {}", to_string(*statement.where)) : std::string{};
+
+    auto group_str = std::string{};
+    if (!statement.group_by.empty()) {
+        std::vector<std::string> term_strs;
+        for (const auto& term : statement.group_by) term_strs.push_back(to_string(term));
+        group_str = fmt::format(" GROUP BY {}", fmt::join(term_strs, ", "));
+        if (statement.having) group_str += fmt::format(" HAVING {}", to_string(*statement.having));
+    }
 
-    return fmt::format("SELECT {}{} FROM {}", modifier_str, fmt::join(proj_strings,", "), fmt::join(src_strings,", "));
+    auto order_str = std::string{};
+    if (!statement.order_by.empty()) {
+        std::vector<std::string> term_strs;
+        for (const auto& term : statement.order_by) {
+            term_strs.push_back(term.order == SortOrder::DESC ? fmt::format("{} DESC", to_string(term.expr)) : to_string(term.expr));
+        }
+        order_str = fmt::format(" ORDER BY {}", fmt::join(term_strs, ", "));
+    }
+    if (statement.limit) order_str += fmt::format(" LIMIT {}", to_string(*statement.limit));
+    if (statement.offset) order_str += fmt::format(" OFFSET {}", to_string(*statement.offset));
+
+    return fmt::format("SELECT {}{} FROM {}{}{}{}", modifier_str, fmt::join(proj_strings,", "), from_str, where_str, group_str, order_str);
 }
 
 auto to_string(const ColumnDef& def) -> std::string {
-    const auto& type_str = def.type_name ? *def.type_name : "";
+    [[maybe_unused]] const auto type_str = def.type_name.value_or("");
 
     // TODO: Finish the formatting here
 
-    return def.column_name;
+    return std::string{def.column_name};
 }
 
 auto to_string(const CreateTableStmt& statement) -> std::string {
@@ -78,12 +162,45 @@ auto to_string(const CreateTableStmt& statement) -> std::string {
 
     // TODO: Finish the formatting here
 
-    return fmt::format("CREATE TABLE{}{}{}({})", is_temporary_str, if_not_exists_str, table_str, fmt::join(column_def_strs, ", "));
+    if (statement.as_select) {
+        return fmt::format("CREATE TABLE{}{}{} AS {}", is_temporary_str, if_not_exists_str, table_str, to_string(*statement.as_select));
+    }
+    std::vector<std::string_view> option_strs{};
+    for (const auto option : statement.table_options) {
+        option_strs.push_back(option == TableOption::WITHOUT_ROWID ? "WITHOUT ROWID" : option == TableOption::STRICT ? "STRICT" : "COLUMNAR");
+    }
+    return fmt::format("CREATE TABLE{}{}{}({}){}{}", is_temporary_str, if_not_exists_str, table_str, fmt::join(column_def_strs, ", "),
+                       option_strs.empty() ? "" : " ", fmt::join(option_strs, ", "));
+}
+
+auto to_string(const CreateIndexStmt& statement) -> std::string {
+    const auto unique_str = statement.unique ? "UNIQUE " : "";
+    const auto if_not_exists_str = statement.if_not_exists_clause ? "IF NOT EXISTS " : "";
+    const auto index_str = statement.schema_name
+        ? fmt::format("{}.{}", *statement.schema_name, statement.index_name)
+        : std::string{statement.index_name};
+
+    std::vector<std::string> column_strs{};
+    column_strs.reserve(statement.columns.size());
+    for (const auto& column : statement.columns) {
+        column_strs.push_back(column.order == SortOrder::DESC ? fmt::format("{} DESC", column.column_name) : std::string{column.column_name});
+    }
+
+    return fmt::format("CREATE {}INDEX {}{} ON {}({})", unique_str, if_not_exists_str, index_str, statement.table_name, fmt::join(column_strs, ", "));
 }
 
 auto to_string(const WithClause& with_clause) -> std::string {
-    // TODO: Implement this
-    return "";
+    std::vector<std::string> cte_strs;
+    cte_strs.reserve(with_clause.common_table_expressions.size());
+    for (const auto& cte : with_clause.common_table_expressions) {
+        const auto columns_str = cte.column_names.empty() ? std::string{} : fmt::format("({})", fmt::join(cte.column_names, ", "));
+        const auto* materialized_str =
+            (cte.materliazed_specifier == MateralizedSpecifier::MATERLIAZED)      ? "MATERIALIZED "
+          : (cte.materliazed_specifier == MateralizedSpecifier::NOT_MATERIALIZED) ? "NOT MATERIALIZED "
+          : "";
+        cte_strs.push_back(fmt::format("{}{} AS {}({})", cte.name, columns_str, materialized_str, to_string(cte.select_stmt)));
+    }
+    return fmt::format("WITH {}{} ", with_clause.recursive ? "RECURSIVE " : "", fmt::join(cte_strs, ", "));
 }
 
 auto to_string(const InsertStmt& statement) -> std::string {
@@ -119,12 +236,17 @@ auto to_string(const InsertStmt& statement) -> std::string {
             return "DEFAULT VALUES";
         },
         [](const InsertStmtValuesExpr& values) -> std::string {
-            std::vector<std::string> expr_strings;
-            expr_strings.reserve(values.expressions.size());
-            for (const auto& expr : values.expressions) {
-                expr_strings.push_back(to_string(expr));
+            std::vector<std::string> row_strings;
+            row_strings.reserve(values.rows.size());
+            for (const auto& row : values.rows) {
+                std::vector<std::string> expr_strings;
+                expr_strings.reserve(row.size());
+                for (const auto& expr : row) {
+                    expr_strings.push_back(to_string(expr));
+                }
+                row_strings.push_back(fmt::format("({})", fmt::join(expr_strings, ", ")));
             }
-            return fmt::format("VALUES({})", fmt::join(expr_strings, ", "));
+            return fmt::format("VALUES{}", fmt::join(row_strings, ", "));
         },
         [](const SelectStmt& select_stmt) -> std::string {
             return to_string(select_stmt);
@@ -133,10 +255,46 @@ auto to_string(const InsertStmt& statement) -> std::string {
 
     return result;
 }
+auto to_string(const ExplainStmt& statement) -> std::string {
+    const auto* mode = statement.mode == ExplainMode::QUERY_PLAN ? "EXPLAIN QUERY PLAN"
+                     : statement.mode == ExplainMode::ANALYZE    ? "EXPLAIN ANALYZE"
+                     : "EXPLAIN";
+    return fmt::format("{} {}", mode, to_string(*statement.statement));
+}
+
+auto to_string(const AnalyzeStmt& statement) -> std::string {
+    if (!statement.target) {
+        return "ANALYZE";
+    }
+    const auto& target = *statement.target;
+    return target.schema_name ? fmt::format("ANALYZE {}.{}", *target.schema_name, target.table_name)
+                              : fmt::format("ANALYZE {}", target.table_name);
+}
+
 auto to_string(const Statement& statement) -> std::string {
     return std::visit(overloaded   {
         [](const SelectStmt& stmt) -> std::string { return to_string(stmt); },
         [](const CreateTableStmt& stmt) -> std::string { return to_string(stmt); },
-        [](const InsertStmt& stmt) -> std::string { return to_string(stmt); }
+        [](const InsertStmt& stmt) -> std::string { return to_string(stmt); },
+        [](const CreateIndexStmt& stmt) -> std::string { return to_string(stmt); },
+        [](const ExplainStmt& stmt) -> std::string { return to_string(stmt); },
+        [](const AnalyzeStmt& stmt) -> std::string { return to_string(stmt); }
     }, statement);
 }
+
+auto to_string(const Value& value) -> std::string {
+    return std::visit(overloaded{
+        [](const Null&) -> std::string { return ""; },
+        [](std::int64_t v) -> std::string { return std::to_string(v); },
+        [](double v) -> std::string { return real_to_text(v); },
+        [](const std::string& v) -> std::string { return v; },
+        [](const Blob& v) -> std::string { return fmt::format("x'{:02x}'", fmt::join(v, "")); }
+    }, value);
+}
+
+auto to_string(std::span<const Value> row) -> std::string {
+    std::vector<std::string> column_strs;
+    column_strs.reserve(row.size());
+    for (const auto& value : row) column_strs.push_back(to_string(value));
+    return fmt::format("{}", fmt::join(column_strs, "|"));
+}
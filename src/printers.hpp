@@ -1,9 +1,17 @@
 #pragma once
 #include "IR.hpp"
+#include "value.hpp"
+#include <span>
 
 [[nodiscard]] auto to_string(const SelectStmt& statement) -> std::string;
 [[nodiscard]] auto to_string(const CreateTableStmt& statement) -> std::string;
+[[nodiscard]] auto to_string(const CreateIndexStmt& statement) -> std::string;
+[[nodiscard]] auto to_string(const ExplainStmt& statement) -> std::string;
+[[nodiscard]] auto to_string(const AnalyzeStmt& statement) -> std::string;
 [[nodiscard]] auto to_string(const Statement& statement) -> std::string;
 [[nodiscard]] auto to_string(const Expr& expression) -> std::string;
 [[nodiscard]] auto to_string(const ResultColumn& rc) -> std::string;
 [[nodiscard]] auto to_string(const TableOrSubquery& ts) -> std::string;
+[[nodiscard]] auto to_string(const Value& value) -> std::string;
+// a result row in sqlite's default "list" mode, columns separated by '|'
+[[nodiscard]] auto to_string(std::span<const Value> row) -> std::string;
@@ -0,0 +1,264 @@
+#include "record.hpp"
+#include "common.hpp"
+#include <bit>
+#include <cstring>
+
+namespace {
+
+auto integer_serial_type(std::int64_t v) -> std::uint64_t {
+    if (v == 0) return 8;
+    if (v == 1) return 9;
+    if (v >= INT8_MIN && v <= INT8_MAX) return 1;
+    if (v >= INT16_MIN && v <= INT16_MAX) return 2;
+    if (v >= -(1LL << 23) && v < (1LL << 23)) return 3;
+    if (v >= INT32_MIN && v <= INT32_MAX) return 4;
+    if (v >= -(1LL << 47) && v < (1LL << 47)) return 5;
+    return 6;
+}
+
+// big endian, sign extended
+auto read_integer(const std::uint8_t* in, std::size_t size) -> std::int64_t {
+    auto value = static_cast<std::uint64_t>(static_cast<std::int8_t>(in[0]));
+    for (auto i = std::size_t{1}; i < size; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return static_cast<std::int64_t>(value);
+}
+
+auto write_integer(std::uint8_t* out, std::uint64_t value, std::size_t size) -> void {
+    for (auto i = size; i > 0; --i) {
+        out[i - 1] = static_cast<std::uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+} // namespace
+
+auto varint_size(std::uint64_t value) -> std::size_t {
+    if (value & 0xff00'0000'0000'0000ULL) return 9;
+    auto size = std::size_t{1};
+    while (value > 0x7f) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+auto put_varint(std::uint8_t* out, std::uint64_t value) -> std::size_t {
+    if (value & 0xff00'0000'0000'0000ULL) {
+        out[8] = static_cast<std::uint8_t>(value);
+        value >>= 8;
+        for (auto i = 8; i > 0; --i) {
+            out[i - 1] = static_cast<std::uint8_t>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        return 9;
+    }
+
+    const auto size = varint_size(value);
+    for (auto i = size; i > 0; --i) {
+        out[i - 1] = static_cast<std::uint8_t>((value & 0x7f) | (i == size ? 0x00 : 0x80));
+        value >>= 7;
+    }
+    return size;
+}
+
+auto get_varint(std::span<const std::uint8_t> in, std::uint64_t& value) -> std::size_t {
+    value = 0;
+    for (auto i = std::size_t{0}; i < in.size() && i < max_varint_size; ++i) {
+        if (i == 8) {
+            value = (value << 8) | in[i];
+            return 9;
+        }
+        value = (value << 7) | (in[i] & 0x7f);
+        if (!(in[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+auto serial_type(const Value& value) -> std::uint64_t {
+    return std::visit(overloaded{
+        [](const Null&) -> std::uint64_t { return 0; },
+        [](std::int64_t v) -> std::uint64_t { return integer_serial_type(v); },
+        [](double) -> std::uint64_t { return 7; },
+        [](const std::string& v) -> std::uint64_t { return 13 + 2 * v.size(); },
+        [](const Blob& v) -> std::uint64_t { return 12 + 2 * v.size(); }
+    }, value);
+}
+
+auto serial_type_size(std::uint64_t serial_type) -> std::size_t {
+    switch (serial_type) {
+        case 0: case 8: case 9: return 0;
+        case 1: return 1;
+        case 2: return 2;
+        case 3: return 3;
+        case 4: return 4;
+        case 5: return 6;
+        case 6: case 7: return 8;
+        case 10: case 11: fail("Malformed record - reserved serial type {}", serial_type);
+        default: return static_cast<std::size_t>((serial_type - 12) / 2);
+    }
+}
+
+auto to_value(const ValueView& view) -> Value {
+    return std::visit(overloaded{
+        [](const Null&) -> Value { return Null{}; },
+        [](std::int64_t v) -> Value { return v; },
+        [](double v) -> Value { return v; },
+        [](std::string_view v) -> Value { return std::string{v}; },
+        [](std::span<const std::uint8_t> v) -> Value { return Blob(v.begin(), v.end()); }
+    }, view);
+}
+
+auto view_of(const Value& value) -> ValueView {
+    return std::visit(overloaded{
+        [](const Null&) -> ValueView { return Null{}; },
+        [](std::int64_t v) -> ValueView { return v; },
+        [](double v) -> ValueView { return v; },
+        [](const std::string& v) -> ValueView { return std::string_view{v}; },
+        [](const Blob& v) -> ValueView { return std::span<const std::uint8_t>{v}; }
+    }, value);
+}
+
+namespace {
+
+auto header_size_for(std::size_t types_size) -> std::size_t {
+    // the header size counts its own varint
+    auto size = types_size + 1;
+    while (varint_size(size) + types_size != size) {
+        size = varint_size(size) + types_size;
+    }
+    return size;
+}
+
+} // namespace
+
+auto encode_record(std::span<const Value> values) -> Blob {
+    auto types_size = std::size_t{0};
+    auto body_size = std::size_t{0};
+    for (const auto& value : values) {
+        const auto type = serial_type(value);
+        types_size += varint_size(type);
+        body_size += serial_type_size(type);
+    }
+    const auto header_size = header_size_for(types_size);
+
+    auto record = Blob(header_size + body_size);
+    auto* header = record.data();
+    auto* body = record.data() + header_size;
+    header += put_varint(header, header_size);
+
+    for (const auto& value : values) {
+        const auto type = serial_type(value);
+        header += put_varint(header, type);
+        const auto size = serial_type_size(type);
+        std::visit(overloaded{
+            [](const Null&) {},
+            [&](std::int64_t v) { write_integer(body, static_cast<std::uint64_t>(v), size); },
+            [&](double v) { write_integer(body, std::bit_cast<std::uint64_t>(v), size); },
+            [&](const std::string& v) { std::memcpy(body, v.data(), v.size()); },
+            [&](const Blob& v) { if (!v.empty()) std::memcpy(body, v.data(), v.size()); }
+        }, value);
+        body += size;
+    }
+    return record;
+}
+
+auto decode_record(std::span<const std::uint8_t> record) -> std::vector<Value> {
+    auto view = RecordView{record};
+    const auto count = view.column_count();
+    auto values = std::vector<Value>{};
+    values.reserve(count);
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        values.push_back(to_value(view.column(i)));
+    }
+    return values;
+}
+
+// ===================================
+// RecordView
+// ===================================
+RecordView::RecordView(std::span<const std::uint8_t> record) : record(record) {
+    auto size = std::uint64_t{};
+    const auto length = get_varint(record, size);
+    if (length == 0 || size < length || size > record.size()) {
+        fail("Malformed record header");
+    }
+    header_size = static_cast<std::size_t>(size);
+    rewind();
+}
+
+auto RecordView::rewind() -> void {
+    auto size = std::uint64_t{};
+    parsed = 0;
+    type_offset = get_varint(record, size);
+    value_offset = header_size;
+}
+
+auto RecordView::column_count() const -> std::size_t {
+    auto count = parsed;
+    auto offset = type_offset;
+    auto type = std::uint64_t{};
+    while (offset < header_size) {
+        const auto length = get_varint(record.subspan(offset, header_size - offset), type);
+        if (length == 0) {
+            fail("Malformed record header");
+        }
+        offset += length;
+        ++count;
+    }
+    return count;
+}
+
+auto RecordView::column(std::size_t n) -> ValueView {
+    if (n < parsed) {
+        rewind();
+    }
+
+    auto type = std::uint64_t{};
+    for (;;) {
+        if (type_offset >= header_size) {
+            return Null{};
+        }
+        // serial types below 128 (every type but long TEXT and BLOB) take a single byte
+        auto length = std::size_t{1};
+        type = record[type_offset];
+        if (type & 0x80) {
+            length = get_varint(record.subspan(type_offset, header_size - type_offset), type);
+            if (length == 0) {
+                fail("Malformed record header");
+            }
+        }
+        if (parsed == n) {
+            break;
+        }
+        type_offset += length;
+        value_offset += serial_type_size(type);
+        ++parsed;
+    }
+
+    const auto size = serial_type_size(type);
+    if (value_offset + size > record.size()) {
+        fail("Malformed record - column {} runs past the end", n);
+    }
+    const auto* data = record.data() + value_offset;
+    switch (type) {
+        case 0: return Null{};
+        case 8: return std::int64_t{0};
+        case 9: return std::int64_t{1};
+        case 7: {
+            auto bits = std::uint64_t{0};
+            for (auto i = std::size_t{0}; i < 8; ++i) bits = (bits << 8) | data[i];
+            return std::bit_cast<double>(bits);
+        }
+        case 1: case 2: case 3: case 4: case 5: case 6:
+            return read_integer(data, size);
+        default:
+            if (type % 2 == 1) {
+                return std::string_view{reinterpret_cast<const char*>(data), size};
+            }
+            return std::span<const std::uint8_t>{data, size};
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// sqlite's record format (https://www.sqlite.org/fileformat2.html#record_format):
+//   [header size][serial type x n][column value x n]
+// header size and serial types are varints, values are stored big endian in as few bytes as
+// their serial type allows, integers 0 and 1 take no payload bytes at all.
+
+// sqlite's varint: 1-9 bytes, big endian, 7 bits per byte except for the 9th which holds 8
+inline constexpr std::size_t max_varint_size = 9;
+[[nodiscard]] auto varint_size(std::uint64_t value) -> std::size_t;
+// writes the varint to out (which has to have room for varint_size(value) bytes), returns its size
+auto put_varint(std::uint8_t* out, std::uint64_t value) -> std::size_t;
+// reads a varint, returns its size or 0 if the input ends first
+auto get_varint(std::span<const std::uint8_t> in, std::uint64_t& value) -> std::size_t;
+
+[[nodiscard]] auto serial_type(const Value& value) -> std::uint64_t;
+[[nodiscard]] auto serial_type_size(std::uint64_t serial_type) -> std::size_t;
+
+// A column value pointing into the record, TEXT and BLOB reference the record's bytes.
+using ValueView = std::variant<Null, std::int64_t, double, std::string_view, std::span<const std::uint8_t>>;
+[[nodiscard]] auto to_value(const ValueView& view) -> Value;
+// the other way around, TEXT and BLOB referencing the value's bytes
+[[nodiscard]] auto view_of(const Value& value) -> ValueView;
+
+[[nodiscard]] auto encode_record(std::span<const Value> values) -> Blob;
+[[nodiscard]] auto decode_record(std::span<const std::uint8_t> record) -> std::vector<Value>;
+
+// Reads single columns straight out of an encoded record (e.g. a page buffer), without
+// allocating and without decoding the columns before it. The header is parsed lazily and the
+// position of the furthest parsed column is remembered, so reading the columns in order costs
+// one serial type per column.
+class RecordView {
+public:
+    RecordView() = default;
+    explicit RecordView(std::span<const std::uint8_t> record);
+
+    [[nodiscard]] auto column_count() const -> std::size_t;
+    // NULL for columns past the end of the record, as in sqlite after ALTER TABLE ADD COLUMN
+    [[nodiscard]] auto column(std::size_t n) -> ValueView;
+
+private:
+    auto rewind() -> void;
+
+    std::span<const std::uint8_t> record;
+    std::size_t header_size = 0;
+    // the next column to parse: its serial type's offset in the header and its value's offset
+    std::size_t parsed = 0;
+    std::size_t type_offset = 0;
+    std::size_t value_offset = 0;
+};
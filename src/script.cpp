@@ -0,0 +1,141 @@
+#include "script.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// how much of a stream without a prompt is read at once at most
+constexpr std::size_t chunk_size = std::size_t{64} << 10;
+
+} // namespace
+
+ScriptReader::ScriptReader(std::istream& input, std::function<void(bool continuation)> prompt)
+    : input(input), prompt(std::move(prompt)) {}
+
+auto ScriptReader::next() -> std::optional<std::string_view> {
+    for (;;) {
+        if (const auto end = scan()) {
+            const auto begin = std::exchange(start, std::min(*end + 1, buffer.size()));
+            const auto text = std::string_view{buffer}.substr(begin, *end - begin);
+            if (std::exchange(command, false)) {
+                scanned = start;
+                line_start = true;
+                statement_line = scan_line++;
+                return text;
+            }
+            if (std::exchange(has_text, false)) {
+                statement_line = text_line;
+                return text;
+            }
+            continue;
+        }
+
+        if (!at_end) {
+            at_end = !read();
+            continue;
+        }
+        // the rest of the input is the last statement, if there is one
+        state = State::CODE;
+        const auto begin = std::exchange(start, buffer.size());
+        scanned = start;
+        if (!std::exchange(has_text, false)) {
+            return std::nullopt;
+        }
+        statement_line = text_line;
+        return std::string_view{buffer}.substr(begin);
+    }
+}
+
+auto ScriptReader::read() -> bool {
+    // dropping the statements returned only once they are half of the buffer keeps a script of
+    // many short statements on one line linear
+    if (start > 0 && start >= buffer.size() / 2) {
+        buffer.erase(0, start);
+        scanned -= start;
+        start = 0;
+    }
+    if (prompt) {
+        prompt(has_text);
+        auto line = std::string{};
+        if (!std::getline(input, line)) {
+            return false;
+        }
+        buffer += line;
+        buffer += '\n';
+        return true;
+    }
+    // waits for one character, then takes what the stream has buffered
+    const auto c = input.get();
+    if (c == std::istream::traits_type::eof()) {
+        return false;
+    }
+    const auto size = buffer.size();
+    buffer.resize(size + chunk_size);
+    buffer[size] = static_cast<char>(c);
+    const auto count = input.readsome(buffer.data() + size + 1, static_cast<std::streamsize>(chunk_size - 1));
+    buffer.resize(size + 1 + static_cast<std::size_t>(count));
+    return true;
+}
+
+auto ScriptReader::scan() -> std::optional<std::size_t> {
+    for (; scanned < buffer.size(); ++scanned) {
+        // "--", "/*" and "*/" are read together, wait for the next character unless it's the end
+        if (scanned + 1 == buffer.size() && !at_end) {
+            return std::nullopt;
+        }
+        const auto c = buffer[scanned];
+        const auto next = scanned + 1 < buffer.size() ? buffer[scanned + 1] : '\0';
+        const auto at_line_start = std::exchange(line_start, c == '\n');
+        switch (state) {
+            case State::CODE:
+                if (c == ';') {
+                    return scanned++;
+                }
+                if (c == '.' && at_line_start && !has_text) {
+                    // a shell command, once its whole line is there
+                    const auto end = buffer.find('\n', scanned);
+                    if (end == std::string::npos && !at_end) {
+                        line_start = true;
+                        return std::nullopt;
+                    }
+                    start = scanned;
+                    command = true;
+                    return end == std::string::npos ? buffer.size() : end;
+                }
+                if (c == '\'') {
+                    state = State::STRING;
+                } else if (c == '-' && next == '-') {
+                    state = State::LINE_COMMENT;
+                } else if (c == '/' && next == '*') {
+                    state = State::BLOCK_COMMENT;
+                    ++scanned;
+                }
+                if (!has_text && (state == State::CODE || state == State::STRING) && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                    has_text = true;
+                    text_line = scan_line;
+                }
+                break;
+            case State::STRING:
+                // a quote written twice leaves the literal and enters it again
+                if (c == '\'') {
+                    state = State::CODE;
+                }
+                break;
+            case State::LINE_COMMENT:
+                if (c == '\n') {
+                    state = State::CODE;
+                }
+                break;
+            case State::BLOCK_COMMENT:
+                if (c == '*' && next == '/') {
+                    state = State::CODE;
+                    ++scanned;
+                }
+                break;
+        }
+        if (c == '\n') {
+            ++scan_line;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Splits SQL read from a stream into its statements, at the semicolons outside of string literals
+// and comments. The stream is read in chunks of what it has available and only as far as the
+// statement returned, so a script goes through in the memory of its longest statement however
+// long it is, or its lines are. With a prompt it's read a line at a time instead, so a statement
+// typed at a terminal runs as soon as its line ends.
+class ScriptReader {
+public:
+    // prompt - called before every line is read, with whether the line continues a statement
+    explicit ScriptReader(std::istream& input, std::function<void(bool continuation)> prompt = {});
+
+    // the next statement, without its semicolon, valid until the next call, nullopt once the
+    // input is done. The last statement doesn't need a semicolon, empty ones are skipped. A line
+    // starting with a dot outside of a statement is returned as it is, for the shell's commands.
+    [[nodiscard]] auto next() -> std::optional<std::string_view>;
+    // the line the statement returned last starts on, from 1
+    [[nodiscard]] auto line() const -> std::size_t { return statement_line; }
+    // in the middle of a statement, with some of its text read already
+    [[nodiscard]] auto continuing() const -> bool { return has_text; }
+
+private:
+    enum class State : std::uint8_t { CODE, STRING, LINE_COMMENT, BLOCK_COMMENT };
+
+    // scans the buffer from scanned on, returns the position of the semicolon ending the
+    // statement, or of the end of a shell command's line with command set
+    auto scan() -> std::optional<std::size_t>;
+    // appends the next line, or chunk, of the input to the buffer, returns false at its end
+    auto read() -> bool;
+
+    std::istream& input;
+    std::function<void(bool continuation)> prompt;
+    // what was read of the statement so far and of the ones after it, from start on, the
+    // statements before start are dropped only once they make up half of it
+    std::string buffer;
+    std::size_t start = 0;
+    std::size_t scanned = 0;
+    bool at_end = false;
+    State state = State::CODE;
+    // scanned is at the beginning of a line
+    bool line_start = true;
+    bool command = false;
+    // the statement has more than whitespace and comments, starting on text_line
+    bool has_text = false;
+    std::size_t text_line = 0;
+    // the line at scanned
+    std::size_t scan_line = 1;
+    std::size_t statement_line = 0;
+};
@@ -0,0 +1,389 @@
+#include "server.hpp"
+#include "common.hpp"
+#include "record.hpp"
+#include <arpa/inet.h>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <span>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+[[noreturn]] auto io_error(std::string_view what) -> void {
+    fail("I/O error while {}: {}", what, std::strerror(errno));
+}
+
+auto get_u32(const char* in) -> std::uint32_t {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(in);
+    return std::uint32_t{bytes[0]} << 24 | std::uint32_t{bytes[1]} << 16 | std::uint32_t{bytes[2]} << 8 | bytes[3];
+}
+
+auto append_frame(std::string& out, FrameKind kind, std::string_view payload) -> void {
+    const auto length = static_cast<std::uint32_t>(payload.size() + 1);
+    out += static_cast<char>(length >> 24);
+    out += static_cast<char>(length >> 16);
+    out += static_cast<char>(length >> 8);
+    out += static_cast<char>(length);
+    out += static_cast<char>(kind);
+    out += payload;
+}
+
+auto as_text(const Blob& bytes) -> std::string_view {
+    return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+// a port number listens on the loopback interface, anything else is a Unix domain socket path
+auto tcp_port(std::string_view address) -> std::optional<std::uint16_t> {
+    auto port = std::uint16_t{};
+    const auto* end = address.data() + address.size();
+    const auto [ptr, ec] = std::from_chars(address.data(), end, port);
+    if (address.empty() || ec != std::errc{} || ptr != end) {
+        return std::nullopt;
+    }
+    return port;
+}
+
+auto listen_on(const std::string& address) -> int {
+    const auto port = tcp_port(address);
+    const auto tcp = port.has_value();
+
+    const auto fd = ::socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        io_error("creating the listening socket");
+    }
+    auto bound = 0;
+    if (tcp) {
+        const auto reuse = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        auto socket_address = sockaddr_in{};
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_port = htons(*port);
+        socket_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bound = ::bind(fd, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address));
+    } else {
+        auto socket_address = sockaddr_un{};
+        socket_address.sun_family = AF_UNIX;
+        if (address.empty() || address.size() >= sizeof(socket_address.sun_path)) {
+            ::close(fd);
+            fail("Invalid socket path '{}'", address);
+        }
+        address.copy(socket_address.sun_path, address.size());
+        // a socket left behind by a server that didn't shut down cleanly
+        ::unlink(address.c_str());
+        bound = ::bind(fd, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address));
+    }
+    if (bound < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        const auto error = errno;
+        ::close(fd);
+        errno = error;
+        io_error(fmt::format("listening on '{}'", address));
+    }
+    return fd;
+}
+
+} // namespace
+
+Server::Server(Database& db, ServerOptions options)
+    : db(db),
+      options(std::move(options)),
+      cache(db, this->options.statement_cache_size, this->options.frontend),
+      workers(std::make_unique<ThreadPool>(std::max(this->options.threads, std::size_t{1}))) {
+    listener = listen_on(this->options.address);
+    epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    events = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll < 0 || events < 0) {
+        io_error("starting the event loop");
+    }
+    for (const auto fd : {listener, events}) {
+        auto event = epoll_event{.events = EPOLLIN, .data = {.fd = fd}};
+        if (::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+            io_error("starting the event loop");
+        }
+    }
+}
+
+Server::~Server() {
+    // lets the queries waiting for a client to read their rows give up
+    for (const auto& [fd, connection] : connections) {
+        {
+            const auto lock = std::scoped_lock{mutex};
+            connection->closed = true;
+        }
+        connection->drained.notify_all();
+    }
+    workers.reset();
+    for (const auto& [fd, connection] : connections) {
+        ::close(fd);
+    }
+    for (const auto fd : {listener, epoll, events}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    if (!tcp_port(options.address)) {
+        ::unlink(options.address.c_str());
+    }
+}
+
+auto Server::run() -> void {
+    auto ready = std::array<epoll_event, 64>{};
+    while (!stopping) {
+        const auto count = ::epoll_wait(epoll, ready.data(), static_cast<int>(ready.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            io_error("waiting for connections");
+        }
+        for (const auto& event : std::span{ready.data(), static_cast<std::size_t>(count)}) {
+            if (event.data.fd == listener) {
+                accept_connections();
+            } else if (event.data.fd == events) {
+                auto counter = std::uint64_t{};
+                while (::read(events, &counter, sizeof(counter)) > 0) {
+                }
+                auto flushed = std::vector<std::shared_ptr<Connection>>{};
+                {
+                    const auto lock = std::scoped_lock{mutex};
+                    flushed.swap(pending_output);
+                }
+                for (const auto& connection : flushed) {
+                    if (!connection->closed) {
+                        flush(connection);
+                    }
+                }
+            } else if (const auto it = connections.find(event.data.fd); it != connections.end()) {
+                const auto connection = it->second;
+                if ((event.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) {
+                    read(connection);
+                }
+                if ((event.events & EPOLLOUT) != 0 && !connection->closed) {
+                    flush(connection);
+                }
+            }
+        }
+    }
+}
+
+auto Server::stop() -> void {
+    stopping = true;
+    wake();
+}
+
+auto Server::wake() -> void {
+    const auto one = std::uint64_t{1};
+    [[maybe_unused]] const auto written = ::write(events, &one, sizeof(one));
+}
+
+auto Server::accept_connections() -> void {
+    for (;;) {
+        const auto fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // EAGAIN once the backlog is empty, running out of descriptors waits for a close
+            return;
+        }
+        // a query is a single small write, don't hold it back waiting for more
+        const auto no_delay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        auto event = epoll_event{.events = EPOLLIN, .data = {.fd = fd}};
+        if (::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ::close(fd);
+            continue;
+        }
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        connections.emplace(fd, std::move(connection));
+    }
+}
+
+auto Server::read(const std::shared_ptr<Connection>& connection) -> void {
+    auto buffer = std::array<char, 64 * 1024>{};
+    for (;;) {
+        const auto count = ::recv(connection->fd, buffer.data(), buffer.size(), 0);
+        if (count > 0) {
+            connection->input.append(buffer.data(), static_cast<std::size_t>(count));
+            continue;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        // the client hung up, the queries it sent before don't get an answer anyway
+        close(connection);
+        return;
+    }
+
+    auto& input = connection->input;
+    auto queries = std::vector<std::string>{};
+    auto offset = std::size_t{0};
+    while (input.size() - offset >= 4) {
+        const auto length = get_u32(input.data() + offset);
+        if (length == 0 || length > max_frame_size) {
+            close(connection);
+            return;
+        }
+        if (input.size() - offset - 4 < length) {
+            break;
+        }
+        queries.emplace_back(input, offset + 4, length);
+        offset += 4 + length;
+    }
+    input.erase(0, offset);
+    if (!queries.empty()) {
+        const auto lock = std::scoped_lock{mutex};
+        for (auto& query : queries) {
+            connection->queries.push_back(std::move(query));
+        }
+        schedule(connection);
+    }
+}
+
+auto Server::flush(const std::shared_ptr<Connection>& connection) -> void {
+    auto failed = false;
+    auto more = false;
+    {
+        const auto lock = std::scoped_lock{mutex};
+        auto& output = connection->output;
+        auto sent = std::size_t{0};
+        while (sent < output.size()) {
+            const auto count = ::send(connection->fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+            if (count >= 0) {
+                sent += static_cast<std::size_t>(count);
+            } else if (errno != EINTR) {
+                failed = errno != EAGAIN && errno != EWOULDBLOCK;
+                break;
+            }
+        }
+        output.erase(0, sent);
+        more = !output.empty();
+        if (output.size() <= output_low_water) {
+            connection->drained.notify_all();
+        }
+    }
+    if (failed) {
+        close(connection);
+        return;
+    }
+    if (more != connection->writing) {
+        auto event = epoll_event{.events = EPOLLIN | (more ? EPOLLOUT : 0u), .data = {.fd = connection->fd}};
+        ::epoll_ctl(epoll, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->writing = more;
+    }
+}
+
+auto Server::close(const std::shared_ptr<Connection>& connection) -> void {
+    ::epoll_ctl(epoll, EPOLL_CTL_DEL, connection->fd, nullptr);
+    ::close(connection->fd);
+    connections.erase(connection->fd);
+    connection->closed = true;
+
+    const auto lock = std::scoped_lock{mutex};
+    connection->queries.clear();
+    connection->output.clear();
+    connection->drained.notify_all();
+}
+
+auto Server::schedule(const std::shared_ptr<Connection>& connection) -> void {
+    if (connection->busy || connection->queries.empty()) {
+        return;
+    }
+    connection->busy = true;
+    workers->start(1, [this, connection](std::size_t, std::size_t) { serve(connection); });
+}
+
+auto Server::serve(const std::shared_ptr<Connection>& connection) -> void {
+    auto query = std::string{};
+    {
+        const auto lock = std::scoped_lock{mutex};
+        if (connection->queries.empty()) {
+            // closed after it was scheduled
+            connection->busy = false;
+            return;
+        }
+        query = std::move(connection->queries.front());
+        connection->queries.pop_front();
+    }
+
+    // readers run next to each other and to the writer, writers wait for each other in
+    // Database::begin
+    execute(connection, query);
+
+    const auto lock = std::scoped_lock{mutex};
+    connection->busy = false;
+    schedule(connection);
+}
+
+auto Server::execute(const std::shared_ptr<Connection>& connection, std::string_view query) -> void {
+    auto response = std::string{};
+    try {
+        if (static_cast<FrameKind>(query[0]) != FrameKind::QUERY) {
+            fail("Unexpected frame kind {}", static_cast<int>(query[0]));
+        }
+        if (query.size() < frame_header_size) {
+            fail("Malformed query frame");
+        }
+        const auto sql_size = get_u32(query.data() + 1);
+        if (sql_size > query.size() - frame_header_size) {
+            fail("Malformed query frame, the sql runs past its end");
+        }
+        const auto sql = query.substr(frame_header_size, sql_size);
+        const auto rest = query.substr(frame_header_size + sql_size);
+        const auto parameters = rest.empty()
+            ? std::vector<Value>{}
+            : decode_record({reinterpret_cast<const std::uint8_t*>(rest.data()), rest.size()});
+
+        auto statement = cache.prepare(sql);
+        for (auto i = std::size_t{0}; i < parameters.size(); ++i) {
+            statement.bind(i + 1, parameters[i]);
+        }
+        while (statement.step()) {
+            append_frame(response, FrameKind::ROW, as_text(encode_record(statement.row())));
+            // a client that hung up doesn't get the rest, the statement is abandoned
+            if (response.size() >= output_chunk_size && !send(connection, response)) {
+                return;
+            }
+        }
+        append_frame(response, FrameKind::DONE, {});
+    } catch (const SqlError& e) {
+        append_frame(response, FrameKind::ERROR, e.what());
+    } catch (const std::exception& e) {
+        // anything escaping would leave the connection busy without an answer, for good
+        append_frame(response, FrameKind::ERROR, fmt::format("Internal error: {}", e.what()));
+    }
+    send(connection, response);
+}
+
+auto Server::send(const std::shared_ptr<Connection>& connection, std::string& frames) -> bool {
+    auto lock = std::unique_lock{mutex};
+    if (connection->closed) {
+        return false;
+    }
+    const auto notify = connection->output.empty();
+    connection->output += frames;
+    frames.clear();
+    if (notify) {
+        pending_output.push_back(connection);
+        lock.unlock();
+        wake();
+        lock.lock();
+    }
+    if (connection->output.size() > output_high_water) {
+        connection->drained.wait(lock, [&] { return connection->closed || connection->output.size() <= output_low_water; });
+    }
+    return !connection->closed;
+}
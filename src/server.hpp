@@ -0,0 +1,114 @@
+#pragma once
+#include "database.hpp"
+#include "statement.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// The wire protocol: every message is a frame, [length][kind][payload], the length a 4 byte big
+// endian count of the bytes after it, kind a single byte.
+//  - client: QUERY, payload [4 byte big endian sql length][sql][record of the parameters], the
+//    parameters in sqlite's record format (see record.hpp), numbered from 1 in the record's order
+//  - server: a ROW per result row, payload the row's record, then DONE with an empty payload, or
+//    ERROR with the message as payload if the query failed, after the rows it returned before
+// A connection's queries run in the order they were sent, each answered before the next starts.
+enum class FrameKind : std::uint8_t { QUERY = 1, ROW = 2, DONE = 3, ERROR = 4 };
+inline constexpr std::size_t frame_header_size = 5;
+// a client sending anything longer is disconnected
+inline constexpr std::size_t max_frame_size = std::size_t{64} << 20;
+// a query hands its frames to the event loop in chunks of about this size
+inline constexpr std::size_t output_chunk_size = std::size_t{64} << 10;
+// a query stops stepping while more than output_high_water bytes wait to be sent to its client,
+// until the event loop got them down to output_low_water
+inline constexpr std::size_t output_high_water = std::size_t{1} << 20;
+inline constexpr std::size_t output_low_water = std::size_t{256} << 10;
+
+struct ServerOptions {
+    // a Unix domain socket path, or a port to listen on at 127.0.0.1
+    std::string address;
+    // the threads running statements
+    std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::size_t statement_cache_size = 256;
+    Frontend frontend = Frontend::NATIVE;
+};
+
+// Serves one database to many clients. A single thread runs an epoll loop for accepting,
+// reading and writing, and hands complete queries to a pool of workers. All connections share
+// the database, and so its buffer pool, and one StatementCache. Queries run on the workers as
+// their own transactions, reads on snapshots next to each other and to the one write at a time,
+// see Transaction. Result rows stream out while the query runs, a client reading slowly holds
+// up its query's worker, not the server's memory.
+class Server {
+public:
+    Server(Database& db, ServerOptions options);
+    ~Server();
+    Server(const Server&) = delete;
+    auto operator=(const Server&) -> Server& = delete;
+
+    // serves until stop()
+    auto run() -> void;
+    // safe to call from any thread and from a signal handler
+    auto stop() -> void;
+
+private:
+    struct Connection {
+        int fd;
+        // event loop only: bytes read that don't make a whole frame yet
+        std::string input;
+        // guarded by mutex
+        std::deque<std::string> queries;
+        std::string output;
+        // signalled when output drains to output_low_water or the connection closes
+        std::condition_variable drained;
+        // a worker is running one of its queries
+        bool busy = false;
+        // event loop only: registered for EPOLLOUT
+        bool writing = false;
+        std::atomic<bool> closed = false;
+    };
+
+    auto accept_connections() -> void;
+    auto read(const std::shared_ptr<Connection>& connection) -> void;
+    // sends what it can without blocking, waits for the socket to become writable for the rest
+    auto flush(const std::shared_ptr<Connection>& connection) -> void;
+    auto close(const std::shared_ptr<Connection>& connection) -> void;
+    // hands the connection's next query to a worker if it may run now, mutex held
+    auto schedule(const std::shared_ptr<Connection>& connection) -> void;
+    // on a worker: runs the connection's next query
+    auto serve(const std::shared_ptr<Connection>& connection) -> void;
+    // runs a query, streaming its response frames to the connection
+    auto execute(const std::shared_ptr<Connection>& connection, std::string_view query) -> void;
+    // moves the frames to the connection's output, waits while that is above the high-water
+    // mark, returns false if the connection closed
+    auto send(const std::shared_ptr<Connection>& connection, std::string& frames) -> bool;
+    auto wake() -> void;
+
+    Database& db;
+    ServerOptions options;
+    int listener = -1;
+    int epoll = -1;
+    // workers write to it when they have output for the event loop to send, and stop() does
+    int events = -1;
+    std::atomic<bool> stopping = false;
+    // event loop only
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+    std::mutex mutex;
+    // the connections with new output
+    std::vector<std::shared_ptr<Connection>> pending_output;
+
+    StatementCache cache;
+    // reset first when destroyed, to finish the running queries while the rest is still there
+    std::unique_ptr<ThreadPool> workers;
+};
@@ -0,0 +1,238 @@
+#include "sorter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+// memcmp order, a key sorts before the longer keys it's a prefix of
+auto compare_keys(std::span<const std::uint8_t> lhs, std::span<const std::uint8_t> rhs) -> int {
+    const auto common = std::min(lhs.size(), rhs.size());
+    if (const auto result = common == 0 ? 0 : std::memcmp(lhs.data(), rhs.data(), common); result != 0) {
+        return result;
+    }
+    return lhs.size() < rhs.size() ? -1 : lhs.size() > rhs.size() ? 1 : 0;
+}
+
+// the order rows come out in, Sorter::Entry's
+auto entry_before(const auto& lhs, const auto& rhs) -> bool {
+    const auto result = compare_keys(lhs.key, rhs.key);
+    return result < 0 || (result == 0 && lhs.sequence < rhs.sequence);
+}
+
+// a value's share of a Sorter's memory
+auto value_memory(const Value& value) -> std::size_t {
+    auto size = sizeof(Value);
+    if (const auto* text = std::get_if<std::string>(&value)) {
+        size += text->size();
+    } else if (const auto* blob = std::get_if<Blob>(&value)) {
+        size += blob->size();
+    }
+    return size;
+}
+
+} // namespace
+
+Sorter::Sorter(std::size_t row_width, std::optional<std::size_t> limit, std::size_t memory_budget)
+    : row_width(row_width), limit(limit), memory_budget(memory_budget), top_n(limit.has_value()) {}
+
+auto Sorter::add(std::span<const std::uint8_t> key, std::span<const Value> row) -> void {
+    if (limit == 0) {
+        return;
+    }
+    if (top_n) {
+        add_to_heap(key, row);
+    } else {
+        add_to_run(key, row);
+    }
+}
+
+auto Sorter::next(std::span<Value> result) -> bool {
+    finish();
+    if (limit && position == *limit) {
+        return false;
+    }
+    if (merge) {
+        if (!merge->next(merged_key, merged_row)) {
+            return false;
+        }
+        std::ranges::move(merged_row, result.begin());
+    } else {
+        if (position == entries.size()) {
+            return false;
+        }
+        const auto first = values.begin() + static_cast<std::ptrdiff_t>(entries[position].row * row_width);
+        std::ranges::move(first, first + static_cast<std::ptrdiff_t>(row_width), result.begin());
+    }
+    ++position;
+    return true;
+}
+
+auto Sorter::partial(std::size_t parts) const -> Sorter {
+    return Sorter{row_width, limit, memory_budget / std::max(parts, std::size_t{1})};
+}
+
+auto Sorter::add_parts(std::vector<Sorter> parts) -> void {
+    for (auto& part : parts) {
+        has_spilled = has_spilled || part.has_spilled;
+        this->parts.push_back(std::move(part));
+    }
+}
+
+auto Sorter::finish() -> void {
+    if (finished) {
+        return;
+    }
+    finished = true;
+    if (runs.empty() && parts.empty()) {
+        sort_entries();
+    } else {
+        if (!entries.empty()) {
+            spill();
+        }
+        merge.emplace(std::exchange(runs, {}), std::exchange(parts, {}));
+    }
+}
+
+auto Sorter::next_keyed(Blob& key, std::vector<Value>& row) -> bool {
+    finish();
+    if (limit && position == *limit) {
+        return false;
+    }
+    if (merge) {
+        if (!merge->next(key, row)) {
+            return false;
+        }
+    } else {
+        if (position == entries.size()) {
+            return false;
+        }
+        std::swap(key, entries[position].key);
+        const auto first = values.begin() + static_cast<std::ptrdiff_t>(entries[position].row * row_width);
+        row.assign(std::make_move_iterator(first), std::make_move_iterator(first + static_cast<std::ptrdiff_t>(row_width)));
+    }
+    ++position;
+    return true;
+}
+
+auto Sorter::entry_memory(const Entry& entry) const -> std::size_t {
+    auto size = sizeof(Entry) + entry.key.size();
+    const auto first = values.begin() + static_cast<std::ptrdiff_t>(entry.row * row_width);
+    for (auto value = first; value != first + static_cast<std::ptrdiff_t>(row_width); ++value) {
+        size += value_memory(*value);
+    }
+    return size;
+}
+
+auto Sorter::add_to_heap(std::span<const std::uint8_t> key, std::span<const Value> row) -> void {
+    const auto before = [](const Entry& lhs, const Entry& rhs) { return entry_before(lhs, rhs); };
+    if (entries.size() < *limit) {
+        const auto slot = static_cast<std::uint32_t>(entries.size());
+        values.insert(values.end(), row.begin(), row.end());
+        entries.push_back(Entry{.key = Blob(key.begin(), key.end()), .sequence = sequence++, .row = slot});
+        memory += entry_memory(entries.back());
+        std::ranges::push_heap(entries, before);
+        // a limit this large sorts like no limit at all
+        top_n = memory <= memory_budget;
+        return;
+    }
+    // a later row with the same key comes out after the largest, so it isn't kept either
+    if (compare_keys(key, entries.front().key) >= 0) {
+        return;
+    }
+    std::ranges::pop_heap(entries, before);
+    auto& entry = entries.back();
+    memory -= entry_memory(entry);
+    entry.key.assign(key.begin(), key.end());
+    entry.sequence = sequence++;
+    std::ranges::copy(row, values.begin() + static_cast<std::ptrdiff_t>(entry.row * row_width));
+    memory += entry_memory(entry);
+    std::ranges::push_heap(entries, before);
+}
+
+auto Sorter::add_to_run(std::span<const std::uint8_t> key, std::span<const Value> row) -> void {
+    const auto slot = static_cast<std::uint32_t>(entries.size());
+    values.insert(values.end(), row.begin(), row.end());
+    entries.push_back(Entry{.key = Blob(key.begin(), key.end()), .sequence = sequence++, .row = slot});
+    memory += entry_memory(entries.back());
+    if (memory > memory_budget || entries.size() == UINT32_MAX) {
+        spill();
+    }
+}
+
+auto Sorter::sort_entries() -> void {
+    std::ranges::sort(entries, [](const Entry& lhs, const Entry& rhs) { return entry_before(lhs, rhs); });
+}
+
+auto Sorter::spill() -> void {
+    sort_entries();
+    auto run = Run{.rows = std::make_unique<SpillFile>(), .level = 0};
+    const auto count = limit ? std::min(*limit, entries.size()) : entries.size();
+    for (const auto& entry : std::span{entries}.first(count)) {
+        run.rows->write(entry.key, std::span{values}.subspan(entry.row * row_width, row_width));
+    }
+    entries.clear();
+    values.clear();
+    memory = 0;
+    runs.push_back(std::move(run));
+    has_spilled = true;
+
+    // the levels never go up along runs, so the last merge_fan_in runs are all of a level when the
+    // first of them is
+    while (runs.size() >= merge_fan_in && runs[runs.size() - merge_fan_in].level == runs.back().level) {
+        const auto first = runs.end() - static_cast<std::ptrdiff_t>(merge_fan_in);
+        auto merged = Run{.rows = std::make_unique<SpillFile>(), .level = runs.back().level + 1};
+        auto merging = Merge{std::vector<Run>(std::make_move_iterator(first), std::make_move_iterator(runs.end()))};
+        runs.erase(first, runs.end());
+        for (auto written = std::size_t{0}; (!limit || written < *limit) && merging.next(merged_key, merged_row); ++written) {
+            merged.rows->write(merged_key, merged_row);
+        }
+        runs.push_back(std::move(merged));
+    }
+}
+
+// ===================================
+// Sorter::Merge
+// ===================================
+Sorter::Merge::Merge(std::vector<Run> runs, std::vector<Sorter> parts)
+    : runs(std::move(runs)), parts(std::move(parts)), keys(this->runs.size() + this->parts.size()), rows(keys.size()) {
+    for (auto& run : this->runs) {
+        run.rows->rewind();
+    }
+    for (auto run = std::size_t{0}; run < keys.size(); ++run) {
+        if (read(run, keys[run], rows[run])) {
+            heap.push_back(run);
+        }
+    }
+    std::ranges::make_heap(heap, [this](std::size_t a, std::size_t b) { return after(a, b); });
+}
+
+auto Sorter::Merge::next(Blob& key, std::vector<Value>& row) -> bool {
+    if (heap.empty()) {
+        return false;
+    }
+    const auto order = [this](std::size_t a, std::size_t b) { return after(a, b); };
+    std::ranges::pop_heap(heap, order);
+    const auto run = heap.back();
+    std::swap(key, keys[run]);
+    std::swap(row, rows[run]);
+    if (read(run, keys[run], rows[run])) {
+        std::ranges::push_heap(heap, order);
+    } else {
+        heap.pop_back();
+    }
+    return true;
+}
+
+auto Sorter::Merge::after(std::size_t a, std::size_t b) const -> bool {
+    const auto result = compare_keys(keys[a], keys[b]);
+    return result > 0 || (result == 0 && a > b);
+}
+
+auto Sorter::Merge::read(std::size_t run, Blob& key, std::vector<Value>& row) -> bool {
+    if (run < runs.size()) {
+        return runs[run].rows->read(key, row);
+    }
+    return parts[run - runs.size()].next_keyed(key, row);
+}
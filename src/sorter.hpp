@@ -0,0 +1,111 @@
+#pragma once
+#include "hash_join.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+// how much memory a sort keeps its rows in by default, see Sorter
+inline constexpr std::size_t default_sort_memory_budget = std::size_t{64} << 20;
+
+// ORDER BY: rows go in with a key encoded like an index key (see append_key_column, a DESC term's
+// bytes inverted), so sorting them is memcmp on the keys. They come out in key order, rows with
+// equal keys in the order they went in.
+//
+// With a limit only that many rows come out, and the rows with the smallest keys are kept in a
+// heap with the largest of them on top, which a new row replaces if its key is smaller - a table
+// is never sorted to get its first rows. Without a limit, or once the heap outgrows the memory
+// budget, the rows are sorted in memory until they outgrow the budget, then written to a temporary
+// file as a sorted run (its first limit rows only). As for an LSM tree, merge_fan_in runs of a
+// level are merged into a run of the next level as they pile up, and next() merges what's left.
+//
+// A parallel sort gives each morsel a partial Sorter, and add_parts() merges them as they come out.
+class Sorter {
+public:
+    // limit - how many rows come out at most, all of them without one
+    Sorter(std::size_t row_width, std::optional<std::size_t> limit, std::size_t memory_budget);
+
+    auto add(std::span<const std::uint8_t> key, std::span<const Value> row) -> void;
+    // after the last add: loads the next row into row_width values, false once there's none
+    auto next(std::span<Value> result) -> bool;
+
+    // an empty Sorter like this one for a share of the rows, with a parts-th of the memory budget
+    [[nodiscard]] auto partial(std::size_t parts) const -> Sorter;
+    // instead of the rows of add(): takes the partial Sorters of the shares of the rows in their
+    // order, their rows come out merged, ties in the order of the parts
+    auto add_parts(std::vector<Sorter> parts) -> void;
+
+    [[nodiscard]] auto spilled() const -> bool { return has_spilled; }
+
+    static constexpr std::size_t merge_fan_in = 16;
+
+private:
+    struct Entry {
+        Blob key;
+        // the order the rows went in, which breaks ties
+        std::uint64_t sequence = 0;
+        // the row's values at row * row_width in values
+        std::uint32_t row = 0;
+    };
+
+    struct Run {
+        std::unique_ptr<SpillFile> rows;
+        // 0 for a run of rows sorted in memory, n + 1 for one merged from runs of level n
+        std::size_t level = 0;
+    };
+
+    // Reads runs back in key order, then the parts, ties in the order of the runs and the parts.
+    class Merge {
+    public:
+        explicit Merge(std::vector<Run> runs, std::vector<Sorter> parts = {});
+        auto next(Blob& key, std::vector<Value>& row) -> bool;
+
+    private:
+        // whether run a's row comes out after run b's
+        [[nodiscard]] auto after(std::size_t a, std::size_t b) const -> bool;
+        // the next row of a run, or of a part past the runs
+        auto read(std::size_t run, Blob& key, std::vector<Value>& row) -> bool;
+
+        std::vector<Run> runs;
+        std::vector<Sorter> parts;
+        std::vector<Blob> keys;
+        std::vector<std::vector<Value>> rows;
+        // the runs with a row left, a heap with the smallest row on top
+        std::vector<std::size_t> heap;
+    };
+
+    // sorts what's in memory, or sets up the merge of the runs and the parts
+    auto finish() -> void;
+    // like next(), with the row's key as well
+    auto next_keyed(Blob& key, std::vector<Value>& row) -> bool;
+    auto entry_memory(const Entry& entry) const -> std::size_t;
+    // keeps the row in place of the heap's largest if it's smaller
+    auto add_to_heap(std::span<const std::uint8_t> key, std::span<const Value> row) -> void;
+    auto add_to_run(std::span<const std::uint8_t> key, std::span<const Value> row) -> void;
+    auto sort_entries() -> void;
+    // writes the sorted entries to a run of level 0, merging the runs that pile up
+    auto spill() -> void;
+
+    std::size_t row_width;
+    std::optional<std::size_t> limit;
+    std::size_t memory_budget;
+
+    std::vector<Entry> entries;
+    std::vector<Value> values;
+    std::size_t memory = 0;
+    std::uint64_t sequence = 0;
+    // whether entries is a heap, which it is while the limit's rows fit into the budget
+    bool top_n;
+
+    std::vector<Run> runs;
+    std::vector<Sorter> parts;
+    bool has_spilled = false;
+    bool finished = false;
+    std::size_t position = 0;
+    std::optional<Merge> merge;
+    Blob merged_key;
+    std::vector<Value> merged_row;
+};
@@ -0,0 +1,168 @@
+#include "statement.hpp"
+#include "common.hpp"
+#include <algorithm>
+
+auto compile(std::string_view sql, const Database& db, Frontend frontend) -> CompiledStatement {
+    auto compiled = CompiledStatement{
+        .sql = std::string{sql},
+        .program = {},
+        .parameter_names = {},
+        .schema_cookie = db.schema_cookie()
+    };
+    parse(compiled.sql, frontend, [&](const Statement& statement, std::span<const std::string_view> parameters) {
+        // the writer may be adding to the schema on another thread
+        const auto lock = db.schema_lock();
+        compiled.program = generate_bytecode(statement, db);
+        compiled.parameter_names.assign(parameters.begin(), parameters.end());
+    });
+    return compiled;
+}
+
+// ===================================
+// PreparedStatement
+// ===================================
+PreparedStatement::PreparedStatement(StatementCache& cache, std::shared_ptr<const CompiledStatement> compiled)
+    : cache(&cache),
+      compiled(std::move(compiled)),
+      parameters(this->compiled->parameter_names.size()),
+      vm(cache.database()) {}
+
+PreparedStatement::PreparedStatement(PreparedStatement&& other) noexcept
+    : cache(other.cache),
+      compiled(std::move(other.compiled)),
+      parameters(std::move(other.parameters)),
+      vm(std::move(other.vm)),
+      running(std::exchange(other.running, false)) {}
+
+PreparedStatement::~PreparedStatement() {
+    if (running) {
+        try {
+            vm.reset();
+        } catch (const SqlError&) {
+            // ending a read transaction doesn't fail and a rollback has nothing left to report
+        }
+    }
+}
+
+auto PreparedStatement::parameter_index(std::string_view name) const -> std::size_t {
+    const auto& names = compiled->parameter_names;
+    const auto it = std::ranges::find(names, name);
+    return it == names.end() ? 0 : static_cast<std::size_t>(it - names.begin()) + 1;
+}
+
+auto PreparedStatement::bind(std::size_t index, Value value) -> void {
+    if (running) {
+        fail("Cannot bind parameters of a running statement, reset it first");
+    }
+    if (index == 0 || index > parameters.size()) {
+        fail("Bind index {} is out of range, the statement has {} parameters", index, parameters.size());
+    }
+    parameters[index - 1] = std::move(value);
+}
+
+auto PreparedStatement::bind(std::string_view name, Value value) -> void {
+    const auto index = parameter_index(name);
+    if (index == 0) {
+        fail("No such parameter: '{}'", name);
+    }
+    bind(index, std::move(value));
+}
+
+auto PreparedStatement::clear_bindings() -> void {
+    if (running) {
+        fail("Cannot clear the bindings of a running statement, reset it first");
+    }
+    std::ranges::fill(parameters, Value{});
+}
+
+auto PreparedStatement::step() -> bool {
+    if (!running) {
+        if (compiled->schema_cookie != cache->database().schema_cookie()) {
+            // the parameters are numbered by the text, so the bindings still line up
+            compiled = cache->lookup(compiled->sql);
+            parameters.resize(compiled->parameter_names.size());
+        }
+        vm.start(compiled->program, parameters);
+        running = true;
+    }
+    return vm.step() == StepResult::ROW;
+}
+
+auto PreparedStatement::reset() -> void {
+    if (running) {
+        vm.reset();
+        running = false;
+    }
+}
+
+// ===================================
+// StatementCache
+// ===================================
+StatementCache::StatementCache(Database& db, std::size_t capacity, Frontend frontend)
+    : db(db), capacity(std::max(capacity, std::size_t{1})), frontend(frontend) {}
+
+auto StatementCache::prepare(std::string_view sql) -> PreparedStatement {
+    return PreparedStatement{*this, lookup(sql)};
+}
+
+auto StatementCache::execute(std::string_view sql, std::span<const Value> parameters, const RowCallback& on_row) -> void {
+    auto statement = prepare(sql);
+    for (auto i = std::size_t{0}; i < parameters.size(); ++i) {
+        statement.bind(i + 1, parameters[i]);
+    }
+    while (statement.step()) {
+        if (on_row) {
+            on_row(statement.row());
+        }
+    }
+}
+
+auto StatementCache::size() const -> std::size_t {
+    const auto lock = std::scoped_lock{mutex};
+    return entries.size();
+}
+
+auto StatementCache::hits() const -> std::uint64_t {
+    const auto lock = std::scoped_lock{mutex};
+    return hit_count;
+}
+
+auto StatementCache::misses() const -> std::uint64_t {
+    const auto lock = std::scoped_lock{mutex};
+    return miss_count;
+}
+
+auto StatementCache::lookup(std::string_view sql) -> std::shared_ptr<const CompiledStatement> {
+    {
+        const auto lock = std::scoped_lock{mutex};
+        if (const auto it = index.find(sql); it != index.end()) {
+            auto entry = it->second;
+            if ((*entry)->schema_cookie == db.schema_cookie()) {
+                ++hit_count;
+                entries.splice(entries.begin(), entries, entry);
+                return *entry;
+            }
+            // compiled against an older schema, VERIFY_COOKIE would reject it
+            index.erase(it);
+            entries.erase(entry);
+        }
+        ++miss_count;
+    }
+
+    // compiled without the lock, so other statements can be looked up meanwhile
+    auto compiled = std::make_shared<const CompiledStatement>(compile(sql, db, frontend));
+    const auto lock = std::scoped_lock{mutex};
+    if (const auto it = index.find(compiled->sql); it != index.end()) {
+        // compiled by another thread at the same time
+        const auto entry = it->second;
+        index.erase(it);
+        entries.erase(entry);
+    }
+    entries.push_front(compiled);
+    index.emplace(compiled->sql, entries.begin());
+    if (entries.size() > capacity) {
+        index.erase(entries.back()->sql);
+        entries.pop_back();
+    }
+    return compiled;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "bytecode_gen.hpp"
+#include "database.hpp"
+#include "frontend.hpp"
+#include "value.hpp"
+#include "vm.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The result of parsing, building the IR of and generating code for one statement.
+struct CompiledStatement {
+    std::string sql;
+    SqlBytecodeProgram program;
+    // parameter n's name is at n - 1, empty for an anonymous "?", see Parameter
+    std::vector<std::string> parameter_names;
+    // the schema the program was generated against
+    std::int64_t schema_cookie;
+};
+
+[[nodiscard]] auto compile(std::string_view sql, const Database& db, Frontend frontend = Frontend::NATIVE) -> CompiledStatement;
+
+class StatementCache;
+
+// sqlite3_stmt: a compiled statement, the values bound to its parameters and its execution state.
+//  - bind - before the first step or after a reset
+//  - step - runs up to the next result row, returns false once the statement is done
+//  - reset - rewinds to the beginning, the bindings stay
+// The statement is recompiled transparently when the schema changed since it was compiled.
+class PreparedStatement {
+public:
+    PreparedStatement(StatementCache& cache, std::shared_ptr<const CompiledStatement> compiled);
+    PreparedStatement(PreparedStatement&& other) noexcept;
+    PreparedStatement(const PreparedStatement&) = delete;
+    // abandons the execution if the statement is still running
+    ~PreparedStatement();
+
+    [[nodiscard]] auto sql() const -> std::string_view { return compiled->sql; }
+    [[nodiscard]] auto program() const -> const SqlBytecodeProgram& { return compiled->program; }
+
+    // the largest parameter number
+    [[nodiscard]] auto parameter_count() const -> std::size_t { return compiled->parameter_names.size(); }
+    // number of the parameter with the given name (e.g. ":id"), 0 if there is none
+    [[nodiscard]] auto parameter_index(std::string_view name) const -> std::size_t;
+
+    // parameters are numbered from 1
+    auto bind(std::size_t index, Value value) -> void;
+    auto bind(std::string_view name, Value value) -> void;
+    // sets every parameter back to NULL
+    auto clear_bindings() -> void;
+
+    auto step() -> bool;
+    // the current result row, valid until the next step
+    [[nodiscard]] auto row() const -> std::span<const Value> { return vm.row(); }
+    auto reset() -> void;
+
+private:
+    StatementCache* cache;
+    std::shared_ptr<const CompiledStatement> compiled;
+    std::vector<Value> parameters;
+    VirtualMachine vm;
+    bool running = false;
+};
+
+// Compiled statements keyed by their SQL text, so running the same statement again skips
+// parsing, IR construction and code generation. Holds up to capacity statements and evicts
+// the least recently prepared one, statements evicted while in use stay alive until dropped.
+// Statements may be prepared on several threads at once, each of them used by one at a time.
+class StatementCache {
+public:
+    explicit StatementCache(Database& db, std::size_t capacity = 256, Frontend frontend = Frontend::NATIVE);
+
+    auto prepare(std::string_view sql) -> PreparedStatement;
+    // prepare + step through every row
+    auto execute(std::string_view sql, std::span<const Value> parameters = {}, const RowCallback& on_row = {}) -> void;
+
+    [[nodiscard]] auto database() -> Database& { return db; }
+    [[nodiscard]] auto size() const -> std::size_t;
+    [[nodiscard]] auto hits() const -> std::uint64_t;
+    [[nodiscard]] auto misses() const -> std::uint64_t;
+
+private:
+    friend class PreparedStatement;
+
+    // the cached compilation, recompiled if it's stale
+    auto lookup(std::string_view sql) -> std::shared_ptr<const CompiledStatement>;
+
+    Database& db;
+    std::size_t capacity;
+    Frontend frontend;
+    mutable std::mutex mutex;
+    // most recently used first, the index points into it and its keys are views of the entries' sql
+    std::list<std::shared_ptr<const CompiledStatement>> entries;
+    std::unordered_map<std::string_view, std::list<std::shared_ptr<const CompiledStatement>>::iterator> index;
+    std::uint64_t hit_count = 0;
+    std::uint64_t miss_count = 0;
+};
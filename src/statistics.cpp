@@ -0,0 +1,370 @@
+#include "statistics.hpp"
+#include "columnar.hpp"
+#include "common.hpp"
+#include "operators.hpp"
+#include "record.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string_view>
+
+namespace {
+
+// splitmix64's finalizer, spreading the bits of std::hash over the whole word
+auto mix(std::uint64_t hash) -> std::uint64_t {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+auto as_number(const Value& value) -> std::optional<double> {
+    if (const auto* integer = std::get_if<std::int64_t>(&value)) {
+        return static_cast<double>(*integer);
+    }
+    if (const auto* real = std::get_if<double>(&value)) {
+        return *real;
+    }
+    return std::nullopt;
+}
+
+// the values are never NULL, which compare() leaves unordered
+auto less(const Value& lhs, const Value& rhs) -> bool {
+    return *compare(lhs, rhs) < 0;
+}
+
+// the equi-depth buckets of the sorted values, scale - the table's rows per sampled value
+auto build_histogram(std::span<const Value> values, double scale) -> std::vector<HistogramBucket> {
+    auto histogram = std::vector<HistogramBucket>{};
+    if (values.empty()) {
+        return histogram;
+    }
+    const auto depth = (values.size() + histogram_buckets - 1) / histogram_buckets;
+    auto rows = std::size_t{0};
+    auto distinct = std::size_t{0};
+    const auto close = [&](const Value& bound) {
+        histogram.push_back(HistogramBucket{.bound = bound, .rows = static_cast<double>(rows) * scale,
+                                            .distinct = static_cast<double>(distinct)});
+        rows = 0;
+        distinct = 0;
+    };
+    for (auto run = std::size_t{0}; run < values.size();) {
+        auto end = run + 1;
+        while (end < values.size() && *compare(values[end], values[run]) == 0) {
+            ++end;
+        }
+        // a value never straddles two buckets, and one with a bucket's worth of rows gets its own
+        if (rows > 0 && rows + (end - run) > depth) {
+            close(values[run - 1]);
+        }
+        rows += end - run;
+        ++distinct;
+        if (rows >= depth) {
+            close(values[end - 1]);
+        }
+        run = end;
+    }
+    if (rows > 0) {
+        close(values.back());
+    }
+    return histogram;
+}
+
+auto number(const Value& value) -> double {
+    const auto number = as_number(value);
+    if (!number) {
+        fail("Malformed schema table entry - statistics that aren't numbers");
+    }
+    return *number;
+}
+
+} // namespace
+
+// ===================================
+// HyperLogLog
+// ===================================
+auto HyperLogLog::add(const Value& value) -> void {
+    key.clear();
+    append_key_column(key, value, false);
+    add_hash(mix(std::hash<std::string_view>{}(std::string_view{reinterpret_cast<const char*>(key.data()), key.size()})));
+}
+
+auto HyperLogLog::add_hash(std::uint64_t hash) -> void {
+    // the top bits pick the register, the zeros are counted in the rest
+    const auto reg = hash >> (64 - precision);
+    const auto rank = static_cast<std::uint8_t>(std::countl_zero((hash << precision) | (std::uint64_t{1} << (precision - 1))) + 1);
+    registers[reg] = std::max(registers[reg], rank);
+}
+
+auto HyperLogLog::estimate() const -> double {
+    constexpr auto m = static_cast<double>(std::size_t{1} << precision);
+    constexpr auto alpha = 0.7213 / (1.0 + 1.079 / m);
+    auto sum = 0.0;
+    auto zeros = 0;
+    for (const auto reg : registers) {
+        sum += std::ldexp(1.0, -reg);
+        zeros += reg == 0 ? 1 : 0;
+    }
+    const auto estimate = alpha * m * m / sum;
+    // linear counting while few registers are set, it's the more accurate one there
+    if (estimate <= 2.5 * m && zeros > 0) {
+        return m * std::log(m / zeros);
+    }
+    return estimate;
+}
+
+// ===================================
+// ColumnStatistics
+// ===================================
+auto ColumnStatistics::equal(const Value& value, double rows) const -> double {
+    if (std::holds_alternative<Null>(value) || rows <= 0) {
+        return 0.0;
+    }
+    const auto bucket = std::ranges::find_if(histogram, [&](const HistogramBucket& b) { return !less(b.bound, value); });
+    if (bucket != histogram.end() && bucket->distinct == 1 && *compare(bucket->bound, value) == 0) {
+        return bucket->rows / rows;
+    }
+    // the rows the values with a bucket of their own leave are shared by the other values
+    auto single_rows = 0.0;
+    auto singles = 0.0;
+    for (const auto& b : histogram) {
+        if (b.distinct == 1) {
+            single_rows += b.rows;
+            singles += 1;
+        }
+    }
+    const auto others = std::max(rows - nulls - single_rows, 0.0);
+    return others / std::max(distinct - singles, 1.0) / rows;
+}
+
+auto ColumnStatistics::equal(double rows) const -> double {
+    if (rows <= 0) {
+        return 0.0;
+    }
+    return (rows - nulls) / std::max(distinct, 1.0) / rows;
+}
+
+auto ColumnStatistics::below(const Value& value, bool inclusive, double rows) const -> double {
+    if (std::holds_alternative<Null>(value) || rows <= 0) {
+        return 0.0;
+    }
+    if (histogram.empty()) {
+        return (rows - nulls) / 3 / rows;
+    }
+    auto count = 0.0;
+    for (auto i = std::size_t{0}; i < histogram.size(); ++i) {
+        const auto& bucket = histogram[i];
+        const auto order = *compare(value, bucket.bound);
+        if (order > 0) {
+            count += bucket.rows;
+            continue;
+        }
+        if (order == 0) {
+            // the bound's share of the bucket is a guess unless it's the bucket's only value
+            const auto bound_rows = bucket.rows / std::max(bucket.distinct, 1.0);
+            count += inclusive ? bucket.rows : bucket.rows - bound_rows;
+            break;
+        }
+        if (bucket.distinct == 1) {
+            break;
+        }
+        // within the bucket, numbers are taken to be spread evenly between the bounds
+        auto share = 0.5;
+        const auto high = as_number(bucket.bound);
+        const auto low = i > 0 ? as_number(histogram[i - 1].bound) : std::nullopt;
+        const auto point = as_number(value);
+        if (high && low && point && *high > *low) {
+            share = std::clamp((*point - *low) / (*high - *low), 0.0, 1.0);
+        }
+        count += bucket.rows * share;
+        break;
+    }
+    return std::clamp(count / rows, 0.0, 1.0);
+}
+
+auto ColumnStatistics::above(const Value& value, bool inclusive, double rows) const -> double {
+    if (std::holds_alternative<Null>(value) || rows <= 0) {
+        return 0.0;
+    }
+    return std::max((rows - nulls) / rows - below(value, !inclusive, rows), 0.0);
+}
+
+auto TableStatistics::index(std::string_view name) const -> const IndexStatistics* {
+    const auto it = std::ranges::find(indexes, name, &IndexStatistics::name);
+    return it == indexes.end() ? nullptr : &*it;
+}
+
+// ===================================
+// ANALYZE
+// ===================================
+auto analyze_table(BTree& table, const TableSchema& schema,
+                   const std::function<IndexBTree&(const IndexSchema&)>& index) -> TableStatistics {
+    const auto column_count = schema.columns.size();
+    auto distinct = std::vector<HyperLogLog>(column_count);
+    auto nulls = std::vector<double>(column_count);
+    auto sample = std::vector<std::vector<Value>>{};
+    // the same sample every time for the same table
+    auto random = std::mt19937_64{};
+    auto rows = std::uint64_t{0};
+
+    auto cursor = BTreeCursor{table};
+    // a COLUMNAR table's rows are mostly in segments
+    auto columnar = schema.columnar ? std::make_unique<ColumnarCursor>(column_count) : nullptr;
+    auto row = std::vector<Value>(column_count);
+    for (auto ok = columnar ? columnar->first(cursor) : cursor.first(); ok; ok = columnar ? columnar->next(cursor) : cursor.next()) {
+        const auto in_segment = columnar && columnar->in_segment();
+        auto record = in_segment ? RecordView{} : RecordView{cursor.payload()};
+        for (auto column = std::size_t{0}; column < column_count; ++column) {
+            row[column] = in_segment ? columnar->column(cursor, column) : to_value(record.column(column));
+            if (std::holds_alternative<Null>(row[column])) {
+                nulls[column] += 1;
+            } else {
+                distinct[column].add(row[column]);
+            }
+        }
+        ++rows;
+        // reservoir sampling, every row ends up in the sample with the same probability
+        if (sample.size() < statistics_sample_size) {
+            sample.push_back(row);
+        } else if (const auto slot = random() % rows; slot < statistics_sample_size) {
+            sample[slot] = row;
+        }
+    }
+
+    auto statistics = TableStatistics{.rows = static_cast<double>(rows)};
+    auto values = std::vector<Value>{};
+    for (auto column = std::size_t{0}; column < column_count; ++column) {
+        values.clear();
+        for (auto& sampled : sample) {
+            if (!std::holds_alternative<Null>(sampled[column])) {
+                values.push_back(std::move(sampled[column]));
+            }
+        }
+        std::ranges::sort(values, less);
+        const auto non_null = static_cast<double>(rows) - nulls[column];
+        const auto scale = values.empty() ? 0.0 : non_null / static_cast<double>(values.size());
+        statistics.columns.push_back(ColumnStatistics{
+            .distinct = non_null > 0 ? std::clamp(distinct[column].estimate(), 1.0, non_null) : 0.0,
+            .nulls = nulls[column],
+            .histogram = build_histogram(values, scale)
+        });
+    }
+
+    // an index's entries are sorted, a key prefix differs from the previous entry's in a
+    // column once the entries differ before the column's end
+    auto previous = Blob{};
+    auto ends = std::vector<std::size_t>{};
+    for (const auto& index_schema : schema.indexes) {
+        auto counts = IndexStatistics{.name = index_schema.name, .distinct = std::vector<double>(index_schema.columns.size())};
+        auto entries = IndexCursor{index(index_schema)};
+        previous.clear();
+        for (auto ok = entries.first(); ok; ok = entries.next()) {
+            const auto entry = entries.entry();
+            ends.clear();
+            auto end = std::size_t{0};
+            for (const auto& column : index_schema.columns) {
+                end += key_column_size(entry.subspan(end), column.descending);
+                ends.push_back(end);
+            }
+            const auto common = std::min(entry.size(), previous.size());
+            const auto differs = static_cast<std::size_t>(std::ranges::mismatch(entry.first(common), std::span{previous}.first(common)).in1 - entry.begin());
+            for (auto i = std::size_t{0}; i < ends.size(); ++i) {
+                if (previous.empty() || ends[i] > differs) {
+                    counts.distinct[i] += 1;
+                }
+            }
+            previous.assign(entry.begin(), entry.end());
+        }
+        statistics.indexes.push_back(std::move(counts));
+    }
+    return statistics;
+}
+
+auto encode_statistics(const TableSchema& schema, const TableStatistics& statistics) -> std::vector<Blob> {
+    const auto header = [&](std::string_view kind, std::string_view name) {
+        return std::vector<Value>{schema.name, std::int64_t{0}, std::string{statistics_entry}, std::string{kind}, std::string{name}};
+    };
+    auto rows = std::vector<Blob>{};
+    auto row = header("table", schema.name);
+    row.emplace_back(statistics.rows);
+    rows.push_back(encode_record(row));
+
+    for (auto column = std::size_t{0}; column < statistics.columns.size(); ++column) {
+        auto histogram = statistics.columns[column].histogram;
+        while (true) {
+            row = header("column", schema.columns[column].name);
+            row.emplace_back(statistics.columns[column].distinct);
+            row.emplace_back(statistics.columns[column].nulls);
+            for (const auto& bucket : histogram) {
+                row.push_back(bucket.bound);
+                row.emplace_back(bucket.rows);
+                row.emplace_back(bucket.distinct);
+            }
+            auto record = encode_record(row);
+            if (record.size() <= BTree::max_payload_size || histogram.empty()) {
+                rows.push_back(std::move(record));
+                break;
+            }
+            // too big for a row: half as many buckets, a single one with a long bound is dropped
+            auto halved = std::vector<HistogramBucket>{};
+            for (auto i = std::size_t{0}; i + 1 < histogram.size(); i += 2) {
+                halved.push_back(HistogramBucket{.bound = histogram[i + 1].bound, .rows = histogram[i].rows + histogram[i + 1].rows,
+                                                 .distinct = histogram[i].distinct + histogram[i + 1].distinct});
+            }
+            if (histogram.size() % 2 == 1 && !halved.empty()) {
+                halved.back().bound = histogram.back().bound;
+                halved.back().rows += histogram.back().rows;
+                halved.back().distinct += histogram.back().distinct;
+            }
+            histogram = std::move(halved);
+        }
+    }
+
+    for (const auto& index : statistics.indexes) {
+        row = header("index", index.name);
+        for (const auto distinct : index.distinct) {
+            row.emplace_back(distinct);
+        }
+        rows.push_back(encode_record(row));
+    }
+    return rows;
+}
+
+auto decode_statistics(const TableSchema& schema, std::span<const Value> row, TableStatistics& statistics) -> void {
+    const auto* kind = row.size() > 4 ? std::get_if<std::string>(&row[3]) : nullptr;
+    const auto* name = row.size() > 4 ? std::get_if<std::string>(&row[4]) : nullptr;
+    if (!kind || !name) {
+        fail("Malformed schema table entry - statistics of '{}'", schema.name);
+    }
+    const auto values = row.subspan(5);
+    if (*kind == "table" && values.size() == 1) {
+        statistics.rows = number(values[0]);
+        return;
+    }
+    if (*kind == "index") {
+        auto index = IndexStatistics{.name = *name};
+        for (const auto& value : values) {
+            index.distinct.push_back(number(value));
+        }
+        statistics.indexes.push_back(std::move(index));
+        return;
+    }
+    const auto column = schema.column_index(*name);
+    if (*kind != "column" || !column || values.size() < 2 || values.size() % 3 != 2) {
+        fail("Malformed schema table entry - statistics of '{}'", schema.name);
+    }
+    statistics.columns.resize(schema.columns.size());
+    auto& column_statistics = statistics.columns[*column];
+    column_statistics.distinct = number(values[0]);
+    column_statistics.nulls = number(values[1]);
+    column_statistics.histogram.clear();
+    for (auto i = std::size_t{2}; i < values.size(); i += 3) {
+        if (std::holds_alternative<Null>(values[i])) {
+            fail("Malformed schema table entry - statistics of '{}'", schema.name);
+        }
+        column_statistics.histogram.push_back(HistogramBucket{.bound = values[i], .rows = number(values[i + 1]), .distinct = number(values[i + 2])});
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "btree.hpp"
+#include "catalog.hpp"
+#include "index.hpp"
+#include "value.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Counts the distinct values it's given in a fixed 4 KiB, to within about 1.6%: each value's hash
+// picks a register, which keeps the longest run of leading zeros among the hashes it got
+// (https://en.wikipedia.org/wiki/HyperLogLog).
+class HyperLogLog {
+public:
+    static constexpr unsigned precision = 12;
+
+    // values that compare equal count once, 1 and 1.0 included
+    auto add(const Value& value) -> void;
+    auto add_hash(std::uint64_t hash) -> void;
+    [[nodiscard]] auto estimate() const -> double;
+
+private:
+    std::array<std::uint8_t, std::size_t{1} << precision> registers{};
+    Blob key;
+};
+
+// A bucket of an equi-depth histogram: the values up to and including bound, after the previous
+// bucket's bound.
+struct HistogramBucket {
+    Value bound;
+    // the table's rows in the bucket, and how many distinct values they had in the sample
+    double rows = 0;
+    double distinct = 0;
+};
+
+// ANALYZE's numbers on a column, from every row for the counts and from a sample of the rows for
+// the histogram of the non-NULL values. The buckets hold about as many rows each, a value with
+// more rows than that gets a bucket of its own, which is how the histogram shows skew.
+struct ColumnStatistics {
+    double distinct = 0;
+    double nulls = 0;
+    std::vector<HistogramBucket> histogram{};
+
+    // the fraction of the table's rows with column = value, or column < value (<= if inclusive).
+    // NULL compares to nothing
+    [[nodiscard]] auto equal(const Value& value, double rows) const -> double;
+    [[nodiscard]] auto below(const Value& value, bool inclusive, double rows) const -> double;
+    // column > value, >= if inclusive
+    [[nodiscard]] auto above(const Value& value, bool inclusive, double rows) const -> double;
+    // = for a value not known while compiling
+    [[nodiscard]] auto equal(double rows) const -> double;
+};
+
+struct IndexStatistics {
+    std::string name;
+    // distinct[i] - how many distinct keys the first i + 1 indexed columns make
+    std::vector<double> distinct{};
+};
+
+// What the planner knows about a table as of its last ANALYZE.
+struct TableStatistics {
+    double rows = 0;
+    // in the table's column order
+    std::vector<ColumnStatistics> columns{};
+    std::vector<IndexStatistics> indexes{};
+
+    [[nodiscard]] auto index(std::string_view name) const -> const IndexStatistics*;
+};
+
+inline constexpr std::size_t histogram_buckets = 32;
+// rows the histograms are built from, a reservoir sample of the table
+inline constexpr std::size_t statistics_sample_size = 4096;
+
+// Scans the table for its row count and each column's distinct values and NULLs, keeping a sample
+// of its rows for the histograms, and each index for how many distinct keys its prefixes make.
+// index - the tree of each of the schema's indexes
+auto analyze_table(BTree& table, const TableSchema& schema,
+                   const std::function<IndexBTree&(const IndexSchema&)>& index) -> TableStatistics;
+
+// The rows of the schema table holding the statistics, (table, 0, 'statistics', kind, name, ...):
+//  - 'table', the table's name, rows
+//  - 'column', the column's name, distinct, nulls, then bound, rows, distinct per bucket
+//  - 'index', the index's name, distinct per indexed column
+// A histogram is halved until its row fits into a page, see BTree::max_payload_size.
+inline constexpr std::string_view statistics_entry = "statistics";
+[[nodiscard]] auto encode_statistics(const TableSchema& schema, const TableStatistics& statistics) -> std::vector<Blob>;
+// adds a row of encode_statistics, fails for a malformed one
+auto decode_statistics(const TableSchema& schema, std::span<const Value> row, TableStatistics& statistics) -> void;
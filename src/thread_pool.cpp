@@ -0,0 +1,135 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+// ===================================
+// Job
+// ===================================
+ThreadPool::Job::Job(std::size_t morsels, std::size_t workers, Task task)
+    : task(std::move(task)), queues(workers), pending(morsels) {
+    for (auto worker = std::size_t{0}; worker < workers; ++worker) {
+        for (auto morsel = worker * morsels / workers; morsel < (worker + 1) * morsels / workers; ++morsel) {
+            queues[worker].morsels.push_back(morsel);
+        }
+    }
+}
+
+auto ThreadPool::Job::take(std::size_t worker) -> std::optional<std::size_t> {
+    if (cancelled) {
+        return std::nullopt;
+    }
+    {
+        auto& own = queues[worker];
+        const auto lock = std::scoped_lock{own.mutex};
+        if (!own.morsels.empty()) {
+            const auto morsel = own.morsels.front();
+            own.morsels.pop_front();
+            return morsel;
+        }
+    }
+    for (auto i = std::size_t{1}; i < queues.size(); ++i) {
+        auto& victim = queues[(worker + i) % queues.size()];
+        const auto lock = std::scoped_lock{victim.mutex};
+        if (!victim.morsels.empty()) {
+            const auto morsel = victim.morsels.back();
+            victim.morsels.pop_back();
+            return morsel;
+        }
+    }
+    return std::nullopt;
+}
+
+auto ThreadPool::Job::run(std::size_t morsel, std::size_t worker) -> void {
+    try {
+        task(morsel, worker);
+    } catch (...) {
+        {
+            const auto lock = std::scoped_lock{mutex};
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        cancel();
+    }
+    finished(1);
+}
+
+auto ThreadPool::Job::cancel() -> void {
+    cancelled = true;
+    auto dropped = std::size_t{0};
+    for (auto& queue : queues) {
+        const auto lock = std::scoped_lock{queue.mutex};
+        dropped += queue.morsels.size();
+        queue.morsels.clear();
+    }
+    if (dropped > 0) {
+        finished(dropped);
+    }
+}
+
+auto ThreadPool::Job::finished(std::size_t count) -> void {
+    const auto lock = std::scoped_lock{mutex};
+    pending -= count;
+    if (pending == 0) {
+        done.notify_all();
+    }
+}
+
+auto ThreadPool::Job::wait() -> void {
+    auto lock = std::unique_lock{mutex};
+    done.wait(lock, [&] { return pending == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// ===================================
+// ThreadPool
+// ===================================
+ThreadPool::ThreadPool(std::size_t threads) {
+    for (auto worker = std::size_t{0}; worker < std::max(threads, std::size_t{1}); ++worker) {
+        this->threads.emplace_back([this, worker] { work(worker); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        const auto lock = std::scoped_lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+auto ThreadPool::start(std::size_t morsels, Task task) -> std::shared_ptr<Job> {
+    auto job = std::make_shared<Job>(morsels, size(), std::move(task));
+    if (morsels > 0) {
+        {
+            const auto lock = std::scoped_lock{mutex};
+            jobs.push_back(job);
+        }
+        wake.notify_all();
+    }
+    return job;
+}
+
+auto ThreadPool::work(std::size_t worker) -> void {
+    auto lock = std::unique_lock{mutex};
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+        const auto job = jobs.front();
+        lock.unlock();
+        while (const auto morsel = job->take(worker)) {
+            job->run(*morsel, worker);
+        }
+        lock.lock();
+        // every morsel of the job was taken, the workers still running them finish on their own
+        if (!jobs.empty() && jobs.front() == job) {
+            jobs.pop_front();
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "pager.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Runs jobs split into morsels on a fixed set of threads. Each worker has a deque of its own per
+// job: a job deals its morsels out in contiguous shares up front, so neighbouring morsels (and
+// their pages) tend to stay on one thread. A worker takes from the front of its deque, and once
+// it runs dry steals from the back of another's, the morsels their owner would have got to last.
+class ThreadPool {
+public:
+    // task(morsel, worker) - worker is below size(), for per-worker partial results
+    using Task = std::function<void(std::size_t morsel, std::size_t worker)>;
+
+    class Job {
+    public:
+        Job(std::size_t morsels, std::size_t workers, Task task);
+
+        // the morsels no worker took yet won't run
+        auto cancel() -> void;
+        // blocks until every morsel ran or was cancelled, then rethrows the first exception a
+        // task threw, which cancelled the rest of the job
+        auto wait() -> void;
+
+    private:
+        friend class ThreadPool;
+
+        // a deque per worker, each on its own cache line so workers don't contend for them
+        struct alignas(cache_line_size) Queue {
+            std::mutex mutex;
+            std::deque<std::size_t> morsels;
+        };
+
+        auto take(std::size_t worker) -> std::optional<std::size_t>;
+        auto run(std::size_t morsel, std::size_t worker) -> void;
+        auto finished(std::size_t count) -> void;
+
+        Task task;
+        std::vector<Queue> queues;
+        std::atomic<bool> cancelled = false;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::size_t pending;
+        std::exception_ptr error;
+    };
+
+    explicit ThreadPool(std::size_t threads);
+    // finishes the jobs that were started first
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+    // starts running task for every morsel in [0, morsels) and returns right away, the jobs
+    // started before get their morsels handed out first
+    auto start(std::size_t morsels, Task task) -> std::shared_ptr<Job>;
+    [[nodiscard]] auto size() const -> std::size_t { return threads.size(); }
+
+private:
+    auto work(std::size_t worker) -> void;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    // the jobs that still have morsels to hand out, oldest first
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+// sqlite's storage classes: NULL, INTEGER, REAL, TEXT and BLOB
+using Null = std::monostate;
+using Blob = std::vector<std::uint8_t>;
+using Value = std::variant<Null, std::int64_t, double, std::string, Blob>;
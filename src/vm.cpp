@@ -0,0 +1,1227 @@
+#include "vm.hpp"
+#include "common.hpp"
+#include "index.hpp"
+#include "operators.hpp"
+#include "record.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+// Computed goto (a GNU extension) gives every handler its own indirect jump to the next one,
+// which branch predictors handle much better than the single shared jump of a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace {
+
+auto register_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        switch (instr.opcode) {
+            case Opcode::NEWRECNO:
+            case Opcode::INTEGER:
+            case Opcode::ROWID:
+            case Opcode::VARIABLE:
+            case Opcode::NULL_:
+            case Opcode::REAL:
+            case Opcode::STRING:
+            case Opcode::BLOB:
+                count = std::max(count, instr.P2 + 1);
+                break;
+            case Opcode::COLUMN:
+                count = std::max(count, instr.P3 + 1);
+                break;
+            case Opcode::RESULTROW:
+                count = std::max(count, instr.P1 + instr.P2);
+                break;
+            case Opcode::MAKERECORD:
+                count = std::max({count, instr.P1 + instr.P2, instr.P3 + 1});
+                break;
+            case Opcode::PUTINTKEY:
+                count = std::max({count, instr.P2 + 1, instr.P3 + 1});
+                break;
+            case Opcode::ADD:
+            case Opcode::SUBTRACT:
+            case Opcode::MULTIPLY:
+            case Opcode::DIVIDE:
+            case Opcode::REMAINDER:
+            case Opcode::CONCAT:
+            case Opcode::EQ:
+            case Opcode::NE:
+            case Opcode::LT:
+            case Opcode::LE:
+            case Opcode::GT:
+            case Opcode::GE:
+            case Opcode::AND:
+            case Opcode::OR:
+                count = std::max({count, instr.P1 + 1, instr.P2 + 1, instr.P3 + 1});
+                break;
+            case Opcode::NOT:
+            case Opcode::NEGATE:
+            case Opcode::COPY:
+                count = std::max({count, instr.P1 + 1, instr.P2 + 1});
+                break;
+            case Opcode::IFNOT:
+            case Opcode::MUSTBEINT:
+            case Opcode::TYPECHECK:
+            case Opcode::IFPOS:
+            case Opcode::DECRJUMPZERO:
+                count = std::max(count, instr.P1 + 1);
+                break;
+            case Opcode::FUNCTION:
+                count = std::max({count, instr.P2 + instr.P5, instr.P3 + 1});
+                break;
+            case Opcode::MAKEKEY:
+                count = std::max({count, instr.P1 + instr.P2, instr.P3 + 1});
+                break;
+            case Opcode::IDXINSERT:
+            case Opcode::IDXDELETE:
+            case Opcode::IDXROWID:
+                count = std::max(count, instr.P2 + 1);
+                break;
+            case Opcode::NOCONFLICT:
+                count = std::max(count, instr.P3 + instr.P5);
+                break;
+            case Opcode::IDXSEEK:
+            case Opcode::IDXGE:
+            case Opcode::SEEKROWID:
+            case Opcode::ZONEFILTER:
+                count = std::max(count, instr.P3 + 1);
+                break;
+            case Opcode::HASHOPEN:
+                count = std::max(count, instr.P3 + instr.P5);
+                break;
+            case Opcode::HASHINSERT:
+                count = std::max(count, instr.P2 + instr.P5);
+                break;
+            case Opcode::HASHPROBE:
+            case Opcode::AGGSTEP:
+            case Opcode::AGGNEXT:
+            case Opcode::SORTNEXT:
+                count = std::max(count, instr.P3 + instr.P5);
+                break;
+            case Opcode::SORTOPEN:
+                count = std::max(count, instr.P3 + 2);
+                break;
+            case Opcode::SORTINSERT:
+                count = std::max({count, instr.P2 + 1, instr.P3 + instr.P5});
+                break;
+            case Opcode::PROFILEROW:
+                count = std::max(count, instr.P2 + profile_row_width);
+                break;
+            case Opcode::INITCOROUTINE:
+            case Opcode::YIELD:
+            case Opcode::ENDCOROUTINE:
+                count = std::max(count, instr.P1 + 1);
+                break;
+            default:
+                break;
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+auto cursor_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        if (instr.opcode == Opcode::OPENWRITE || instr.opcode == Opcode::OPENREAD || instr.opcode == Opcode::OPENEPHEMERAL) {
+            count = std::max(count, instr.P1 + 1);
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+auto index_cursor_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        if (instr.opcode == Opcode::OPENINDEX) {
+            count = std::max(count, instr.P1 + 1);
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+auto ephemeral_table_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        if (instr.opcode == Opcode::OPENEPHEMERAL) {
+            count = std::max(count, instr.P2 + 1);
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+auto aggregation_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        if (instr.opcode == Opcode::AGGOPEN) {
+            count = std::max(count, instr.P1 + 1);
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+auto sorter_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        if (instr.opcode == Opcode::SORTOPEN) {
+            count = std::max(count, instr.P1 + 1);
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+auto join_cursor_count(const SqlBytecodeProgram& program) -> std::size_t {
+    auto count = std::int64_t{0};
+    for (const auto& instr : program) {
+        if (instr.opcode == Opcode::HASHOPEN) {
+            count = std::max(count, instr.P1 + 1);
+        }
+    }
+    return static_cast<std::size_t>(count);
+}
+
+// orders - 'A' or 'D' per value, see MAKEKEY
+auto make_key(std::span<const Value> values, std::string_view orders) -> Blob {
+    auto key = Blob{};
+    for (auto i = std::size_t{0}; i < values.size(); ++i) {
+        append_key_column(key, values[i], orders[i] == 'D');
+    }
+    if (orders.size() > values.size() && orders[values.size()] == '+') {
+        key.push_back(key_prefix_end);
+    }
+    return key;
+}
+
+// the instructions between a SCAN and the NEXT closing its loop
+auto loop_body(const SqlBytecodeProgram& program, const Instruction* scan) -> std::span<const Instruction> {
+    const auto first = scan + 1;
+    const auto loop_start = static_cast<std::int64_t>(first - program.data());
+    for (auto pc = first; pc != program.data() + program.size(); ++pc) {
+        if (pc->opcode == Opcode::NEXT && pc->P1 == scan->P1 && pc->P2 == loop_start) {
+            return {first, pc};
+        }
+    }
+    fail("Malformed program - SCAN at {} has no matching NEXT", loop_start - 1);
+}
+
+// The side of a co-routine that only collects its rows: a GROUP BY's or an aggregate's AGGSTEP,
+// or an ORDER BY's MAKEKEY and SORTERINSERT, each jumping back to its YIELD for the next row.
+struct RowSink {
+    HashAggregate* aggregation = nullptr;
+    Sorter* sorter = nullptr;
+    // ORDER BY - the MAKEKEY's orders and how many of the registers make the key
+    std::string_view orders;
+    std::size_t key_width = 0;
+    // the co-routine's registers it reads, the key's first
+    std::vector<std::int64_t> registers;
+};
+
+// the sink of the rows a co-routine's YIELD hands over, nullopt if the other side does anything else
+auto row_sink(const SqlBytecodeProgram& program, const Instruction& yield, std::span<const Value> registers,
+              std::span<std::optional<HashAggregate>> aggregations, std::span<std::optional<Sorter>> sorters) -> std::optional<RowSink> {
+    const auto* other = std::get_if<std::int64_t>(&registers[static_cast<std::size_t>(yield.P1)]);
+    if (!other || *other < 0 || static_cast<std::size_t>(*other) + 1 >= program.size()) {
+        return std::nullopt;
+    }
+    const auto reading = static_cast<std::size_t>(*other);
+    if (program[reading].opcode != Opcode::YIELD || program[reading].P1 != yield.P1 || program[reading].P3 != 0) {
+        return std::nullopt;
+    }
+    // the COPYs in front of a MAKEKEY, from the registers they write to the ones they read
+    auto copies = std::unordered_map<std::int64_t, std::int64_t>{};
+    const auto source = [&](std::int64_t reg) {
+        const auto it = copies.find(reg);
+        return it == copies.end() ? reg : it->second;
+    };
+    auto sink = RowSink{};
+    auto pc = reading + 1;
+    for (; pc < program.size() && program[pc].opcode == Opcode::COPY; ++pc) {
+        copies[program[pc].P2] = source(program[pc].P1);
+    }
+    if (pc + 2 < program.size() && program[pc].opcode == Opcode::MAKEKEY) {
+        const auto& make = program[pc];
+        const auto& insert = program[pc + 1];
+        const auto& back = program[pc + 2];
+        if (insert.opcode != Opcode::SORTINSERT || insert.P2 != make.P3 || back.opcode != Opcode::GOTO ||
+            back.P2 != static_cast<std::int64_t>(reading) || !sorters[static_cast<std::size_t>(insert.P1)]) {
+            return std::nullopt;
+        }
+        sink.sorter = &*sorters[static_cast<std::size_t>(insert.P1)];
+        sink.orders = program.text(make.P4);
+        sink.key_width = static_cast<std::size_t>(make.P2);
+        for (auto reg = make.P1; reg < make.P1 + make.P2; ++reg) {
+            sink.registers.push_back(source(reg));
+        }
+        for (auto reg = insert.P3; reg < insert.P3 + static_cast<std::int64_t>(insert.P5); ++reg) {
+            sink.registers.push_back(source(reg));
+        }
+        return sink;
+    }
+    // a DISTINCT hands rows back as they go in
+    const auto& step = program[pc];
+    if (!copies.empty() || step.opcode != Opcode::AGGSTEP || step.P2 != static_cast<std::int64_t>(reading) ||
+        !aggregations[static_cast<std::size_t>(step.P1)] || aggregations[static_cast<std::size_t>(step.P1)]->hands_back()) {
+        return std::nullopt;
+    }
+    sink.aggregation = &*aggregations[static_cast<std::size_t>(step.P1)];
+    for (auto reg = step.P3; reg < step.P3 + static_cast<std::int64_t>(step.P5); ++reg) {
+        sink.registers.push_back(reg);
+    }
+    return sink;
+}
+
+// Runs a loop compiled to plan, whose rows all go into the sink, to its end. With more than one
+// morsel each gets a partial aggregation or sort on the pool, and they're merged in morsel order,
+// so the result is the one of a single scan.
+// pool - only used with more than one morsel
+auto collect_rows(const RowSink& sink, BTreeCursor& cursor, const BatchPlan& plan, std::span<const RowidRange> morsels,
+                  const std::shared_ptr<ThreadPool>& pool) -> void {
+    const auto width = plan.outputs.size();
+    const auto feed = [&](HashAggregate* aggregation, Sorter* sorter, std::span<Value> rows) {
+        for (auto row = std::size_t{0}; row < rows.size(); row += width) {
+            const auto values = rows.subspan(row, width);
+            if (aggregation) {
+                aggregation->add(values);
+            } else {
+                sorter->add(make_key(values.first(sink.key_width), sink.orders), values.subspan(sink.key_width));
+            }
+        }
+    };
+    if (morsels.size() <= 1) {
+        auto scan = BatchScan{cursor, plan};
+        while (const auto batch = scan.next_batch()) {
+            feed(sink.aggregation, sink.sorter, *batch);
+        }
+        return;
+    }
+
+    auto aggregations = std::vector<HashAggregate>{};
+    auto sorters = std::vector<Sorter>{};
+    for (auto morsel = std::size_t{0}; morsel < morsels.size(); ++morsel) {
+        if (sink.aggregation) {
+            aggregations.push_back(sink.aggregation->partial(morsels.size()));
+        } else {
+            sorters.push_back(sink.sorter->partial(morsels.size()));
+        }
+    }
+    scan_morsels(cursor.btree(), cursor.view(), plan, morsels, *pool, [&](std::size_t morsel, std::span<Value> rows) {
+        feed(sink.aggregation ? &aggregations[morsel] : nullptr, sink.sorter ? &sorters[morsel] : nullptr, rows);
+    });
+    if (sink.aggregation) {
+        for (auto& part : aggregations) {
+            sink.aggregation->add_part(part);
+        }
+    } else {
+        sink.sorter->add_parts(std::move(sorters));
+    }
+}
+
+// the time stamp counter where there is one, nanoseconds elsewhere
+auto cycle_count() -> std::uint64_t {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// The expression handlers below take the INTEGER only path inline and leave everything else
+// (other types, overflow, division by zero) to the generic operators.
+
+// checked - the operation on two INTEGERs, nullopt if it can't be done in INTEGER
+template <typename Checked, typename Generic>
+auto arithmetic(const Value& lhs, const Value& rhs, Value& destination, Checked checked, Generic generic) -> void {
+    const auto* a = std::get_if<std::int64_t>(&lhs);
+    const auto* b = std::get_if<std::int64_t>(&rhs);
+    if (a && b) {
+        if (const auto result = checked(*a, *b)) {
+            destination = *result;
+            return;
+        }
+    }
+    destination = generic(lhs, rhs);
+}
+
+template <typename Compare>
+auto comparison(const Value& lhs, const Value& rhs, Value& destination, Compare compare) -> void {
+    const auto* a = std::get_if<std::int64_t>(&lhs);
+    const auto* b = std::get_if<std::int64_t>(&rhs);
+    if (a && b) {
+        destination = std::int64_t{compare(*a, *b)};
+    } else if (const auto order = ::compare(lhs, rhs)) {
+        destination = std::int64_t{compare(*order, 0)};
+    } else {
+        destination = Null{};
+    }
+}
+
+// for the errors of TYPECHECK
+auto storage_class_name(const Value& value) -> std::string_view {
+    return std::visit(overloaded{
+        [](const Null&) { return "NULL"; },
+        [](std::int64_t) { return "INTEGER"; },
+        [](double) { return "REAL"; },
+        [](const std::string&) { return "TEXT"; },
+        [](const Blob&) { return "BLOB"; }
+    }, value);
+}
+
+auto column_type_name(ColumnType type) -> std::string_view {
+    switch (type) {
+        case ColumnType::INTEGER: return "INTEGER";
+        case ColumnType::REAL:    return "REAL";
+        case ColumnType::TEXT:    return "TEXT";
+        case ColumnType::BLOB:    return "BLOB";
+        case ColumnType::ANY:     return "ANY";
+    }
+    return "ANY";
+}
+
+} // namespace
+
+#if VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+auto VirtualMachine::execute(const SqlBytecodeProgram& program, const RowCallback& on_row,
+                             std::span<const Value> parameters) -> void {
+    start(program, parameters);
+    while (step() == StepResult::ROW) {
+        if (on_row) {
+            on_row(row());
+        }
+    }
+}
+
+auto VirtualMachine::start(const SqlBytecodeProgram& program, std::span<const Value> parameters) -> void {
+    // a program with a prologue ends with the GOTO back to its start
+    if (program.empty() || (program.back().opcode != Opcode::HALT && program.back().opcode != Opcode::GOTO)) {
+        fail("Malformed program - it has to end with HALT or GOTO");
+    }
+    reset();
+
+    this->program = &program;
+    this->parameters = parameters;
+    resume_at = 0;
+    registers.assign(register_count(program), Value{});
+    cursors.clear();
+    cursors.resize(cursor_count(program));
+    index_cursors.clear();
+    index_cursors.resize(index_cursor_count(program));
+    join_cursors.clear();
+    join_cursors.resize(join_cursor_count(program));
+    aggregations.clear();
+    aggregations.resize(aggregation_count(program));
+    sorters.clear();
+    sorters.resize(sorter_count(program));
+    ephemeral_tables.clear();
+    ephemeral_tables.resize(ephemeral_table_count(program));
+    const auto profiled_program = std::ranges::any_of(program, [](const Instruction& instr) { return instr.opcode == Opcode::PROFILEROW; });
+    profile.assign(profiled_program ? program.size() : 0, InstructionProfile{});
+}
+
+auto VirtualMachine::step() -> StepResult {
+    if (!program) {
+        return StepResult::DONE;
+    }
+    try {
+        const auto result = run();
+        pause_profile();
+        return result;
+    } catch (...) {
+        abort();
+        throw;
+    }
+}
+
+auto VirtualMachine::reset() -> void {
+    if (!program) {
+        return;
+    }
+    finish();
+    // only SELECTs produce rows, so there's nothing to keep from a write stopped midway
+    if (auto ending = std::exchange(transaction, std::nullopt)) {
+        if (ending->write()) {
+            ending->rollback();
+        } else {
+            ending->commit();
+        }
+    }
+}
+
+auto VirtualMachine::abort() -> void {
+    finish();
+    if (auto ending = std::exchange(transaction, std::nullopt)) {
+        ending->rollback();
+    }
+}
+
+auto VirtualMachine::finish() -> void {
+    program = nullptr;
+    result_row = {};
+    cursors.clear();
+    index_cursors.clear();
+    join_cursors.clear();
+    aggregations.clear();
+    sorters.clear();
+    ephemeral_tables.clear();
+    profile.clear();
+    profiled = nullptr;
+}
+
+auto VirtualMachine::profile_instruction(std::size_t address) -> void {
+    const auto now = cycle_count();
+    if (profiled) {
+        profiled->cycles += now - profiled_since;
+    }
+    profiled = &profile[address];
+    ++profiled->executions;
+    profiled_since = now;
+}
+
+auto VirtualMachine::pause_profile() -> void {
+    if (profiled) {
+        profiled->cycles += cycle_count() - profiled_since;
+        profiled = nullptr;
+    }
+}
+
+auto VirtualMachine::start_batches(const Instruction* scan) -> ScanLoop {
+    const auto& program = *this->program;
+    auto& cursor = *cursors[static_cast<std::size_t>(scan->P1)];
+    const auto body = loop_body(program, scan);
+    const auto next = static_cast<std::int64_t>(body.data() + body.size() - program.data());
+    // a co-routine's loop whose rows go into an aggregation or a sort feeds them in itself
+    auto sink = std::optional<RowSink>{};
+    if (!body.empty() && body.back().opcode == Opcode::YIELD) {
+        sink = row_sink(program, body.back(), registers, aggregations, sorters);
+    }
+    auto plan = compile_batch_plan(body, scan->P1, registers, next, sink ? std::span{sink->registers} : std::span<const std::int64_t>{});
+    if (!plan) {
+        return ScanLoop::ROWS;
+    }
+    if (cursor.columnar) {
+        plan->segment_columns = cursor.columnar->columns_in_table();
+        plan->zone_filters.assign(cursor.columnar->zone_filters().begin(), cursor.columnar->zone_filters().end());
+    }
+    auto ranges = std::vector<RowidRange>{};
+    if (db.worker_count() > 1) {
+        ranges = cursor.btree.btree().partition(db.worker_count() * morsels_per_worker, morsel_min_leaves, cursor.btree.view());
+    }
+    if (sink) {
+        collect_rows(*sink, cursor.btree, *plan, ranges, ranges.size() > 1 ? db.thread_pool() : nullptr);
+        return ScanLoop::COLLECTED;
+    }
+    if (ranges.size() > 1) {
+        cursor.parallel = std::make_unique<ParallelScan>(cursor.btree.btree(), cursor.btree.view(), std::move(*plan), std::move(ranges), db.thread_pool());
+    } else {
+        cursor.batch = std::make_unique<BatchScan>(cursor.btree, std::move(*plan));
+    }
+    return ScanLoop::BATCHES;
+}
+
+auto VirtualMachine::run() -> StepResult {
+    Value* const r = registers.data();
+    const auto& program = *this->program;
+    const Instruction* pc = program.data() + resume_at;
+
+#if VM_COMPUTED_GOTO
+    // has to list the handlers in the order of the Opcode enumerators
+    static void* const dispatch_table[] = {
+        &&op_NOOP,
+        &&op_HALT,
+        &&op_VERIFY_COOKIE,
+        &&op_TRANSACTION,
+        &&op_OPENWRITE,
+        &&op_NEWRECNO,
+        &&op_INTEGER,
+        &&op_MAKERECORD,
+        &&op_PUTINTKEY,
+        &&op_CLOSE,
+        &&op_COMMIT,
+        &&op_CREATETABLE,
+        &&op_OPENREAD,
+        &&op_REWIND,
+        &&op_NEXT,
+        &&op_COLUMN,
+        &&op_ROWID,
+        &&op_RESULTROW,
+        &&op_VARIABLE,
+        &&op_SCAN,
+        &&op_GOTO,
+        &&op_NULL_,
+        &&op_REAL,
+        &&op_STRING,
+        &&op_ADD,
+        &&op_SUBTRACT,
+        &&op_MULTIPLY,
+        &&op_DIVIDE,
+        &&op_REMAINDER,
+        &&op_CONCAT,
+        &&op_EQ,
+        &&op_NE,
+        &&op_LT,
+        &&op_LE,
+        &&op_GT,
+        &&op_GE,
+        &&op_AND,
+        &&op_OR,
+        &&op_NOT,
+        &&op_NEGATE,
+        &&op_IFNOT,
+        &&op_COPY,
+        &&op_FUNCTION,
+        &&op_CREATEINDEX,
+        &&op_OPENINDEX,
+        &&op_CLOSEINDEX,
+        &&op_MAKEKEY,
+        &&op_IDXINSERT,
+        &&op_IDXDELETE,
+        &&op_NOCONFLICT,
+        &&op_IDXSEEK,
+        &&op_IDXGE,
+        &&op_IDXNEXT,
+        &&op_IDXROWID,
+        &&op_SEEKROWID,
+        &&op_DELETE,
+        &&op_HASHOPEN,
+        &&op_HASHINSERT,
+        &&op_HASHPROBE,
+        &&op_HASHNEXT,
+        &&op_HASHDRAIN,
+        &&op_AGGOPEN,
+        &&op_AGGSTEP,
+        &&op_AGGNEXT,
+        &&op_SORTOPEN,
+        &&op_SORTINSERT,
+        &&op_SORTNEXT,
+        &&op_MUSTBEINT,
+        &&op_IFPOS,
+        &&op_DECRJUMPZERO,
+        &&op_INITCOROUTINE,
+        &&op_YIELD,
+        &&op_ENDCOROUTINE,
+        &&op_OPENEPHEMERAL,
+        &&op_ANALYZE,
+        &&op_TYPECHECK,
+        &&op_ZONEFILTER,
+        &&op_EXPLAIN,
+        &&op_PROFILEROW,
+        &&op_BLOB
+    };
+    static_assert(std::size(dispatch_table) == opcode_count);
+    // a profiled program dispatches every instruction to the profiler first, which dispatches it for real
+    void* profile_table[opcode_count];
+    void* const* table = dispatch_table;
+    if (!profile.empty()) {
+        std::ranges::fill(profile_table, &&profile_dispatch);
+        table = profile_table;
+    }
+
+#define VM_CASE(op) op_##op:
+#define VM_NEXT() goto *table[static_cast<std::size_t>((++pc)->opcode)]
+#define VM_JUMP(target) pc = program.data() + (target); goto *table[static_cast<std::size_t>(pc->opcode)]
+    goto *table[static_cast<std::size_t>(pc->opcode)];
+profile_dispatch:
+    profile_instruction(static_cast<std::size_t>(pc - program.data()));
+    goto *dispatch_table[static_cast<std::size_t>(pc->opcode)];
+#else
+#define VM_CASE(op) case Opcode::op:
+#define VM_NEXT() ++pc; continue
+#define VM_JUMP(target) pc = program.data() + (target); continue
+    for (;;) {
+        if (!profile.empty()) {
+            profile_instruction(static_cast<std::size_t>(pc - program.data()));
+        }
+        switch (pc->opcode) {
+#endif
+
+    VM_CASE(NOOP) {
+        VM_NEXT();
+    }
+    VM_CASE(HALT) {
+        if (pc->P1 != 0) {
+            fail("{}", program.text(pc->P4));
+        }
+        finish();
+        return StepResult::DONE;
+    }
+    VM_CASE(VERIFY_COOKIE) {
+        if (pc->P1 != (transaction ? transaction->schema_cookie() : db.schema_cookie())) {
+            fail("Database schema has changed");
+        }
+        VM_NEXT();
+    }
+    VM_CASE(TRANSACTION) {
+        if (transaction) {
+            fail("Cannot start a transaction within a transaction");
+        }
+        transaction.emplace(db.begin(pc->P2 != 0));
+        VM_NEXT();
+    }
+    VM_CASE(OPENWRITE) {
+        if (!transaction || !transaction->write()) {
+            fail("Cannot open a table for writing outside of a write transaction");
+        }
+        auto& cursor = cursors[static_cast<std::size_t>(pc->P1)].emplace(BTreeCursor{db.table(program.text(pc->P4))});
+        if (pc->P3 != 0) {
+            cursor.columnar = std::make_unique<ColumnarCursor>(static_cast<std::size_t>(pc->P3));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(NEWRECNO) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        const auto max_rowid = cursor.columnar ? cursor.columnar->max_rowid(cursor.btree) : cursor.btree.btree().max_rowid();
+        if (max_rowid == std::numeric_limits<std::int64_t>::max()) {
+            fail("Cannot allocate a new rowid");
+        }
+        r[pc->P2] = max_rowid + 1;
+        VM_NEXT();
+    }
+    VM_CASE(INTEGER) {
+        r[pc->P2] = pc->P1;
+        VM_NEXT();
+    }
+    VM_CASE(MAKERECORD) {
+        r[pc->P3] = encode_record({r + pc->P1, static_cast<std::size_t>(pc->P2)});
+        VM_NEXT();
+    }
+    VM_CASE(PUTINTKEY) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        if (cursor.columnar) {
+            cursor.columnar->insert(cursor.btree, std::get<std::int64_t>(r[pc->P3]), std::get<Blob>(r[pc->P2]));
+        } else {
+            cursor.btree.insert(std::get<std::int64_t>(r[pc->P3]), std::get<Blob>(r[pc->P2]));
+            if (cursor.ephemeral) {
+                cursor.ephemeral->pager.spill();
+            }
+        }
+        cursor.record_valid = false;
+        VM_NEXT();
+    }
+    VM_CASE(CLOSE) {
+        auto& cursor = cursors[static_cast<std::size_t>(pc->P1)];
+        // the rows a COLUMNAR table's cursor held back go in now
+        if (cursor && cursor->columnar) {
+            cursor->columnar->flush(cursor->btree);
+        }
+        cursor.reset();
+        VM_NEXT();
+    }
+    VM_CASE(COMMIT) {
+        if (!transaction) {
+            fail("Cannot commit - no transaction is active");
+        }
+        for (auto& cursor : cursors) {
+            if (cursor && cursor->columnar) {
+                cursor->columnar->flush(cursor->btree);
+            }
+        }
+        transaction->commit();
+        transaction.reset();
+        VM_NEXT();
+    }
+    VM_CASE(CREATETABLE) {
+        if (!db.create_table(program.text(pc->P4), pc->P1 != 0)) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OPENREAD) {
+        if (!transaction) {
+            fail("Cannot open a table for reading outside of a transaction");
+        }
+        const auto* snapshot = pc->P2 != 0 ? transaction->initial_snapshot() : transaction->snapshot();
+        auto& cursor = cursors[static_cast<std::size_t>(pc->P1)].emplace(BTreeCursor{db.table(program.text(pc->P4)), snapshot});
+        if (pc->P3 != 0) {
+            cursor.columnar = std::make_unique<ColumnarCursor>(static_cast<std::size_t>(pc->P3));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(REWIND) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        cursor.record_valid = false;
+        if (!(cursor.columnar ? cursor.columnar->first(cursor.btree) : cursor.btree.first())) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(NEXT) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        cursor.record_valid = false;
+        if (cursor.columnar ? cursor.columnar->next(cursor.btree) : cursor.btree.next()) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(COLUMN) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        if (cursor.columnar && cursor.columnar->in_segment()) {
+            r[pc->P3] = cursor.columnar->column(cursor.btree, static_cast<std::size_t>(pc->P2));
+            VM_NEXT();
+        }
+        if (!cursor.record_valid) {
+            cursor.record = RecordView{cursor.btree.payload()};
+            cursor.record_valid = true;
+        }
+        r[pc->P3] = to_value(cursor.record.column(static_cast<std::size_t>(pc->P2)));
+        VM_NEXT();
+    }
+    VM_CASE(ROWID) {
+        const auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        r[pc->P2] = cursor.columnar ? cursor.columnar->rowid(cursor.btree) : cursor.btree.rowid();
+        VM_NEXT();
+    }
+    VM_CASE(RESULTROW) {
+        result_row = {r + pc->P1, static_cast<std::size_t>(pc->P2)};
+        resume_at = static_cast<std::size_t>(pc - program.data()) + 1;
+        return StepResult::ROW;
+    }
+    VM_CASE(VARIABLE) {
+        const auto index = static_cast<std::size_t>(pc->P1);
+        // unbound parameters are NULL
+        r[pc->P2] = index >= 1 && index <= parameters.size() ? parameters[index - 1] : Value{};
+        VM_NEXT();
+    }
+    VM_CASE(SCAN) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        if (!cursor.batch && !cursor.parallel) {
+            cursor.record_valid = false;
+            const auto has_rows = cursor.columnar ? cursor.columnar->first(cursor.btree) : cursor.btree.first();
+            // a profiled loop runs row at a time, so every instruction in it gets counted
+            const auto loop = has_rows && profile.empty() ? start_batches(pc) : ScanLoop::ROWS;
+            if (loop == ScanLoop::COLLECTED || (loop == ScanLoop::ROWS && !has_rows)) {
+                VM_JUMP(pc->P2);
+            }
+            if (loop == ScanLoop::ROWS) {
+                // row at a time through the loop, as after a REWIND
+                VM_NEXT();
+            }
+        }
+        if (const auto row = cursor.parallel ? cursor.parallel->next_row() : cursor.batch->next_row()) {
+            // resumes here for the next row
+            result_row = *row;
+            resume_at = static_cast<std::size_t>(pc - program.data());
+            return StepResult::ROW;
+        }
+        cursor.batch.reset();
+        cursor.parallel.reset();
+        VM_JUMP(pc->P2);
+    }
+    VM_CASE(GOTO) {
+        VM_JUMP(pc->P2);
+    }
+    VM_CASE(NULL_) {
+        r[pc->P2] = Null{};
+        VM_NEXT();
+    }
+    VM_CASE(REAL) {
+        r[pc->P2] = std::bit_cast<double>(pc->P1);
+        VM_NEXT();
+    }
+    VM_CASE(STRING) {
+        r[pc->P2] = program.operand(pc->P4);
+        VM_NEXT();
+    }
+    VM_CASE(ADD) {
+        arithmetic(r[pc->P1], r[pc->P2], r[pc->P3], [](std::int64_t a, std::int64_t b) {
+            auto result = std::int64_t{};
+            return __builtin_add_overflow(a, b, &result) ? std::nullopt : std::optional{result};
+        }, add);
+        VM_NEXT();
+    }
+    VM_CASE(SUBTRACT) {
+        arithmetic(r[pc->P1], r[pc->P2], r[pc->P3], [](std::int64_t a, std::int64_t b) {
+            auto result = std::int64_t{};
+            return __builtin_sub_overflow(a, b, &result) ? std::nullopt : std::optional{result};
+        }, subtract);
+        VM_NEXT();
+    }
+    VM_CASE(MULTIPLY) {
+        arithmetic(r[pc->P1], r[pc->P2], r[pc->P3], [](std::int64_t a, std::int64_t b) {
+            auto result = std::int64_t{};
+            return __builtin_mul_overflow(a, b, &result) ? std::nullopt : std::optional{result};
+        }, multiply);
+        VM_NEXT();
+    }
+    VM_CASE(DIVIDE) {
+        arithmetic(r[pc->P1], r[pc->P2], r[pc->P3], [](std::int64_t a, std::int64_t b) {
+            const auto exact = b != 0 && (b != -1 || a != std::numeric_limits<std::int64_t>::min());
+            return exact ? std::optional{a / b} : std::nullopt;
+        }, divide);
+        VM_NEXT();
+    }
+    VM_CASE(REMAINDER) {
+        arithmetic(r[pc->P1], r[pc->P2], r[pc->P3], [](std::int64_t a, std::int64_t b) {
+            return b != 0 && b != -1 ? std::optional{a % b} : std::nullopt;
+        }, modulo);
+        VM_NEXT();
+    }
+    VM_CASE(CONCAT) {
+        r[pc->P3] = concat(r[pc->P1], r[pc->P2]);
+        VM_NEXT();
+    }
+    VM_CASE(EQ) {
+        comparison(r[pc->P1], r[pc->P2], r[pc->P3], std::equal_to{});
+        VM_NEXT();
+    }
+    VM_CASE(NE) {
+        comparison(r[pc->P1], r[pc->P2], r[pc->P3], std::not_equal_to{});
+        VM_NEXT();
+    }
+    VM_CASE(LT) {
+        comparison(r[pc->P1], r[pc->P2], r[pc->P3], std::less{});
+        VM_NEXT();
+    }
+    VM_CASE(LE) {
+        comparison(r[pc->P1], r[pc->P2], r[pc->P3], std::less_equal{});
+        VM_NEXT();
+    }
+    VM_CASE(GT) {
+        comparison(r[pc->P1], r[pc->P2], r[pc->P3], std::greater{});
+        VM_NEXT();
+    }
+    VM_CASE(GE) {
+        comparison(r[pc->P1], r[pc->P2], r[pc->P3], std::greater_equal{});
+        VM_NEXT();
+    }
+    VM_CASE(AND) {
+        r[pc->P3] = logical_and(r[pc->P1], r[pc->P2]);
+        VM_NEXT();
+    }
+    VM_CASE(OR) {
+        r[pc->P3] = logical_or(r[pc->P1], r[pc->P2]);
+        VM_NEXT();
+    }
+    VM_CASE(NOT) {
+        r[pc->P2] = logical_not(r[pc->P1]);
+        VM_NEXT();
+    }
+    VM_CASE(NEGATE) {
+        r[pc->P2] = negate(r[pc->P1]);
+        VM_NEXT();
+    }
+    VM_CASE(IFNOT) {
+        const auto& value = r[pc->P1];
+        const auto* integer = std::get_if<std::int64_t>(&value);
+        if (integer ? *integer == 0 : truth(value) != true) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(COPY) {
+        r[pc->P2] = r[pc->P1];
+        VM_NEXT();
+    }
+    VM_CASE(FUNCTION) {
+        r[pc->P3] = call_function(static_cast<std::size_t>(pc->P1), {r + pc->P2, pc->P5});
+        VM_NEXT();
+    }
+    VM_CASE(CREATEINDEX) {
+        if (!db.create_index(program.text(pc->P4), pc->P1 != 0)) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OPENINDEX) {
+        if (!transaction || (pc->P2 != 0 && !transaction->write())) {
+            fail("Cannot open an index outside of a transaction");
+        }
+        const auto* snapshot = pc->P2 == 0 && pc->P3 != 0 ? transaction->initial_snapshot() : transaction->snapshot();
+        index_cursors[static_cast<std::size_t>(pc->P1)].emplace(db.index(program.text(pc->P4)), snapshot);
+        VM_NEXT();
+    }
+    VM_CASE(CLOSEINDEX) {
+        index_cursors[static_cast<std::size_t>(pc->P1)].reset();
+        VM_NEXT();
+    }
+    VM_CASE(MAKEKEY) {
+        r[pc->P3] = make_key({r + pc->P1, static_cast<std::size_t>(pc->P2)}, program.text(pc->P4));
+        VM_NEXT();
+    }
+    VM_CASE(IDXINSERT) {
+        index_cursors[static_cast<std::size_t>(pc->P1)]->index().insert(std::get<Blob>(r[pc->P2]));
+        VM_NEXT();
+    }
+    VM_CASE(IDXDELETE) {
+        index_cursors[static_cast<std::size_t>(pc->P1)]->index().erase(std::get<Blob>(r[pc->P2]));
+        VM_NEXT();
+    }
+    VM_CASE(NOCONFLICT) {
+        const auto values = std::span<const Value>{r + pc->P3, pc->P5};
+        if (std::ranges::any_of(values, [](const Value& value) { return std::holds_alternative<Null>(value); })) {
+            VM_JUMP(pc->P2);
+        }
+        // computed gotos leave scopes without running destructors, so the key can't outlive this call
+        const auto conflict = [&](const Blob& key) {
+            auto& cursor = *index_cursors[static_cast<std::size_t>(pc->P1)];
+            return cursor.seek(key) && cursor.entry().size() >= key.size() && std::ranges::equal(cursor.entry().first(key.size()), key);
+        }(make_key(values, program.text(pc->P4)));
+        if (!conflict) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(IDXSEEK) {
+        if (!index_cursors[static_cast<std::size_t>(pc->P1)]->seek(std::get<Blob>(r[pc->P3]))) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(IDXGE) {
+        if (!std::ranges::lexicographical_compare(index_cursors[static_cast<std::size_t>(pc->P1)]->entry(), std::get<Blob>(r[pc->P3]))) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(IDXNEXT) {
+        if (index_cursors[static_cast<std::size_t>(pc->P1)]->next()) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(IDXROWID) {
+        r[pc->P2] = entry_rowid(index_cursors[static_cast<std::size_t>(pc->P1)]->entry());
+        VM_NEXT();
+    }
+    VM_CASE(SEEKROWID) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        cursor.record_valid = false;
+        const auto rowid = std::get<std::int64_t>(r[pc->P3]);
+        if (cursor.columnar ? !cursor.columnar->seek(cursor.btree, rowid) : !cursor.btree.seek(rowid) || cursor.btree.rowid() != rowid) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(DELETE) {
+        auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)];
+        if (cursor.columnar) {
+            cursor.columnar->erase(cursor.btree);
+        } else {
+            cursor.btree.erase();
+        }
+        cursor.record_valid = false;
+        VM_NEXT();
+    }
+    VM_CASE(HASHOPEN) {
+        join_cursors[static_cast<std::size_t>(pc->P1)].emplace(JoinCursor{
+            .join = HashJoin{pc->P5, db.join_memory_budget()},
+            .probe_row = pc->P2,
+            .build_row = pc->P3
+        });
+        VM_NEXT();
+    }
+    VM_CASE(HASHINSERT) {
+        auto& cursor = *join_cursors[static_cast<std::size_t>(pc->P1)];
+        cursor.join.insert({r + pc->P2, pc->P5}, {r + cursor.build_row, cursor.join.build_width()});
+        VM_NEXT();
+    }
+    VM_CASE(HASHPROBE) {
+        auto& cursor = *join_cursors[static_cast<std::size_t>(pc->P1)];
+        const auto probe_width = static_cast<std::size_t>(cursor.build_row - cursor.probe_row);
+        if (!cursor.join.probe({r + pc->P3, pc->P5}, {r + cursor.probe_row, probe_width})) {
+            VM_JUMP(pc->P2);
+        }
+        std::ranges::copy(cursor.join.build_row(), r + cursor.build_row);
+        VM_NEXT();
+    }
+    VM_CASE(HASHNEXT) {
+        auto& cursor = *join_cursors[static_cast<std::size_t>(pc->P1)];
+        if (cursor.join.next()) {
+            if (cursor.join.draining()) {
+                std::ranges::copy(cursor.join.probe_row(), r + cursor.probe_row);
+            }
+            std::ranges::copy(cursor.join.build_row(), r + cursor.build_row);
+            VM_JUMP(pc->P2);
+        }
+        if (cursor.join.draining()) {
+            VM_JUMP(pc->P3);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(HASHDRAIN) {
+        auto& cursor = *join_cursors[static_cast<std::size_t>(pc->P1)];
+        if (cursor.join.drain()) {
+            std::ranges::copy(cursor.join.probe_row(), r + cursor.probe_row);
+            std::ranges::copy(cursor.join.build_row(), r + cursor.build_row);
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(AGGOPEN) {
+        // the functions can't outlive this call, see NOCONFLICT
+        [&] {
+            auto functions = std::vector<AggregateFunction>{};
+            for (const auto code : program.text(pc->P4)) {
+                functions.push_back(static_cast<AggregateFunction>(code));
+            }
+            aggregations[static_cast<std::size_t>(pc->P1)].emplace(static_cast<std::size_t>(pc->P2), static_cast<std::size_t>(pc->P3),
+                                                                   functions, pc->P5 != 0, db.aggregate_memory_budget());
+        }();
+        VM_NEXT();
+    }
+    VM_CASE(AGGSTEP) {
+        if (!aggregations[static_cast<std::size_t>(pc->P1)]->add({r + pc->P3, pc->P5})) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(AGGNEXT) {
+        if (!aggregations[static_cast<std::size_t>(pc->P1)]->next({r + pc->P3, pc->P5})) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(SORTOPEN) {
+        auto limit = std::optional<std::size_t>{};
+        if (pc->P5 != 0) {
+            const auto count = std::get<std::int64_t>(r[pc->P3]);
+            const auto offset = std::get<std::int64_t>(r[pc->P3 + 1]);
+            if (count >= 0) {
+                // the OFFSET's rows come out of it as well
+                limit = static_cast<std::size_t>(count) + static_cast<std::size_t>(std::max(offset, std::int64_t{0}));
+            }
+        }
+        sorters[static_cast<std::size_t>(pc->P1)].emplace(static_cast<std::size_t>(pc->P2), limit, db.sort_memory_budget());
+        VM_NEXT();
+    }
+    VM_CASE(SORTINSERT) {
+        sorters[static_cast<std::size_t>(pc->P1)]->add(std::get<Blob>(r[pc->P2]), {r + pc->P3, pc->P5});
+        VM_NEXT();
+    }
+    VM_CASE(SORTNEXT) {
+        if (!sorters[static_cast<std::size_t>(pc->P1)]->next({r + pc->P3, pc->P5})) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(MUSTBEINT) {
+        auto& value = r[pc->P1];
+        // 2^63, the first double past the INTEGERs
+        constexpr auto integer_end = 9223372036854775808.0;
+        if (const auto* real = std::get_if<double>(&value); real && *real == std::trunc(*real) && *real >= -integer_end && *real < integer_end) {
+            value = static_cast<std::int64_t>(*real);
+        } else if (!std::holds_alternative<std::int64_t>(value)) {
+            fail("Datatype mismatch");
+        }
+        VM_NEXT();
+    }
+    VM_CASE(IFPOS) {
+        auto& counter = std::get<std::int64_t>(r[pc->P1]);
+        if (counter > 0) {
+            counter -= pc->P3;
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(DECRJUMPZERO) {
+        if (--std::get<std::int64_t>(r[pc->P1]) == 0) {
+            VM_JUMP(pc->P2);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(INITCOROUTINE) {
+        r[pc->P1] = static_cast<std::int64_t>(pc - program.data());
+        VM_JUMP(pc->P2);
+    }
+    VM_CASE(YIELD) {
+        // on to where the other side stopped: the co-routine's start if that was its
+        // INITCOROUTINE, a reading YIELD's P3 if it has one, otherwise the instruction after it
+        const auto& other = program[static_cast<std::size_t>(std::get<std::int64_t>(r[pc->P1]))];
+        r[pc->P1] = static_cast<std::int64_t>(pc - program.data());
+        if (other.P3 != 0) {
+            VM_JUMP(other.P3);
+        }
+        pc = &other;
+        VM_NEXT();
+    }
+    VM_CASE(ENDCOROUTINE) {
+        VM_JUMP(program[static_cast<std::size_t>(std::get<std::int64_t>(r[pc->P1]))].P2);
+    }
+    VM_CASE(OPENEPHEMERAL) {
+        auto& ephemeral = ephemeral_tables[static_cast<std::size_t>(pc->P2)];
+        if (!ephemeral) {
+            ephemeral = std::make_unique<EphemeralTable>(db.cache_size());
+        }
+        cursors[static_cast<std::size_t>(pc->P1)].emplace(BTreeCursor{ephemeral->tree}).ephemeral = ephemeral.get();
+        VM_NEXT();
+    }
+    VM_CASE(ANALYZE) {
+        db.analyze(program.text(pc->P4));
+        VM_NEXT();
+    }
+    VM_CASE(TYPECHECK) {
+        // the converted value can't outlive this call, see NOCONFLICT
+        [&] {
+            const auto type = static_cast<ColumnType>(pc->P2);
+            auto converted = to_column_type(r[pc->P1], type);
+            if (!converted) {
+                fail("Cannot store {} value in {} column '{}'", storage_class_name(r[pc->P1]), column_type_name(type), program.text(pc->P4));
+            }
+            r[pc->P1] = std::move(*converted);
+        }();
+        VM_NEXT();
+    }
+    VM_CASE(ZONEFILTER) {
+        if (auto& cursor = *cursors[static_cast<std::size_t>(pc->P1)]; cursor.columnar) {
+            cursor.columnar->add_filter(ZoneFilter{
+                .column = static_cast<std::size_t>(pc->P2),
+                .comparison = static_cast<ZoneComparison>(pc->P5),
+                .value = r[pc->P3]
+            });
+        }
+        VM_NEXT();
+    }
+    VM_CASE(EXPLAIN) {
+        VM_NEXT();
+    }
+    VM_CASE(PROFILEROW) {
+        const auto& instr = program[static_cast<std::size_t>(pc->P1)];
+        const auto& counts = profile[static_cast<std::size_t>(pc->P1)];
+        auto* row = r + pc->P2;
+        row[0] = pc->P1;
+        row[1] = std::string{opcode_name(instr.opcode)};
+        row[2] = instr.P1;
+        row[3] = instr.P2;
+        row[4] = instr.P3;
+        row[5] = instr.P4 == 0 ? Value{} : program.operand(instr.P4);
+        row[6] = std::int64_t{instr.P5};
+        row[7] = static_cast<std::int64_t>(counts.executions);
+        row[8] = static_cast<std::int64_t>(counts.cycles);
+        row[9] = instr.opcode == Opcode::EXPLAIN ? Value{static_cast<std::int64_t>(profile[static_cast<std::size_t>(instr.P3)].executions)} : Value{};
+        VM_NEXT();
+    }
+    VM_CASE(BLOB) {
+        r[pc->P2] = program.operand(pc->P4);
+        VM_NEXT();
+    }
+
+#if !VM_COMPUTED_GOTO
+        }
+    }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_JUMP
+}
+
+#if VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+#include "batch.hpp"
+#include "btree.hpp"
+#include "bytecode_gen.hpp"
+#include "columnar.hpp"
+#include "database.hpp"
+#include "hash_aggregate.hpp"
+#include "hash_join.hpp"
+#include "index.hpp"
+#include "pager.hpp"
+#include "record.hpp"
+#include "sorter.hpp"
+#include "value.hpp"
+#include "wal.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+struct EphemeralTable;
+
+struct Cursor {
+    BTreeCursor btree;
+    // the current row's record, parsed lazily by COLUMN
+    RecordView record{};
+    bool record_valid = false;
+    // set while SCAN runs the cursor's loop in batches, on the worker threads for a big table
+    std::unique_ptr<BatchScan> batch;
+    std::unique_ptr<ParallelScan> parallel;
+    // on a COLUMNAR table, which it reads and writes the rows through, see OPENREAD
+    std::unique_ptr<ColumnarCursor> columnar;
+    // on a temporary table, whose pages PUTINTKEY lets go to its file, see Pager::spill
+    EphemeralTable* ephemeral = nullptr;
+};
+
+struct JoinCursor {
+    HashJoin join;
+    // where the probe row and the build row are, see HASHOPEN
+    std::int64_t probe_row;
+    std::int64_t build_row;
+};
+
+// A temporary table of an execution, see OPENEPHEMERAL, on a temporary pager of its own. It stays
+// in memory up to a buffer pool's budget and goes to a temporary file beyond it.
+struct EphemeralTable {
+    explicit EphemeralTable(std::size_t cache_size)
+        : pager("", WalOptions{}, PagerOptions{.cache_size = cache_size, .temporary = true}), tree(pager, BTree::create(pager)) {}
+
+    Pager pager;
+    BTree tree;
+};
+
+// receives the registers of every RESULTROW, only valid for the duration of the call
+using RowCallback = std::function<void(std::span<const Value>)>;
+
+// what EXPLAIN ANALYZE reports per instruction, see PROFILEROW
+struct InstructionProfile {
+    std::uint64_t executions = 0;
+    // from the instruction's dispatch to the next one's, in time stamp counter ticks where there
+    // is a counter and nanoseconds elsewhere
+    std::uint64_t cycles = 0;
+};
+
+enum class StepResult {
+    ROW,    // stopped at a RESULTROW, see VirtualMachine::row
+    DONE    // ran into HALT
+};
+
+class VirtualMachine {
+public:
+    explicit VirtualMachine(Database& db) : db(db) {}
+
+    // runs the program to completion, rolling back the open transaction if it fails
+    // parameters - values of the VARIABLE opcodes, parameter n is at n - 1
+    auto execute(const SqlBytecodeProgram& program, const RowCallback& on_row = {},
+                 std::span<const Value> parameters = {}) -> void;
+
+    // sqlite3_step style execution, one result row at a time. The program and the parameters
+    // have to outlive the execution, a failing step rolls back the open transaction.
+    auto start(const SqlBytecodeProgram& program, std::span<const Value> parameters = {}) -> void;
+    // DONE once the program has finished
+    auto step() -> StepResult;
+    // the registers of the RESULTROW the last step stopped at, valid until the next step
+    [[nodiscard]] auto row() const -> std::span<const Value> { return result_row; }
+    // abandons a program that hasn't run into HALT yet, ending its transaction
+    auto reset() -> void;
+
+private:
+    // how a SCAN runs its loop
+    enum class ScanLoop {
+        ROWS,       // a row at a time through the instructions
+        BATCHES,    // the cursor's BatchScan or ParallelScan hands out the result rows
+        COLLECTED   // the rows all went into an aggregation or a sort already
+    };
+
+    auto run() -> StepResult;
+    // sets up the loop of a SCAN whose table has rows, see ScanLoop
+    auto start_batches(const Instruction* scan) -> ScanLoop;
+    auto abort() -> void;
+    auto finish() -> void;
+    // starts the clock of the instruction at address, stopping the previous one's
+    auto profile_instruction(std::size_t address) -> void;
+    // stops the clock while the VM isn't running
+    auto pause_profile() -> void;
+
+    Database& db;
+    // from TRANSACTION until COMMIT, or until the program fails or is reset
+    std::optional<Transaction> transaction;
+    // the running program, null once it ran into HALT (or failed, or was reset)
+    const SqlBytecodeProgram* program = nullptr;
+    // where the next step resumes
+    std::size_t resume_at = 0;
+    std::span<const Value> parameters;
+    std::span<const Value> result_row;
+    std::vector<Value> registers;
+    std::vector<std::optional<Cursor>> cursors;
+    std::vector<std::optional<IndexCursor>> index_cursors;
+    std::vector<std::optional<JoinCursor>> join_cursors;
+    std::vector<std::optional<HashAggregate>> aggregations;
+    std::vector<std::optional<Sorter>> sorters;
+    // created by their first OPENEPHEMERAL, dropped once the program ends, after the cursors on them
+    std::vector<std::unique_ptr<EphemeralTable>> ephemeral_tables;
+    // one per instruction while a program with a PROFILEROW runs, empty otherwise
+    std::vector<InstructionProfile> profile;
+    // the instruction on the clock, since profiled_since
+    InstructionProfile* profiled = nullptr;
+    std::uint64_t profiled_since = 0;
+};
@@ -0,0 +1,300 @@
+#include "wal.hpp"
+#include "common.hpp"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr auto wal_magic = std::uint32_t{0x626c5741};
+constexpr auto wal_version = std::uint32_t{1};
+
+// header: magic, version, page size, unused, salt1, salt2, checksum of the first 24 bytes
+constexpr auto header_size = std::size_t{32};
+// frame header: page, database size for a commit frame or 0, salt1, salt2, running checksum
+constexpr auto frame_header_size = std::size_t{24};
+constexpr auto frame_size = frame_header_size + page_size;
+
+[[noreturn]] auto io_error(std::string_view what) -> void {
+    fail("I/O error while {}: {}", what, std::strerror(errno));
+}
+
+auto put(std::uint8_t* dest, std::uint32_t value) -> void {
+    std::memcpy(dest, &value, sizeof(value));
+}
+
+auto get(const std::uint8_t* src) -> std::uint32_t {
+    auto value = std::uint32_t{};
+    std::memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+// sqlite's WAL checksum, a Fletcher-like sum over pairs of 32-bit words
+auto Wal::add(Checksum sum, const std::uint8_t* bytes, std::size_t size) -> Checksum {
+    for (auto i = std::size_t{0}; i < size; i += 8) {
+        sum.s0 += get(bytes + i) + sum.s1;
+        sum.s1 += get(bytes + i + 4) + sum.s0;
+    }
+    return sum;
+}
+
+Wal::Wal(const std::string& path, int database_fd, WalOptions options)
+    : database_fd(database_fd), path(path), options(options) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        io_error("opening the write-ahead log");
+    }
+    recover();
+}
+
+Wal::~Wal() {
+    // a clean close leaves everything in the database file
+    try {
+        if (failure.empty()) {
+            checkpoint();
+            ::unlink(path.c_str());
+        }
+    } catch (const SqlError&) {
+        // the log stays and is recovered on the next open
+    }
+    ::close(fd);
+}
+
+auto Wal::recover() -> void {
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        io_error("reading the write-ahead log size");
+    }
+    const auto size = static_cast<std::uint64_t>(st.st_size);
+
+    auto header = std::array<std::uint8_t, header_size>{};
+    if (size < header_size || ::pread(fd, header.data(), header_size, 0) != static_cast<ssize_t>(header_size)) {
+        reset();
+        return;
+    }
+    const auto expected = add(Checksum{}, header.data(), header_size - 8);
+    if (get(header.data()) != wal_magic || get(header.data() + 4) != wal_version || get(header.data() + 8) != page_size
+        || get(header.data() + 24) != expected.s0 || get(header.data() + 28) != expected.s1) {
+        reset();
+        return;
+    }
+    salt1 = get(header.data() + 16);
+    salt2 = get(header.data() + 20);
+    checksum = expected;
+    end = header_size;
+
+    // frames of the transaction being read, only indexed once its commit frame checks out
+    auto transaction = std::vector<std::pair<PageId, std::uint64_t>>{};
+    auto running = checksum;
+    auto frame = std::vector<std::uint8_t>(frame_size);
+    for (auto offset = end; offset + frame_size <= size; offset += frame_size) {
+        if (::pread(fd, frame.data(), frame_size, static_cast<off_t>(offset)) != static_cast<ssize_t>(frame_size)) {
+            io_error("reading the write-ahead log");
+        }
+        if (get(frame.data() + 8) != salt1 || get(frame.data() + 12) != salt2) {
+            break;
+        }
+        running = add(running, frame.data(), 8);
+        running = add(running, frame.data() + frame_header_size, page_size);
+        if (get(frame.data() + 16) != running.s0 || get(frame.data() + 20) != running.s1) {
+            break;
+        }
+
+        transaction.emplace_back(get(frame.data()), offset);
+        if (get(frame.data() + 4) != 0) {
+            for (const auto& [id, frame_offset] : transaction) {
+                index[id] = frame_offset;
+            }
+            frames += transaction.size();
+            transaction.clear();
+            end = offset + frame_size;
+            checksum = running;
+        }
+    }
+    // whatever follows the last commit is overwritten by the next one
+    tail = end;
+}
+
+auto Wal::reset() -> void {
+    ++salt1;
+    salt2 = std::random_device{}();
+
+    auto header = std::array<std::uint8_t, header_size>{};
+    put(header.data(), wal_magic);
+    put(header.data() + 4, wal_version);
+    put(header.data() + 8, static_cast<std::uint32_t>(page_size));
+    put(header.data() + 16, salt1);
+    put(header.data() + 20, salt2);
+    checksum = add(Checksum{}, header.data(), header_size - 8);
+    put(header.data() + 24, checksum.s0);
+    put(header.data() + 28, checksum.s1);
+
+    if (::ftruncate(fd, 0) != 0) {
+        io_error("truncating the write-ahead log");
+    }
+    write_batch(header, 0);
+
+    index.clear();
+    frames = 0;
+    end = header_size;
+    tail = header_size;
+}
+
+auto Wal::read_frame(std::uint64_t offset, Page& page) const -> void {
+    const auto position = static_cast<off_t>(offset + frame_header_size);
+    if (::pread(fd, page.data.data(), page_size, position) != static_cast<ssize_t>(page_size)) {
+        io_error("reading the write-ahead log");
+    }
+}
+
+auto Wal::write_batch(std::span<const std::uint8_t> bytes, std::uint64_t offset) -> void {
+    if (::pwrite(fd, bytes.data(), bytes.size(), static_cast<off_t>(offset)) != static_cast<ssize_t>(bytes.size())) {
+        io_error("writing the write-ahead log");
+    }
+    if (::fsync(fd) != 0) {
+        io_error("syncing the write-ahead log");
+    }
+}
+
+auto Wal::read(PageId id, Page& page) -> bool {
+    // held throughout so a checkpoint can't empty the log under us
+    const auto lock = std::scoped_lock{mutex};
+    const auto it = index.find(id);
+    if (it == index.end()) {
+        return false;
+    }
+    read_frame(it->second, page);
+    return true;
+}
+
+auto Wal::contains(PageId id) const -> bool {
+    const auto lock = std::scoped_lock{mutex};
+    return index.contains(id);
+}
+
+auto Wal::frame_count() const -> std::size_t {
+    const auto lock = std::scoped_lock{mutex};
+    return frames;
+}
+
+auto Wal::commit_count() const -> std::uint64_t {
+    const auto lock = std::scoped_lock{mutex};
+    return durable;
+}
+
+auto Wal::sync_count() const -> std::uint64_t {
+    const auto lock = std::scoped_lock{mutex};
+    return syncs;
+}
+
+auto Wal::append(std::span<const Frame> new_frames, PageId page_count) -> std::uint64_t {
+    const auto lock = std::scoped_lock{mutex};
+    if (!failure.empty()) {
+        fail("The write-ahead log is unusable after an earlier error: {}", failure);
+    }
+
+    for (auto i = std::size_t{0}; i < new_frames.size(); ++i) {
+        const auto& [id, page] = new_frames[i];
+        const auto start = pending.size();
+        pending.resize(start + frame_size);
+        auto* frame = pending.data() + start;
+        put(frame, id);
+        put(frame + 4, i + 1 == new_frames.size() ? page_count : 0);
+        put(frame + 8, salt1);
+        put(frame + 12, salt2);
+        std::memcpy(frame + frame_header_size, page->data.data(), page_size);
+        checksum = add(checksum, frame, 8);
+        checksum = add(checksum, frame + frame_header_size, page_size);
+        put(frame + 16, checksum.s0);
+        put(frame + 20, checksum.s1);
+        pending_index.emplace_back(id, tail);
+        tail += frame_size;
+    }
+    const auto ticket = ++queued;
+    batch_changed.notify_all();
+    return ticket;
+}
+
+auto Wal::wait_durable(std::uint64_t ticket) -> void {
+    auto lock = std::unique_lock{mutex};
+    // whoever finds no sync in progress syncs everything queued so far, its own commit included
+    while (durable < ticket) {
+        if (!failure.empty()) {
+            fail("Commit failed: {}", failure);
+        }
+        if (syncing) {
+            batch_changed.wait(lock);
+            continue;
+        }
+
+        syncing = true;
+        if (options.commit_delay.count() > 0) {
+            batch_changed.wait_for(lock, options.commit_delay, [&] { return queued - durable >= options.max_batch; });
+        }
+        const auto batch = std::exchange(pending, {});
+        const auto batch_index = std::exchange(pending_index, {});
+        const auto batch_last = queued;
+        const auto offset = end;
+
+        lock.unlock();
+        auto error = std::string{};
+        try {
+            write_batch(batch, offset);
+        } catch (const SqlError& e) {
+            error = e.what();
+        }
+        lock.lock();
+
+        syncing = false;
+        if (error.empty()) {
+            for (const auto& [id, frame_offset] : batch_index) {
+                index[id] = frame_offset;
+            }
+            frames += batch_index.size();
+            end += batch.size();
+            durable = batch_last;
+            ++syncs;
+        } else {
+            failure = error;
+        }
+        batch_changed.notify_all();
+    }
+}
+
+auto Wal::checkpoint() -> void {
+    auto lock = std::unique_lock{mutex};
+    batch_changed.wait(lock, [&] { return !syncing && pending.empty(); });
+    if (!failure.empty()) {
+        fail("Cannot checkpoint after an earlier error: {}", failure);
+    }
+    if (index.empty()) {
+        return;
+    }
+
+    auto page = Page{};
+    for (const auto& [id, offset] : index) {
+        read_frame(offset, page);
+        const auto position = static_cast<off_t>(id) * static_cast<off_t>(page_size);
+        if (::pwrite(database_fd, page.data.data(), page_size, position) != static_cast<ssize_t>(page_size)) {
+            io_error("writing a page");
+        }
+    }
+    if (::fsync(database_fd) != 0) {
+        io_error("syncing the database file");
+    }
+    // a crash before the reset replays the same pages again
+    reset();
+}
+
+auto Wal::checkpoint_if_needed() -> void {
+    if (frame_count() >= options.checkpoint_frames) {
+        checkpoint();
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "pager.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct WalOptions {
+    // how long the first committer of a batch waits for others to join it before syncing
+    std::chrono::microseconds commit_delay{0};
+    // a batch is synced as soon as it holds this many commits, without waiting out the delay
+    std::size_t max_batch = 64;
+    // the log is copied back into the database file once it holds this many frames
+    std::size_t checkpoint_frames = 1000;
+};
+
+// Write-ahead log next to a database file ("<path>-wal"), in the layout of sqlite's WAL: a header
+// followed by frames, each holding one page. The last frame of a transaction records the database
+// size, which marks it as a commit. Every frame is checksummed together with all the frames
+// before it, so recovery keeps exactly the prefix of complete transactions and drops a torn tail.
+//
+// A commit is split in two: append() queues the transaction's frames, which orders it, and
+// wait_durable() returns once it's synced. Transactions appended while a batch is being synced
+// are written and synced together by the next of their committers to wait, so N commits that
+// append before the first of them syncs cost one fsync instead of N.
+class Wal {
+public:
+    // the frame that needs the commit mark must be last
+    using Frame = std::pair<PageId, const Page*>;
+
+    // recovers the committed transactions already in the log
+    Wal(const std::string& path, int database_fd, WalOptions options);
+    ~Wal();
+    Wal(const Wal&) = delete;
+    auto operator=(const Wal&) -> Wal& = delete;
+
+    // the newest committed version of the page, false if the log doesn't have it
+    [[nodiscard]] auto read(PageId id, Page& page) -> bool;
+    [[nodiscard]] auto contains(PageId id) const -> bool;
+    [[nodiscard]] auto frame_count() const -> std::size_t;
+
+    // queues a transaction behind the ones queued before it, page_count is the database size
+    // after it. Returns its ticket for wait_durable().
+    [[nodiscard]] auto append(std::span<const Frame> frames, PageId page_count) -> std::uint64_t;
+    // returns once the transaction of the ticket, and so every one queued before it, is durable
+    auto wait_durable(std::uint64_t ticket) -> void;
+    // copies the newest version of every logged page into the database file and empties the log
+    auto checkpoint() -> void;
+    auto checkpoint_if_needed() -> void;
+
+    [[nodiscard]] auto commit_count() const -> std::uint64_t;
+    [[nodiscard]] auto sync_count() const -> std::uint64_t;
+
+private:
+    struct Checksum {
+        std::uint32_t s0 = 0;
+        std::uint32_t s1 = 0;
+    };
+
+    static auto add(Checksum sum, const std::uint8_t* bytes, std::size_t size) -> Checksum;
+    auto recover() -> void;
+    auto reset() -> void;
+    auto read_frame(std::uint64_t offset, Page& page) const -> void;
+    auto write_batch(std::span<const std::uint8_t> bytes, std::uint64_t offset) -> void;
+
+    int fd = -1;
+    int database_fd = -1;
+    std::string path;
+    WalOptions options;
+
+    mutable std::mutex mutex;
+    std::condition_variable batch_changed;
+    std::uint32_t salt1 = 0;
+    std::uint32_t salt2 = 0;
+    Checksum checksum;
+    // page -> file offset of its newest durable frame
+    std::unordered_map<PageId, std::uint64_t> index;
+    std::size_t frames = 0;
+    // end of the durable frames
+    std::uint64_t end = 0;
+    // where the next frame goes, after the batch being synced and the pending one
+    std::uint64_t tail = 0;
+
+    // encoded frames of the batch waiting for the next sync, with their index entries
+    std::vector<std::uint8_t> pending;
+    std::vector<std::pair<PageId, std::uint64_t>> pending_index;
+    std::uint64_t queued = 0;
+    std::uint64_t durable = 0;
+    bool syncing = false;
+    // set when a sync fails, after which nothing more can be committed
+    std::string failure;
+
+    std::uint64_t syncs = 0;
+};
@@ -0,0 +1,92 @@
+// HashAggregate finds the same groups with a budget of a few bytes, spilling rows to partitions,
+// as it does in memory, and so do GROUP BY and DISTINCT queries.
+#include "database.hpp"
+#include "hash_aggregate.hpp"
+#include "operators.hpp"
+#include "statement.hpp"
+#include "value.hpp"
+#include "doctest.h"
+#include "helpers.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t tiny_budget = 256;
+
+using Group = std::tuple<std::int64_t, std::int64_t, std::int64_t, std::int64_t>;
+
+// (group, count, sum, min) of every group, sorted
+auto aggregate(std::size_t memory_budget, bool& spilled) -> std::vector<Group> {
+    const auto functions = std::array{AggregateFunction::COUNT_ROWS, AggregateFunction::SUM, AggregateFunction::MIN};
+    auto aggregation = HashAggregate{1, 0, functions, false, memory_budget};
+    for (auto i = std::int64_t{0}; i < 5000; ++i) {
+        const auto row = std::array<Value, 3>{(i * 7919) % 1300, i, 5000 - i};
+        aggregation.add(row);
+    }
+    auto groups = std::vector<Group>{};
+    auto result = std::array<Value, 4>{};
+    while (aggregation.next(result)) {
+        groups.emplace_back(std::get<std::int64_t>(result[0]), std::get<std::int64_t>(result[1]), std::get<std::int64_t>(result[2]),
+                            std::get<std::int64_t>(result[3]));
+    }
+    spilled = aggregation.spilled();
+    std::ranges::sort(groups);
+    return groups;
+}
+
+} // namespace
+
+TEST_CASE("HashAggregate spills and finds the same groups") {
+    auto in_memory = false;
+    auto spilled = false;
+    const auto expected = aggregate(std::size_t{64} << 20, in_memory);
+    CHECK_FALSE(in_memory);
+    CHECK(expected.size() == 1300);
+    CHECK(aggregate(tiny_budget, spilled) == expected);
+    CHECK(spilled);
+}
+
+TEST_CASE("GROUP BY and DISTINCT give the same rows with a tiny memory budget") {
+    const auto fill = [](StatementCache& cache) {
+        cache.execute("create table t (id integer, g integer, v text)");
+        auto sql = std::string{"insert into t values "};
+        for (auto i = 0; i < 3000; ++i) {
+            const auto g = i % 13 == 0 ? std::string{"NULL"} : std::to_string((i * 31) % 400);
+            sql += fmt::format("{}({}, {}, 'v{}')", i == 0 ? "" : ", ", i, g, (i * 17) % 101);
+        }
+        cache.execute(sql);
+    };
+    const auto queries = std::array<std::string_view, 4>{
+        "select g, count(*), sum(id), avg(id), min(v), max(v) from t group by g order by g",
+        "select v, count(g) from t group by v having count(*) > 29 order by v",
+        "select distinct v from t order by v",
+        "select count(*), sum(id), min(g), max(g) from t",
+    };
+
+    auto reference = Database{};
+    auto reference_cache = StatementCache{reference};
+    fill(reference_cache);
+
+    for (const auto workers : {std::size_t{1}, std::size_t{4}}) {
+        CAPTURE(workers);
+        auto db = Database{};
+        db.set_aggregate_memory_budget(tiny_budget);
+        db.set_worker_count(workers);
+        auto cache = StatementCache{db};
+        fill(cache);
+        for (const auto sql : queries) {
+            CAPTURE(sql);
+            const auto expected = rows(reference_cache, sql);
+            CHECK_FALSE(expected.empty());
+            CHECK(rows(cache, sql) == expected);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+// CREATE TABLE ... AS SELECT names the table's columns after the SELECT's, and renames the ones it
+// repeats the way sqlite does, so the new table never has two columns of the same name.
+#include "common.hpp"
+#include "database.hpp"
+#include "statement.hpp"
+#include "doctest.h"
+#include "helpers.hpp"
+#include <string>
+#include <vector>
+
+namespace {
+
+auto fill(StatementCache& cache) -> void {
+    cache.execute("create table t (a integer, b text)");
+    cache.execute("create table u (a integer, c text)");
+    cache.execute("insert into t values (1, 'x'), (2, 'y')");
+    cache.execute("insert into u values (1, 'p'), (3, 'q')");
+}
+
+} // namespace
+
+TEST_CASE("a repeated column of the SELECT gets a numbered name") {
+    auto db = Database{};
+    auto cache = StatementCache{db};
+    fill(cache);
+
+    cache.execute("create table t2 as select a, a, b, a from t");
+    CHECK(db.schema("t2").definition() == "t2(a integer, a:1 integer, b text, a:2 integer)");
+    CHECK(rows(cache, "select a, b from t2") == std::vector<std::string>{"1|x|", "2|y|"});
+
+    SUBCASE("skipping the names already taken") {
+        cache.execute("create table t3 as select * from t2, t");
+        CHECK(db.schema("t3").definition() == "t3(a integer, a:1 integer, b text, a:2 integer, a:3 integer, b:1 text)");
+    }
+}
+
+TEST_CASE("columns of the same name from different tables get numbered names") {
+    auto db = Database{};
+    auto cache = StatementCache{db};
+    fill(cache);
+
+    cache.execute("create table j as select t.a, u.a, c from t join u on t.a = u.a");
+    CHECK(db.schema("j").definition() == "j(a integer, a:1 integer, c text)");
+    cache.execute("create table s as select * from t, u");
+    CHECK(db.schema("s").definition() == "s(a integer, b text, a:1 integer, c text)");
+    CHECK(rows(cache, "select count(*) from s") == std::vector<std::string>{"4|"});
+}
+
+TEST_CASE("a repeated column in a table definition is an error") {
+    auto db = Database{};
+    auto cache = StatementCache{db};
+    CHECK_THROWS_AS(cache.execute("create table t (a integer, b text, a real)"), SqlError);
+}
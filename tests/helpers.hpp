@@ -0,0 +1,43 @@
+#pragma once
+#include "printers.hpp"
+#include "statement.hpp"
+#include "doctest.h"
+#include <filesystem>
+#include <stdlib.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// a directory of its own in the temporary directory, removed with everything in it
+class TemporaryDirectory {
+public:
+    TemporaryDirectory() {
+        auto name = (std::filesystem::temp_directory_path() / "bootleg-sql-test-XXXXXX").string();
+        REQUIRE(::mkdtemp(name.data()) != nullptr);
+        path = name;
+    }
+    ~TemporaryDirectory() { std::filesystem::remove_all(path); }
+    TemporaryDirectory(const TemporaryDirectory&) = delete;
+    auto operator=(const TemporaryDirectory&) -> TemporaryDirectory& = delete;
+
+    [[nodiscard]] auto file(const std::string& name) const -> std::string { return (path / name).string(); }
+
+private:
+    std::filesystem::path path;
+};
+
+// the rows of a query, each as its values separated by '|', in the order they come out
+inline auto rows(StatementCache& cache, std::string_view sql) -> std::vector<std::string> {
+    auto result = std::vector<std::string>{};
+    auto statement = cache.prepare(sql);
+    while (statement.step()) {
+        auto text = std::string{};
+        for (const auto& value : statement.row()) {
+            text += to_string(value);
+            text += '|';
+        }
+        result.push_back(std::move(text));
+    }
+    return result;
+}
@@ -0,0 +1,191 @@
+// HashJoin pairs every probe row with every build row of an equal key, never on a NULL, the same
+// in memory as through the grace partitions it spills past its memory budget.
+#include "database.hpp"
+#include "hash_join.hpp"
+#include "statement.hpp"
+#include "value.hpp"
+#include "doctest.h"
+#include "helpers.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t tiny_budget = 256;
+
+// a row of either side: its key and the id it's told apart by
+struct Row {
+    Value key;
+    std::int64_t id;
+};
+
+using Pairs = std::vector<std::pair<std::int64_t, std::int64_t>>;
+
+// the (probe, build) ids of the pairs, sorted
+auto join(std::span<const Row> build, std::span<const Row> probe, std::size_t memory_budget, bool& spilled) -> Pairs {
+    auto join = HashJoin{1, memory_budget};
+    for (const auto& row : build) {
+        const auto values = std::array<Value, 1>{row.id};
+        join.insert(std::span{&row.key, 1}, values);
+    }
+    auto pairs = Pairs{};
+    const auto pair = [&](std::span<const Value> probe_row) {
+        pairs.emplace_back(std::get<std::int64_t>(probe_row[0]), std::get<std::int64_t>(join.build_row()[0]));
+    };
+    for (const auto& row : probe) {
+        const auto values = std::array<Value, 1>{row.id};
+        if (join.probe(std::span{&row.key, 1}, values)) {
+            do {
+                pair(values);
+            } while (join.next());
+        }
+    }
+    if (join.drain()) {
+        do {
+            pair(join.probe_row());
+        } while (join.next());
+    }
+    spilled = join.spilled();
+    std::ranges::sort(pairs);
+    return pairs;
+}
+
+// what the join should find, by comparing every pair of rows
+auto nested_loops(std::span<const Row> build, std::span<const Row> probe) -> Pairs {
+    auto pairs = Pairs{};
+    for (const auto& probe_row : probe) {
+        for (const auto& build_row : build) {
+            if (probe_row.key.index() != 0 && probe_row.key == build_row.key) {
+                pairs.emplace_back(probe_row.id, build_row.id);
+            }
+        }
+    }
+    std::ranges::sort(pairs);
+    return pairs;
+}
+
+// in memory, then spilled, both against nested loops
+auto check_join(std::span<const Row> build, std::span<const Row> probe) -> Pairs {
+    const auto expected = nested_loops(build, probe);
+    auto spilled = false;
+    CHECK(join(build, probe, default_join_memory_budget, spilled) == expected);
+    CHECK_FALSE(spilled);
+    CHECK(join(build, probe, tiny_budget, spilled) == expected);
+    CHECK(spilled);
+    return expected;
+}
+
+} // namespace
+
+TEST_CASE("a join past its memory budget spills to grace partitions") {
+    auto build = std::vector<Row>{};
+    for (auto i = std::int64_t{0}; i < 2000; ++i) {
+        build.push_back(Row{.key = i % 500, .id = i});
+    }
+    auto probe = std::vector<Row>{};
+    for (auto i = std::int64_t{0}; i < 1000; ++i) {
+        probe.push_back(Row{.key = i % 700, .id = i});
+    }
+    // 800 probe rows have a key below 500, with 4 build rows each
+    CHECK(check_join(build, probe).size() == 800 * 4);
+}
+
+TEST_CASE("NULL keys never match") {
+    auto build = std::vector<Row>{};
+    auto probe = std::vector<Row>{};
+    for (auto i = std::int64_t{0}; i < 600; ++i) {
+        build.push_back(Row{.key = i % 3 == 0 ? Value{} : Value{i % 50}, .id = i});
+        probe.push_back(Row{.key = i % 4 == 0 ? Value{} : Value{i % 70}, .id = i});
+    }
+    const auto pairs = check_join(build, probe);
+    CHECK_FALSE(pairs.empty());
+
+    SUBCASE("not even with nothing but NULLs") {
+        auto nulls = std::vector<Row>{};
+        for (auto i = std::int64_t{0}; i < 300; ++i) {
+            nulls.push_back(Row{.key = Value{}, .id = i});
+        }
+        // they aren't even kept, so there's nothing to spill
+        auto spilled = false;
+        CHECK(join(nulls, nulls, tiny_budget, spilled).empty());
+        CHECK_FALSE(spilled);
+    }
+}
+
+TEST_CASE("duplicate keys on both sides pair up every way") {
+    auto build = std::vector<Row>{};
+    auto probe = std::vector<Row>{};
+    for (auto i = std::int64_t{0}; i < 400; ++i) {
+        build.push_back(Row{.key = fmt::format("k{}", i % 10), .id = i});
+    }
+    for (auto i = std::int64_t{0}; i < 200; ++i) {
+        probe.push_back(Row{.key = fmt::format("k{}", i % 20), .id = i});
+    }
+    // half the probe rows have one of the 10 build keys, 40 build rows each
+    CHECK(check_join(build, probe).size() == 100 * 40);
+
+    SUBCASE("a single key, which no repartitioning splits") {
+        auto skewed = std::vector<Row>{};
+        for (auto i = std::int64_t{0}; i < 300; ++i) {
+            skewed.push_back(Row{.key = std::int64_t{7}, .id = i});
+        }
+        CHECK(check_join(skewed, skewed).size() == 300 * 300);
+    }
+}
+
+TEST_CASE("a join query gives the same rows with a tiny memory budget") {
+    const auto fill = [](StatementCache& cache) {
+        cache.execute("create table t (id integer, g integer, v text)");
+        cache.execute("create table u (k integer, w text)");
+        auto sql = std::string{"insert into t values "};
+        for (auto i = 0; i < 3000; ++i) {
+            const auto g = i % 7 == 0 ? std::string{"NULL"} : std::to_string((i * 31) % 40);
+            sql += fmt::format("{}({}, {}, 'v{}')", i == 0 ? "" : ", ", i, g, (i * 17) % 101);
+        }
+        cache.execute(sql);
+        sql = "insert into u values ";
+        for (auto i = 0; i < 600; ++i) {
+            const auto k = i % 11 == 0 ? std::string{"NULL"} : std::to_string(i % 50);
+            sql += fmt::format("{}({}, 'w{}')", i == 0 ? "" : ", ", k, i);
+        }
+        cache.execute(sql);
+    };
+    const auto queries = std::array<std::string_view, 3>{
+        "select t.id, u.w from t join u on t.g = u.k order by t.id, u.w",
+        "select count(*), sum(t.id) from t, u where u.k = t.g and t.id < 1000",
+        "select t.v, count(*) from t join u on t.g = u.k group by t.v order by t.v",
+    };
+
+    auto reference = Database{};
+    auto reference_cache = StatementCache{reference};
+    fill(reference_cache);
+    // a hash join, not nested loops over the tables
+    auto plan = std::string{};
+    for (const auto& row : rows(reference_cache, fmt::format("explain {}", queries[0]))) {
+        plan += row;
+    }
+    CHECK(plan.find("HashOpen") != std::string::npos);
+
+    for (const auto workers : {std::size_t{1}, std::size_t{4}}) {
+        CAPTURE(workers);
+        auto db = Database{};
+        db.set_join_memory_budget(tiny_budget);
+        db.set_worker_count(workers);
+        auto cache = StatementCache{db};
+        fill(cache);
+        for (const auto sql : queries) {
+            CAPTURE(sql);
+            const auto expected = rows(reference_cache, sql);
+            CHECK_FALSE(expected.empty());
+            CHECK(rows(cache, sql) == expected);
+        }
+    }
+}
@@ -0,0 +1,122 @@
+// The native parser and the one generated from grammar/Grammar.g4 build the same IR for every
+// statement of the grammar, and reject the same syntax errors.
+#include "IR.hpp"
+#include "common.hpp"
+#include "frontend.hpp"
+#include "printers.hpp"
+// after IR.hpp, the parser's FAIL token clashes with doctest's FAIL macro
+#include "doctest.h"
+#include <array>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// the IR the frontend builds, printed
+auto ir(std::string_view sql, Frontend frontend) -> std::string {
+    auto printed = std::string{};
+    parse(sql, frontend, [&](const Statement& statement, std::span<const std::string_view>) { printed = to_string(statement); });
+    return printed;
+}
+
+constexpr auto statements = std::to_array<std::string_view>({
+    // select
+    "select a from t",
+    "SELECT * FROM t;",
+    ";; select t.* from t -- a comment\n /* and another */ ;",
+    "select a, b as c, t.d from t where a = 1 and (b <> 2 or not c != 3)",
+    "select distinct a from t",
+    "select all a from t",
+    "select -a, +b, a || 'x' || b, a * b / c % d, a + b - c from t",
+    "select a < b, a <= b, a > b, a >= b, a == b from t",
+    "select 1.5, 2., 3e4, 5.5E-2, 'it''s', NULL from t",
+    "select count(*), count(a), sum(a), avg(b), min(a, b), max(c), typeof(a) from t group by c having count(*) > 1",
+    "select a from t group by a, b",
+    "select a from t order by a desc, b asc, c limit 10 offset 5",
+    "select a from t limit ? offset ?",
+    "select a from t where a = ?1 and b = ? and c = :name and d = :name",
+    "select * from main.t as x",
+    "select * from t, u where t.a = u.b",
+    "select * from t join u on t.a = u.b inner join v on v.c = u.c cross join w",
+    // insert
+    "insert into t values (1, 'a'), (2, NULL)",
+    "insert into t (a, b) values (?, :b)",
+    "insert into main.t as x values (1)",
+    "insert into t select * from u",
+    "insert into t default values",
+    "insert or replace into t values (1)",
+    "insert or ignore into t values (1)",
+    "insert or abort into t values (1)",
+    "insert or fail into t values (1)",
+    "insert or rollback into t values (1)",
+    "replace into t values (1)",
+    "with c as (select a from t) insert into u select a from c",
+    "with recursive c(x, y) as (select a, b from t), d as materialized (select a from c) insert into u select * from d",
+    // create
+    "create table t (a, b integer, c text, d real, e blob)",
+    "create temp table if not exists main.t (a integer)",
+    "create table t (a integer, b text) strict",
+    "create table t (a integer, b text) without rowid",
+    "create table t (a integer, b text) strict, columnar",
+    "create table t as select a, b from u",
+    "create index i on t (a)",
+    "create unique index if not exists main.i on t (a desc, b asc)",
+    // explain and analyze
+    "explain select * from t",
+    "explain query plan select * from t where a = 1",
+    "explain analyze select count(*) from t",
+    "explain create table t (a)",
+    "analyze",
+    "analyze t",
+    "analyze main.i",
+});
+
+constexpr auto syntax_errors = std::to_array<std::string_view>({
+    "",
+    ";",
+    "select",
+    "select a",
+    "select from t",
+    "select a from",
+    "select a from t where",
+    "select a, from t",
+    "select a from t order a",
+    "select (a from t",
+    "select a from t limit",
+    "select a from t; select b from t",
+    "select 'unterminated from t",
+    "insert into t",
+    "insert t values (1)",
+    "insert into t values ()",
+    "create table t",
+    "create table t ()",
+    "create index on t (a)",
+    "explain analyze",
+});
+
+} // namespace
+
+TEST_CASE("the native and the ANTLR parser build the same IR") {
+    for (const auto sql : statements) {
+        CAPTURE(sql);
+        const auto native = ir(sql, Frontend::NATIVE);
+        CHECK(native == ir(sql, Frontend::ANTLR));
+        // compares the IR itself and the parameter names, not just how they print
+        CHECK_NOTHROW(ir(sql, Frontend::CHECKED));
+    }
+}
+
+TEST_CASE("the native and the ANTLR parser reject the same syntax errors") {
+    for (const auto sql : syntax_errors) {
+        CAPTURE(sql);
+        CHECK_THROWS_AS(ir(sql, Frontend::NATIVE), SqlError);
+        CHECK_THROWS_AS(ir(sql, Frontend::ANTLR), SqlError);
+    }
+}
+
+TEST_CASE("column constraints are rejected by both parsers") {
+    const auto sql = std::string_view{"create table t (a integer not null)"};
+    CHECK_THROWS_AS(ir(sql, Frontend::NATIVE), SqlError);
+    CHECK_THROWS_AS(ir(sql, Frontend::ANTLR), SqlError);
+}
@@ -0,0 +1,101 @@
+// Sorter gives the same rows in the same order, ties in the order they went in, whether it sorts
+// in memory, keeps a top-N heap or merges runs spilled past its memory budget, and so does
+// ORDER BY.
+#include "database.hpp"
+#include "sorter.hpp"
+#include "statement.hpp"
+#include "value.hpp"
+#include "doctest.h"
+#include "helpers.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t tiny_budget = 256;
+
+// the rows of 5000 keys with plenty of duplicates, in the order they come out
+auto sort(std::optional<std::size_t> limit, std::size_t memory_budget, bool& spilled) -> std::vector<std::int64_t> {
+    auto sorter = Sorter{1, limit, memory_budget};
+    for (auto i = std::int64_t{0}; i < 5000; ++i) {
+        const auto key = fmt::format("{:04}", (i * 7919) % 997);
+        const auto row = std::array<Value, 1>{i};
+        sorter.add(std::span{reinterpret_cast<const std::uint8_t*>(key.data()), key.size()}, row);
+    }
+    auto rows = std::vector<std::int64_t>{};
+    auto result = std::array<Value, 1>{};
+    while (sorter.next(result)) {
+        rows.push_back(std::get<std::int64_t>(result[0]));
+    }
+    spilled = sorter.spilled();
+    return rows;
+}
+
+} // namespace
+
+TEST_CASE("Sorter spills and keeps the order of equal keys") {
+    auto in_memory = false;
+    auto spilled = false;
+    const auto expected = sort(std::nullopt, std::size_t{64} << 20, in_memory);
+    CHECK_FALSE(in_memory);
+    REQUIRE(expected.size() == 5000);
+    // by key, and equal keys in the order their rows went in
+    const auto key = [](std::int64_t id) { return (id * 7919) % 997; };
+    CHECK(std::ranges::is_sorted(expected, [&](std::int64_t a, std::int64_t b) { return key(a) < key(b) || (key(a) == key(b) && a < b); }));
+    CHECK(sort(std::nullopt, tiny_budget, spilled) == expected);
+    CHECK(spilled);
+
+    SUBCASE("with a limit") {
+        const auto first = std::vector<std::int64_t>(expected.begin(), expected.begin() + 100);
+        CHECK(sort(100, std::size_t{64} << 20, in_memory) == first);
+        CHECK_FALSE(in_memory);
+        CHECK(sort(100, tiny_budget, spilled) == first);
+        CHECK(spilled);
+    }
+}
+
+TEST_CASE("ORDER BY gives the same rows with a tiny memory budget") {
+    const auto fill = [](StatementCache& cache) {
+        cache.execute("create table t (id integer, g integer, v text)");
+        auto sql = std::string{"insert into t values "};
+        for (auto i = 0; i < 3000; ++i) {
+            const auto g = i % 13 == 0 ? std::string{"NULL"} : std::to_string((i * 31) % 40);
+            sql += fmt::format("{}({}, {}, 'v{}')", i == 0 ? "" : ", ", i, g, (i * 17) % 101);
+        }
+        cache.execute(sql);
+    };
+    const auto queries = std::array<std::string_view, 5>{
+        "select id, v from t order by v, g desc, id",
+        "select id, g from t order by g",
+        "select id, v from t order by v desc limit 20",
+        "select id, v from t order by v, id limit 10 offset 2500",
+        "select g, count(*) from t group by g order by count(*) desc, g",
+    };
+
+    auto reference = Database{};
+    auto reference_cache = StatementCache{reference};
+    fill(reference_cache);
+
+    for (const auto workers : {std::size_t{1}, std::size_t{4}}) {
+        CAPTURE(workers);
+        auto db = Database{};
+        db.set_sort_memory_budget(tiny_budget);
+        db.set_worker_count(workers);
+        auto cache = StatementCache{db};
+        fill(cache);
+        for (const auto sql : queries) {
+            CAPTURE(sql);
+            const auto expected = rows(reference_cache, sql);
+            CHECK_FALSE(expected.empty());
+            CHECK(rows(cache, sql) == expected);
+        }
+    }
+}
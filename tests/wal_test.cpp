@@ -0,0 +1,165 @@
+// Recovery from the write-ahead log of a database that was never closed: every committed
+// transaction is back, and a torn or corrupted tail loses the last transaction only. And group
+// commit: transactions committing at the same time share their syncs, and readers don't see a
+// commit until it's synced.
+#include "common.hpp"
+#include "database.hpp"
+#include "statement.hpp"
+#include "value.hpp"
+#include "wal.hpp"
+#include "doctest.h"
+#include "helpers.hpp"
+#include <fmt/format.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr auto transactions = 5;
+constexpr auto rows_per_transaction = 200;
+
+// ids 0 to n - 1, and the sum of those, for the first n rows
+auto count_and_sum(const std::string& path) -> std::vector<std::int64_t> {
+    auto db = Database{path};
+    auto cache = StatementCache{db};
+    auto statement = cache.prepare("select count(*), sum(id) from t");
+    REQUIRE(statement.step());
+    const auto row = statement.row();
+    return {std::get<std::int64_t>(row[0]), row[1].index() == 0 ? 0 : std::get<std::int64_t>(row[1])};
+}
+
+auto expected(std::int64_t rows) -> std::vector<std::int64_t> { return {rows, rows * (rows - 1) / 2}; }
+
+// What a crash leaves behind: copies of the database file and its log, taken while the database
+// that committed every transaction is still open, so nothing was checkpointed.
+auto crash(const TemporaryDirectory& directory, const std::string& copy) -> void {
+    const auto path = directory.file("test.db");
+    auto db = Database{path, WalOptions{.checkpoint_frames = 1'000'000}};
+    auto cache = StatementCache{db};
+    cache.execute("create table t (id integer, v text)");
+    for (auto transaction = 0; transaction < transactions; ++transaction) {
+        auto sql = std::string{"insert into t values "};
+        for (auto i = 0; i < rows_per_transaction; ++i) {
+            const auto id = transaction * rows_per_transaction + i;
+            sql += fmt::format("{}({}, '{:0>40}')", i == 0 ? "" : ", ", id, id);
+        }
+        cache.execute(sql);
+    }
+    REQUIRE(std::filesystem::file_size(path + "-wal") > 0);
+    std::filesystem::copy_file(path, copy);
+    std::filesystem::copy_file(path + "-wal", copy + "-wal");
+}
+
+} // namespace
+
+TEST_CASE("the log brings back every committed transaction") {
+    const auto directory = TemporaryDirectory{};
+    const auto copy = directory.file("copy.db");
+    crash(directory, copy);
+
+    CHECK(count_and_sum(copy) == expected(transactions * rows_per_transaction));
+    // a clean close checkpointed the log into the database file
+    CHECK_FALSE(std::filesystem::exists(copy + "-wal"));
+    CHECK(count_and_sum(copy) == expected(transactions * rows_per_transaction));
+}
+
+TEST_CASE("a torn log loses its last transaction only") {
+    const auto directory = TemporaryDirectory{};
+    const auto copy = directory.file("copy.db");
+    crash(directory, copy);
+
+    SUBCASE("truncated in its last frame") {
+        std::filesystem::resize_file(copy + "-wal", std::filesystem::file_size(copy + "-wal") - 1);
+    }
+    SUBCASE("with a byte of its last frame changed") {
+        auto log = std::fstream{copy + "-wal", std::ios::in | std::ios::out | std::ios::binary};
+        log.seekg(-1, std::ios::end);
+        const auto byte = static_cast<char>(log.get() ^ 0x5a);
+        log.seekp(-1, std::ios::end);
+        log.put(byte);
+    }
+    CHECK(count_and_sum(copy) == expected((transactions - 1) * rows_per_transaction));
+}
+
+TEST_CASE("a log shorter than its header is ignored") {
+    const auto directory = TemporaryDirectory{};
+    const auto copy = directory.file("copy.db");
+    crash(directory, copy);
+
+    std::filesystem::resize_file(copy + "-wal", 16);
+    // the table was created in the log as well, so it isn't there
+    auto db = Database{copy};
+    auto cache = StatementCache{db};
+    CHECK_THROWS_AS(cache.prepare("select count(*) from t"), SqlError);
+}
+
+TEST_CASE("transactions appended while one waits to sync are synced with it") {
+    const auto directory = TemporaryDirectory{};
+    const auto path = directory.file("test.db");
+    const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    REQUIRE(fd >= 0);
+    constexpr auto committers = 8;
+    {
+        auto wal = Wal{path + "-wal", fd, WalOptions{.commit_delay = std::chrono::milliseconds{50}, .max_batch = committers}};
+        auto threads = std::vector<std::jthread>{};
+        for (auto committer = 0; committer < committers; ++committer) {
+            threads.emplace_back([&wal, committer] {
+                auto page = Page{};
+                page.data.fill(static_cast<std::uint8_t>(committer));
+                const auto frame = Wal::Frame{static_cast<PageId>(committer + 1), &page};
+                wal.wait_durable(wal.append(std::span{&frame, 1}, committers + 1));
+            });
+        }
+        threads.clear();
+        CHECK(wal.commit_count() == committers);
+        CHECK(wal.sync_count() < wal.commit_count());
+        CHECK(wal.frame_count() == committers);
+    }
+    ::close(fd);
+}
+
+TEST_CASE("writers committing at the same time share their syncs") {
+    const auto directory = TemporaryDirectory{};
+    constexpr auto writers = 8;
+    auto db = Database{directory.file("test.db"), WalOptions{.commit_delay = std::chrono::milliseconds{50}, .max_batch = writers}};
+    StatementCache{db}.execute("create table t (id integer, v text)");
+    const auto before = db.wal_stats();
+
+    auto threads = std::vector<std::jthread>{};
+    for (auto writer = 0; writer < writers; ++writer) {
+        threads.emplace_back([&db, writer] { StatementCache{db}.execute(fmt::format("insert into t values ({}, 'w')", writer)); });
+    }
+    threads.clear();
+
+    const auto after = db.wal_stats();
+    CHECK(after.commits - before.commits == writers);
+    CHECK(after.syncs - before.syncs < after.commits - before.commits);
+    auto cache = StatementCache{db};
+    CHECK(rows(cache, "select count(*), sum(id) from t") == std::vector<std::string>{"8|28|"});
+}
+
+TEST_CASE("readers see a commit once it's synced, not once it's published") {
+    const auto directory = TemporaryDirectory{};
+    auto db = Database{directory.file("test.db"), WalOptions{.commit_delay = std::chrono::milliseconds{500}, .max_batch = 8}};
+    StatementCache{db}.execute("create table t (id integer, v text)");
+    const auto before = db.wal_stats();
+
+    // the writer publishes its commit and lets the next writer in, then waits out the delay
+    auto writer = std::jthread{[&db] { StatementCache{db}.execute("insert into t values (1, 'w')"); }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    auto cache = StatementCache{db};
+    CHECK(rows(cache, "select count(*) from t") == std::vector<std::string>{"0|"});
+    // which it isn't yet
+    CHECK(db.wal_stats().commits == before.commits);
+
+    writer.join();
+    CHECK(db.wal_stats().commits == before.commits + 1);
+    CHECK(rows(cache, "select count(*) from t") == std::vector<std::string>{"1|"});
+}